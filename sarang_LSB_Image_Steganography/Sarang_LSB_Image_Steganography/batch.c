@@ -0,0 +1,469 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "batch.h"
+#include "pool.h"
+#include "types.h"
+
+/* One manifest line */
+typedef struct _BatchJob
+{
+    size_t line;                // Manifest line, from 1
+    OperationType op;           // e_unsupported if the line did not parse
+    char *image;                // Source image on encode, stego image on decode
+    char *secret;               // Encode only
+    char *output;               // Optional
+    off_t size;                 // Image size, the scheduling weight
+
+    /* Result */
+    Status status;
+    unsigned long long bytes;   // Secret bytes encoded or decoded
+    double seconds;
+    char written[ 256 ];        // Output actually written
+    char error[ 256 ];
+} BatchJob;
+
+/* State shared by the workers */
+typedef struct _Batch
+{
+    const BatchOptions *opts;
+    BatchJob *jobs;             // Largest first
+    size_t count;
+    atomic_size_t next;         // Next job to start
+    atomic_size_t failed;
+    pthread_mutex_t lock;       // Serialises the result lines
+    FILE *results;
+} Batch;
+
+/* Function Definitions */
+
+/* Removes leading and trailing white space in place */
+static char *trim( char *str )
+{
+    while( isspace( ( uchar )*str ) )
+        str++;
+
+    char *end = str + strlen( str );
+    while( end > str && isspace( ( uchar )end[-1] ) )
+        *--end = '\0';
+
+    return str;
+}
+
+/* Appends code point cp as UTF-8 */
+static char *put_utf8( char *out, unsigned cp )
+{
+    if( cp < 0x80 )
+        *out++ = cp;
+    else if( cp < 0x800 )
+    {
+        *out++ = 0xC0 | cp >> 6;
+        *out++ = 0x80 | ( cp & 0x3F );
+    }
+    else
+    {
+        *out++ = 0xE0 | cp >> 12;
+        *out++ = 0x80 | ( ( cp >> 6 ) & 0x3F );
+        *out++ = 0x80 | ( cp & 0x3F );
+    }
+
+    return out;
+}
+
+/* Returns the string value of "key" in the flat JSON object line
+ * The value is allocated, NULL if the key is missing or not a string
+ */
+static char *json_field( const char *line, const char *key )
+{
+    size_t key_len = strlen( key );
+
+    for( const char *p = strchr( line, '"' ); p; p = strchr( p + 1, '"' ) )
+    {
+        if( strncmp( p + 1, key, key_len ) != 0 || p[ key_len + 1 ] != '"' )
+            continue;
+
+        const char *v = p + key_len + 2;
+        while( isspace( ( uchar )*v ) )
+            v++;
+        if( *v++ != ':' )
+            continue;
+        while( isspace( ( uchar )*v ) )
+            v++;
+        if( *v++ != '"' )
+            return NULL;
+
+        // Decoding never grows the string, \u escapes shrink to at most 3 bytes
+        char *value = malloc( strlen( v ) + 1 );
+        char *out = value;
+        if( value == NULL )
+            return NULL;
+
+        for( ; *v && *v != '"'; v++ )
+        {
+            if( *v != '\\' )
+            {
+                *out++ = *v;
+                continue;
+            }
+
+            switch( *++v )
+            {
+                case 'n': *out++ = '\n'; break;
+                case 't': *out++ = '\t'; break;
+                case 'r': *out++ = '\r'; break;
+                case 'b': *out++ = '\b'; break;
+                case 'f': *out++ = '\f'; break;
+                case 'u':
+                {
+                    unsigned cp;
+                    if( sscanf( v + 1, "%4x", &cp ) != 1 )
+                    {
+                        free( value );
+                        return NULL;
+                    }
+                    out = put_utf8( out, cp );
+                    v += 4;
+                    break;
+                }
+                case '\0':
+                    free( value );
+                    return NULL;
+                default: *out++ = *v; break; // \" \\ \/
+            }
+        }
+
+        if( *v != '"' )
+        {
+            free( value );
+            return NULL;
+        }
+        *out = '\0';
+
+        return value;
+    }
+
+    return NULL;
+}
+
+/* Maps the op field to an operation */
+static OperationType parse_op( const char *op )
+{
+    if( op == NULL )
+        return e_unsupported;
+    if( strcmp( op, "encode" ) == 0 || strcmp( op, "-e" ) == 0 || strcmp( op, "e" ) == 0 )
+        return e_encode;
+    if( strcmp( op, "decode" ) == 0 || strcmp( op, "-d" ) == 0 || strcmp( op, "d" ) == 0 )
+        return e_decode;
+
+    return e_unsupported;
+}
+
+/* Duplicates a CSV field, NULL for a missing or empty one */
+static char *csv_field( char **fields, int count, int i )
+{
+    if( i >= count || fields[i][0] == '\0' )
+        return NULL;
+
+    return strdup( fields[i] );
+}
+
+/* Fills job from one manifest line
+ * Returns 0 for blank and comment lines, 1 for a job
+ * A line that does not parse still is a job, failing with an error
+ */
+static int parse_job( char *line, BatchJob *job )
+{
+    char *op = NULL;
+
+    line = trim( line );
+    if( line[0] == '\0' || line[0] == '#' )
+        return 0;
+
+    if( line[0] == '{' )
+    {
+        op = json_field( line, "op" );
+        job -> image = json_field( line, "image" );
+        job -> secret = json_field( line, "secret" );
+        job -> output = json_field( line, "output" );
+    }
+    else
+    {
+        char *fields[4];
+        int count = 0;
+
+        for( char *field; count < 4 && ( field = strsep( &line, "," ) ) != NULL; )
+            fields[ count++ ] = trim( field );
+
+        if( count > 0 && strcmp( fields[0], "op" ) == 0 )
+            return 0; // Header line
+
+        op = csv_field( fields, count, 0 );
+        job -> image = csv_field( fields, count, 1 );
+        if( op && parse_op( op ) == e_encode )
+        {
+            job -> secret = csv_field( fields, count, 2 );
+            job -> output = csv_field( fields, count, 3 );
+        }
+        else
+            job -> output = csv_field( fields, count, 2 );
+    }
+
+    job -> op = parse_op( op );
+    free( op );
+
+    if( job -> op == e_unsupported )
+        snprintf( job -> error, sizeof( job -> error ), "unknown op" );
+    else if( job -> image == NULL || ( job -> op == e_encode && job -> secret == NULL ) )
+    {
+        snprintf( job -> error, sizeof( job -> error ), "missing %s", job -> image ? "secret" : "image" );
+        job -> op = e_unsupported;
+    }
+
+    struct stat st;
+    if( job -> image && stat( job -> image, &st ) == 0 )
+        job -> size = st.st_size;
+
+    return 1;
+}
+
+/* Reads every job of the manifest */
+static Status read_manifest( const char *path, BatchJob **jobs, size_t *count )
+{
+    FILE *fptr = fopen( path, "r" );
+    char *line = NULL;
+    size_t line_cap = 0, line_no = 0, cap = 0;
+
+    if( fptr == NULL )
+    {
+        perror( "fopen" );
+        fprintf( stderr, "ERROR: Unable to open file %s\n", path );
+        return e_failure;
+    }
+
+    *jobs = NULL;
+    *count = 0;
+
+    while( getline( &line, &line_cap, fptr ) != -1 )
+    {
+        line_no++;
+
+        if( *count == cap )
+        {
+            cap = cap ? cap * 2 : 64;
+            BatchJob *grown = realloc( *jobs, cap * sizeof( BatchJob ) );
+            if( grown == NULL )
+            {
+                free( line );
+                fclose( fptr );
+                return e_failure;
+            }
+            *jobs = grown;
+        }
+
+        BatchJob *job = &( *jobs )[ *count ];
+        memset( job, 0, sizeof( *job ) );
+        job -> line = line_no;
+        job -> status = e_failure;
+
+        if( parse_job( line, job ) )
+            ( *count )++;
+    }
+
+    free( line );
+    fclose( fptr );
+
+    return e_success;
+}
+
+/* Largest image first, manifest order among equals */
+static int compare_jobs( const void *a, const void *b )
+{
+    const BatchJob *x = a, *y = b;
+
+    if( x -> size != y -> size )
+        return x -> size > y -> size ? -1 : 1;
+
+    return x -> line < y -> line ? -1 : x -> line > y -> line;
+}
+
+/* Keeps the last message of a failed job's log as its error */
+static void take_error( BatchJob *job, const char *log )
+{
+    const char *end = log + strlen( log );
+
+    while( end > log && end[-1] == '\n' )
+        end--;
+
+    const char *start = end;
+    while( start > log && start[-1] != '\n' )
+        start--;
+
+    if( strncmp( start, "INFO: ", 6 ) == 0 )
+        start += 6;
+
+    snprintf( job -> error, sizeof( job -> error ), "%.*s", ( int )( end - start ), start );
+}
+
+/* Runs one job, its messages are collected to find the error */
+static void run_job( const BatchOptions *opts, BatchJob *job )
+{
+    char *log = NULL;
+    size_t log_size = 0;
+    FILE *log_out = open_memstream( &log, &log_size );
+    StegContext ctx = *opts -> steg;
+    StegResult result = { 0 };
+    StegError error = steg_err_args;
+    double start = report_now();
+
+    reporter_init( &ctx.reporter, log_out ? r_human : r_quiet );
+    ctx.reporter.out = log_out;
+
+    if( job -> op == e_encode )
+        error = steg_encode_file( &ctx, job -> image, job -> secret, job -> output, &result );
+    else if( job -> op == e_decode )
+        error = steg_decode_file( &ctx, job -> image, job -> output, &result );
+
+    job -> seconds = report_now() - start;
+    job -> status = error == steg_ok ? e_success : e_failure;
+    job -> bytes = result.secret_size;
+    snprintf( job -> written, sizeof( job -> written ), "%s", result.output );
+
+    if( log_out )
+    {
+        fclose( log_out );
+        if( job -> status != e_success && job -> error[0] == '\0' )
+            take_error( job, log );
+        free( log );
+    }
+
+    // Nothing was logged before the job failed, fall back to the code
+    if( job -> status != e_success && job -> error[0] == '\0' )
+        snprintf( job -> error, sizeof( job -> error ), "%s", steg_strerror( error ) );
+}
+
+/* Writes "key":value for a string that may be NULL */
+static void result_string( FILE *out, const char *key, const char *value )
+{
+    fprintf( out, ",\"%s\":", key );
+    if( value && value[0] )
+        report_json_string( out, value );
+    else
+        fputs( "null", out );
+}
+
+/* Writes the result line of job */
+static void write_result( Batch *batch, const BatchJob *job )
+{
+    FILE *out = batch -> results;
+    const char *op = job -> op == e_encode ? "encode" : job -> op == e_decode ? "decode" : NULL;
+
+    pthread_mutex_lock( &batch -> lock );
+
+    fprintf( out, "{\"line\":%zu", job -> line );
+    result_string( out, "op", op );
+    result_string( out, "image", job -> image );
+    result_string( out, "secret", job -> secret );
+    result_string( out, "output", job -> written[0] ? job -> written : job -> output );
+    fprintf( out, ",\"status\":\"%s\",\"bytes\":%llu,\"seconds\":%.6f",
+             job -> status == e_success ? "ok" : "failed", job -> bytes, job -> seconds );
+    result_string( out, "error", job -> status == e_success ? NULL : job -> error );
+    fputs( "}\n", out );
+    fflush( out );
+
+    pthread_mutex_unlock( &batch -> lock );
+}
+
+/* Pool task: runs the next job in size order
+ * Each pool task starts exactly one job, but not the one of its own
+ * index, so the order stays largest first whichever worker is free
+ */
+static int batch_task( size_t task, int worker, void *arg )
+{
+    Batch *batch = arg;
+    BatchJob *job = &batch -> jobs[ atomic_fetch_add( &batch -> next, 1 ) ];
+
+    ( void )task;
+    ( void )worker;
+
+    run_job( batch -> opts, job );
+    write_result( batch, job );
+
+    if( job -> status != e_success )
+        atomic_fetch_add( &batch -> failed, 1 );
+
+    report_info( &batch -> opts -> steg -> reporter, "Line %zu: %s %s, %s in %.3fs%s%s", job -> line,
+                 job -> op == e_encode ? "encode" : job -> op == e_decode ? "decode" : "job",
+                 job -> image ? job -> image : "-", job -> status == e_success ? "ok" : "failed",
+                 job -> seconds, job -> status == e_success ? "" : ": ", job -> status == e_success ? "" : job -> error );
+
+    return 0; // A failed job never stops the batch
+}
+
+/* Runs every job of the manifest */
+Status run_batch( const BatchOptions *opts )
+{
+    Batch batch = { .opts = opts };
+    char *results_name = NULL;
+    Status status;
+
+    if( read_manifest( opts -> manifest, &batch.jobs, &batch.count ) != e_success )
+    {
+        return e_failure;
+    }
+
+    const char *results = opts -> results;
+    if( results == NULL )
+    {
+        results_name = malloc( strlen( opts -> manifest ) + sizeof( ".results.jsonl" ) );
+        if( results_name == NULL )
+        {
+            free( batch.jobs );
+            return e_failure;
+        }
+        sprintf( results_name, "%s.results.jsonl", opts -> manifest );
+        results = results_name;
+    }
+
+    batch.results = strcmp( results, "-" ) == 0 ? stdout : fopen( results, "w" );
+    if( batch.results == NULL )
+    {
+        perror( "fopen" );
+        fprintf( stderr, "ERROR: Unable to open file %s\n", results );
+        status = e_failure;
+    }
+    else
+    {
+        qsort( batch.jobs, batch.count, sizeof( BatchJob ), compare_jobs );
+        pthread_mutex_init( &batch.lock, NULL );
+
+        int workers = pool_workers( opts -> jobs, batch.count );
+        report_info( &opts -> steg -> reporter, "Running %zu jobs of %s on %d workers", batch.count, opts -> manifest, workers );
+
+        double start = report_now();
+        status = batch.count ? pool_run( workers, batch.count, batch_task, &batch, NULL ) : e_success;
+        if( atomic_load( &batch.failed ) )
+            status = e_failure;
+
+        report_info( &opts -> steg -> reporter, "Batch done in %.3fs: %zu jobs, %zu failed, results in %s",
+                     report_now() - start, batch.count, atomic_load( &batch.failed ), results );
+
+        pthread_mutex_destroy( &batch.lock );
+        if( batch.results != stdout && fclose( batch.results ) != 0 )
+            status = e_failure;
+    }
+
+    for( size_t i = 0; i < batch.count; i++ )
+    {
+        free( batch.jobs[i].image );
+        free( batch.jobs[i].secret );
+        free( batch.jobs[i].output );
+    }
+    free( batch.jobs );
+    free( results_name );
+
+    return status;
+}
@@ -0,0 +1,37 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+#include "types.h" // Contains user defined types
+#include "steg.h"
+
+/*
+ * Batch mode
+ * Runs the encode and decode jobs of a manifest inside one process.
+ * Every manifest line is one job, either a JSON object
+ *     {"op":"encode","image":"a.bmp","secret":"s.txt","output":"o.bmp"}
+ *     {"op":"decode","image":"o.bmp","output":"out"}
+ * or CSV
+ *     encode,a.bmp,s.txt[,o.bmp]
+ *     decode,o.bmp[,out]
+ * Blank lines and lines starting with '#' are skipped. Outputs default
+ * as on the command line, so jobs without one overwrite each other.
+ * Jobs run largest image first on a bounded worker pool and every job
+ * gets one JSON line in the results file.
+ */
+
+/* Settings of one batch */
+typedef struct _BatchOptions
+{
+    const char *manifest;
+    const char *results;        // NULL is <manifest>.results.jsonl
+    int jobs;                   // Jobs run at once, 0 is one per CPU
+    const StegContext *steg;    // Settings of every job, its reporter gets the batch messages
+} BatchOptions;
+
+/* Runs every job of the manifest
+ * Returns e_success if every job succeeded
+ */
+Status run_batch( const BatchOptions *opts );
+
+#endif
@@ -0,0 +1,1008 @@
+/*
+ * lsb_bench
+ * Benchmarks of the kernels, the I/O stages and whole encodes, decodes and
+ * verifications on synthetic carriers, with JSON Lines results that are compared
+ * against a stored baseline
+ *     lsb_bench gen <width> <height> <24|32> <out.bmp> [seed]
+ *     lsb_bench run [--quick] [--results <file|->] [--dir <tmp dir>] [--filter <prefix>]
+ *     lsb_bench compare <baseline.jsonl> <results.jsonl> [--threshold <percent>] [--io-threshold <percent>]
+ * Every result line is
+ *     {"name":"kernel/avx2/embed/1","bytes":262144,"seconds":0.000021,"mb_s":12483.0}
+ * where bytes is what one call processes and seconds the best time of
+ * one call over BENCH_TRIALS trials. The end to end lines add the system
+ * calls of the I/O of one call: reads and writes, and with --io uring its
+ * io_uring_enter() calls
+ *     {"name":"e2e/encode/uring/48M/full","bytes":48000054,"seconds":0.041,"mb_s":1170.7,"syscalls":90}
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "steg.h"
+#include "encode.h"
+#include "decode.h"
+#include "lsb.h"
+#include "lz.h"
+#include "crc32c.h"
+#include "chacha.h"
+#include "bmp.h"
+#include "fcopy.h"
+#include "blockio.h"
+#include "report.h"
+#include "types.h"
+
+#define BENCH_TRIALS 5
+#define BENCH_MIN_TIME 0.05     // Seconds a trial runs at least, --quick divides it by 5
+#define BENCH_THRESHOLD 10.0    // Percent a result may drop below its baseline
+#define BENCH_IO_THRESHOLD 25.0 // Same for the file benchmarks, io/ and e2e/, which the page cache makes noisy
+
+/* One benchmark: fn does bytes of work on arg per call */
+typedef void ( *BenchFn )( void *arg );
+
+/* Settings of a run */
+typedef struct _BenchRun
+{
+    FILE *out;
+    const char *filter;     // Only names starting with it, NULL for all
+    double min_time;
+    int quick;
+    char dir[ 256 ];        // Scratch directory of the file benchmarks
+} BenchRun;
+
+/* Function Definitions */
+
+/* Deterministic xorshift64*, the same stream on every machine */
+static uint64_t bench_rand( uint64_t *state )
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+/* Fills n bytes of buf from seed */
+static void fill_random( uchar *buf, size_t n, uint64_t seed )
+{
+    uint64_t state = seed * 0x9E3779B97F4A7C15ULL + 1;
+
+    for( size_t i = 0; i < n; i += 8 )
+    {
+        uint64_t v = bench_rand( &state );
+        memcpy( buf + i, &v, n - i < 8 ? n - i : 8 );
+    }
+}
+
+/* Fills n bytes of buf with text like data that compresses about 3:1 */
+static void fill_text( uchar *buf, size_t n, uint64_t seed )
+{
+    static const char *words[] = { "carrier ", "pixel ", "secret ", "stego ", "the ", "of ", "bitmap ", "row ",
+                                   "payload ", "image ", "and ", "least ", "significant ", "bit ", "\n", "data " };
+    uint64_t state = seed + 1;
+    size_t i = 0;
+
+    while( i < n )
+    {
+        const char *word = words[ bench_rand( &state ) & 15 ];
+        size_t len = strlen( word );
+
+        memcpy( buf + i, word, n - i < len ? n - i : len );
+        i += len;
+    }
+}
+
+/* Builds a width x height bmp of bpp 24 or 32, rows padded to 4 bytes,
+ * pixels from seed: a gradient with noise in the low bits, as a photo
+ * Returns the image, its size in *size, NULL if out of memory
+ */
+static uchar *bench_bmp( int width, int height, int bpp, uint64_t seed, size_t *size )
+{
+    size_t row_bytes = ( size_t )width * ( bpp / 8 );
+    size_t stride = ( row_bytes + 3 ) & ~( size_t )3;
+    size_t pixels = stride * height;
+    uchar *image = calloc( 1, BMP_HEADER_MIN + pixels );
+    uint64_t state = seed + 1;
+
+    if( image == NULL )
+    {
+        return NULL;
+    }
+
+    uint32_t header[] = { BMP_HEADER_MIN + pixels, 0, BMP_HEADER_MIN,                   // File header after "BM"
+                          40, width, height, 1 | bpp << 16, 0, pixels, 2835, 2835, 0, 0 };
+    image[0] = 'B';
+    image[1] = 'M';
+    memcpy( image + 2, header, sizeof( header ) );
+
+    for( int y = 0; y < height; y++ )
+    {
+        uchar *row = image + BMP_HEADER_MIN + stride * y;
+
+        for( size_t x = 0; x < row_bytes; x++ )
+            row[x] = ( ( x * 255 / row_bytes + y * 255 / height ) / 2 ) ^ ( bench_rand( &state ) & 7 );
+    }
+
+    *size = BMP_HEADER_MIN + pixels;
+
+    return image;
+}
+
+/* Writes n bytes of buf to path */
+static Status write_file( const char *path, const void *buf, size_t n )
+{
+    FILE *fptr = fopen( path, "wb" );
+
+    if( fptr == NULL )
+    {
+        perror( path );
+        return e_failure;
+    }
+    size_t written = fwrite( buf, 1, n, fptr );
+
+    return fclose( fptr ) == 0 && written == n ? e_success : e_failure;
+}
+
+/* Best seconds per call of fn over BENCH_TRIALS trials of at least min_time */
+static double bench_time( BenchFn fn, void *arg, double min_time )
+{
+    size_t iters = 1;
+    double best, elapsed;
+
+    // Calibrate the calls per trial, which also warms the caches
+    for( ;; )
+    {
+        double start = report_now();
+        for( size_t i = 0; i < iters; i++ )
+            fn( arg );
+        elapsed = report_now() - start;
+
+        if( elapsed >= min_time || iters >= ( ( size_t )1 << 30 ) )
+            break;
+        iters = elapsed > 0 ? iters * 2 : iters * 16;
+    }
+    best = elapsed / iters;
+
+    for( int trial = 1; trial < BENCH_TRIALS; trial++ )
+    {
+        double start = report_now();
+        for( size_t i = 0; i < iters; i++ )
+            fn( arg );
+        elapsed = ( report_now() - start ) / iters;
+
+        if( elapsed < best )
+            best = elapsed;
+    }
+
+    return best;
+}
+
+/* Whether the filter skips the benchmark name */
+static int bench_skipped( const BenchRun *run, const char *name )
+{
+    return run -> filter && strncmp( name, run -> filter, strlen( run -> filter ) ) != 0;
+}
+
+/* Writes the result line of a benchmark, syscalls may be NULL */
+static void bench_line( BenchRun *run, const char *name, size_t bytes, double seconds, const size_t *syscalls )
+{
+    fprintf( run -> out, "{\"name\":" );
+    report_json_string( run -> out, name );
+    fprintf( run -> out, ",\"bytes\":%zu,\"seconds\":%.9f,\"mb_s\":%.1f", bytes, seconds, seconds > 0 ? bytes / seconds / 1e6 : 0.0 );
+    if( syscalls )
+        fprintf( run -> out, ",\"syscalls\":%zu", *syscalls );
+    fprintf( run -> out, "}\n" );
+    fflush( run -> out );
+
+    if( syscalls )
+        fprintf( stderr, "%-44s %10.1f MB/s %8zu syscalls\n", name, seconds > 0 ? bytes / seconds / 1e6 : 0.0, *syscalls );
+    else
+        fprintf( stderr, "%-44s %10.1f MB/s\n", name, seconds > 0 ? bytes / seconds / 1e6 : 0.0 );
+}
+
+/* Runs one benchmark unless the filter skips it, one result line */
+static void bench( BenchRun *run, const char *name, size_t bytes, BenchFn fn, void *arg )
+{
+    if( bench_skipped( run, name ) )
+        return;
+
+    bench_line( run, name, bytes, bench_time( fn, arg, run -> min_time ), NULL );
+}
+
+/* Microbenchmarks */
+
+/* Buffers of the kernel benchmarks */
+typedef struct _KernelArgs
+{
+    int bits;
+    size_t n;               // Payload bytes
+    uchar *data;
+    uchar *src;
+    uchar *dst;
+    const BmpInfo *bmp;     // Layout of the bmp benchmarks
+    long long sink;         // Keeps the reference loops from being dropped
+} KernelArgs;
+
+static void run_encode_byte( void *arg )
+{
+    KernelArgs *k = arg;
+
+    for( size_t i = 0; i < k -> n; i++ )
+        encode_byte_to_lsb( k -> data[i], ( char * )k -> dst + i * 8 );
+}
+
+static void run_decode_byte( void *arg )
+{
+    KernelArgs *k = arg;
+    long long sum = 0;
+
+    for( size_t i = 0; i < k -> n; i++ )
+        sum += decode_byte_from_lsb( ( char * )k -> src + i * 8 );
+    k -> sink += sum;
+}
+
+static void run_embed( void *arg )
+{
+    KernelArgs *k = arg;
+
+    lsb_embed_bits( k -> bits, k -> data, k -> n, k -> src, k -> dst );
+}
+
+static void run_extract( void *arg )
+{
+    KernelArgs *k = arg;
+
+    lsb_extract_bits( k -> bits, k -> src, k -> n, k -> data );
+}
+
+static void run_bmp_embed( void *arg )
+{
+    KernelArgs *k = arg;
+
+    bmp_embed( k -> bmp, k -> bits, k -> data, k -> n, 0, k -> src, k -> dst, 0 );
+}
+
+static void run_bmp_extract( void *arg )
+{
+    KernelArgs *k = arg;
+
+    bmp_extract( k -> bmp, k -> bits, k -> src, 0, 0, k -> n, k -> data );
+}
+
+/* The byte at a time reference functions and every kernel the CPU has, at every depth */
+static void bench_kernels( BenchRun *run )
+{
+    static const char *kernels[] = { "avx512", "avx2", "sse2", "pdep", "lut" };
+    char saved[ 16 ], name[ 64 ];
+    KernelArgs k = { .n = 256 * 1024 };
+
+    k.data = malloc( k.n );
+    k.src = malloc( k.n * 8 );
+    k.dst = malloc( k.n * 8 );
+    if( k.data == NULL || k.src == NULL || k.dst == NULL )
+    {
+        fprintf( stderr, "ERROR: Out of memory\n" );
+        goto done;
+    }
+    fill_random( k.data, k.n, 1 );
+    fill_random( k.src, k.n * 8, 2 );
+
+    // Payload bytes per second, the rate a secret goes in or out at
+    bench( run, "byte/encode_byte_to_lsb", k.n, run_encode_byte, &k );
+    bench( run, "byte/decode_byte_from_lsb", k.n, run_decode_byte, &k );
+
+    snprintf( saved, sizeof( saved ), "%s", lsb_kernel_name() );
+    for( size_t i = 0; i < sizeof( kernels ) / sizeof( kernels[0] ); i++ )
+    {
+        if( lsb_select_kernel( kernels[i] ) != e_success )
+            continue;
+
+        k.bits = 1;
+        snprintf( name, sizeof( name ), "kernel/%s/embed/1", kernels[i] );
+        bench( run, name, k.n, run_embed, &k );
+        snprintf( name, sizeof( name ), "kernel/%s/extract/1", kernels[i] );
+        bench( run, name, k.n, run_extract, &k );
+    }
+    lsb_select_kernel( saved );
+
+    // The wider depths have one implementation each
+    for( k.bits = 2; k.bits <= LSB_BITS_MAX; k.bits *= 2 )
+    {
+        snprintf( name, sizeof( name ), "kernel/embed/%d", k.bits );
+        bench( run, name, k.n, run_embed, &k );
+        snprintf( name, sizeof( name ), "kernel/extract/%d", k.bits );
+        bench( run, name, k.n, run_extract, &k );
+    }
+
+done:
+    free( k.data );
+    free( k.src );
+    free( k.dst );
+}
+
+/* Row spans: a layout without padding against one gathered row by row */
+static void bench_spans( BenchRun *run )
+{
+    static const struct { const char *name; int width; int bpp; } layouts[] = {
+        { "bmp/contiguous", 1024, 24 },     // 3072 byte rows, no padding
+        { "bmp/padded", 1023, 24 },         // 3069 byte rows, 3 bytes padding
+        { "bmp/narrow", 33, 24 },           // 99 byte rows, a span per 12 payload bytes
+        { "bmp/32bit", 1023, 32 },
+    };
+    char name[ 64 ];
+
+    for( size_t i = 0; i < sizeof( layouts ) / sizeof( layouts[0] ); i++ )
+    {
+        int height = 2 * 1024 * 1024 / ( layouts[i].width * layouts[i].bpp / 8 );
+        size_t size;
+        BmpInfo bmp;
+        uchar *image = bench_bmp( layouts[i].width, height, layouts[i].bpp, i, &size );
+        uchar *stego = malloc( size );
+        KernelArgs k = { .bits = 1, .src = image, .dst = stego, .bmp = &bmp };
+
+        if( image == NULL || stego == NULL || bmp_parse( image, size, &bmp ) != e_success )
+        {
+            fprintf( stderr, "ERROR: Unable to build %s\n", layouts[i].name );
+            free( image );
+            free( stego );
+            continue;
+        }
+        k.n = bmp.capacity / 8;
+        k.data = malloc( k.n );
+        if( k.data )
+        {
+            fill_random( k.data, k.n, i );
+            snprintf( name, sizeof( name ), "%s/embed", layouts[i].name );
+            bench( run, name, k.n, run_bmp_embed, &k );
+            snprintf( name, sizeof( name ), "%s/extract", layouts[i].name );
+            bench( run, name, k.n, run_bmp_extract, &k );
+        }
+
+        free( k.data );
+        free( image );
+        free( stego );
+    }
+}
+
+/* Buffers of the codec benchmarks */
+typedef struct _LzArgs
+{
+    uchar *raw;
+    uchar *frame;
+    uchar *out;
+    size_t n;
+    size_t frame_len;
+} LzArgs;
+
+static void run_lz_encode( void *arg )
+{
+    LzArgs *l = arg;
+
+    l -> frame_len = lz_frame_encode( l -> raw, l -> n, l -> frame );
+}
+
+static void run_lz_decode( void *arg )
+{
+    LzArgs *l = arg;
+
+    lz_frame_decode( l -> frame, l -> frame + LZ_FRAME_HEADER, l -> out );
+}
+
+/* One frame of text and of random data, raw bytes per second */
+static void bench_codec( BenchRun *run )
+{
+    LzArgs l = { .n = LZ_BLOCK };
+
+    l.raw = malloc( l.n );
+    l.frame = malloc( LZ_FRAME_BOUND( l.n ) );
+    l.out = malloc( l.n );
+    if( l.raw && l.frame && l.out )
+    {
+        fill_text( l.raw, l.n, 3 );
+        bench( run, "lz/text/compress", l.n, run_lz_encode, &l );
+        run_lz_encode( &l );
+        bench( run, "lz/text/decompress", l.n, run_lz_decode, &l );
+
+        fill_random( l.raw, l.n, 4 );
+        bench( run, "lz/random/compress", l.n, run_lz_encode, &l );
+        run_lz_encode( &l );
+        bench( run, "lz/random/decompress", l.n, run_lz_decode, &l );
+    }
+
+    free( l.raw );
+    free( l.frame );
+    free( l.out );
+}
+
+/* Buffer of the checksum benchmark */
+typedef struct _CrcArgs
+{
+    uchar *data;
+    size_t n;
+    uint32_t crc;
+} CrcArgs;
+
+static void run_crc32c( void *arg )
+{
+    CrcArgs *c = arg;
+
+    c -> crc = crc32c( c -> crc, c -> data, c -> n );
+}
+
+/* The checksum of the secret, with the implementation the CPU has */
+static void bench_checksum( BenchRun *run )
+{
+    CrcArgs c = { .n = 256 * 1024 };
+    char name[ 64 ];
+
+    c.data = malloc( c.n );
+    if( c.data )
+    {
+        fill_random( c.data, c.n, 5 );
+        snprintf( name, sizeof( name ), "crc32c/%s", crc32c_kernel_name() );
+        bench( run, name, c.n, run_crc32c, &c );
+    }
+
+    free( c.data );
+}
+
+/* Buffer and cipher of the encryption benchmark */
+typedef struct _CipherArgs
+{
+    uchar *data;
+    size_t n;
+    ChaCha cipher;
+} CipherArgs;
+
+static void run_chacha( void *arg )
+{
+    CipherArgs *c = arg;
+
+    // In the blocks scatter.c encrypts at once
+    for( size_t done = 0; done < c -> n; done += SCATTER_CIPHER_BLOCK )
+        chacha_xor( &c -> cipher, done, c -> data + done, c -> data + done, SCATTER_CIPHER_BLOCK );
+}
+
+/* The keystream XOR of encrypted data */
+static void bench_cipher( BenchRun *run )
+{
+    CipherArgs c = { .n = 256 * 1024 };
+
+    c.data = malloc( c.n );
+    if( c.data )
+    {
+        fill_random( c.data, c.n, 7 );
+        chacha_init( &c.cipher, "bench", c.n );
+        bench( run, "chacha20/xor", c.n, run_chacha, &c );
+    }
+
+    free( c.data );
+}
+
+/* Files of the I/O and end to end benchmarks */
+typedef struct _FileArgs
+{
+    const char *image;
+    const char *secret;
+    const char *stego;
+    const char *output;
+    size_t size;                // Image bytes
+    size_t block_size;
+    StegContext ctx;
+    StegResult result;          // Of the last call
+} FileArgs;
+
+/* Read and write system calls of the process so far, see proc(5) */
+static size_t proc_syscalls( void )
+{
+    FILE *fptr = fopen( "/proc/self/io", "r" );
+    char line[ 64 ];
+    size_t n, total = 0;
+
+    if( fptr == NULL )
+    {
+        return 0;
+    }
+    while( fgets( line, sizeof( line ), fptr ) )
+    {
+        if( sscanf( line, "syscr: %zu", &n ) == 1 || sscanf( line, "syscw: %zu", &n ) == 1 )
+            total += n;
+    }
+    fclose( fptr );
+
+    return total;
+}
+
+/* Like bench() for the file calls, with the system calls of one more call:
+ * its reads and writes, which io_uring does without, and its io_uring_enter() calls
+ */
+static void bench_file( BenchRun *run, const char *name, size_t bytes, BenchFn fn, FileArgs *f )
+{
+    if( bench_skipped( run, name ) )
+        return;
+
+    double seconds = bench_time( fn, f, run -> min_time );
+
+    // Reading /proc/self/io reads too, count that out
+    size_t start = proc_syscalls();
+    size_t own = proc_syscalls() - start;
+    start = proc_syscalls();
+    fn( f );
+    size_t syscalls = proc_syscalls() - start - own + f -> result.io_enters;
+
+    bench_line( run, name, bytes, seconds, &syscalls );
+}
+
+/* Header and remaining image bytes through copy_stream_region(), as encode_image() copies them */
+static void run_copy( void *arg )
+{
+    FileArgs *f = arg;
+    FILE *src = fopen( f -> image, "rb" );
+    FILE *dst = fopen( f -> stego, "wb" );
+
+    if( src && dst )
+    {
+        copy_bmp_header( src, dst, BMP_HEADER_MIN );
+        copy_stream_region( src, dst, f -> size - BMP_HEADER_MIN );
+    }
+    if( src )
+        fclose( src );
+    if( dst )
+        fclose( dst );
+}
+
+/* The image read a block at a time, as the stdio engine reads it */
+static void run_block_read( void *arg )
+{
+    FileArgs *f = arg;
+    FILE *src = fopen( f -> image, "rb" );
+    BlockBuffer block;
+
+    if( src && block_alloc( &block, f -> block_size ) == e_success )
+    {
+        while( fread( block.data, 1, block.capacity, src ) == block.capacity )
+            ;
+        block_free( &block );
+    }
+    if( src )
+        fclose( src );
+}
+
+/* The image written a block at a time */
+static void run_block_write( void *arg )
+{
+    FileArgs *f = arg;
+    FILE *dst = fopen( f -> stego, "wb" );
+    BlockBuffer block;
+
+    if( dst && block_alloc( &block, f -> block_size ) == e_success )
+    {
+        memset( block.data, 0x5A, block.capacity );
+        for( size_t done = 0; done < f -> size; done += block.capacity )
+            fwrite( block.data, 1, f -> size - done < block.capacity ? f -> size - done : block.capacity, dst );
+        block_free( &block );
+    }
+    if( dst )
+        fclose( dst );
+}
+
+static void run_encode_file( void *arg )
+{
+    FileArgs *f = arg;
+
+    if( steg_encode_file( &f -> ctx, f -> image, f -> secret, f -> stego, &f -> result ) != steg_ok )
+        fprintf( stderr, "ERROR: Encoding %s failed\n", f -> image );
+}
+
+static void run_decode_file( void *arg )
+{
+    FileArgs *f = arg;
+
+    if( steg_decode_file( &f -> ctx, f -> stego, f -> output, &f -> result ) != steg_ok )
+        fprintf( stderr, "ERROR: Decoding %s failed\n", f -> stego );
+}
+
+static void run_verify_file( void *arg )
+{
+    FileArgs *f = arg;
+
+    if( steg_verify_file( &f -> ctx, f -> stego, &f -> result ) != steg_ok )
+        fprintf( stderr, "ERROR: Verifying %s failed\n", f -> stego );
+}
+
+/* Copies, block reads and writes of a carrier in the page cache */
+static void bench_io( BenchRun *run, const char *image, size_t size, const char *tag )
+{
+    char stego[ 320 ], name[ 64 ];
+    FileArgs f = { .image = image, .stego = stego, .size = size, .block_size = BLOCK_SIZE_DEFAULT };
+
+    snprintf( stego, sizeof( stego ), "%s/io.bmp", run -> dir );
+
+    snprintf( name, sizeof( name ), "io/copy_image/%s", tag );
+    bench( run, name, size, run_copy, &f );
+    snprintf( name, sizeof( name ), "io/block_read/%s", tag );
+    bench( run, name, size, run_block_read, &f );
+    snprintf( name, sizeof( name ), "io/block_write/%s", tag );
+    bench( run, name, size, run_block_write, &f );
+
+    unlink( stego );
+}
+
+/* Whole encodes, decodes and verifications of each payload size with each engine
+ * Encodes count image bytes, as every call writes a whole stego image,
+ * decodes and verifications the payload bytes they read back
+ */
+static void bench_end_to_end( BenchRun *run, const char *image, size_t size, const char *tag )
+{
+    static const struct { const char *name; Engine engine; int threads; IoBackend io; int pipeline; } engines[] = {
+        { "stdio", eng_stdio, 1, io_stdio, 0 },
+        { "mmap", eng_mmap, 1, io_stdio, 0 },
+        { "threads4", eng_stdio, 4, io_stdio, 0 },
+        { "uring", eng_stdio, 1, io_uring, 0 },
+        { "pipeline", eng_stdio, 1, io_stdio, 1 },
+    };
+    size_t capacity = ( size - BMP_HEADER_MIN ) / 8 - 64;
+    size_t payloads[] = { 1024, 64 * 1024, capacity };
+    char secret[ 320 ], stego[ 320 ], output[ 320 ], decoded[ 320 ], name[ 96 ];
+
+    snprintf( secret, sizeof( secret ), "%s/secret.bin", run -> dir );
+    snprintf( stego, sizeof( stego ), "%s/stego.bmp", run -> dir );
+    snprintf( output, sizeof( output ), "%s/decoded", run -> dir );
+    snprintf( decoded, sizeof( decoded ), "%s/decoded.bin", run -> dir );
+
+    for( size_t p = 0; p < sizeof( payloads ) / sizeof( payloads[0] ); p++ )
+    {
+        uchar *payload = malloc( payloads[p] );
+
+        if( payload == NULL || payloads[p] > capacity )
+        {
+            free( payload );
+            continue;
+        }
+        fill_random( payload, payloads[p], p );
+        if( write_file( secret, payload, payloads[p] ) != e_success )
+        {
+            free( payload );
+            continue;
+        }
+        free( payload );
+
+        for( size_t e = 0; e < sizeof( engines ) / sizeof( engines[0] ); e++ )
+        {
+            FileArgs f = { .image = image, .secret = secret, .stego = stego, .output = output, .size = size };
+            const char *payload_tag = p == 0 ? "1K" : p == 1 ? "64K" : "full";
+
+            steg_context_init( &f.ctx );
+            f.ctx.engine = engines[e].engine;
+            f.ctx.threads = engines[e].threads;
+            f.ctx.io = engines[e].io;
+            f.ctx.pipeline = engines[e].pipeline;
+
+            snprintf( name, sizeof( name ), "e2e/encode/%s/%s/%s", engines[e].name, tag, payload_tag );
+            bench_file( run, name, size, run_encode_file, &f );
+            snprintf( name, sizeof( name ), "e2e/decode/%s/%s/%s", engines[e].name, tag, payload_tag );
+            bench_file( run, name, payloads[p], run_decode_file, &f );
+            snprintf( name, sizeof( name ), "e2e/verify/%s/%s/%s", engines[e].name, tag, payload_tag );
+            bench_file( run, name, payloads[p], run_verify_file, &f );
+        }
+    }
+
+    unlink( secret );
+    unlink( stego );
+    unlink( decoded );
+}
+
+/* 4K windows from the middle of a payload that fills the image, encoded with a
+ * chunk index, so the rate against the whole decode shows what the range saved
+ */
+static void bench_range( BenchRun *run, const char *image, size_t size, const char *tag )
+{
+    static const struct { const char *name; Engine engine; } engines[] = {
+        { "stdio", eng_stdio },
+        { "mmap", eng_mmap },
+    };
+    size_t payload_size = ( ( size - BMP_HEADER_MIN ) / 8 - 64 ) / 4100 * 4096; // 4 index bytes per 4K
+    char secret[ 320 ], stego[ 320 ], output[ 320 ], decoded[ 320 ], name[ 96 ];
+    FileArgs f = { .image = image, .secret = secret, .stego = stego, .output = output, .size = size };
+
+    snprintf( secret, sizeof( secret ), "%s/secret.bin", run -> dir );
+    snprintf( stego, sizeof( stego ), "%s/stego.bmp", run -> dir );
+    snprintf( output, sizeof( output ), "%s/decoded", run -> dir );
+    snprintf( decoded, sizeof( decoded ), "%s/decoded.bin", run -> dir );
+
+    uchar *payload = malloc( payload_size );
+    if( payload == NULL )
+    {
+        return;
+    }
+    fill_random( payload, payload_size, 6 );
+    Status status = write_file( secret, payload, payload_size );
+    free( payload );
+
+    steg_context_init( &f.ctx );
+    f.ctx.index = 1;
+    if( status != e_success || steg_encode_file( &f.ctx, image, secret, stego, NULL ) != steg_ok )
+    {
+        fprintf( stderr, "ERROR: Encoding %s with a chunk index failed\n", image );
+        unlink( secret );
+        return;
+    }
+
+    f.ctx.range_offset = payload_size / 2;
+    f.ctx.range_length = 4096;
+    for( size_t e = 0; e < sizeof( engines ) / sizeof( engines[0] ); e++ )
+    {
+        f.ctx.engine = engines[e].engine;
+
+        snprintf( name, sizeof( name ), "e2e/range/%s/%s/4K", engines[e].name, tag );
+        bench_file( run, name, f.ctx.range_length, run_decode_file, &f );
+    }
+
+    unlink( secret );
+    unlink( stego );
+    unlink( decoded );
+}
+
+/* Runs the whole suite */
+static int bench_run( BenchRun *run )
+{
+    // Carriers: small enough for the caches, and a photo sized one
+    static const struct { const char *tag; int width; int height; int quick; } carriers[] = {
+        { "1M", 600, 582, 1 },
+        { "48M", 4096, 4096, 0 },
+    };
+    char path[ 320 ];
+    int status = 0;
+
+    fprintf( stderr, "Kernel %s, results are the best of %d trials\n", lsb_kernel_name(), BENCH_TRIALS );
+
+    bench_kernels( run );
+    bench_spans( run );
+    bench_codec( run );
+    bench_checksum( run );
+    bench_cipher( run );
+
+    for( size_t c = 0; c < sizeof( carriers ) / sizeof( carriers[0] ); c++ )
+    {
+        size_t size;
+        uchar *image;
+
+        if( run -> quick && !carriers[c].quick )
+            continue;
+
+        image = bench_bmp( carriers[c].width, carriers[c].height, 24, c, &size );
+        snprintf( path, sizeof( path ), "%s/carrier_%s.bmp", run -> dir, carriers[c].tag );
+        if( image == NULL || write_file( path, image, size ) != e_success )
+        {
+            fprintf( stderr, "ERROR: Unable to write carrier %s\n", path );
+            free( image );
+            status = 1;
+            continue;
+        }
+        free( image );
+
+        bench_io( run, path, size, carriers[c].tag );
+        bench_end_to_end( run, path, size, carriers[c].tag );
+        bench_range( run, path, size, carriers[c].tag );
+        unlink( path );
+    }
+
+    return status;
+}
+
+/* Reads the "name" and "mb_s" of a result line, 0 if it has none */
+static int parse_result( const char *line, char *name, size_t name_size, double *mb_s )
+{
+    const char *key = strstr( line, "\"name\":\"" );
+    const char *rate = strstr( line, "\"mb_s\":" );
+
+    if( key == NULL || rate == NULL )
+        return 0;
+
+    key += strlen( "\"name\":\"" );
+    const char *end = strchr( key, '"' );
+    if( end == NULL || ( size_t )( end - key ) >= name_size )
+        return 0;
+
+    memcpy( name, key, end - key );
+    name[ end - key ] = '\0';
+    *mb_s = strtod( rate + strlen( "\"mb_s\":" ), NULL );
+
+    return 1;
+}
+
+/* Named rates of a results file */
+typedef struct _BenchResults
+{
+    char ( *names )[ 96 ];
+    double *mb_s;
+    size_t count;
+} BenchResults;
+
+/* Loads a results file, e_failure if it cannot be read */
+static Status load_results( const char *path, BenchResults *results )
+{
+    FILE *fptr = fopen( path, "r" );
+    char line[ 512 ];
+    size_t capacity = 0;
+
+    memset( results, 0, sizeof( *results ) );
+    if( fptr == NULL )
+    {
+        perror( path );
+        return e_failure;
+    }
+
+    while( fgets( line, sizeof( line ), fptr ) )
+    {
+        char name[ 96 ];
+        double mb_s;
+
+        if( !parse_result( line, name, sizeof( name ), &mb_s ) )
+            continue;
+
+        if( results -> count == capacity )
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            void *names = realloc( results -> names, capacity * sizeof( results -> names[0] ) );
+            void *rates = names ? realloc( results -> mb_s, capacity * sizeof( double ) ) : NULL;
+            if( names )
+                results -> names = names;
+            if( rates == NULL )
+            {
+                fclose( fptr );
+                return e_failure;
+            }
+            results -> mb_s = rates;
+        }
+        strcpy( results -> names[ results -> count ], name );
+        results -> mb_s[ results -> count++ ] = mb_s;
+    }
+    fclose( fptr );
+
+    return e_success;
+}
+
+/* Compares results against baseline, 1 if any rate dropped more than threshold percent,
+ * io_threshold for the file benchmarks
+ */
+static int bench_compare( const char *baseline_path, const char *results_path, double threshold, double io_threshold )
+{
+    BenchResults baseline, results;
+    int regressed = 0;
+    size_t compared = 0;
+
+    if( load_results( baseline_path, &baseline ) != e_success || load_results( results_path, &results ) != e_success )
+    {
+        return 2;
+    }
+
+    printf( "%-44s %12s %12s %8s\n", "benchmark", "baseline", "now MB/s", "change" );
+    for( size_t i = 0; i < results.count; i++ )
+    {
+        const char *name = results.names[i];
+        size_t j = 0;
+
+        while( j < baseline.count && strcmp( baseline.names[j], name ) != 0 )
+            j++;
+        if( j == baseline.count )
+        {
+            printf( "%-44s %12s %12.1f %8s\n", name, "-", results.mb_s[i], "new" );
+            continue;
+        }
+
+        double change = baseline.mb_s[j] > 0 ? ( results.mb_s[i] / baseline.mb_s[j] - 1 ) * 100 : 0;
+        int slow = change < -( strncmp( name, "io/", 3 ) == 0 || strncmp( name, "e2e/", 4 ) == 0 ? io_threshold : threshold );
+
+        printf( "%-44s %12.1f %12.1f %+7.1f%%%s\n", name, baseline.mb_s[j], results.mb_s[i], change, slow ? "  REGRESSION" : "" );
+        regressed |= slow;
+        compared++;
+    }
+    printf( "%zu benchmarks compared, threshold %.1f%%, %.1f%% for files: %s\n", compared, threshold, io_threshold, regressed ? "regressed" : "ok" );
+
+    free( baseline.names );
+    free( baseline.mb_s );
+    free( results.names );
+    free( results.mb_s );
+
+    return regressed;
+}
+
+static void usage( void )
+{
+    fprintf( stderr, "./lsb_bench: Generate: ./lsb_bench gen <width> <height> <24|32> <out.bmp> [seed]\n" );
+    fprintf( stderr, "./lsb_bench: Run:      ./lsb_bench run [--quick] [--results <file|->] [--dir <tmp dir>] [--filter <prefix>]\n" );
+    fprintf( stderr, "./lsb_bench: Compare:  ./lsb_bench compare <baseline.jsonl> <results.jsonl> [--threshold <percent, default 10>]\n" );
+    fprintf( stderr, "./lsb_bench:                           [--io-threshold <percent of the io/ and e2e/ benchmarks, default 25>]\n" );
+}
+
+int main( int argc, char *argv[] )
+{
+    if( argc >= 6 && strcmp( argv[1], "gen" ) == 0 )
+    {
+        int width = atoi( argv[2] ), height = atoi( argv[3] ), bpp = atoi( argv[4] );
+        size_t size;
+        uchar *image;
+
+        if( width <= 0 || height <= 0 || ( bpp != 24 && bpp != 32 ) )
+        {
+            usage();
+            return 1;
+        }
+        image = bench_bmp( width, height, bpp, argc > 6 ? strtoull( argv[6], NULL, 10 ) : 0, &size );
+        if( image == NULL || write_file( argv[5], image, size ) != e_success )
+        {
+            free( image );
+            return 1;
+        }
+        free( image );
+
+        return 0;
+    }
+
+    if( argc >= 2 && strcmp( argv[1], "run" ) == 0 )
+    {
+        BenchRun run = { .out = stdout, .min_time = BENCH_MIN_TIME };
+        const char *results = NULL, *dir = "/tmp";
+
+        for( int i = 2; i < argc; i++ )
+        {
+            if( strcmp( argv[i], "--quick" ) == 0 )
+                run.quick = 1;
+            else if( strcmp( argv[i], "--results" ) == 0 && i + 1 < argc )
+                results = argv[++i];
+            else if( strcmp( argv[i], "--dir" ) == 0 && i + 1 < argc )
+                dir = argv[++i];
+            else if( strcmp( argv[i], "--filter" ) == 0 && i + 1 < argc )
+                run.filter = argv[++i];
+            else
+            {
+                usage();
+                return 1;
+            }
+        }
+        if( run.quick )
+            run.min_time /= 5;
+
+        snprintf( run.dir, sizeof( run.dir ), "%s/lsb_bench.XXXXXX", dir );
+        if( mkdtemp( run.dir ) == NULL )
+        {
+            perror( run.dir );
+            return 1;
+        }
+        if( results && strcmp( results, "-" ) != 0 && ( run.out = fopen( results, "w" ) ) == NULL )
+        {
+            perror( results );
+            rmdir( run.dir );
+            return 1;
+        }
+
+        int status = bench_run( &run );
+
+        if( run.out != stdout && fclose( run.out ) != 0 )
+            status = 1;
+        rmdir( run.dir );
+
+        return status;
+    }
+
+    if( argc >= 4 && strcmp( argv[1], "compare" ) == 0 )
+    {
+        double threshold = BENCH_THRESHOLD, io_threshold = BENCH_IO_THRESHOLD;
+
+        for( int i = 4; i + 1 < argc; i += 2 )
+        {
+            if( strcmp( argv[i], "--threshold" ) == 0 )
+                threshold = strtod( argv[i + 1], NULL );
+            else if( strcmp( argv[i], "--io-threshold" ) == 0 )
+                io_threshold = strtod( argv[i + 1], NULL );
+        }
+
+        return bench_compare( argv[2], argv[3], threshold, io_threshold );
+    }
+
+    usage();
+
+    return 1;
+}
@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "blockio.h"
+#include "types.h"
+
+/* Function Definitions */
+
+/* Clamp a requested block size, 0 means the default */
+size_t block_size_clamp( size_t size )
+{
+    if( size == 0 )
+        return BLOCK_SIZE_DEFAULT;
+    if( size < BLOCK_SIZE_MIN )
+        return BLOCK_SIZE_MIN;
+    if( size > BLOCK_SIZE_MAX )
+        return BLOCK_SIZE_MAX;
+
+    return size & ~( size_t )7; // Whole groups of 8 image bytes
+}
+
+/* Allocate an aligned block */
+Status block_alloc( BlockBuffer *block, size_t capacity )
+{
+    void *data;
+
+    memset( block, 0, sizeof( *block ) );
+    capacity = block_size_clamp( capacity );
+
+    if( posix_memalign( &data, BLOCK_ALIGN, capacity ) != 0 )
+    {
+        return e_failure;
+    }
+
+    block -> data = data;
+    block -> capacity = capacity;
+
+    return e_success;
+}
+
+/* Free the block */
+void block_free( BlockBuffer *block )
+{
+    free( block -> data );
+    memset( block, 0, sizeof( *block ) );
+}
+
+/* Reads exactly len bytes at off */
+int pread_full( int fd, void *buf, size_t len, off_t off )
+{
+    while( len > 0 )
+    {
+        ssize_t n = pread( fd, buf, len, off );
+        if( n <= 0 )
+            return -1;
+        buf = ( char * )buf + n;
+        len -= n;
+        off += n;
+    }
+
+    return 0;
+}
+
+/* Writes exactly len bytes at off */
+int pwrite_full( int fd, const void *buf, size_t len, off_t off )
+{
+    while( len > 0 )
+    {
+        ssize_t n = pwrite( fd, buf, len, off );
+        if( n <= 0 )
+            return -1;
+        buf = ( const char * )buf + n;
+        len -= n;
+        off += n;
+    }
+
+    return 0;
+}
+
+/* Writes exactly len bytes at the offset of fd */
+int write_full( int fd, const void *buf, size_t len )
+{
+    while( len > 0 )
+    {
+        ssize_t n = write( fd, buf, len );
+        if( n <= 0 )
+            return -1;
+        buf = ( const char * )buf + n;
+        len -= n;
+    }
+
+    return 0;
+}
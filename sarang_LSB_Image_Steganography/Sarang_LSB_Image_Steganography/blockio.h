@@ -0,0 +1,50 @@
+#ifndef BLOCKIO_H
+#define BLOCKIO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "types.h" // Contains user defined types
+
+/*
+ * Block buffers for the stdio engine
+ * Image data is read, encoded and written a whole block at a time
+ * instead of 8 bytes per data byte.
+ */
+
+#define BLOCK_SIZE_MIN ( 64 * 1024 )
+#define BLOCK_SIZE_DEFAULT ( 1024 * 1024 )
+#define BLOCK_SIZE_MAX ( 64 * 1024 * 1024 )
+#define BLOCK_ALIGN 4096
+
+/* Window over a file, data[0 .. fill) holds the file from offset base */
+typedef struct _BlockBuffer
+{
+    uchar *data;        // BLOCK_ALIGN aligned
+    size_t capacity;
+    size_t fill;        // Valid bytes in data
+    off_t base;         // File offset of data[0]
+} BlockBuffer;
+
+/* Allocate an aligned block, capacity is clamped to the limits above
+ * and rounded down to a multiple of 8
+ */
+Status block_alloc( BlockBuffer *block, size_t capacity );
+
+/* Free the block, safe on a block that was never allocated */
+void block_free( BlockBuffer *block );
+
+/* Clamp a requested block size, 0 means the default */
+size_t block_size_clamp( size_t size );
+
+/* Whole transfers, 0 once all len bytes are done, -1 on an error or end of file */
+
+/* Reads exactly len bytes at off */
+int pread_full( int fd, void *buf, size_t len, off_t off );
+
+/* Writes exactly len bytes at off */
+int pwrite_full( int fd, const void *buf, size_t len, off_t off );
+
+/* Writes exactly len bytes at the offset of fd, pipes included */
+int write_full( int fd, const void *buf, size_t len );
+
+#endif
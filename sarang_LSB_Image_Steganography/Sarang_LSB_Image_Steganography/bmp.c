@@ -0,0 +1,296 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "bmp.h"
+#include "lsb.h"
+#include "blockio.h"
+#include "types.h"
+
+#define BI_RGB 0
+#define BI_BITFIELDS 3
+#define BI_ALPHABITFIELDS 6
+
+/* Function Definitions */
+
+static uint32_t le16( const uchar *p )
+{
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t le32( const uchar *p )
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | ( uint32_t )p[3] << 24;
+}
+
+/* Parses the BMP_HEADER_MIN bytes at header of an image of file_size bytes */
+Status bmp_parse_header( const uchar *header, off_t file_size, BmpInfo *bmp )
+{
+    if( header[0] != 'B' || header[1] != 'M' )
+    {
+        return e_failure;
+    }
+
+    uint32_t offset = le32( header + 10 );
+    uint32_t header_size = le32( header + 14 );
+    int32_t width = ( int32_t )le32( header + 18 );
+    int32_t height = ( int32_t )le32( header + 22 );
+    uint32_t bpp = le16( header + 28 );
+    uint32_t compression = le32( header + 30 );
+
+    // BITMAPINFOHEADER or one of its extensions ( V2 .. V5 ), core headers are too old
+    if( header_size < 40 || offset < 14 + header_size )
+    {
+        return e_failure;
+    }
+    if( width <= 0 || height == 0 || height == INT32_MIN || ( bpp != 24 && bpp != 32 ) )
+    {
+        return e_failure;
+    }
+    // Bit fields only move channels around within 32 bit pixels
+    if( compression != BI_RGB && !( bpp == 32 && ( compression == BI_BITFIELDS || compression == BI_ALPHABITFIELDS ) ) )
+    {
+        return e_failure;
+    }
+
+    size_t rows = height < 0 ? -( int64_t )height : height;
+    size_t row_bytes = ( size_t )width * ( bpp / 8 );
+    size_t stride = ( row_bytes + 3 ) & ~( size_t )3;
+
+    if( offset > file_size || ( size_t )( file_size - offset ) / stride < rows )
+    {
+        return e_failure; // Rows missing
+    }
+
+    bmp -> data_offset = offset;
+    bmp -> width = width;
+    bmp -> height = rows;
+    bmp -> top_down = height < 0;
+    bmp -> bpp = bpp;
+    bmp -> row_bytes = row_bytes;
+    bmp -> stride = stride;
+    bmp -> capacity = row_bytes * rows;
+
+    return e_success;
+}
+
+/* Parses the header of the image in memory */
+Status bmp_parse( const uchar *image, size_t image_size, BmpInfo *bmp )
+{
+    if( image == NULL || image_size < BMP_HEADER_MIN )
+    {
+        return e_failure;
+    }
+
+    return bmp_parse_header( image, image_size, bmp );
+}
+
+/* Parses the header of the image file of fptr, read with pread() */
+Status bmp_read( FILE *fptr, BmpInfo *bmp )
+{
+    uchar header[ BMP_HEADER_MIN ];
+    struct stat st;
+    int fd = fileno( fptr );
+
+    if( fstat( fd, &st ) != 0 || pread( fd, header, sizeof( header ), 0 ) != sizeof( header ) )
+    {
+        return e_failure;
+    }
+
+    return bmp_parse_header( header, st.st_size, bmp );
+}
+
+/* Layout of images encoded before the header was parsed */
+void bmp_legacy( BmpInfo *bmp, off_t file_size )
+{
+    memset( bmp, 0, sizeof( *bmp ) );
+
+    bmp -> data_offset = BMP_LEGACY_OFFSET;
+    bmp -> capacity = file_size > BMP_LEGACY_OFFSET ? file_size - BMP_LEGACY_OFFSET : 0;
+    bmp -> row_bytes = bmp -> stride = bmp -> capacity;
+    bmp -> height = 1;
+}
+
+/* 1 if the carrier bytes are where bmp_legacy() puts them */
+int bmp_is_legacy( const BmpInfo *bmp )
+{
+    return bmp -> data_offset == BMP_LEGACY_OFFSET && bmp -> stride == bmp -> row_bytes;
+}
+
+/* File offset of carrier byte pos */
+off_t bmp_offset( const BmpInfo *bmp, size_t pos )
+{
+    if( bmp -> stride == bmp -> row_bytes )
+        return bmp -> data_offset + ( off_t )pos;
+
+    return bmp -> data_offset + ( off_t )( pos / bmp -> row_bytes * bmp -> stride + pos % bmp -> row_bytes );
+}
+
+/* First carrier byte at or after file offset offset */
+size_t bmp_carrier_index( const BmpInfo *bmp, off_t offset )
+{
+    if( offset <= bmp -> data_offset )
+        return 0;
+
+    size_t rel = offset - bmp -> data_offset;
+    size_t pos = rel;
+
+    if( bmp -> stride != bmp -> row_bytes )
+    {
+        size_t col = rel % bmp -> stride;
+        pos = rel / bmp -> stride * bmp -> row_bytes + ( col < bmp -> row_bytes ? col : bmp -> row_bytes );
+    }
+
+    return pos < bmp -> capacity ? pos : bmp -> capacity;
+}
+
+/* Most file bytes len carrier bytes span: a partial row at each end and the padding of every row */
+size_t bmp_file_bound( const BmpInfo *bmp, size_t len )
+{
+    if( bmp -> stride == bmp -> row_bytes )
+        return len;
+
+    return len + ( len / bmp -> row_bytes + 2 ) * ( bmp -> stride - bmp -> row_bytes );
+}
+
+/* Bytes of 8 rows, or of 8 bytes without padding */
+static size_t block_unit( const BmpInfo *bmp )
+{
+    return bmp -> stride == bmp -> row_bytes ? 8 : 8 * bmp -> stride;
+}
+
+/* Block size to allocate for a requested one */
+size_t bmp_block_size( const BmpInfo *bmp, size_t requested )
+{
+    size_t size = block_size_clamp( requested );
+
+    return size < block_unit( bmp ) ? block_unit( bmp ) : size;
+}
+
+/* File bytes to read into a block of capacity bytes */
+size_t bmp_block_bytes( const BmpInfo *bmp, size_t capacity )
+{
+    return capacity / block_unit( bmp ) * block_unit( bmp );
+}
+
+/* Starts iterating the row spans of len carrier bytes from pos */
+void bmp_spans( BmpSpans *it, const BmpInfo *bmp, size_t pos, size_t len )
+{
+    it -> bmp = bmp;
+    it -> pos = pos;
+    it -> end = pos + len;
+}
+
+/* Next row span, up to the end of its row */
+int bmp_next_span( BmpSpans *it, BmpSpan *span )
+{
+    const BmpInfo *bmp = it -> bmp;
+
+    if( it -> pos >= it -> end )
+        return 0;
+
+    size_t len = it -> end - it -> pos;
+    if( bmp -> stride != bmp -> row_bytes )
+    {
+        size_t row_left = bmp -> row_bytes - it -> pos % bmp -> row_bytes;
+        if( len > row_left )
+            len = row_left;
+    }
+
+    span -> pos = it -> pos;
+    span -> len = len;
+    span -> offset = bmp_offset( bmp, it -> pos );
+    it -> pos += len;
+
+    return 1;
+}
+
+/* Copies len carrier bytes from pos out of the file bytes at file */
+static void gather( const BmpInfo *bmp, size_t pos, size_t len, const uchar *file, off_t base, uchar *carrier )
+{
+    BmpSpans it;
+    BmpSpan span;
+
+    bmp_spans( &it, bmp, pos, len );
+    while( bmp_next_span( &it, &span ) )
+    {
+        memcpy( carrier, file + ( span.offset - base ), span.len );
+        carrier += span.len;
+    }
+}
+
+/* Copies len carrier bytes back to their spans of the file bytes at file */
+static void scatter( const BmpInfo *bmp, size_t pos, size_t len, const uchar *carrier, uchar *file, off_t base )
+{
+    BmpSpans it;
+    BmpSpan span;
+
+    bmp_spans( &it, bmp, pos, len );
+    while( bmp_next_span( &it, &span ) )
+    {
+        memcpy( file + ( span.offset - base ), carrier, span.len );
+        carrier += span.len;
+    }
+}
+
+/* 1 if len carrier bytes from pos are one span */
+static int contiguous( const BmpInfo *bmp, size_t pos, size_t len )
+{
+    return bmp -> stride == bmp -> row_bytes || pos % bmp -> row_bytes + len <= bmp -> row_bytes;
+}
+
+/* Embeds n payload bytes into the carrier bytes from pos */
+void bmp_embed( const BmpInfo *bmp, int bits, const uchar *data, size_t n, size_t pos,
+                const uchar *src, uchar *dst, off_t base )
+{
+    size_t len = LSB_CARRIER( n, bits );
+    off_t first = bmp_offset( bmp, pos );
+    size_t span = bmp_offset( bmp, pos + len ) - first;
+
+    // Padding the spans skip keeps the source bytes
+    if( src != dst && span > len )
+        memcpy( dst + ( first - base ), src + ( first - base ), span );
+
+    if( contiguous( bmp, pos, len ) )
+    {
+        lsb_embed_bits( bits, data, n, src + ( first - base ), dst + ( first - base ) );
+        return;
+    }
+
+    uchar stage[ BMP_STAGE ];
+    size_t step = BMP_STAGE / LSB_CARRIER( 1, bits );   // Payload bytes per staging pass
+
+    for( size_t done = 0; done < n; done += step )
+    {
+        size_t count = n - done < step ? n - done : step;
+        size_t at = pos + LSB_CARRIER( done, bits );
+
+        gather( bmp, at, LSB_CARRIER( count, bits ), src, base, stage );
+        lsb_embed_bits( bits, data + done, count, stage, stage );
+        scatter( bmp, at, LSB_CARRIER( count, bits ), stage, dst, base );
+    }
+}
+
+/* Extracts n payload bytes from the carrier bytes from pos */
+void bmp_extract( const BmpInfo *bmp, int bits, const uchar *src, off_t base, size_t pos, size_t n, uchar *data )
+{
+    size_t len = LSB_CARRIER( n, bits );
+
+    if( contiguous( bmp, pos, len ) )
+    {
+        lsb_extract_bits( bits, src + ( bmp_offset( bmp, pos ) - base ), n, data );
+        return;
+    }
+
+    uchar stage[ BMP_STAGE ];
+    size_t step = BMP_STAGE / LSB_CARRIER( 1, bits );
+
+    for( size_t done = 0; done < n; done += step )
+    {
+        size_t count = n - done < step ? n - done : step;
+
+        gather( bmp, pos + LSB_CARRIER( done, bits ), LSB_CARRIER( count, bits ), src, base, stage );
+        lsb_extract_bits( bits, stage, count, data + done );
+    }
+}
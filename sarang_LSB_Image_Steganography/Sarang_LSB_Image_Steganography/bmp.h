@@ -0,0 +1,114 @@
+#ifndef BMP_H
+#define BMP_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "types.h" // Contains user defined types
+
+/*
+ * BMP layout
+ * The carrier of an image is the pixel bytes of its rows in file order,
+ * without the padding that rounds every row up to 4 bytes. The header
+ * is parsed for where the rows start ( bfOffBits, so V4 and V5 headers
+ * and palettes are never touched ), their width and bit depth, and the
+ * row count of bottom up and top down images alike.
+ * A row span is a run of carrier bytes that is contiguous in the file.
+ * Images without padding are one span and go to the kernels as they
+ * are. Otherwise carrier bytes are gathered span by span into a staging
+ * buffer, so the vector kernels run at full width across row ends, and
+ * scattered back.
+ */
+
+#define BMP_HEADER_MIN 54       // File header and BITMAPINFOHEADER, all that is parsed
+#define BMP_LEGACY_OFFSET 54    // Where images of the first layout start, see bmp_legacy()
+#define BMP_STAGE ( 16 * 1024 ) // Carrier bytes gathered at a time
+
+/* Parsed layout of a 24 or 32 bit image */
+typedef struct _BmpInfo
+{
+    off_t data_offset;  // File offset of the first row
+    int width;
+    int height;         // Rows, positive also for top down images
+    int top_down;
+    int bpp;            // Bits per pixel, 24 or 32
+    size_t row_bytes;   // Carrier bytes per row
+    size_t stride;      // File bytes per row, padding included
+    size_t capacity;    // Carrier bytes of the image
+} BmpInfo;
+
+/* Row span: len carrier bytes from carrier byte pos, at file offset offset */
+typedef struct _BmpSpan
+{
+    size_t pos;
+    size_t len;
+    off_t offset;
+} BmpSpan;
+
+/* Row span iterator, see bmp_spans() */
+typedef struct _BmpSpans
+{
+    const BmpInfo *bmp;
+    size_t pos;
+    size_t end;
+} BmpSpans;
+
+/* Parses the header of the image_size byte image at image
+ * Returns e_failure unless it is an uncompressed 24 or 32 bit bmp
+ * whose rows are all there
+ */
+Status bmp_parse( const uchar *image, size_t image_size, BmpInfo *bmp );
+
+/* Same for the first BMP_HEADER_MIN bytes of an image of file_size bytes */
+Status bmp_parse_header( const uchar *header, off_t file_size, BmpInfo *bmp );
+
+/* Same for the image file of fptr, its offset does not move */
+Status bmp_read( FILE *fptr, BmpInfo *bmp );
+
+/* Layout of images encoded before the header was parsed: one span from
+ * offset 54 to the end of the file of file_size bytes
+ */
+void bmp_legacy( BmpInfo *bmp, off_t file_size );
+
+/* 1 if the carrier bytes are where bmp_legacy() puts them: rows
+ * without padding from offset 54
+ */
+int bmp_is_legacy( const BmpInfo *bmp );
+
+/* File offset of carrier byte pos, pos may be bmp -> capacity */
+off_t bmp_offset( const BmpInfo *bmp, size_t pos );
+
+/* First carrier byte at or after file offset offset, bmp -> capacity if none */
+size_t bmp_carrier_index( const BmpInfo *bmp, off_t offset );
+
+/* Most file bytes len carrier bytes span, padding included */
+size_t bmp_file_bound( const BmpInfo *bmp, size_t len );
+
+/* Block size to allocate for a requested one, whole rows have to fit */
+size_t bmp_block_size( const BmpInfo *bmp, size_t requested );
+
+/* File bytes to read into a block of capacity bytes: whole groups of 8
+ * rows, so every block holds whole payload bytes
+ * Returns 0 if not even 8 rows fit
+ */
+size_t bmp_block_bytes( const BmpInfo *bmp, size_t capacity );
+
+/* Starts iterating the row spans of carrier bytes pos .. pos + len - 1 */
+void bmp_spans( BmpSpans *it, const BmpInfo *bmp, size_t pos, size_t len );
+
+/* Next row span, returns 0 after the last one */
+int bmp_next_span( BmpSpans *it, BmpSpan *span );
+
+/* Embeds n payload bytes at bits per carrier byte into the carrier bytes
+ * from pos, src and dst hold the file from offset base and may be the
+ * same; padding between the spans is copied from src to dst
+ */
+void bmp_embed( const BmpInfo *bmp, int bits, const uchar *data, size_t n, size_t pos,
+                const uchar *src, uchar *dst, off_t base );
+
+/* Extracts n payload bytes at bits per carrier byte from the carrier bytes
+ * from pos, src holds the file from offset base
+ */
+void bmp_extract( const BmpInfo *bmp, int bits, const uchar *src, off_t base, size_t pos, size_t n, uchar *data );
+
+#endif
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "chacha.h"
+#include "sha256.h"
+#include "types.h"
+
+#define ROTL32( v, n ) ( ( ( v ) << ( n ) ) | ( ( v ) >> ( 32 - ( n ) ) ) )
+
+#define QUARTER( a, b, c, d ) \
+    do { \
+        a += b; d ^= a; d = ROTL32( d, 16 ); \
+        c += d; b ^= c; b = ROTL32( b, 12 ); \
+        a += b; d ^= a; d = ROTL32( d, 8 ); \
+        c += d; b ^= c; b = ROTL32( b, 7 ); \
+    } while( 0 )
+
+#define CHACHA_KEY_NONCE 0x68706963U    // "ciph", last nonce word of the data's keystream
+#define CHACHA_SEAL_NONCE 0x6C616573U   // "seal", same for the tag key and the CRC mask
+
+/* Function Definitions */
+
+/* Block counter of key and nonce, 20 rounds with the input added back */
+static void chacha_block( const uint32_t key[8], uint32_t counter, const uint32_t nonce[3], uint32_t out[16] )
+{
+    uint32_t in[16] = { 0x61707865, 0x3320646E, 0x79622D32, 0x6B206574,   // "expand 32-byte k"
+                        key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+                        counter, nonce[0], nonce[1], nonce[2] };
+    uint32_t x[16];
+
+    memcpy( x, in, sizeof( x ) );
+    for( int r = 0; r < 10; r++ )
+    {
+        // Column round, then diagonal round
+        QUARTER( x[0], x[4], x[8], x[12] );
+        QUARTER( x[1], x[5], x[9], x[13] );
+        QUARTER( x[2], x[6], x[10], x[14] );
+        QUARTER( x[3], x[7], x[11], x[15] );
+        QUARTER( x[0], x[5], x[10], x[15] );
+        QUARTER( x[1], x[6], x[11], x[12] );
+        QUARTER( x[2], x[7], x[8], x[13] );
+        QUARTER( x[3], x[4], x[9], x[14] );
+    }
+
+    for( int i = 0; i < 16; i++ )
+        out[i] = x[i] + in[i];
+}
+
+/* Keystream block as bytes, words little endian */
+static void keystream( const ChaCha *c, uint32_t counter, uchar ks[ CHACHA_BLOCK ] )
+{
+    uint32_t out[16];
+
+    chacha_block( c -> key, counter, c -> nonce, out );
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy( ks, out, CHACHA_BLOCK );
+#else
+    for( int i = 0; i < 16; i++ )
+    {
+        ks[ 4 * i ] = out[i];
+        ks[ 4 * i + 1 ] = out[i] >> 8;
+        ks[ 4 * i + 2 ] = out[i] >> 16;
+        ks[ 4 * i + 3 ] = out[i] >> 24;
+    }
+#endif
+}
+
+/* Derives key and nonce
+ * The key is PBKDF2 of the key string with the salt as 8 little endian
+ * bytes, the nonce a constant as the key is new with every salt; block 0
+ * of the seal nonce gives the tag key and the CRC mask
+ */
+void chacha_init( ChaCha *c, const char *key, uint64_t salt )
+{
+    uchar salt_bytes[8], derived[ SHA256_SIZE ], seal[ CHACHA_BLOCK ];
+    ChaCha sealer;
+
+    for( int i = 0; i < 8; i++ )
+        salt_bytes[i] = salt >> 8 * i;
+    pbkdf2_sha256( ( const uchar * )key, strlen( key ), salt_bytes, sizeof( salt_bytes ), CHACHA_KDF_ROUNDS,
+                   derived, sizeof( derived ) );
+    for( int i = 0; i < 8; i++ )
+        c -> key[i] = derived[ 4 * i ] | derived[ 4 * i + 1 ] << 8 | derived[ 4 * i + 2 ] << 16 | ( uint32_t )derived[ 4 * i + 3 ] << 24;
+    c -> nonce[0] = 0;
+    c -> nonce[1] = 0;
+    c -> nonce[2] = CHACHA_KEY_NONCE;
+
+    sealer = *c;
+    sealer.nonce[2] = CHACHA_SEAL_NONCE;
+    keystream( &sealer, 0, seal );
+    memcpy( c -> mac_key, seal, POLY1305_KEY );
+    c -> crc_mask = seal[32] | seal[33] << 8 | seal[34] << 16 | ( uint32_t )seal[35] << 24;
+}
+
+/* XORs n bytes with the keystream from offset on, a block at a time */
+void chacha_xor( const ChaCha *c, uint64_t offset, const uchar *in, uchar *out, size_t n )
+{
+    uchar ks[ CHACHA_BLOCK ];
+    uint32_t counter = offset / CHACHA_BLOCK;
+    size_t skip = offset % CHACHA_BLOCK;
+
+    while( n > 0 )
+    {
+        size_t len = CHACHA_BLOCK - skip < n ? CHACHA_BLOCK - skip : n;
+
+        keystream( c, counter++, ks );
+        if( len == CHACHA_BLOCK )
+        {
+            // Whole blocks 8 bytes at a time
+            for( int i = 0; i < CHACHA_BLOCK; i += 8 )
+            {
+                uint64_t a, b;
+
+                memcpy( &a, in + i, 8 );
+                memcpy( &b, ks + i, 8 );
+                a ^= b;
+                memcpy( out + i, &a, 8 );
+            }
+        }
+        else
+        {
+            for( size_t i = 0; i < len; i++ )
+                out[i] = in[i] ^ ks[ skip + i ];
+        }
+
+        in += len;
+        out += len;
+        n -= len;
+        skip = 0;
+    }
+}
+
+/* RFC 8439 2.4.2, then every split of a buffer against the whole */
+Status chacha_self_test( void )
+{
+    static const char plain[] = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.";
+    static const uchar expect[16] = { 0x6E, 0x2E, 0x35, 0x9A, 0x25, 0x68, 0xF9, 0x80, 0x41, 0xBA, 0x07, 0x28, 0xDD, 0x0D, 0x69, 0x81 };
+    static const uchar expect_end[8] = { 0x5A, 0xF9, 0x0B, 0xBF, 0x74, 0xA3, 0x5B, 0xE6 }; // Bytes 96 to 103
+    ChaCha c = { .nonce = { 0, 0x4A000000, 0 } };
+    uchar data[ 3 * CHACHA_BLOCK + 16 ], whole[ sizeof( data ) ], part[ sizeof( data ) ];
+    size_t len = sizeof( plain ) - 1;
+    int ok;
+
+    for( int i = 0; i < 8; i++ )
+        c.key[i] = ( 4 * i ) | ( 4 * i + 1 ) << 8 | ( 4 * i + 2 ) << 16 | ( uint32_t )( 4 * i + 3 ) << 24;
+
+    // Block counter 1 is keystream byte 64
+    chacha_xor( &c, CHACHA_BLOCK, ( const uchar * )plain, data, len );
+    ok = memcmp( data, expect, sizeof( expect ) ) == 0 && memcmp( data + 96, expect_end, sizeof( expect_end ) ) == 0;
+
+    // Ranges from any offset match the whole, and XOR twice gives the data back
+    for( size_t i = 0; i < sizeof( data ); i++ )
+        data[i] = i * 37 + 11;
+    chacha_xor( &c, 5, data, whole, sizeof( data ) );
+    for( size_t split = 0; split <= sizeof( data ) && ok; split += 7 )
+    {
+        chacha_xor( &c, 5, data, part, split );
+        chacha_xor( &c, 5 + split, data + split, part + split, sizeof( data ) - split );
+        ok = memcmp( part, whole, sizeof( data ) ) == 0;
+    }
+    chacha_xor( &c, 5, whole, whole, sizeof( data ) );
+    ok = ok && memcmp( whole, data, sizeof( data ) ) == 0;
+
+    printf( "chacha20 %s\n", ok ? "ok" : "MISMATCH" );
+
+    return ok ? e_success : e_failure;
+}
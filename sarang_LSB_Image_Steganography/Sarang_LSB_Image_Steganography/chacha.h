@@ -0,0 +1,50 @@
+#ifndef CHACHA_H
+#define CHACHA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h" // Contains user defined types
+#include "poly1305.h"
+
+/*
+ * ChaCha20 of the data, RFC 8439
+ * Byte i of the data is XORed with byte i % 64 of keystream block i / 64,
+ * so any range of it is encrypted or decrypted on its own and no pass
+ * over the data is needed besides the one that embeds or extracts it.
+ * The 256 bit key is PBKDF2-HMAC-SHA256, see sha256.h, of the key string
+ * and a salt over CHACHA_KDF_ROUNDS rounds, about half a second per
+ * encode or decode, so each guess at a key costs as much. Encodes draw
+ * the salt from getrandom() and store it with the fields, see common.h,
+ * so one key never gives the same keystream twice and a guess holds for
+ * one image only. Block 0 under a second nonce gives the one time
+ * Poly1305 key that tags the data, see poly1305.h, and the mask of the
+ * stored CRC32C, which would else give away a checksum of the plaintext.
+ * The 32 bit block counter covers 256G of data.
+ */
+
+#define CHACHA_BLOCK 64     // Keystream bytes per block
+#define CHACHA_KDF_ROUNDS 600000    // PBKDF2 rounds of the key string
+
+/* Key and nonce of one encode or decode, and what else the salt gives */
+typedef struct _ChaCha
+{
+    uint32_t key[8];
+    uint32_t nonce[3];
+    uchar mac_key[ POLY1305_KEY ];  // One time key of the tag of the data
+    uint32_t crc_mask;              // XORed into the stored CRC32C
+} ChaCha;
+
+/* Derives key, nonce, tag key and mask from the key string and salt */
+void chacha_init( ChaCha *c, const char *key, uint64_t salt );
+
+/* XORs n bytes at in with the keystream from byte offset on, to out,
+ * which may be in
+ */
+void chacha_xor( const ChaCha *c, uint64_t offset, const uchar *in, uchar *out, size_t n );
+
+/* Checks the block function against the RFC 8439 test vector and
+ * ranges of the keystream against the whole, prints one line
+ */
+Status chacha_self_test( void );
+
+#endif
@@ -0,0 +1,139 @@
+#include <stdlib.h>
+#include <string.h>
+#include "chunk_index.h"
+#include "crc32c.h"
+#include "lz.h"
+#include "types.h"
+
+/* Function Definitions */
+
+/* Raw bytes an entry covers */
+size_t chunk_index_span( Codec codec )
+{
+    return codec == codec_lz ? LZ_BLOCK : INDEX_CHUNK;
+}
+
+/* Entries of a secret of raw_size bytes */
+size_t chunk_index_entries( Codec codec, size_t raw_size )
+{
+    return ( raw_size + chunk_index_span( codec ) - 1 ) / chunk_index_span( codec );
+}
+
+/* Bytes the index takes in the image */
+size_t chunk_index_size( Codec codec, size_t raw_size )
+{
+    return chunk_index_entries( codec, raw_size ) * ( codec == codec_lz ? INDEX_ENTRY_LZ : INDEX_ENTRY_RAW );
+}
+
+/* Makes room for entries entries */
+Status chunk_index_reserve( ChunkIndex *idx, size_t entries )
+{
+    if( entries <= idx -> capacity )
+    {
+        return e_success;
+    }
+
+    uint32_t *crc = realloc( idx -> crc, entries * sizeof( uint32_t ) );
+    if( crc == NULL )
+    {
+        return e_failure;
+    }
+    idx -> crc = crc;
+
+    uint32_t *offset = realloc( idx -> offset, entries * sizeof( uint32_t ) );
+    if( offset == NULL )
+    {
+        return e_failure;
+    }
+    idx -> offset = offset;
+
+    memset( idx -> crc + idx -> capacity, 0, ( entries - idx -> capacity ) * sizeof( uint32_t ) );
+    memset( idx -> offset + idx -> capacity, 0, ( entries - idx -> capacity ) * sizeof( uint32_t ) );
+    idx -> capacity = entries;
+
+    return e_success;
+}
+
+/* Adds the next len raw bytes, the checksum of a chunk continues across calls */
+Status chunk_index_add( ChunkIndex *idx, const uchar *data, size_t len )
+{
+    while( len > 0 )
+    {
+        size_t entry = idx -> raw / INDEX_CHUNK;
+        size_t n = INDEX_CHUNK - idx -> raw % INDEX_CHUNK;
+
+        if( n > len )
+            n = len;
+
+        // Streams grow the index as they go, in steps of doubling
+        if( entry >= idx -> capacity && chunk_index_reserve( idx, idx -> capacity ? idx -> capacity * 2 : 256 ) != e_success )
+        {
+            return e_failure;
+        }
+
+        idx -> crc[ entry ] = crc32c( idx -> crc[ entry ], data, n );
+        idx -> count = entry + 1;
+        idx -> raw += n;
+        data += n;
+        len -= n;
+    }
+
+    return e_success;
+}
+
+/* Adds the next frame */
+Status chunk_index_add_frame( ChunkIndex *idx, size_t offset, const uchar *raw, size_t len )
+{
+    if( idx -> count >= idx -> capacity && chunk_index_reserve( idx, idx -> capacity ? idx -> capacity * 2 : 256 ) != e_success )
+    {
+        return e_failure;
+    }
+
+    idx -> offset[ idx -> count ] = offset;
+    idx -> crc[ idx -> count ] = crc32c( 0, raw, len );
+    idx -> count++;
+    idx -> raw += len;
+
+    return e_success;
+}
+
+/* Writes the entries to out */
+size_t chunk_index_write( const ChunkIndex *idx, uchar *out )
+{
+    uchar *start = out;
+
+    for( size_t i = 0; i < idx -> count; i++ )
+    {
+        if( idx -> codec == codec_lz )
+        {
+            memcpy( out, &idx -> offset[i], 4 );
+            out += 4;
+        }
+        memcpy( out, &idx -> crc[i], 4 );
+        out += 4;
+    }
+
+    return out - start;
+}
+
+/* Reads the entry at bytes */
+void chunk_index_entry( Codec codec, const uchar *bytes, size_t *offset, uint32_t *crc )
+{
+    uint32_t at = 0;
+
+    if( codec == codec_lz )
+    {
+        memcpy( &at, bytes, 4 );
+        bytes += 4;
+    }
+    memcpy( crc, bytes, 4 );
+    *offset = at;
+}
+
+/* Frees the entries */
+void chunk_index_free( ChunkIndex *idx )
+{
+    free( idx -> crc );
+    free( idx -> offset );
+    memset( idx, 0, sizeof( *idx ) );
+}
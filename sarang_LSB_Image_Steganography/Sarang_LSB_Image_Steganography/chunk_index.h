@@ -0,0 +1,66 @@
+#ifndef CHUNK_INDEX_H
+#define CHUNK_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h" // Contains user defined types
+
+/*
+ * Chunk index
+ * Stored after the data at the data's depth when EXTN_INDEX is set, see
+ * common.h, so a range of the secret can be decoded and checked without
+ * the rest. Raw data has one entry per INDEX_CHUNK bytes of the secret:
+ *     4 bytes  CRC32C of the chunk
+ * Compressed data one per frame, which always holds LZ_BLOCK raw bytes
+ * but the last:
+ *     4 bytes  offset of the frame in the stored data
+ *     4 bytes  CRC32C of its raw bytes
+ * Byte i of raw data sits at a carrier byte of its own, so entry i / INDEX_CHUNK
+ * is all a range needs; frames are found through their offsets.
+ */
+
+#define INDEX_CHUNK 4096    // Raw secret bytes per entry of uncompressed data
+#define INDEX_ENTRY_RAW 4
+#define INDEX_ENTRY_LZ 8
+
+/* Entries built while encoding */
+typedef struct _ChunkIndex
+{
+    Codec codec;
+    uint32_t *crc;          // CRC32C of every chunk
+    uint32_t *offset;       // Stored offset of every frame, codec_lz only
+    size_t count;           // Entries so far, the last one may still grow
+    size_t capacity;
+    size_t raw;             // Raw bytes added so far
+} ChunkIndex;
+
+/* Raw bytes an entry covers */
+size_t chunk_index_span( Codec codec );
+
+/* Entries of a secret of raw_size bytes */
+size_t chunk_index_entries( Codec codec, size_t raw_size );
+
+/* Bytes the index of a secret of raw_size bytes takes in the image */
+size_t chunk_index_size( Codec codec, size_t raw_size );
+
+/* Makes room for entries entries, they start out as checksums of nothing */
+Status chunk_index_reserve( ChunkIndex *idx, size_t entries );
+
+/* Adds the next len raw bytes, uncompressed data only */
+Status chunk_index_add( ChunkIndex *idx, const uchar *data, size_t len );
+
+/* Adds the next frame, stored at offset, of len raw bytes */
+Status chunk_index_add_frame( ChunkIndex *idx, size_t offset, const uchar *raw, size_t len );
+
+/* Writes the entries to out, which holds chunk_index_size( codec, raw ) bytes
+ * Returns the bytes written
+ */
+size_t chunk_index_write( const ChunkIndex *idx, uchar *out );
+
+/* Reads the entry at bytes, offset is 0 for raw data */
+void chunk_index_entry( Codec codec, const uchar *bytes, size_t *offset, uint32_t *crc );
+
+/* Frees the entries, safe on an index that was never used */
+void chunk_index_free( ChunkIndex *idx );
+
+#endif
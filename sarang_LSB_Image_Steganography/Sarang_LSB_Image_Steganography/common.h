@@ -4,4 +4,38 @@
 /* Magic string to identify whether stegged or not */
 #define MAGIC_STRING "#*"
 
+/* The extension size field holds the extension length in its low byte,
+ * the payload bits per carrier byte of the data in the next one and
+ * the Codec of the data in the third.
+ * 0 bits is the original layout of 1 bit, which the header fields
+ * always use. With a codec the secret file size is followed by the
+ * size of the stored data, a long too.
+ * EXTN_ROWS is set when the fields follow the parsed rows of an image
+ * whose layout differs from the legacy one at offset 54, see bmp.h, so
+ * the two are never mistaken for each other.
+ * The flags below are only set by opt-in settings, so the defaults keep
+ * the original layout, see steg.h.
+ * EXTN_CRC is set when the last field before the data is the CRC32C
+ * of the secret, a long too, see crc32c.h.
+ * EXTN_INDEX is set when a chunk index follows the data, see chunk_index.h.
+ * EXTN_CONTAINER is set when the data is a container of named entries,
+ * see container.h.
+ * EXTN_SCATTER is set when the data and the chunk index are scattered
+ * over the rows after the fields with a key, see scatter.h.
+ * EXTN_CIPHER is set when they are also encrypted with ChaCha20 of that
+ * key, see chacha.h; it comes with EXTN_SCATTER only. A random salt of
+ * the encode, a long too, then follows the other fields, and the 16
+ * byte Poly1305 tag of the data after it. The CRC32C is masked then.
+ */
+#define EXTN_LEN_MASK 0xFF
+#define EXTN_BITS_SHIFT 8
+#define EXTN_CODEC_SHIFT 16
+#define EXTN_CODEC_MASK 0xFF
+#define EXTN_ROWS ( 1L << 24 )
+#define EXTN_CRC ( 1L << 25 )
+#define EXTN_INDEX ( 1L << 26 )
+#define EXTN_CONTAINER ( 1L << 27 )
+#define EXTN_SCATTER ( 1L << 28 )
+#define EXTN_CIPHER ( 1L << 29 )
+
 #endif
@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <string.h>
+#include "container.h"
+#include "types.h"
+
+/* Function Definitions */
+
+/* Writes n bytes of value little endian */
+static void put_le( uchar *out, uint64_t value, int n )
+{
+    for( int i = 0; i < n; i++ )
+        out[i] = value >> ( 8 * i );
+}
+
+/* Reads n bytes little endian */
+static uint64_t get_le( const uchar *in, int n )
+{
+    uint64_t value = 0;
+
+    for( int i = 0; i < n; i++ )
+        value |= ( uint64_t )in[i] << ( 8 * i );
+
+    return value;
+}
+
+/* Writes the table of count entries to fptr */
+Status container_write_toc( FILE *fptr, const StegEntry *entries, size_t count )
+{
+    uchar field[ CONTAINER_ENTRY ];
+    size_t toc_size = CONTAINER_HEADER;
+
+    for( size_t i = 0; i < count; i++ )
+        toc_size += CONTAINER_ENTRY + strlen( entries[i].name );
+
+    put_le( field, count, 4 );
+    put_le( field + 4, toc_size, 4 );
+    if( fwrite( field, 1, CONTAINER_HEADER, fptr ) != CONTAINER_HEADER )
+    {
+        return e_failure;
+    }
+
+    for( size_t i = 0; i < count; i++ )
+    {
+        size_t len = strlen( entries[i].name );
+
+        put_le( field, entries[i].size, 4 );
+        put_le( field + 4, entries[i].crc, 4 );
+        field[8] = len;
+        if( fwrite( field, 1, CONTAINER_ENTRY, fptr ) != CONTAINER_ENTRY || fwrite( entries[i].name, 1, len, fptr ) != len )
+        {
+            return e_failure;
+        }
+    }
+
+    return e_success;
+}
+
+/* Reads count and table bytes of the header */
+Status container_read_header( const uchar *bytes, size_t data_size, size_t *count, size_t *toc_size )
+{
+    *count = get_le( bytes, 4 );
+    *toc_size = get_le( bytes + 4, 4 );
+
+    // Every entry takes at least CONTAINER_ENTRY table bytes
+    if( *toc_size < CONTAINER_HEADER || *toc_size > data_size || *count > ( *toc_size - CONTAINER_HEADER ) / CONTAINER_ENTRY )
+    {
+        return e_failure;
+    }
+
+    return e_success;
+}
+
+/* Parses the entries of the table and works out their offsets */
+Status container_parse_toc( const uchar *toc, size_t toc_size, size_t data_size, StegEntry *entries, size_t count )
+{
+    size_t pos = CONTAINER_HEADER;
+    size_t offset = toc_size;
+
+    for( size_t i = 0; i < count; i++ )
+    {
+        if( pos + CONTAINER_ENTRY > toc_size )
+        {
+            return e_failure;
+        }
+
+        size_t len = toc[ pos + 8 ];
+        if( pos + CONTAINER_ENTRY + len > toc_size )
+        {
+            return e_failure;
+        }
+
+        entries[i].size = get_le( toc + pos, 4 );
+        entries[i].crc = get_le( toc + pos + 4, 4 );
+        memcpy( entries[i].name, toc + pos + CONTAINER_ENTRY, len );
+        entries[i].name[ len ] = '\0';
+        entries[i].offset = offset;
+
+        if( entries[i].size > data_size - offset )
+        {
+            return e_failure; // Runs past the data
+        }
+        offset += entries[i].size;
+        pos += CONTAINER_ENTRY + len;
+    }
+
+    return pos == toc_size ? e_success : e_failure;
+}
@@ -0,0 +1,43 @@
+#ifndef CONTAINER_H
+#define CONTAINER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h" // Contains user defined types
+#include "steg.h"
+
+/*
+ * Container
+ * Many named files in one stego image, marked by EXTN_CONTAINER, see
+ * common.h. The data of the image starts with the table of contents:
+ *     4 bytes  entry count
+ *     4 bytes  table bytes, these 8 included
+ *     per entry:
+ *         4 bytes  size
+ *         4 bytes  CRC32C of its bytes
+ *         1 byte   name length, then the name without terminator
+ * followed by the bytes of every entry in table order, all little endian.
+ * An entry starts at the table size plus the sizes of the entries before
+ * it, so listing decodes the table only and extracting an entry decodes
+ * the range of its bytes, see decode_range_data().
+ */
+
+#define CONTAINER_HEADER 8
+#define CONTAINER_ENTRY 9       // Table bytes of an entry besides its name
+#define CONTAINER_EXTN ".ctr"   // Extension stored for the container
+
+/* Writes the table of count entries to fptr from its current offset */
+Status container_write_toc( FILE *fptr, const StegEntry *entries, size_t count );
+
+/* Reads count and table bytes of the header at bytes
+ * Returns e_failure if they cannot be those of a container of data_size bytes
+ */
+Status container_read_header( const uchar *bytes, size_t data_size, size_t *count, size_t *toc_size );
+
+/* Parses the count entries of the toc_size byte table at toc into entries
+ * and works out their offsets, e_failure if an entry runs past data_size
+ */
+Status container_parse_toc( const uchar *toc, size_t toc_size, size_t data_size, StegEntry *entries, size_t count );
+
+#endif
@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "crc32c.h"
+#include "types.h"
+
+#if defined( __x86_64__ )
+#define CRC_X86 1
+#include <immintrin.h>
+#endif
+
+#define CRC_POLY 0x82F63B78     // Castagnoli polynomial, bit reflected
+#define CRC_LONG 8192           // Lane of the three streams, bytes
+#define CRC_SHORT 256           // Lane for what is left of a buffer
+
+/* Function pointer type of the implementations, on the register without
+ * the inversions of crc32c()
+ */
+typedef uint32_t ( *CrcFn )( uint32_t crc, const uchar *data, size_t n );
+
+/* One implementation of the checksum */
+typedef struct _CrcKernel
+{
+    const char *name;
+    int ( *supported )( void );
+    CrcFn update;
+} CrcKernel;
+
+/* Slice by 8 tables, table[0] is the classic byte table */
+static uint32_t table[8][256];
+
+/* x^( 2^n ) modulo the polynomial, for crc32c_combine() */
+static uint32_t x2n_table[32];
+
+/* Multipliers that move a lane checksum past 1 and 2 lanes, see shift_crc() */
+static uint32_t long_k1, long_k2, short_k1, short_k2;
+
+/* Function Definitions */
+
+/* a * b modulo the polynomial, both bit reflected, a not 0 */
+static uint32_t multmodp( uint32_t a, uint32_t b )
+{
+    uint32_t m = ( uint32_t )1 << 31;
+    uint32_t p = 0;
+
+    for( ;; )
+    {
+        if( a & m )
+        {
+            p ^= b;
+            if( ( a & ( m - 1 ) ) == 0 )
+                break;
+        }
+        m >>= 1;
+        b = b & 1 ? ( b >> 1 ) ^ CRC_POLY : b >> 1;
+    }
+
+    return p;
+}
+
+/* x^( n * 2^k ) modulo the polynomial */
+static uint32_t x2nmodp( size_t n, unsigned k )
+{
+    uint32_t p = ( uint32_t )1 << 31; // x^0
+
+    while( n )
+    {
+        if( n & 1 )
+            p = multmodp( x2n_table[ k & 31 ], p );
+        n >>= 1;
+        k++;
+    }
+
+    return p;
+}
+
+/* Portable path: 8 bytes per step through the slice by 8 tables */
+static uint32_t crc_table( uint32_t crc, const uchar *data, size_t n )
+{
+    for( ; n >= 8; n -= 8, data += 8 )
+    {
+        uint32_t low = crc ^ ( data[0] | data[1] << 8 | data[2] << 16 | ( uint32_t )data[3] << 24 );
+
+        crc = table[7][ low & 0xFF ] ^ table[6][ ( low >> 8 ) & 0xFF ] ^
+              table[5][ ( low >> 16 ) & 0xFF ] ^ table[4][ low >> 24 ] ^
+              table[3][ data[4] ] ^ table[2][ data[5] ] ^ table[1][ data[6] ] ^ table[0][ data[7] ];
+    }
+
+    while( n-- )
+        crc = ( crc >> 8 ) ^ table[0][ ( crc ^ *data++ ) & 0xFF ];
+
+    return crc;
+}
+
+static int always( void )
+{
+    return 1;
+}
+
+#ifdef CRC_X86
+
+static int has_sse42( void )
+{
+    return __builtin_cpu_supports( "sse4.2" ) && __builtin_cpu_supports( "pclmul" );
+}
+
+/* Moves a lane checksum past the lanes after it: the carry-less product
+ * with k = x^( 8 * bytes - 33 ) is reduced by one crc32 instruction,
+ * which adds the other x^33
+ */
+__attribute__(( target( "sse4.2,pclmul" ) ))
+static inline uint32_t shift_crc( uint32_t crc, uint32_t k )
+{
+    __m128i product = _mm_clmulepi64_si128( _mm_cvtsi32_si128( crc ), _mm_cvtsi32_si128( k ), 0 );
+
+    return ( uint32_t )_mm_crc32_u64( 0, ( uint64_t )_mm_cvtsi128_si64( product ) );
+}
+
+/* SSE4.2 path: crc32 has a latency of 3 and a throughput of 1, so three
+ * independent streams over three lanes keep it busy, then the lanes fold
+ */
+__attribute__(( target( "sse4.2,pclmul" ) ))
+static uint32_t crc_sse42( uint32_t crc, const uchar *data, size_t n )
+{
+    static const size_t lanes[2] = { CRC_LONG, CRC_SHORT };
+
+    for( int l = 0; l < 2; l++ )
+    {
+        size_t lane = lanes[l];
+        uint32_t k1 = l == 0 ? long_k1 : short_k1;
+        uint32_t k2 = l == 0 ? long_k2 : short_k2;
+
+        for( ; n >= 3 * lane; n -= 3 * lane, data += 3 * lane )
+        {
+            uint64_t crc0 = crc, crc1 = 0, crc2 = 0;
+
+            for( size_t i = 0; i < lane; i += 8 )
+            {
+                uint64_t w0, w1, w2;
+
+                memcpy( &w0, data + i, 8 );
+                memcpy( &w1, data + lane + i, 8 );
+                memcpy( &w2, data + 2 * lane + i, 8 );
+                crc0 = _mm_crc32_u64( crc0, w0 );
+                crc1 = _mm_crc32_u64( crc1, w1 );
+                crc2 = _mm_crc32_u64( crc2, w2 );
+            }
+
+            crc = shift_crc( crc0, k2 ) ^ shift_crc( crc1, k1 ) ^ ( uint32_t )crc2;
+        }
+    }
+
+    uint64_t crc64 = crc;
+    for( ; n >= 8; n -= 8, data += 8 )
+    {
+        uint64_t w;
+
+        memcpy( &w, data, 8 );
+        crc64 = _mm_crc32_u64( crc64, w );
+    }
+    crc = crc64;
+
+    while( n-- )
+        crc = _mm_crc32_u8( crc, *data++ );
+
+    return crc;
+}
+
+#endif
+
+/* Implementations, best first */
+static const CrcKernel kernels[] =
+{
+#ifdef CRC_X86
+    { "sse42", has_sse42, crc_sse42 },
+#endif
+    { "table", always,    crc_table },
+};
+
+static const CrcKernel *active = &kernels[ sizeof( kernels ) / sizeof( kernels[0] ) - 1 ];
+
+/* Builds the tables and picks the best implementation the CPU supports, runs before main() */
+__attribute__(( constructor ))
+static void crc32c_init( void )
+{
+    for( int b = 0; b < 256; b++ )
+    {
+        uint32_t crc = b;
+
+        for( int i = 0; i < 8; i++ )
+            crc = crc & 1 ? ( crc >> 1 ) ^ CRC_POLY : crc >> 1;
+        table[0][b] = crc;
+    }
+    for( int b = 0; b < 256; b++ )
+    {
+        for( int k = 1; k < 8; k++ )
+            table[k][b] = ( table[ k - 1 ][b] >> 8 ) ^ table[0][ table[ k - 1 ][b] & 0xFF ];
+    }
+
+    uint32_t p = ( uint32_t )1 << 30; // x^1
+    for( int n = 0; n < 32; n++ )
+    {
+        x2n_table[n] = p;
+        p = multmodp( p, p );
+    }
+
+    long_k1 = x2nmodp( CRC_LONG * 8 - 33, 0 );
+    long_k2 = x2nmodp( CRC_LONG * 16 - 33, 0 );
+    short_k1 = x2nmodp( CRC_SHORT * 8 - 33, 0 );
+    short_k2 = x2nmodp( CRC_SHORT * 16 - 33, 0 );
+
+#ifdef CRC_X86
+    __builtin_cpu_init();
+#endif
+
+    for( size_t i = 0; i < sizeof( kernels ) / sizeof( kernels[0] ); i++ )
+    {
+        if( kernels[i].supported() )
+        {
+            active = &kernels[i];
+            break;
+        }
+    }
+}
+
+/* Checksum of n more bytes of data after crc */
+uint32_t crc32c( uint32_t crc, const void *data, size_t n )
+{
+    return ~active -> update( ~crc, data, n );
+}
+
+/* Checksum of A then B from the checksums of A and B */
+uint32_t crc32c_combine( uint32_t crc1, uint32_t crc2, size_t len2 )
+{
+    return multmodp( x2nmodp( len2, 3 ), crc1 ) ^ crc2;
+}
+
+/* Name of the selected implementation */
+const char *crc32c_kernel_name( void )
+{
+    return active -> name;
+}
+
+/* Reference: one bit at a time */
+static uint32_t crc_bitwise( uint32_t crc, const uchar *data, size_t n )
+{
+    crc = ~crc;
+    while( n-- )
+    {
+        crc ^= *data++;
+        for( int i = 0; i < 8; i++ )
+            crc = crc & 1 ? ( crc >> 1 ) ^ CRC_POLY : crc >> 1;
+    }
+
+    return ~crc;
+}
+
+/* Checks every implementation the CPU supports against the bit by bit loop */
+Status crc32c_self_test( void )
+{
+    enum { max_len = 3 * CRC_LONG + 3 * CRC_SHORT + 64 };
+    static uchar data[ max_len + 8 ];
+    static const size_t lengths[] = { 0, 1, 7, 8, 9, 63, 3 * CRC_SHORT - 1, 3 * CRC_SHORT, 3 * CRC_SHORT + 13,
+                                      3 * CRC_LONG - 8, 3 * CRC_LONG, max_len };
+    Status status = e_success;
+
+    srand( 1 );
+    for( size_t i = 0; i < sizeof( data ); i++ )
+        data[i] = rand();
+
+    for( size_t k = 0; k < sizeof( kernels ) / sizeof( kernels[0] ); k++ )
+    {
+        int ok = 1;
+
+        if( !kernels[k].supported() )
+        {
+            printf( "crc32c %-6s not supported\n", kernels[k].name );
+            continue;
+        }
+
+        ok = ~kernels[k].update( ~0u, ( const uchar * )"123456789", 9 ) == 0xE3069283;
+        for( size_t i = 0; i < sizeof( lengths ) / sizeof( lengths[0] ) && ok; i++ )
+        {
+            // Unaligned starts and a running checksum going in
+            for( size_t off = 0; off < 8 && ok; off += 3 )
+            {
+                uint32_t seed = rand();
+                ok = ~kernels[k].update( ~seed, data + off, lengths[i] ) == crc_bitwise( seed, data + off, lengths[i] );
+            }
+        }
+
+        printf( "crc32c %-6s %s\n", kernels[k].name, ok ? "ok" : "MISMATCH" );
+        if( !ok )
+            status = e_failure;
+    }
+
+    // Checksums of the two halves of every split give the whole
+    int ok = 1;
+    uint32_t whole = crc_bitwise( 0, data, max_len );
+    for( size_t split = 0; split <= max_len && ok; split += 997 )
+        ok = crc32c_combine( crc_bitwise( 0, data, split ), crc_bitwise( 0, data + split, max_len - split ), max_len - split ) == whole;
+
+    printf( "crc32c combine %s\n", ok ? "ok" : "MISMATCH" );
+    if( !ok )
+        status = e_failure;
+
+    return status;
+}
@@ -0,0 +1,33 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h" // Contains user defined types
+
+/*
+ * CRC32C ( Castagnoli ) of the secret data
+ * Same value as the iSCSI / ext4 checksum, crc32c( 0, "123456789", 9 )
+ * is 0xe3069283. With SSE4.2 three streams of crc32 instructions run
+ * side by side over three lanes of a buffer and PCLMUL folds the lane
+ * checksums together, else a slice by 8 table does 8 bytes per step.
+ * The implementation is picked once at startup, like lsb.h.
+ */
+
+/* Checksum of n more bytes of data after crc, which is 0 to start */
+uint32_t crc32c( uint32_t crc, const void *data, size_t n );
+
+/* Checksum of a buffer A followed by a buffer B of len2 bytes, from
+ * the checksums crc1 of A and crc2 of B
+ */
+uint32_t crc32c_combine( uint32_t crc1, uint32_t crc2, size_t len2 );
+
+/* Name of the selected implementation ( "sse42" or "table" ) */
+const char *crc32c_kernel_name( void );
+
+/* Checks every implementation the CPU supports against a bit by bit
+ * loop, and the combining, prints one line per implementation
+ */
+Status crc32c_self_test( void );
+
+#endif
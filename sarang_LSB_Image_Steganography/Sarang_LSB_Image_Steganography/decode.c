@@ -1,12 +1,27 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "types.h"
 #include "decode.h"
+#include "lsb.h"
+#include "mmap_engine.h"
+#include "parallel.h"
+#include "pipeline.h"
+#include "lz.h"
+#include "crc32c.h"
+#include "chunk_index.h"
 #include "common.h"
 
 /* Function Definitions */
 
+static Status decode_failed( DecodeInfo *decInfo, StegError error );
+
 /* Reads and validates the encoded bmp image 
  * bmp image name from command line input is verified and read into
  * structure.
@@ -34,6 +49,13 @@ Status read_and_validate_decode_bmp( char* argv[], DecodeInfo *decInfo )
  */
 Status read_and_validate_decode_output( char* argv[], DecodeInfo *decInfo )
 {
+    // "-" is stdout, never renamed
+    if( argv[3] != NULL && strcmp( argv[3], "-" ) == 0 )
+    {
+        decInfo -> secret_fname = argv[3];
+        return d_success;
+    }
+
     // Check for output file
     if( argv[3] != NULL )
     {
@@ -53,14 +75,12 @@ Status read_and_validate_decode_output( char* argv[], DecodeInfo *decInfo )
                 return d_success;
             }
             
-            static char output_fname[100];
-            strncpy( output_fname, argv[3], dot - argv[3] ); // Copies filename only
-            output_fname[ dot - argv[3] ] = '\0';
-
-            strcat( output_fname, decInfo -> extn_secret_file ); // Concatinates filename with decoded extension
-            decInfo -> secret_fname = output_fname;
+            // Filename only, concatinated with decoded extension
+            snprintf( decInfo -> output_fname, sizeof( decInfo -> output_fname ), "%.*s%s",
+                      ( int )( dot - argv[3] ), argv[3], decInfo -> extn_secret_file );
+            decInfo -> secret_fname = decInfo -> output_fname;
     
-            print_sleep("INFO: Output file extension does not match, Creating %s\n", decInfo -> secret_fname );
+            report_info( decInfo -> reporter, "Output file extension does not match, Creating %s", decInfo -> secret_fname );
 
             return d_success;
         }
@@ -83,12 +103,123 @@ Status open_stego( DecodeInfo *decInfo )
     // Error handling
     if ( decInfo -> fptr_stego_image == NULL )
     {
-    	perror( "fopen" );
-    	fprintf( stderr, "ERROR: Unable to open file %s\n", decInfo -> stego_image_fname );
-    	return d_failure;
+    	report_info( decInfo -> reporter, "Unable to open file %s: %s", decInfo -> stego_image_fname, strerror( errno ) );
+    	return decode_failed( decInfo, steg_err_io );
+    }
+
+    return setup_stego( decInfo );
+}
+
+/* Positions the stego image at carrier byte 0 of its layout, the
+ * stdio engine seeks to the first row and drops what its block holds
+ */
+static void rewind_stego( DecodeInfo *decInfo )
+{
+    decInfo -> carrier_pos = 0;
+
+    if( decInfo -> engine == eng_stdio )
+    {
+        fseeko( decInfo -> fptr_stego_image, decInfo -> bmp.data_offset, SEEK_SET );
+        decInfo -> stego_block.base = decInfo -> bmp.data_offset;
+        decInfo -> stego_block.fill = 0;
+    }
+}
+
+/* Moves the stego image to carrier byte pos, which like every field and
+ * data byte starts at a multiple of 8 / bits. Scattered data is read
+ * around the block, only pos is kept. The stdio engine keeps its
+ * block if pos is in it, else it drops the block and seeks to pos rounded
+ * down to a multiple of 8: blocks of whole groups of 8 rows read from
+ * there end on multiples of 8 carrier bytes too, see bmp_block_bytes()
+ * With io_uring the next block is read from there, not read ahead
+ */
+static Status seek_stego( DecodeInfo *decInfo, size_t pos )
+{
+    BlockBuffer *block = &decInfo -> stego_block;
+    const BmpInfo *bmp = &decInfo -> bmp;
+
+    decInfo -> carrier_pos = pos;
+
+    if( decInfo -> engine != eng_stdio || decInfo -> scatter.domain ||
+        ( block -> fill > 0 && pos >= bmp_carrier_index( bmp, block -> base ) && pos < bmp_carrier_index( bmp, block -> base + block -> fill ) ) )
+    {
+        return d_success;
+    }
+
+    off_t start = bmp_offset( bmp, pos & ~( size_t )7 );
+    if( fseeko( decInfo -> fptr_stego_image, start, SEEK_SET ) != 0 )
+    {
+        return d_failure;
+    }
+    block -> base = start;
+    block -> fill = 0;
+
+    return d_success;
+}
+
+/* Parses the layout of the stego image
+ * Anything that is no 24 or 32 bit bmp is read in the legacy layout,
+ * decode_magic_string() tells if it was stegged at all
+ */
+static Status parse_stego( DecodeInfo *decInfo )
+{
+    struct stat st;
+
+    if( decInfo -> engine != eng_stdio )
+    {
+        if( bmp_parse( decInfo -> stego_map, decInfo -> map_size, &decInfo -> bmp ) != e_success )
+            bmp_legacy( &decInfo -> bmp, decInfo -> map_size );
+        return d_success;
+    }
+
+    if( bmp_read( decInfo -> fptr_stego_image, &decInfo -> bmp ) != e_success )
+    {
+        if( fstat( fileno( decInfo -> fptr_stego_image ), &st ) != 0 )
+        {
+            return d_failure;
+        }
+        bmp_legacy( &decInfo -> bmp, st.st_size );
     }
 
-    fseek( decInfo -> fptr_stego_image, 54, SEEK_SET ); // Skip the header as no information is encoded in header 
+    return d_success;
+}
+
+/* Positions the open stego image at its first row
+ * The mmap engine maps it, the stdio engine allocates its block
+ */
+Status setup_stego( DecodeInfo *decInfo )
+{
+    // Map instead of reading through the stream
+    if( decInfo -> engine == eng_mmap && map_stego( decInfo ) != d_success )
+    {
+        return decode_failed( decInfo, decInfo -> stego_map ? steg_err_format : steg_err_io );
+    }
+
+    if( parse_stego( decInfo ) != d_success )
+    {
+        report_info( decInfo -> reporter, "Unable to read file %s: %s", decInfo -> stego_image_fname, strerror( errno ) );
+        return decode_failed( decInfo, steg_err_io );
+    }
+
+    // The ring of io_uring, without one the stdio engine reads itself
+    if( decInfo -> io == io_uring &&
+        uring_open( &decInfo -> uring, &decInfo -> stego_block, &decInfo -> bmp, decInfo -> block_size,
+                    fileno( decInfo -> fptr_stego_image ), -1 ) != e_success )
+    {
+        report_info( decInfo -> reporter, "io_uring is not available, using stdio");
+        decInfo -> io = io_stdio;
+    }
+
+    if( decInfo -> engine == eng_stdio && decInfo -> io == io_stdio &&
+        ( block_alloc( &decInfo -> stego_block, bmp_block_size( &decInfo -> bmp, decInfo -> block_size ) ) != e_success ||
+          bmp_block_bytes( &decInfo -> bmp, decInfo -> stego_block.capacity ) == 0 ) )
+    {
+        report_info( decInfo -> reporter, "Unable to allocate image block" );
+        return decode_failed( decInfo, steg_err_nomem );
+    }
+
+    rewind_stego( decInfo ); // Skip the header as no information is encoded in header
+
     return d_success; // Opened stego file 
 }
 
@@ -109,52 +240,127 @@ Status open_secret( DecodeInfo *decInfo, char* argv[] )
 
     if( decInfo -> secret_fname == NULL || decInfo -> secret_fname[0] == '\0' )
     {
-        static char def_fname[100];
+        const char *base = argv[3] ? argv[3] : "decoded";
+        const char *reason = argv[3] ? "Output File extension not mentioned." : "Output File not mentioned.";
 
-        if( argv[3] )
-        {
-            strcpy( def_fname, argv[3] );
-            print_sleep("INFO: Output File extension not mentioned. ");
-        }
-        else
-        {
-            strcpy( def_fname, "decoded" );
-            print_sleep("INFO: Output File not mentioned. ");
-        }
-
-        strcat( def_fname, decInfo -> extn_secret_file );
-
-        decInfo -> secret_fname = def_fname;
-        print_sleep("Creating %s as default\n", decInfo -> secret_fname );
+        snprintf( decInfo -> output_fname, sizeof( decInfo -> output_fname ), "%s%s", base, decInfo -> extn_secret_file );
+        decInfo -> secret_fname = decInfo -> output_fname;
+        report_info( decInfo -> reporter, "%s Creating %s as default", reason, decInfo -> secret_fname );
     }
 
-    // Open Secret file
-    decInfo -> fptr_secret = fopen( decInfo -> secret_fname, "wb" );
+    // Open Secret file, the mmap engine needs it readable to map it shared
+    if( strcmp( decInfo -> secret_fname, "-" ) == 0 )
+        decInfo -> fptr_secret = stdout;
+    else
+        decInfo -> fptr_secret = fopen( decInfo -> secret_fname, decInfo -> engine == eng_mmap ? "w+b" : "wb" );
 
     // Error handling
     if( decInfo -> fptr_secret == NULL )
     {
-        perror("fopen");
-    	fprintf( stderr, "ERROR: Unable to open file %s\n", decInfo -> secret_fname );
-    	return d_failure;
+        report_info( decInfo -> reporter, "Unable to open file %s: %s", decInfo -> secret_fname, strerror( errno ) );
+    	return decode_failed( decInfo, steg_err_io );
     }
 
     return d_success; // Opened secret file
 }
 
-/* Reads 8 byte from stego and decodes */
+/* Decodes 1 byte from the next 8 bytes of stego */
 char decode_data_from_image( DecodeInfo *decinfo )
 {
-    char decode_buff[8];
+    char ch = 0;
 
-    fread( decode_buff, 8, 1, decinfo -> fptr_stego_image ); // Read 8 byte from stego image
-    
-    char ch = decode_byte_from_lsb( decode_buff ); // Decode the 1 byte chara from 8 byte
+    decode_data_block( decinfo, &ch, 1 ); // Decode the 1 byte chara from 8 byte
 
     return ch;
 }
 
-/* Decodes 8 byte in image_buffer to character */
+/* Decodes size bytes from the next size * 8 bytes of stego with the bulk kernel
+ * The stego image is read a whole block at a time
+ */
+Status decode_data_block( DecodeInfo *decInfo, char *data, long size )
+{
+    return decode_data_bits( decInfo, data, size, 1 );
+}
+
+/* Same at bits per carrier byte, from the next size * 8 / bits carrier bytes of stego */
+Status decode_data_bits( DecodeInfo *decInfo, char *data, long size, int bits )
+{
+    BlockBuffer *block = &decInfo -> stego_block;
+    const BmpInfo *bmp = &decInfo -> bmp;
+    size_t per = LSB_CARRIER( 1, bits );
+
+    // Scattered data comes from where the key put it
+    if( decInfo -> scatter.domain )
+    {
+        int fd = decInfo -> engine == eng_stdio ? fileno( decInfo -> fptr_stego_image ) : -1;
+
+        if( size < 0 || scatter_extract( &decInfo -> scatter, bmp, bits, decInfo -> stego_map, fd,
+                                         decInfo -> carrier_pos, size, ( uchar * )data ) != e_success )
+        {
+            return d_failure; // Stego image ends before the data does
+        }
+        decInfo -> carrier_pos += ( size_t )size * per;
+
+        return d_success;
+    }
+
+    if( decInfo -> engine != eng_stdio )
+    {
+        size_t pos = decInfo -> carrier_pos;
+
+        if( size < 0 || pos + ( size_t )size * per > bmp -> capacity )
+        {
+            return d_failure; // Stego image ends before the data does
+        }
+
+        bmp_extract( bmp, bits, decInfo -> stego_map, 0, pos, size, ( uchar * )data );
+        decInfo -> carrier_pos = pos + ( size_t )size * per;
+
+        return d_success;
+    }
+
+    while( size > 0 )
+    {
+        size_t end = bmp_carrier_index( bmp, block -> base + block -> fill ); // Carrier bytes up to the block end
+
+        // Block used up, read the next one, whole rows at a time
+        if( decInfo -> carrier_pos >= end && decInfo -> io == io_uring )
+        {
+            if( uring_next( &decInfo -> uring, block ) != e_success )
+            {
+                report_info( decInfo -> reporter, "Unable to read %s through io_uring: %s", decInfo -> stego_image_fname, strerror( decInfo -> uring.error ) );
+                return decode_failed( decInfo, steg_err_io );
+            }
+            end = bmp_carrier_index( bmp, block -> base + block -> fill );
+        }
+        else if( decInfo -> carrier_pos >= end )
+        {
+            block -> base = ftello( decInfo -> fptr_stego_image );
+            block -> fill = fread( block -> data, 1, bmp_block_bytes( bmp, block -> capacity ), decInfo -> fptr_stego_image );
+            end = bmp_carrier_index( bmp, block -> base + block -> fill );
+        }
+
+        size_t chunk = end > decInfo -> carrier_pos ? ( end - decInfo -> carrier_pos ) / per : 0;
+        if( chunk == 0 )
+        {
+            return d_failure; // Stego image ended before the data did
+        }
+        if( chunk > ( size_t )size )
+            chunk = size;
+
+        bmp_extract( bmp, bits, block -> data, block -> base, decInfo -> carrier_pos, chunk, ( uchar * )data );
+
+        decInfo -> carrier_pos += chunk * per;
+        data += chunk;
+        size -= chunk;
+    }
+
+    return d_success;
+}
+
+/* Decodes 8 byte in image_buffer to character
+ * Reference for the bulk kernels in lsb.c
+ */
 char decode_byte_from_lsb( char *image_buffer )
 {
     char ch = 0;
@@ -191,18 +397,78 @@ Status decode_magic_string( DecodeInfo *decInfo )
     return d_success;
 }
 
+/* Retries the magic string in the legacy layout, see bmp_legacy()
+ * Layouts that are the same as the legacy one have nothing to retry
+ */
+Status decode_legacy_magic_string( DecodeInfo *decInfo )
+{
+    const BmpInfo *bmp = &decInfo -> bmp;
+    struct stat st;
+    off_t file_size;
+
+    if( bmp_is_legacy( bmp ) )
+    {
+        return d_failure;
+    }
+
+    if( decInfo -> engine != eng_stdio )
+        file_size = decInfo -> map_size;
+    else if( fstat( fileno( decInfo -> fptr_stego_image ), &st ) == 0 )
+        file_size = st.st_size;
+    else
+        return d_failure;
+
+    bmp_legacy( &decInfo -> bmp, file_size );
+    rewind_stego( decInfo );
+
+    return decode_magic_string( decInfo );
+}
+
 /* Decodes the secret file extension size */
 Status decode_file_extn_size( DecodeInfo *decInfo )
 {
     long size = 0;
-    char* ch = ( char* )&size;  // Gets each byte to store the size byte by byte
+    char* ch = ( char* )&size;  // Gets each byte to store the size
 
-    for( int i = 0; i < sizeof( long ); i++ )
+    if( decode_data_block( decInfo, ch, sizeof( long ) ) != d_success )
     {
-        ch[i] = decode_data_from_image( decInfo );  // Decode each byte of size
+        return d_failure;
+    }
+
+    // Depth and codec of the data next to the length, 0 bits is 1, see common.h
+    long bits = ( size >> EXTN_BITS_SHIFT ) & 0xFF;
+    long codec = ( size >> EXTN_CODEC_SHIFT ) & EXTN_CODEC_MASK;
+    int rows = ( size & EXTN_ROWS ) != 0;
+    int crc = ( size & EXTN_CRC ) != 0;
+    int index = ( size & EXTN_INDEX ) != 0;
+    int container = ( size & EXTN_CONTAINER ) != 0;
+    int scattered = ( size & EXTN_SCATTER ) != 0;
+    int encrypted = ( size & EXTN_CIPHER ) != 0;
+    size &= EXTN_LEN_MASK;
+    if( bits == 0 )
+        bits = 1;
+
+    if( size >= MAX_FILE_SUFFIX || !lsb_bits_valid( bits ) || codec > codec_lz )
+    {
+        return d_failure; // Would not fit extn_secret_file, or unknown depth or codec
+    }
+    if( rows == bmp_is_legacy( &decInfo -> bmp ) )
+    {
+        return d_failure; // Stegged in the other layout
+    }
+    if( encrypted && !scattered )
+    {
+        return d_failure; // The cipher comes with the scatter only
     }
 
     decInfo -> extn_file_size = size;
+    decInfo -> bits = bits;
+    decInfo -> codec = codec;
+    decInfo -> has_crc = crc;
+    decInfo -> has_index = index;
+    decInfo -> container = container;
+    decInfo -> scattered = scattered;
+    decInfo -> encrypted = encrypted;
 
     return d_success;
 }
@@ -226,142 +492,852 @@ Status decode_file_extn( DecodeInfo *decInfo )
 Status decode_file_size( DecodeInfo *decInfo )
 {
     long size;
-    char* ch = (char*)&size; // Gets each byte to store the size byte by byte
-    for( int i = 0; i < sizeof( long ); i++ )
+    char* ch = (char*)&size; // Gets each byte to store the size
+
+    if( decode_data_block( decInfo, ch, sizeof( long ) ) != d_success )
     {
-        ch[i] = decode_data_from_image( decInfo ); // Decode size byte by byte
+        return d_failure;
+    }
+
+    if( size < 0 || size > ( long )UINT_MAX )
+    {
+        return d_failure;
     }
 
     decInfo -> file_size = size;
+    decInfo -> stored_size = size;
+
+    return d_success;
+}
+
+/* Decode the size of the stored data that follows the file size with a codec */
+Status decode_stored_size( DecodeInfo *decInfo )
+{
+    long size;
+
+    if( decode_data_block( decInfo, ( char * )&size, sizeof( long ) ) != d_success )
+    {
+        return d_failure;
+    }
+
+    // Frames never grow by more than their headers
+    long frames = ( decInfo -> file_size + LZ_BLOCK - 1 ) / LZ_BLOCK;
+    if( size < frames * LZ_FRAME_HEADER || size > ( long )decInfo -> file_size + frames * LZ_FRAME_HEADER )
+    {
+        return d_failure;
+    }
+
+    decInfo -> stored_size = size;
+
+    return d_success;
+}
+
+/* Decode the salt of the cipher that follows the checksum, and the tag after it
+ * The checksum stays masked until the key is known, see begin_scatter()
+ */
+Status decode_cipher_salt( DecodeInfo *decInfo )
+{
+    if( decode_data_block( decInfo, ( char * )&decInfo -> cipher_salt, sizeof( long ) ) != d_success )
+    {
+        return d_failure;
+    }
+    decInfo -> crc_masked = decInfo -> has_crc;
+
+    return decode_data_block( decInfo, ( char * )decInfo -> cipher_tag, POLY1305_TAG );
+}
+
+/* Decode the CRC32C of the secret that follows the sizes */
+Status decode_secret_crc( DecodeInfo *decInfo )
+{
+    long crc;
+
+    if( decode_data_block( decInfo, ( char * )&crc, sizeof( long ) ) != d_success )
+    {
+        return d_failure;
+    }
+
+    if( crc < 0 || crc > ( long )UINT32_MAX )
+    {
+        return d_failure;
+    }
+
+    decInfo -> crc = crc;
+
+    return d_success;
+}
+
+/* Writes len decoded bytes that follow done bytes to the output
+ * and adds them to the checksum, verification only does the latter
+ */
+static Status write_decoded( DecodeInfo *decInfo, const uchar *data, size_t len, size_t done )
+{
+    decInfo -> data_crc = crc32c( decInfo -> data_crc, data, len );
+
+    if( decInfo -> verify )
+    {
+        return d_success;
+    }
+
+    if( decInfo -> secret_map )
+    {
+        memcpy( decInfo -> secret_map + done, data, len );
+        return d_success;
+    }
+
+    if( fwrite( data, 1, len, decInfo -> fptr_secret ) != len )
+    {
+        report_info( decInfo -> reporter, "Unable to write %s: %s", decInfo -> secret_fname, strerror( errno ) );
+        return decode_failed( decInfo, steg_err_io );
+    }
+
+    return d_success;
+}
+
+/* Decodes the header of the frame at stored bytes into the data, with at
+ * most left raw bytes of the secret to go, into raw_len and payload_len
+ */
+static Status decode_frame_header( DecodeInfo *decInfo, uchar *header, size_t left, size_t stored,
+                                   size_t *raw_len, size_t *payload_len )
+{
+    if( decode_data_bits( decInfo, ( char * )header, LZ_FRAME_HEADER, decInfo -> bits ) != d_success ||
+        lz_frame_header( header, raw_len, payload_len ) != e_success || *raw_len > left ||
+        stored + LZ_FRAME_HEADER + *payload_len > decInfo -> stored_size )
+    {
+        return decode_failed( decInfo, steg_err_corrupt );
+    }
 
     return d_success;
 }
 
-/* Decode the secret message from bmp file */
+/* Decodes the frame at stored bytes into the data and decompresses it to raw
+ * Returns d_failure as steg_err_corrupt if it does not fit the sizes in the header
+ */
+static Status decode_frame( DecodeInfo *decInfo, uchar *payload, uchar *raw, size_t left, size_t stored,
+                            size_t *raw_len, size_t *frame_len )
+{
+    uchar header[ LZ_FRAME_HEADER ];
+    size_t payload_len;
+
+    if( decode_frame_header( decInfo, header, left, stored, raw_len, &payload_len ) != d_success )
+    {
+        return d_failure;
+    }
+    if( decode_data_bits( decInfo, ( char * )payload, payload_len, decInfo -> bits ) != d_success ||
+        lz_frame_decode( header, payload, raw ) != e_success )
+    {
+        return decode_failed( decInfo, steg_err_corrupt );
+    }
+    *frame_len = LZ_FRAME_HEADER + payload_len;
+
+    return d_success;
+}
+
+/* Decodes the frames of compressed data and writes them as they come
+ * Every frame is checked against the sizes in the header, corrupt
+ * frames fail as steg_err_corrupt
+ */
+Status decode_compressed_data( DecodeInfo *decInfo )
+{
+    size_t size = decInfo -> file_size;
+    size_t stored = 0;
+    Status status = d_success;
+
+    uchar *payload = malloc( LZ_FRAME_BOUND( LZ_BLOCK ) );
+    uchar *raw = malloc( LZ_BLOCK );
+    if( payload == NULL || raw == NULL )
+    {
+        free( payload );
+        free( raw );
+        return decode_failed( decInfo, steg_err_nomem );
+    }
+
+    progress_begin( &decInfo -> progress, decInfo -> reporter, "Decompressing data", size );
+
+    for( size_t done = 0; done < size && status == d_success; )
+    {
+        size_t raw_len, frame_len;
+
+        status = decode_frame( decInfo, payload, raw, size - done, stored, &raw_len, &frame_len );
+        if( status != d_success )
+            break;
+
+        status = write_decoded( decInfo, raw, raw_len, done );
+
+        done += raw_len;
+        stored += frame_len;
+        progress_update( &decInfo -> progress, done );
+    }
+
+    progress_end( &decInfo -> progress );
+    free( payload );
+    free( raw );
+
+    if( status == d_success && stored != decInfo -> stored_size )
+    {
+        return decode_failed( decInfo, steg_err_corrupt );
+    }
+
+    return status;
+}
+
+/* Resolves the range of decInfo against the secret, length 0 is up to its end */
+Status decode_range_bounds( const DecodeInfo *decInfo, size_t *offset, size_t *length )
+{
+    size_t size = decInfo -> file_size;
+
+    if( decInfo -> range_offset > size || decInfo -> range_length > size - decInfo -> range_offset )
+    {
+        return d_failure;
+    }
+
+    *offset = decInfo -> range_offset;
+    *length = decInfo -> range_length ? decInfo -> range_length : size - decInfo -> range_offset;
+
+    return d_success;
+}
+
+/* Decodes count entries of the chunk index from entry first into offsets and crcs
+ * The index follows the stored data, which starts at carrier byte data_pos
+ */
+static Status decode_index_entries( DecodeInfo *decInfo, size_t data_pos, size_t first, size_t count,
+                                    size_t *offsets, uint32_t *crcs )
+{
+    size_t entry = decInfo -> codec == codec_lz ? INDEX_ENTRY_LZ : INDEX_ENTRY_RAW;
+    size_t index_pos = data_pos + LSB_CARRIER( decInfo -> stored_size, decInfo -> bits );
+    Status status = d_failure;
+
+    uchar *bytes = malloc( count * entry );
+    if( bytes == NULL )
+    {
+        return decode_failed( decInfo, steg_err_nomem );
+    }
+
+    if( seek_stego( decInfo, index_pos + LSB_CARRIER( first * entry, decInfo -> bits ) ) == d_success &&
+        decode_data_bits( decInfo, ( char * )bytes, count * entry, decInfo -> bits ) == d_success )
+    {
+        status = d_success;
+        for( size_t i = 0; i < count; i++ )
+        {
+            chunk_index_entry( decInfo -> codec, bytes + i * entry, &offsets[i], &crcs[i] );
+
+            // Frames are stored in order, inside the stored data
+            if( decInfo -> codec == codec_lz && ( offsets[i] >= decInfo -> stored_size || ( i > 0 && offsets[i] <= offsets[ i - 1 ] ) ) )
+                status = d_failure;
+        }
+    }
+    free( bytes );
+
+    return status == d_success ? d_success : decode_failed( decInfo, steg_err_corrupt );
+}
+
+/* Writes the part of the len bytes of data, raw bytes pos .. pos + len - 1
+ * of the secret, that falls into the range off .. off + range_len - 1
+ */
+static Status write_range( DecodeInfo *decInfo, const uchar *data, size_t pos, size_t len, size_t off, size_t range_len )
+{
+    size_t lo = pos > off ? pos : off;
+    size_t hi = pos + len < off + range_len ? pos + len : off + range_len;
+
+    return lo < hi ? write_decoded( decInfo, data + ( lo - pos ), hi - lo, lo - off ) : d_success;
+}
+
+/* Decodes the range of raw data: from the index chunks it overlaps, each
+ * checked against its entry, or without an index from its first byte
+ */
+static Status decode_raw_range( DecodeInfo *decInfo, size_t data_pos, size_t off, size_t len )
+{
+    size_t first = off / INDEX_CHUNK;
+    size_t count = ( off + len - 1 ) / INDEX_CHUNK - first + 1;
+    size_t start = off, end = off + len;
+    uchar chunk[ INDEX_CHUNK ];
+    Status status = d_success;
+
+    size_t *offsets = NULL;
+    uint32_t *crcs = NULL;
+    if( decInfo -> has_index )
+    {
+        offsets = malloc( count * sizeof( size_t ) );
+        crcs = malloc( count * sizeof( uint32_t ) );
+        if( offsets == NULL || crcs == NULL )
+            status = decode_failed( decInfo, steg_err_nomem );
+        else
+            status = decode_index_entries( decInfo, data_pos, first, count, offsets, crcs );
+
+        // Whole chunks, the last one of the secret may be short
+        start = first * INDEX_CHUNK;
+        end = ( first + count ) * INDEX_CHUNK < decInfo -> file_size ? ( first + count ) * INDEX_CHUNK : decInfo -> file_size;
+    }
+
+    if( status == d_success )
+        status = seek_stego( decInfo, data_pos + LSB_CARRIER( start, decInfo -> bits ) );
+
+    for( size_t pos = start; pos < end && status == d_success; )
+    {
+        size_t n = INDEX_CHUNK - pos % INDEX_CHUNK;
+        if( n > end - pos )
+            n = end - pos;
+
+        if( decode_data_bits( decInfo, ( char * )chunk, n, decInfo -> bits ) != d_success )
+        {
+            status = decode_failed( decInfo, steg_err_corrupt );
+            break;
+        }
+        if( crcs && crc32c( 0, chunk, n ) != crcs[ pos / INDEX_CHUNK - first ] )
+        {
+            report_info( decInfo -> reporter, "Chunk at %zu does not match its CRC32C", pos );
+            status = decode_failed( decInfo, steg_err_checksum );
+            break;
+        }
+
+        status = write_range( decInfo, chunk, pos, n, off, len );
+        pos += n;
+    }
+
+    free( offsets );
+    free( crcs );
+
+    return status;
+}
+
+/* Decodes the range of compressed data: from the frame holding its first
+ * byte, found through the index or by hopping over the frames before it,
+ * every frame but the last holds LZ_BLOCK raw bytes
+ */
+static Status decode_lz_range( DecodeInfo *decInfo, size_t data_pos, size_t off, size_t len )
+{
+    size_t first = off / LZ_BLOCK;
+    size_t count = ( off + len - 1 ) / LZ_BLOCK - first + 1;
+    size_t stored = 0;
+    Status status = d_success;
+
+    size_t *offsets = NULL;
+    uint32_t *crcs = NULL;
+    uchar *payload = malloc( LZ_FRAME_BOUND( LZ_BLOCK ) );
+    uchar *raw = malloc( LZ_BLOCK );
+    if( payload == NULL || raw == NULL )
+        status = decode_failed( decInfo, steg_err_nomem );
+
+    if( status == d_success && decInfo -> has_index )
+    {
+        offsets = malloc( count * sizeof( size_t ) );
+        crcs = malloc( count * sizeof( uint32_t ) );
+        if( offsets == NULL || crcs == NULL )
+            status = decode_failed( decInfo, steg_err_nomem );
+        else
+            status = decode_index_entries( decInfo, data_pos, first, count, offsets, crcs );
+        if( status == d_success )
+            stored = offsets[0];
+    }
+
+    if( status == d_success )
+        status = seek_stego( decInfo, data_pos + LSB_CARRIER( stored, decInfo -> bits ) );
+
+    // Only the frame headers before the range are decoded
+    for( size_t f = 0; f < first && !decInfo -> has_index && status == d_success; f++ )
+    {
+        uchar header[ LZ_FRAME_HEADER ];
+        size_t raw_len, payload_len;
+
+        status = decode_frame_header( decInfo, header, decInfo -> file_size - f * LZ_BLOCK, stored, &raw_len, &payload_len );
+        if( status == d_success && raw_len != LZ_BLOCK )
+            status = decode_failed( decInfo, steg_err_corrupt );
+        if( status == d_success )
+            status = seek_stego( decInfo, decInfo -> carrier_pos + LSB_CARRIER( payload_len, decInfo -> bits ) );
+        stored += LZ_FRAME_HEADER + payload_len;
+    }
+
+    for( size_t f = first; f < first + count && status == d_success; f++ )
+    {
+        size_t pos = f * LZ_BLOCK;
+        size_t want = decInfo -> file_size - pos < LZ_BLOCK ? decInfo -> file_size - pos : LZ_BLOCK;
+        size_t raw_len, frame_len;
+
+        if( crcs && offsets[ f - first ] != stored )
+        {
+            status = decode_failed( decInfo, steg_err_corrupt );
+            break;
+        }
+
+        status = decode_frame( decInfo, payload, raw, decInfo -> file_size - pos, stored, &raw_len, &frame_len );
+        if( status == d_success && raw_len != want )
+            status = decode_failed( decInfo, steg_err_corrupt );
+        if( status != d_success )
+            break;
+
+        if( crcs && crc32c( 0, raw, raw_len ) != crcs[ f - first ] )
+        {
+            report_info( decInfo -> reporter, "Frame at %zu does not match its CRC32C", pos );
+            status = decode_failed( decInfo, steg_err_checksum );
+            break;
+        }
+
+        status = write_range( decInfo, raw, pos, raw_len, off, len );
+        stored += frame_len;
+    }
+
+    free( offsets );
+    free( crcs );
+    free( payload );
+    free( raw );
+
+    return status;
+}
+
+/* Sets up the permutation of scattered data and its cipher, carrier_pos is where the data starts,
+ * and unmasks the checksum of encrypted data
+ * Fails as steg_err_key without a key, nothing to do if the data is in order
+ * or the permutation is already there
+ */
+static Status begin_scatter( DecodeInfo *decInfo )
+{
+    const BmpInfo *bmp = &decInfo -> bmp;
+
+    if( !decInfo -> scattered || decInfo -> scatter.domain )
+    {
+        return d_success;
+    }
+    if( decInfo -> key == NULL || decInfo -> key[0] == '\0' )
+    {
+        report_info( decInfo -> reporter, "The data of %s is scattered with a key, none was given", decInfo -> stego_image_fname );
+        return decode_failed( decInfo, steg_err_key );
+    }
+    if( decInfo -> carrier_pos >= bmp -> capacity )
+    {
+        return decode_failed( decInfo, steg_err_corrupt );
+    }
+    if( scatter_init( &decInfo -> scatter, decInfo -> key, decInfo -> carrier_pos, bmp -> capacity - decInfo -> carrier_pos,
+                      decInfo -> encrypted, decInfo -> cipher_salt ) != e_success )
+    {
+        return decode_failed( decInfo, steg_err_nomem );
+    }
+    if( decInfo -> crc_masked )
+    {
+        decInfo -> crc ^= decInfo -> scatter.cipher.crc_mask;
+        decInfo -> crc_masked = 0;
+    }
+
+    return d_success;
+}
+
+/* Decodes only the range of the secret, carrier_pos is where the data starts
+ * Nothing before the range is extracted, so the cost follows the range
+ * rather than the secret
+ */
+Status decode_range_data( DecodeInfo *decInfo )
+{
+    size_t off, len;
+    Status status;
+
+    if( begin_scatter( decInfo ) != d_success )
+    {
+        return d_failure;
+    }
+
+    if( decode_range_bounds( decInfo, &off, &len ) != d_success )
+    {
+        report_info( decInfo -> reporter, "Range of %zu bytes from %zu is outside the %u bytes of the secret",
+                     decInfo -> range_length, decInfo -> range_offset, decInfo -> file_size );
+        return decode_failed( decInfo, steg_err_range );
+    }
+    if( len == 0 )
+    {
+        return d_success;
+    }
+
+    report_info( decInfo -> reporter, "%s %zu bytes from %zu, %s", decInfo -> verify ? "Verifying" : "Decoding", len, off,
+                 decInfo -> has_index ? "checked against the chunk index" : "no chunk index to check them against" );
+
+    if( decInfo -> codec == codec_none )
+        status = decode_raw_range( decInfo, decInfo -> carrier_pos, off, len );
+    else
+        status = decode_lz_range( decInfo, decInfo -> carrier_pos, off, len );
+
+    return status;
+}
+
+/* Whether the output can be mapped: a regular file open for reading and
+ * writing with nothing written to it yet. Redirected stdout and caller
+ * descriptors are often write only or hold a prefix, those take the
+ * block loop below, which writes where the descriptor is.
+ */
+static int output_mappable( DecodeInfo *decInfo )
+{
+    struct stat st;
+
+    if( decInfo -> verify )
+    {
+        return 1; // Nothing is written
+    }
+
+    int fd = fileno( decInfo -> fptr_secret );
+    int flags = fcntl( fd, F_GETFL );
+
+    return flags >= 0 && ( flags & O_ACCMODE ) == O_RDWR && fstat( fd, &st ) == 0 && S_ISREG( st.st_mode ) &&
+           fflush( decInfo -> fptr_secret ) == 0 && lseek( fd, 0, SEEK_CUR ) == 0;
+}
+
+/* Decode the secret message from bmp file
+ * Decoded data is collected in an output block and written a block at a time
+ */
 Status decode_file_data( DecodeInfo *decInfo )
 {
     long size = decInfo -> file_size;
+    BlockBuffer out;
+    Status status = d_success;
+
+    // Pipes and terminals can only be written in order, see below
+    struct stat st;
+    int streaming = decInfo -> engine != eng_memory && !decInfo -> verify &&
+                    ( fstat( fileno( decInfo -> fptr_secret ), &st ) != 0 || !S_ISREG( st.st_mode ) );
+
+    // A range is decoded on its own, whatever the engine
+    if( decInfo -> range )
+    {
+        return decode_range_data( decInfo );
+    }
+
+    if( begin_scatter( decInfo ) != d_success )
+    {
+        return d_failure;
+    }
+
+    // Compressed frames are decoded in order, whatever the output
+    if( decInfo -> codec != codec_none )
+    {
+        return decode_compressed_data( decInfo );
+    }
+
+    // The writer stage writes in order, pipes included, scattered data is read by decode_data_bits()
+    if( decInfo -> pipeline && decInfo -> engine == eng_stdio && !decInfo -> scatter.domain )
+    {
+        return pipeline_decode_file_data( decInfo );
+    }
+
+    if( decInfo -> engine == eng_memory || ( decInfo -> engine == eng_mmap && output_mappable( decInfo ) ) )
+    {
+        return map_decode_file_data( decInfo );
+    }
+
+    if( decInfo -> threads != 1 && !streaming && !decInfo -> scatter.domain )
+    {
+        return parallel_decode_file_data( decInfo );
+    }
+
+    if( block_alloc( &out, decInfo -> block_size ) != e_success )
+    {
+        return d_failure;
+    }
+
+    // Let a whole block fit the pipe, so the reader wakes once per block
+    // Blocks are copied in with fwrite(), not vmsplice()d: the pipe would
+    // keep referencing the pages of out, which the next block overwrites
+    // while a reader that tee()s or splice()s them may not have copied them
+    // yet, and fresh pages per block cost about the copy they save
+    if( streaming )
+    {
+        fflush( decInfo -> fptr_secret );
+        fcntl( fileno( decInfo -> fptr_secret ), F_SETPIPE_SZ, ( int )out.capacity );
+    }
 
-    for ( long i = 0; i < size; i++ )
+    progress_begin( &decInfo -> progress, decInfo -> reporter, decInfo -> verify ? "Verifying data" : "Decoding data", size );
+
+    for( long done = 0; done < size && status == d_success; )
     {
-        char ch = decode_data_from_image ( decInfo ); // Decode 1 byte
-        fputc( ch, decInfo -> fptr_secret );          // Write decoded byte
+        long chunk = size - done;
+        if( chunk > ( long )out.capacity )
+            chunk = out.capacity;
+
+        status = decode_data_bits( decInfo, ( char * )out.data, chunk, decInfo -> bits );
+        decInfo -> data_crc = crc32c( decInfo -> data_crc, out.data, chunk );
+        if( status == d_success && !decInfo -> verify &&
+            fwrite( out.data, 1, chunk, decInfo -> fptr_secret ) != ( size_t )chunk ) // Write decoded block
+        {
+            report_info( decInfo -> reporter, "Unable to write %s: %s", decInfo -> secret_fname, strerror( errno ) );
+            status = decode_failed( decInfo, steg_err_io );
+        }
+
+        done += chunk;
+        progress_update( &decInfo -> progress, done );
     }
+
+    progress_end( &decInfo -> progress );
+    block_free( &out );
     
-    return d_success;
+    return status;
 
 }
 
-Status do_decoding( DecodeInfo *decInfo, char* argv[] )
+/* Records why decoding failed, the first reason is kept */
+static Status decode_failed( DecodeInfo *decInfo, StegError error )
 {
-    print_sleep("INFO: ## Decoding Procedure Started ##\n");
+    if( decInfo -> error == steg_ok )
+        decInfo -> error = error;
 
-    print_sleep("INFO: Opening required files\n");
+    return d_failure;
+}
 
-    // Open stego file
-    if( open_stego( decInfo ) == d_success )
+/* Closes whatever decInfo has open
+ * A failed close of the output file turns status into d_failure
+ */
+Status close_decode_files( DecodeInfo *decInfo, Status status )
+{
+    map_decode_close( decInfo );
+    if( decInfo -> io == io_uring )
+        uring_close( &decInfo -> uring, &decInfo -> stego_block );
+    block_free( &decInfo -> stego_block );
+    scatter_free( &decInfo -> scatter );
+
+    if( decInfo -> fptr_stego_image )
+        fclose( decInfo -> fptr_stego_image );
+    if( decInfo -> fptr_secret == stdout )
     {
-        print_sleep("INFO: Opened %s\n", decInfo -> stego_image_fname );
+        if( fflush( stdout ) != 0 ) // Left open for whoever else writes there
+        {
+            report_info( decInfo -> reporter, "Unable to flush stdout: %s", strerror( errno ) );
+            status = decode_failed( decInfo, steg_err_io );
+        }
     }
-    else
+    else if( decInfo -> fptr_secret && fclose( decInfo -> fptr_secret ) != 0 )
     {
-        exit(1);
+        report_info( decInfo -> reporter, "Unable to close %s: %s", decInfo -> secret_fname, strerror( errno ) );
+        status = decode_failed( decInfo, steg_err_io );
     }
 
-    print_sleep("INFO: Decoding Magic String Signature\n");
+    decInfo -> fptr_stego_image = decInfo -> fptr_secret = NULL;
+
+    return status;
+}
 
-    // Decode magic string
-    if( decode_magic_string( decInfo ) == d_success )
+/* Decodes the fields before the data: magic string, extension and file size
+ * The stego image must be positioned after its header
+ * Returns d_failure on the first failing field, with the reason in decInfo -> error
+ */
+Status decode_header( DecodeInfo *decInfo )
+{
+    report_info( decInfo -> reporter, "Decoding Magic String Signature");
+
+    // Decode magic string, images stegged before the header was parsed
+    // carry it at offset 54 whatever their rows look like
+    if( decode_magic_string( decInfo ) == d_success || decode_legacy_magic_string( decInfo ) == d_success )
     {
-        print_sleep("INFO: Done\n");
+        report_info( decInfo -> reporter, "Done");
     }
     else
     {
-        print_sleep("INFO: Magic string not present, Image is not Stegged\n");
-        exit(1);
+        report_info( decInfo -> reporter, "Magic string not present, Image is not Stegged");
+        return decode_failed( decInfo, steg_err_not_stegged );
     }
 
-    // Decode file extension size
-    print_sleep("INFO: Decoding file extension size from %s\n", decInfo -> stego_image_fname );
-    if( decode_file_extn_size( decInfo ) == d_success )
+    // Decode file extension size, a legacy image may carry the magic
+    // string in its first row too
+    report_info( decInfo -> reporter, "Decoding file extension size from %s", decInfo -> stego_image_fname );
+    if( decode_file_extn_size( decInfo ) == d_success ||
+        ( decode_legacy_magic_string( decInfo ) == d_success && decode_file_extn_size( decInfo ) == d_success ) )
     {
-        print_sleep("INFO: Done\n");
+        report_info( decInfo -> reporter, "Done");
     }
 
     else
     {
-        print_sleep("INFO: error decoding file extension\n");
-        exit(1);
+        report_info( decInfo -> reporter, "error decoding file extension");
+        return decode_failed( decInfo, steg_err_corrupt );
     }
 
     // Decode file extension
-    print_sleep("INFO: Decoding file extension from %s\n", decInfo -> stego_image_fname );
+    report_info( decInfo -> reporter, "Decoding file extension from %s", decInfo -> stego_image_fname );
     if( decode_file_extn( decInfo ) == d_success )
     {
-        print_sleep("INFO: Done\n");
+        report_info( decInfo -> reporter, "Done");
     }
 
     else
     {
-        print_sleep("INFO: error decoding file extension\n");
-        exit(1);
+        report_info( decInfo -> reporter, "error decoding file extension");
+        return decode_failed( decInfo, steg_err_corrupt );
     }
 
-    // Check for output file
-    print_sleep("INFO: Validating output file name\n");
-    if(read_and_validate_decode_output( argv, decInfo ) == d_success )
+    // Decode the file size
+    report_info( decInfo -> reporter, "Decoding file size from %s", decInfo -> stego_image_fname );
+    if( decode_file_size( decInfo ) == d_success )
+    {
+        report_info( decInfo -> reporter, "Done");
+    }
+    else
+    {
+        report_info( decInfo -> reporter, "error decoding file size");
+        return decode_failed( decInfo, steg_err_corrupt );
+    }
+
+    // Decode the stored size of compressed data
+    if( decInfo -> codec != codec_none )
+    {
+        report_info( decInfo -> reporter, "Decoding stored size from %s", decInfo -> stego_image_fname );
+        if( decode_stored_size( decInfo ) == d_success )
+        {
+            report_info( decInfo -> reporter, "Done");
+        }
+        else
+        {
+            report_info( decInfo -> reporter, "error decoding stored size");
+            return decode_failed( decInfo, steg_err_corrupt );
+        }
+    }
+
+    // Decode the checksum of the secret
+    if( decInfo -> has_crc )
     {
-        print_sleep("INFO: Done\n");
+        report_info( decInfo -> reporter, "Decoding checksum from %s", decInfo -> stego_image_fname );
+        if( decode_secret_crc( decInfo ) == d_success )
+        {
+            report_info( decInfo -> reporter, "Done");
+        }
+        else
+        {
+            report_info( decInfo -> reporter, "error decoding checksum");
+            return decode_failed( decInfo, steg_err_corrupt );
+        }
+    }
+
+    // Decode the salt of the cipher
+    if( decInfo -> encrypted )
+    {
+        report_info( decInfo -> reporter, "Decoding cipher salt from %s", decInfo -> stego_image_fname );
+        if( decode_cipher_salt( decInfo ) == d_success )
+        {
+            report_info( decInfo -> reporter, "Done");
+        }
+        else
+        {
+            report_info( decInfo -> reporter, "error decoding cipher salt");
+            return decode_failed( decInfo, steg_err_corrupt );
+        }
     }
 
+    return d_success;
+}
+
+/* Decodes the secret data into the open output, or with verify set
+ * only through the checksum
+ * Returns d_failure with the reason in decInfo -> error, steg_err_checksum
+ * if the data does not match its checksum
+ */
+Status decode_image_data( DecodeInfo *decInfo )
+{
+    // Decode the encoded message from bmp file
+    report_info( decInfo -> reporter, "%s file data from %s", decInfo -> verify ? "Verifying" : "Decoding", decInfo -> stego_image_fname );
+    if( decode_file_data( decInfo ) == d_success )
+    {
+        report_info( decInfo -> reporter, "Done");
+    }
     else
     {
-        print_sleep("INFO: Error validating output file\n");
-        exit(1);
+        report_info( decInfo -> reporter, "error decoding file data");
+        return decode_failed( decInfo, steg_err_io );
     }
 
+    // Before the checksum, a wrong key or a changed bit fails here first
+    if( decInfo -> encrypted && !decInfo -> range )
+    {
+        uchar tag[ POLY1305_TAG ];
 
-    // Open output file with decoded extension
-    if( open_secret( decInfo, argv ) == d_success )
+        report_info( decInfo -> reporter, "Checking Poly1305 tag of the data");
+        if( scatter_tag( &decInfo -> scatter, decInfo -> stored_size, ( const uchar * )decInfo -> extn_secret_file,
+                         decInfo -> extn_file_size, tag ) == e_success && !poly1305_differ( tag, decInfo -> cipher_tag ) )
+        {
+            report_info( decInfo -> reporter, "Done. Tag matches");
+        }
+        else
+        {
+            report_info( decInfo -> reporter, "Poly1305 tag of the data does not match the stored one, wrong key or changed image");
+            return decode_failed( decInfo, steg_err_checksum );
+        }
+    }
+
+    // Images encoded without a checksum have nothing to compare, a range was checked chunk by chunk
+    if( decInfo -> has_crc && !decInfo -> range )
     {
-        print_sleep("INFO: Opened %s\n", decInfo -> secret_fname );
-        print_sleep("INFO: Done, Opened all required files\n" );
+        report_info( decInfo -> reporter, "Checking CRC32C of the data");
+        if( decInfo -> data_crc == decInfo -> crc )
+        {
+            report_info( decInfo -> reporter, "Done. CRC32C %08x matches", decInfo -> data_crc );
+        }
+        else
+        {
+            report_info( decInfo -> reporter, "CRC32C %08x of the data does not match the stored %08x", decInfo -> data_crc, decInfo -> crc );
+            return decode_failed( decInfo, steg_err_checksum );
+        }
+    }
+
+    if( decInfo -> io == io_uring )
+    {
+        const UringStats *stats = &decInfo -> uring.stats;
+        report_info( decInfo -> reporter, "Image I/O: %zu reads in %zu io_uring_enter calls", stats -> reads, stats -> enters );
+    }
+
+    // Successfully did the encoding operation
+    report_info( decInfo -> reporter, decInfo -> verify ? "## Verification done successfully ##" : "## Decoding done successfully ##");
+
+    return d_success;
+}
+
+/* To do the decoding process and calls each required function
+ * Closes all the opened files, also when a step fails
+ * Returns d_failure on the first failing step, with the reason in decInfo -> error
+ */
+Status do_decoding( DecodeInfo *decInfo, char* argv[] )
+{
+    report_info( decInfo -> reporter, "## Decoding Procedure Started ##");
+
+    report_info( decInfo -> reporter, "Opening required files");
+
+    // Open stego file
+    if( open_stego( decInfo ) == d_success )
+    {
+        report_info( decInfo -> reporter, "Opened %s", decInfo -> stego_image_fname );
     }
     else
     {
-        exit(1);
+        report_info( decInfo -> reporter, "Error opening %s", decInfo -> stego_image_fname );
+        return close_decode_files( decInfo, decode_failed( decInfo, steg_err_io ) );
     }
 
-    // Decode the file size
-    print_sleep("INFO: Decoding file size from %s\n", decInfo -> stego_image_fname );
-    if( decode_file_size( decInfo ) == d_success )
+    if( decode_header( decInfo ) != d_success )
+    {
+        return close_decode_files( decInfo, d_failure );
+    }
+
+    // Check for output file
+    report_info( decInfo -> reporter, "Validating output file name");
+    if(read_and_validate_decode_output( argv, decInfo ) == d_success )
     {
-        print_sleep("INFO: Done\n");
+        report_info( decInfo -> reporter, "Done");
     }
+
     else
     {
-        print_sleep("INFO: error decoding file size\n");
-        exit(1);
+        report_info( decInfo -> reporter, "Error validating output file");
+        return close_decode_files( decInfo, decode_failed( decInfo, steg_err_args ) );
     }
 
-    // Decode the encoded message from bmp file
-    print_sleep("INFO: Decoding file data from %s\n", decInfo -> stego_image_fname );
-    if( decode_file_data( decInfo ) == d_success )
+
+    // Open output file with decoded extension
+    if( open_secret( decInfo, argv ) == d_success )
     {
-        print_sleep("INFO: Done\n");
+        report_info( decInfo -> reporter, "Opened %s", decInfo -> secret_fname );
+        report_info( decInfo -> reporter, "Done, Opened all required files" );
     }
     else
     {
-        print_sleep("INFO: error decoding file data\n");
-        exit(1);
+        report_info( decInfo -> reporter, "Error opening %s", decInfo -> secret_fname );
+        return close_decode_files( decInfo, decode_failed( decInfo, steg_err_io ) );
     }
 
-    // Successfully did the encoding operation
-    print_sleep("INFO: ## Decoding done successfully ##\n");
+    // Metadata goes out before the data, so a reader knows what follows
+    if( decInfo -> header_cb )
+    {
+        decInfo -> header_cb( decInfo, decInfo -> header_user );
+    }
 
     // Close all the files
-    fclose( decInfo -> fptr_secret );
-    fclose( decInfo -> fptr_stego_image );
-
-    return d_success;
-}
\ No newline at end of file
+    return close_decode_files( decInfo, decode_image_data( decInfo ) );
+}
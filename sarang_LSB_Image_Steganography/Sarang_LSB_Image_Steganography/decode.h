@@ -2,7 +2,14 @@
 #define DECODE_H
 
 #include <stdio.h>
+#include <stdint.h>
 #include "types.h" // Contains user defined types
+#include "report.h"
+#include "blockio.h"
+#include "bmp.h"
+#include "steg.h"
+#include "uring.h"
+#include "scatter.h"
 
 #define MAX_FILE_SUFFIX 5
 
@@ -18,7 +25,8 @@ typedef struct _DecodeInfo
     /* Stego Image Info */
     char *stego_image_fname;
     FILE *fptr_stego_image;
-    uint image_capacity;
+    size_t image_capacity;
+    BmpInfo bmp;        // Layout of the rows, or of the first format
 
     /* Secret File Info */
     char *secret_fname;
@@ -26,6 +34,54 @@ typedef struct _DecodeInfo
     char extn_secret_file[ MAX_FILE_SUFFIX ];
     uint extn_file_size;
     uint file_size;
+    int bits;           // Payload bits per carrier byte of the data, from the header
+    Codec codec;
+    uint stored_size;   // Data bytes in the image, file_size without a codec
+    int has_crc;        // The header carries a CRC32C of the secret
+    uint32_t crc;       // That CRC32C
+    int crc_masked;     // It is still XORed with the mask of the cipher, see chacha.h
+    uint32_t data_crc;  // CRC32C of the secret bytes decoded so far
+    int verify;         // Only check the data against crc, nothing is written
+    int has_index;      // A chunk index follows the data, see chunk_index.h
+    int container;      // The data is a container of named entries, see container.h
+    int scattered;      // The data is scattered over the rows with a key, see scatter.h
+    int encrypted;      // The scattered data is encrypted with it too, see chacha.h
+    uint64_t cipher_salt;   // Salt of the encode that encrypted it
+    uchar cipher_tag[ POLY1305_TAG ];   // Tag of the encrypted data and the extension, see scatter.h
+    const char *key;    // That key
+    Scatter scatter;    // Its permutation, set up once the data is decoded
+    int range;          // Only decode range_length bytes from range_offset, 0 is up to the end
+    size_t range_offset;
+    size_t range_length;
+    char output_fname[ 256 ];   // Backs secret_fname when it is built from argv
+
+    /* Engine, the maps are only used by eng_mmap and eng_memory */
+    Engine engine;
+    const uchar *stego_map;
+    uchar *secret_map;  // Output buffer of eng_memory, or of any engine's ranges
+    size_t map_size;
+
+    /* Next carrier byte to decode, see bmp.h */
+    size_t carrier_pos;
+
+    /* Stego image block of the stdio engine */
+    size_t block_size;
+    BlockBuffer stego_block;
+    IoBackend io;       // Of the stego block
+    UringIo uring;      // With io_uring
+
+    /* Worker threads for the data, 1 is serial, 0 is one per CPU */
+    int threads;
+    int pipeline;       // Read, extract and write the data as three stages instead, see pipeline.h
+
+    /* Reporting */
+    const Reporter *reporter;
+    ProgressState progress;
+    StegError error;    // Why decoding failed
+
+    /* Called once the fields are decoded, before any data is written */
+    void ( *header_cb )( const struct _DecodeInfo *decInfo, void *user );
+    void *header_user;
 
 } DecodeInfo;
 
@@ -41,6 +97,15 @@ Status read_and_validate_decode_output( char* argv[], DecodeInfo *decInfo );
 /* Perform the decoding */
 Status do_decoding( DecodeInfo *decInfo, char* argv[] );
 
+/* Decode the fields before the data */
+Status decode_header( DecodeInfo *decInfo );
+
+/* Decode the data into the open output */
+Status decode_image_data( DecodeInfo *decInfo );
+
+/* Close whatever decInfo has open, returns status or d_failure if the output failed to close */
+Status close_decode_files( DecodeInfo *decInfo, Status status );
+
 /* Decode stego file extension size */
 Status decode_file_extn_size( DecodeInfo *decInfo );
 
@@ -50,21 +115,51 @@ Status decode_file_extn( DecodeInfo *decInfo );
 /* Get File pointer for i/p ( Stego image ) */
 Status open_stego( DecodeInfo *decInfo );
 
+/* Position the open stego image after its header */
+Status setup_stego( DecodeInfo *decInfo );
+
 /* Get File pointer for o/p file */
 Status open_secret( DecodeInfo *decInfo, char* argv[] );
 
 /* Decode Magic String */
 Status decode_magic_string( DecodeInfo *decInfo );
 
+/* Retries the magic string in the legacy layout of offset 54 */
+Status decode_legacy_magic_string( DecodeInfo *decInfo );
+
 /* Decode stego file size */
 Status decode_file_size( DecodeInfo *decInfo );
 
+/* Decode stored data size, only with a codec */
+Status decode_stored_size( DecodeInfo *decInfo );
+
+/* Decode the checksum of the secret, only with EXTN_CRC set */
+Status decode_secret_crc( DecodeInfo *decInfo );
+
+/* Decode the salt of the cipher and the tag after it, only with EXTN_CIPHER set */
+Status decode_cipher_salt( DecodeInfo *decInfo );
+
 /* Decode stego file data */
 Status decode_file_data( DecodeInfo *decInfo );
 
+/* Decode and decompress the data of a codec, a frame at a time */
+Status decode_compressed_data( DecodeInfo *decInfo );
+
+/* Resolve the range against the file size, d_failure if it is outside the secret */
+Status decode_range_bounds( const DecodeInfo *decInfo, size_t *offset, size_t *length );
+
+/* Decode only the range of the secret, checked against the chunk index if there is one */
+Status decode_range_data( DecodeInfo *decInfo );
+
 /* Decode function, which does real decoding */
 char decode_data_from_image( DecodeInfo *decinfo );
 
+/* Decode size bytes into data with the bulk kernel */
+Status decode_data_block( DecodeInfo *decInfo, char *data, long size );
+
+/* Same at bits per carrier byte */
+Status decode_data_bits( DecodeInfo *decInfo, char *data, long size, int bits );
+
 /* Decode a character from LSB's of each byte from stego image */
 char decode_byte_from_lsb( char *image_buffer );
 
@@ -1,35 +1,47 @@
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <stdint.h>
 #include <ctype.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sys/random.h>
 #include "encode.h"
+#include "lsb.h"
+#include "mmap_engine.h"
+#include "fcopy.h"
+#include "blockio.h"
+#include "parallel.h"
+#include "pipeline.h"
+#include "lz.h"
+#include "undo.h"
+#include "crc32c.h"
 #include "types.h"
 #include "common.h"
 
 /* Function Definitions */
 
+static Status encode_failed( EncodeInfo *encInfo, StegError error );
+
 /* Get image size
  * Input: Image file ptr
- * Output: width * height * bytes per pixel (3 in our case)
- * Description: In BMP Image, width is stored in offset 18,
- * and height after that. size is 4 bytes
+ * Output: carrier bytes, width * height * bytes per pixel without the row padding
+ * Description: The header is parsed by bmp_read(), 0 if it is no
+ * 24 or 32 bit bmp image
  */
-uint get_image_size_for_bmp( FILE *fptr_image )
+size_t get_image_size_for_bmp( FILE *fptr_image )
 {
-    uint width, height;
-    // Seek to 18th byte
-    fseek(fptr_image, 18, SEEK_SET);
-
-    // Read the width (an int)
-    fread(&width, sizeof(int), 1, fptr_image);
-    // Print_sleep("width = %u\n", width);
+    BmpInfo bmp;
 
-    // Read the height (an int)
-    fread(&height, sizeof(int), 1, fptr_image);
-    // Print_sleep("height = %u\n", height);
+    if( bmp_read( fptr_image, &bmp ) != e_success )
+    {
+        return 0;
+    }
 
     // Return image capacity
-    return width * height * 3;
+    return bmp.capacity;
 }
 
  
@@ -46,32 +58,30 @@ Status open_files(EncodeInfo *encInfo)
     // Do Error handling
     if (encInfo -> fptr_src_image == NULL)
     {
-    	perror("fopen");
-    	fprintf(stderr, "ERROR: Unable to open file %s\n", encInfo -> src_image_fname);
+    	report_info( encInfo -> reporter, "Unable to open file %s: %s", encInfo -> src_image_fname, strerror( errno ) );
 
-    	return e_failure;
+    	return encode_failed( encInfo, steg_err_io );
     }
 
-    // Secret file
-    encInfo -> fptr_secret = fopen(encInfo -> secret_fname, "rb");
+    // Secret file, "-" is stdin
+    encInfo -> fptr_secret = strcmp( encInfo -> secret_fname, "-" ) == 0 ? stdin : fopen(encInfo -> secret_fname, "rb");
     // Do Error handling
     if (encInfo -> fptr_secret == NULL)
     {
-    	perror("fopen");
-    	fprintf(stderr, "ERROR: Unable to open file %s\n", encInfo -> secret_fname);
+    	report_info( encInfo -> reporter, "Unable to open file %s: %s", encInfo -> secret_fname, strerror( errno ) );
 
-    	return e_failure;
+    	return encode_failed( encInfo, steg_err_io );
     }
 
-    // Stego Image file
-    encInfo -> fptr_stego_image = fopen(encInfo -> stego_image_fname, "wb");
+    // Stego Image file, the mmap engine needs it readable to map it shared, and a scatter to patch
+    // the rows it copied, in place it is the source image
+    encInfo -> fptr_stego_image = fopen(encInfo -> stego_image_fname, encInfo -> in_place ? "r+b" : encInfo -> engine == eng_mmap || encInfo -> key ? "w+b" : "wb");
     // Do Error handling
     if (encInfo -> fptr_stego_image == NULL)
     {
-    	perror("fopen");
-    	fprintf(stderr, "ERROR: Unable to open file %s\n", encInfo -> stego_image_fname);
+    	report_info( encInfo -> reporter, "Unable to open file %s: %s", encInfo -> stego_image_fname, strerror( errno ) );
 
-    	return e_failure;
+    	return encode_failed( encInfo, steg_err_io );
     }
 
     // No failure return e_success
@@ -109,14 +119,25 @@ Status read_and_validate_encode_args(char *argv[], EncodeInfo *encInfo)
     }
     encInfo -> src_image_fname = argv[2]; // Saves .bmp file name
 
+    // "-" streams the secret from stdin, under the extension already set or .bin
+    if( strcmp( argv[3], "-" ) == 0 && encInfo -> extn_secret_file[0] == '\0' )
+        strcpy( encInfo -> extn_secret_file, ".bin" );
+
     // Check for . extensions
-    char* ext = strrchr( argv[3], '.' );
-    if( ext == NULL )
+    char* ext = strcmp( argv[3], "-" ) == 0 ? encInfo -> extn_secret_file : strrchr( argv[3], '.' );
+    if( ext == NULL || ext[0] != '.' || strlen( ext ) >= MAX_FILE_SUFFIX )
     {
-        return e_failure;  // No extension found
+        return e_failure;  // No extension found, or too long to be decoded again
     }
     encInfo -> secret_fname = argv[3]; // Saves the file name of any extension
-    strcpy( encInfo -> extn_secret_file, ext ); // Saves any extension
+    memmove( encInfo -> extn_secret_file, ext, strlen( ext ) + 1 ); // Saves any extension
+
+    // In place the source image is rewritten, there is no output file
+    if( encInfo -> in_place )
+    {
+        encInfo -> stego_image_fname = argv[2];
+        return argv[4] == NULL ? e_success : e_failure;
+    }
 
     // Check if 4th argument exists
     if( argv[4] != NULL )
@@ -132,89 +153,278 @@ Status read_and_validate_encode_args(char *argv[], EncodeInfo *encInfo)
 
     else
     {
-        print_sleep("INFO: Output File not mentioned. Creating stego_img.bmp as default\n");
+        report_info( encInfo -> reporter, "Output File not mentioned. Creating stego_img.bmp as default");
         encInfo -> stego_image_fname = "stego_img.bmp"; // Creates stego image with default name
         return e_success;
     }
 }
 
-/* Checks if the source .bmp file has enough capacity to store data to be encoded*/
+/* Bytes of the fields before the data
+ * 2 MS + 8 extn size + extn + 8 file size [ + 8 stored size ] [ + 8 crc ] [ + 8 salt + 16 tag ]
+ */
+static long field_bytes( const EncodeInfo *encInfo )
+{
+    return 18 + encInfo -> size_extn_file + ( encInfo -> codec != codec_none ? 8 : 0 ) + ( encInfo -> crc ? 8 : 0 ) +
+           ( encInfo -> key && encInfo -> encrypt ? 8 + POLY1305_TAG : 0 );
+}
+
+/* Checks if the source .bmp file has enough capacity to store data to be encoded
+ * With eng_memory the caller has already stored the secret size
+ */
 Status check_capacity( EncodeInfo *encInfo )
 {
+    // Parse the layout of the rows
+    Status parsed = encInfo -> engine == eng_memory ? bmp_parse( encInfo -> src_map, encInfo -> map_size, &encInfo -> bmp )
+                                                    : bmp_read( encInfo -> fptr_src_image, &encInfo -> bmp );
+    if( parsed != e_success )
+    {
+        report_info( encInfo -> reporter, "%s is no 24 or 32 bit bmp image", encInfo -> src_image_fname );
+        return encode_failed( encInfo, steg_err_format );
+    }
+
     // Store the image capacity
-    uint img_size = get_image_size_for_bmp( encInfo -> fptr_src_image );
-    encInfo -> image_capacity = img_size;
+    encInfo -> image_capacity = encInfo -> bmp.capacity;
+
+    if( encInfo -> engine != eng_memory )
+    {
+        struct stat st;
 
-    // Get secret file size
-    uint file_size = get_file_size( encInfo -> fptr_secret );
+        // Pipes and terminals have no size to ask for, they are streamed
+        encInfo -> streaming = fstat( fileno( encInfo -> fptr_secret ), &st ) == 0 && !S_ISREG( st.st_mode );
+
+        // Get secret file size, the size field holds a long
+        off_t size = encInfo -> streaming ? 0 : get_file_size( encInfo -> fptr_secret );
+        if( size < 0 || ( uintmax_t )size > LONG_MAX )
+        {
+            report_info( encInfo -> reporter, "Unable to size %s", encInfo -> secret_fname );
+            return encode_failed( encInfo, size < 0 ? steg_err_io : steg_err_capacity );
+        }
+        encInfo -> size_secret_file = size;
+    }
+    size_t img_size = encInfo -> image_capacity;
+    long file_size = encInfo -> size_secret_file;
+
+    if( encInfo -> bits == 0 )
+        encInfo -> bits = 1;
+    if( !lsb_bits_valid( encInfo -> bits ) )
+    {
+        report_info( encInfo -> reporter, "Unsupported depth of %d bits", encInfo -> bits );
+        return encode_failed( encInfo, steg_err_args );
+    }
+    if( encInfo -> codec != codec_none && encInfo -> codec != codec_lz )
+    {
+        report_info( encInfo -> reporter, "Unsupported codec %d", encInfo -> codec );
+        return encode_failed( encInfo, steg_err_args );
+    }
+    if( encInfo -> key && encInfo -> key[0] == '\0' )
+    {
+        report_info( encInfo -> reporter, "Empty key");
+        return encode_failed( encInfo, steg_err_args );
+    }
+    if( encInfo -> encrypt && encInfo -> key == NULL )
+    {
+        report_info( encInfo -> reporter, "Encryption needs a key");
+        return encode_failed( encInfo, steg_err_args );
+    }
     
-    if( file_size == 0 )
+    if( file_size == 0 && !encInfo -> streaming )
     {
-        print_sleep("INFO: Empty Secret String\n");
-        exit(1);
+        report_info( encInfo -> reporter, "Empty Secret String");
+        return encode_failed( encInfo, steg_err_empty );
     }
-    encInfo -> size_secret_file = file_size; // Store secret string size
-    print_sleep("INFO: Done. Not empty\n");
+    report_info( encInfo -> reporter, "Done. Not empty");
 
 
     // Get secret file extension size
-    char *extn_ptr = strrchr( encInfo -> secret_fname, '.' );
-    if( extn_ptr == NULL )
+    if( encInfo -> extn_secret_file[0] != '.' )
     {
-        print_sleep("INFO: Empty Secret Extension\n");
-        exit(1);
+        report_info( encInfo -> reporter, "Empty Secret Extension");
+        return encode_failed( encInfo, steg_err_args );
     }
-    encInfo -> size_extn_file = strlen( extn_ptr );
+    encInfo -> size_extn_file = strlen( encInfo -> extn_secret_file );
 
     // Checks if total encoding size required is less than source file size without header size
-    print_sleep("INFO: Checking for %s capacity to handle %s\n", encInfo -> src_image_fname, encInfo -> secret_fname );
-    if( ( 18 + strlen( extn_ptr ) + file_size ) * 8 > ( img_size - 54 ) )  // 2 MS + 4 extndata + 4 secretdata ( 10 )
-        return e_failure;
+    // Header fields take 8 bytes per byte, the data 8 / bits
+    report_info( encInfo -> reporter, "Checking for %s capacity to handle %s", encInfo -> src_image_fname, encInfo -> secret_fname );
+    long header = field_bytes( encInfo ) * 8;
+    // The size of compressed data is only known as it is encoded, checked per frame like a stream
+    // The chunk index follows the data at the data's depth
+    long index = encInfo -> index ? chunk_index_size( codec_none, file_size ) : 0;
+    long data = encInfo -> codec == codec_none ? LSB_CARRIER( file_size + index, encInfo -> bits ) : 0;
+    if( header + data > ( long )img_size )
+        return encode_failed( encInfo, steg_err_capacity );
+
+    // Most a stream or compressed data may bring, index included, checked as it arrives
+    encInfo -> max_secret_size = ( ( long )img_size - header ) * encInfo -> bits / 8;
+
+    // Room for every entry of a secret of known size up front, so parallel chunks can fill their own
+    encInfo -> chunk_index.codec = encInfo -> codec;
+    if( encInfo -> index && !encInfo -> streaming &&
+        chunk_index_reserve( &encInfo -> chunk_index, chunk_index_entries( encInfo -> codec, file_size ) ) != e_success )
+        return encode_failed( encInfo, steg_err_nomem );
 
     return e_success;
 
 }
 
-/* Gets the secret file size */
-uint get_file_size( FILE *fptr )
+/* Gets the secret file size, -1 if fstat() fails */
+off_t get_file_size( FILE *fptr )
 {
-    fseek( fptr, 0, SEEK_END );
-    uint size = ftell( fptr );
-    fseek( fptr, 0, SEEK_SET );
-    return size;
+    struct stat st;
+
+    return fstat( fileno( fptr ), &st ) == 0 ? st.st_size : -1;
 }
 
-/* Copies the .bmp header to stego file as it is */
-Status copy_bmp_header( FILE *fptr_src_image, FILE *fptr_dest_image )
+/* Copies the .bmp header to stego file as it is, inside the kernel
+ * header_size is the offset of the rows, so palettes and V4 / V5 header
+ * fields are copied too
+ */
+Status copy_bmp_header( FILE *fptr_src_image, FILE *fptr_dest_image, off_t header_size )
 {
-    char buffer[55];
-
     // Reset file pointers
     fseek( fptr_src_image, 0, SEEK_SET );
     fseek( fptr_dest_image, 0, SEEK_SET );
 
-    fread( buffer, 54, 1, fptr_src_image );   // Reads 54 bytes from source
-    fwrite( buffer, 54, 1, fptr_dest_image ); // Writes 54 bytes to stego
+    return copy_stream_region( fptr_src_image, fptr_dest_image, header_size ); // Copies the header from source to stego
+}
+
+/* Writes the encoded image block to stego, including any bytes read ahead
+ * After this the source and stego streams are at the same offset again,
+ * with io_uring once every write behind has reached the file
+ * In place the bytes read ahead are left out, the file already holds them
+ */
+Status flush_image_block( EncodeInfo *encInfo )
+{
+    BlockBuffer *block = &encInfo -> image_block;
+    off_t end = block -> base + block -> fill;
+
+    if( encInfo -> in_place )
+    {
+        off_t encoded = bmp_offset( &encInfo -> bmp, encInfo -> carrier_pos );
+        if( end > encoded )
+            block -> fill = encoded > block -> base ? encoded - block -> base : 0;
+    }
+
+    if( encInfo -> io == io_uring )
+    {
+        if( uring_flush( &encInfo -> uring, block ) != e_success ||
+            fseeko( encInfo -> fptr_src_image, block -> base, SEEK_SET ) != 0 ||
+            fseeko( encInfo -> fptr_stego_image, block -> base, SEEK_SET ) != 0 )
+        {
+            report_info( encInfo -> reporter, "Unable to write %s: %s", encInfo -> stego_image_fname,
+                         strerror( encInfo -> uring.error ? encInfo -> uring.error : errno ) );
+            return encode_failed( encInfo, steg_err_io );
+        }
+        return e_success;
+    }
+
+    if( block -> fill > 0 && fwrite( block -> data, 1, block -> fill, encInfo -> fptr_stego_image ) != block -> fill )
+    {
+        report_info( encInfo -> reporter, "Unable to write %s: %s", encInfo -> stego_image_fname, strerror( errno ) );
+        return encode_failed( encInfo, steg_err_io );
+    }
+    if( block -> base + ( off_t )block -> fill < end && fseeko( encInfo -> fptr_stego_image, end, SEEK_SET ) != 0 )
+    {
+        return e_failure;
+    }
+    block -> fill = 0;
 
     return e_success;
 }
 
-/* Reads 8 bytes from source to encode 1 byte of secret file data */
-Status encode_data_to_image( const char *data, int size, FILE *fptr_src_image, FILE *fptr_stego_image )
+/* Encodes 8 carrier bytes of source image for every byte of secret file data
+ * with the bulk kernel, a whole image block is read and written at a time
+ * With the mmap engine the kernel runs straight from source map to stego map
+ */
+Status encode_data_to_image( const char *data, int size, EncodeInfo *encInfo )
 {
-    char image_buffer[8] = {};
-    
-    for( int i = 0; i < size; i++ )
+    return encode_bits_to_image( data, size, 1, encInfo );
+}
+
+/* Same at bits per carrier byte, 8 / bits carrier bytes of source image per byte of data */
+Status encode_bits_to_image( const char *data, int size, int bits, EncodeInfo *encInfo )
+{
+    BlockBuffer *block = &encInfo -> image_block;
+    const BmpInfo *bmp = &encInfo -> bmp;
+    size_t per = LSB_CARRIER( 1, bits );
+
+    // Scattered data goes where the key puts it, straight to the stego image
+    if( encInfo -> scatter.domain )
+    {
+        int fd = encInfo -> engine == eng_stdio ? fileno( encInfo -> fptr_stego_image ) : -1;
+
+        if( scatter_embed( &encInfo -> scatter, bmp, bits, ( const uchar * )data, size, encInfo -> carrier_pos,
+                           encInfo -> src_map, encInfo -> stego_map, fd ) != e_success )
+        {
+            return e_failure;
+        }
+        encInfo -> carrier_pos += ( size_t )size * per;
+
+        return e_success;
+    }
+
+    if( encInfo -> engine != eng_stdio )
+    {
+        size_t pos = encInfo -> carrier_pos;
+
+        if( pos + ( size_t )size * per > bmp -> capacity )
+        {
+            return e_failure; // Not enough image left
+        }
+
+        bmp_embed( bmp, bits, ( const uchar * )data, size, pos, encInfo -> src_map, encInfo -> stego_map, 0 );
+        encInfo -> carrier_pos = pos + ( size_t )size * per;
+
+        return e_success;
+    }
+
+    while( size > 0 )
     {
-        fread( image_buffer, 8, 1, fptr_src_image );    // Read 8 bytes
-        encode_byte_to_lsb( data[i], image_buffer );    // Steg 1 byte to 8 byte
-        fwrite( image_buffer, 8, 1, fptr_stego_image ); // Write 8 byte after encoding
+        size_t end = bmp_carrier_index( bmp, block -> base + block -> fill ); // Carrier bytes up to the block end
+
+        // Block used up, write it and read the next one, whole rows at a time
+        if( encInfo -> carrier_pos >= end && encInfo -> io == io_uring )
+        {
+            if( uring_next( &encInfo -> uring, block ) != e_success )
+            {
+                report_info( encInfo -> reporter, "Unable to read %s through io_uring: %s", encInfo -> src_image_fname, strerror( encInfo -> uring.error ) );
+                return encode_failed( encInfo, steg_err_io );
+            }
+            end = bmp_carrier_index( bmp, block -> base + block -> fill );
+        }
+        else if( encInfo -> carrier_pos >= end )
+        {
+            if( flush_image_block( encInfo ) != e_success )
+            {
+                return e_failure;
+            }
+            block -> base = ftello( encInfo -> fptr_src_image );
+            block -> fill = fread( block -> data, 1, bmp_block_bytes( bmp, block -> capacity ), encInfo -> fptr_src_image );
+            end = bmp_carrier_index( bmp, block -> base + block -> fill );
+        }
+
+        size_t chunk = end > encInfo -> carrier_pos ? ( end - encInfo -> carrier_pos ) / per : 0;
+        if( chunk == 0 )
+        {
+            return e_failure; // Not enough image left
+        }
+        if( chunk > ( size_t )size )
+            chunk = size;
+
+        // Steg chunk bytes to chunk * per carrier bytes
+        bmp_embed( bmp, bits, ( const uchar * )data, chunk, encInfo -> carrier_pos, block -> data, block -> data, block -> base );
+
+        encInfo -> carrier_pos += chunk * per;
+        data += chunk;
+        size -= chunk;
     }
 
     return e_success;
 }
 
-/* LSB of 8 bytes read will be encoded with 1 byte of secret file data */
+/* LSB of 8 bytes read will be encoded with 1 byte of secret file data
+ * Reference for the bulk kernels in lsb.c
+ */
 Status encode_byte_to_lsb( char data, char *image_buffer )
 {
     for( int i = 0; i < 8; i++ )
@@ -230,19 +440,33 @@ Status encode_magic_string( const char *magic_string, EncodeInfo *encInfo )
 {
     int len = strlen( magic_string );
 
-    encode_data_to_image( magic_string, len, encInfo -> fptr_src_image, encInfo -> fptr_stego_image );
-
-    return e_success;
+    return encode_data_to_image( magic_string, len, encInfo );
 }
 
-/* Encodes the size of secret file extension, which will be an integer */
+/* Encodes the size of secret file extension, which will be an integer
+ * A depth other than 1 bit and the row layout are recorded next to it, see common.h
+ */
 Status encode_secret_file_extn_size( long size_extn_file, EncodeInfo *encInfo )
 {
-    uchar* extn_size_len = ( uchar* )&size_extn_file; // Character pointer to access each byte to encode
+    if( encInfo -> bits > 1 )
+        size_extn_file |= ( long )encInfo -> bits << EXTN_BITS_SHIFT;
+    size_extn_file |= ( long )encInfo -> codec << EXTN_CODEC_SHIFT;
+    if( !bmp_is_legacy( &encInfo -> bmp ) )
+        size_extn_file |= EXTN_ROWS;
+    if( encInfo -> crc )
+        size_extn_file |= EXTN_CRC;
+    if( encInfo -> index )
+        size_extn_file |= EXTN_INDEX;
+    if( encInfo -> container )
+        size_extn_file |= EXTN_CONTAINER;
+    if( encInfo -> key )
+        size_extn_file |= EXTN_SCATTER;
+    if( encInfo -> key && encInfo -> encrypt )
+        size_extn_file |= EXTN_CIPHER;
 
-    encode_data_to_image( extn_size_len, sizeof( long ), encInfo -> fptr_src_image, encInfo -> fptr_stego_image );
+    uchar* extn_size_len = ( uchar* )&size_extn_file; // Character pointer to access each byte to encode
 
-    return e_success;
+    return encode_data_to_image( ( const char * )extn_size_len, sizeof( long ), encInfo );
 }
 
 /* Encodes the secret file extension( .txt ) */
@@ -250,10 +474,7 @@ Status encode_secret_file_extn( const char *file_extn, EncodeInfo *encInfo )
 {
     int extn_len = strlen( encInfo -> extn_secret_file );
     
-    encode_data_to_image( file_extn, extn_len, encInfo -> fptr_src_image, encInfo -> fptr_stego_image );
-    
-    return e_success;
- 
+    return encode_data_to_image( file_extn, extn_len, encInfo );
 }
 
 /* Encodes the secret file size, which will be an integer */
@@ -261,173 +482,828 @@ Status encode_secret_file_size( long file_size, EncodeInfo *encInfo )
 {
     uchar* file_size_len = ( uchar* )&file_size; // Character pointer allowing each byte to be accessed and encoded, here all 8 bytes.
 
-    encode_data_to_image( file_size_len, sizeof( long ), encInfo -> fptr_src_image, encInfo -> fptr_stego_image );
+    encInfo -> size_field_pos = encInfo -> carrier_pos; // For patch_secret_file_size()
+
+    return encode_data_to_image( ( const char * )file_size_len, sizeof( long ), encInfo );
+}
+
+/* Encodes the size of the stored data after the file size, 0 until it is patched */
+Status encode_stored_size( long stored_size, EncodeInfo *encInfo )
+{
+    return encode_data_to_image( ( const char * )&stored_size, sizeof( long ), encInfo );
+}
+
+/* Encodes the CRC32C of the secret after the sizes, 0 until it is patched */
+Status encode_secret_crc( uint32_t crc, EncodeInfo *encInfo )
+{
+    long field = crc;
+
+    return encode_data_to_image( ( const char * )&field, sizeof( long ), encInfo );
+}
+
+/* Encodes a fresh salt of the cipher after the checksum, so one key never
+ * gives the same keystream and positions twice, and the tag of the data
+ * after it, 0 until it is patched
+ */
+Status encode_cipher_salt( EncodeInfo *encInfo )
+{
+    if( getrandom( &encInfo -> cipher_salt, sizeof( encInfo -> cipher_salt ), 0 ) != sizeof( encInfo -> cipher_salt ) )
+    {
+        return e_failure;
+    }
+
+    memset( encInfo -> cipher_tag, 0, POLY1305_TAG );
+    if( encode_data_to_image( ( const char * )&encInfo -> cipher_salt, sizeof( long ), encInfo ) != e_success )
+    {
+        return e_failure;
+    }
+
+    return encode_data_to_image( ( const char * )encInfo -> cipher_tag, POLY1305_TAG, encInfo );
+}
+
+/* Adds len more raw secret bytes to the chunk index of uncompressed data, if there is one */
+Status index_secret_data( const uchar *data, size_t len, EncodeInfo *encInfo )
+{
+    if( encInfo -> index && chunk_index_add( &encInfo -> chunk_index, data, len ) != e_success )
+    {
+        return encode_failed( encInfo, steg_err_nomem );
+    }
 
     return e_success;
 }
 
-/* Encodes the secret file data in a chunk */
+/* Encodes the chunk index after the data, at the data's depth
+ * Capacity for it was checked with the data
+ */
+Status encode_chunk_index( EncodeInfo *encInfo )
+{
+    const ChunkIndex *idx = &encInfo -> chunk_index;
+    size_t len = chunk_index_size( encInfo -> codec, encInfo -> size_secret_file );
+
+    if( idx -> count != chunk_index_entries( encInfo -> codec, encInfo -> size_secret_file ) )
+    {
+        return e_failure; // Some data never reached the index
+    }
+
+    uchar *buff = malloc( len );
+    if( buff == NULL )
+    {
+        return encode_failed( encInfo, steg_err_nomem );
+    }
+
+    chunk_index_write( idx, buff );
+    Status status = encode_bits_to_image( ( const char * )buff, len, encInfo -> bits, encInfo );
+    free( buff );
+
+    return status;
+}
+
+/* Encodes a secret of unknown size, a pipe or stdin, as it arrives
+ * Memory stays at one chunk, the image capacity is checked per chunk
+ * and the size field is patched once the stream has ended
+ */
+Status encode_secret_stream( EncodeInfo *encInfo )
+{
+    size_t chunk_size = block_size_clamp( encInfo -> block_size ) / LSB_CARRIER( 1, encInfo -> bits );
+    size_t read_bytes;
+    Status status = e_success;
+    unsigned long long done = 0;
+
+    char *secret_buff = malloc( chunk_size );
+    if( secret_buff == NULL )
+    {
+        return encode_failed( encInfo, steg_err_nomem );
+    }
+
+    progress_begin( &encInfo -> progress, encInfo -> reporter, "Encoding stream", 0 );
+
+    while( status == e_success && ( read_bytes = fread( secret_buff, 1, chunk_size, encInfo -> fptr_secret ) ) > 0 )
+    {
+        size_t index = encInfo -> index ? chunk_index_size( codec_none, done + read_bytes ) : 0;
+
+        if( done + read_bytes + index > ( unsigned long long )encInfo -> max_secret_size ) // Never negative, see check_capacity()
+        {
+            report_info( encInfo -> reporter, "%s cannot handle more than %ld bytes of %s", encInfo -> src_image_fname, encInfo -> max_secret_size, encInfo -> secret_fname );
+            status = encode_failed( encInfo, steg_err_capacity );
+            break;
+        }
+
+        status = encode_bits_to_image( secret_buff, read_bytes, encInfo -> bits, encInfo );
+        encInfo -> data_crc = crc32c( encInfo -> data_crc, secret_buff, read_bytes );
+        if( status == e_success )
+            status = index_secret_data( ( const uchar * )secret_buff, read_bytes, encInfo );
+
+        done += read_bytes;
+        encInfo -> progress.progress.bytes_total = done; // Grows with the stream
+        progress_update( &encInfo -> progress, done );
+    }
+
+    progress_end( &encInfo -> progress );
+    free( secret_buff );
+
+    if( status == e_success && ferror( encInfo -> fptr_secret ) )
+    {
+        report_info( encInfo -> reporter, "Unable to read %s: %s", encInfo -> secret_fname, strerror( errno ) );
+        status = encode_failed( encInfo, steg_err_io );
+    }
+    if( status == e_success && done == 0 )
+    {
+        report_info( encInfo -> reporter, "Empty Secret String");
+        status = encode_failed( encInfo, steg_err_empty );
+    }
+
+    encInfo -> size_secret_file = done;
+
+    return status;
+}
+
+/* Rewrites the size fields of a streamed or compressed secret with the final sizes,
+ * and the checksum and the tag, which are only known once the data is encoded
+ * Encrypted, the checksum is masked, see chacha.h, and the salt is written
+ * again as it sits between the two
+ * The fields' carrier bytes are read again from the source image, so
+ * the stego image may be write only
+ */
+Status patch_secret_file_size( EncodeInfo *encInfo )
+{
+    const BmpInfo *bmp = &encInfo -> bmp;
+    int encrypted = encInfo -> key && encInfo -> encrypt;
+    long fields[ 4 + POLY1305_TAG / sizeof( long ) ];
+    size_t count = 0;
+    size_t pos = encInfo -> size_field_pos;
+
+    // Same order as encoded: file size [ stored size ] [ crc ] [ salt tag ]
+    fields[ count++ ] = encInfo -> size_secret_file;
+    if( encInfo -> codec != codec_none )
+        fields[ count++ ] = encInfo -> size_stored;
+    if( encInfo -> crc )
+        fields[ count++ ] = encInfo -> data_crc ^ ( encrypted ? encInfo -> scatter.cipher.crc_mask : 0 );
+    if( encrypted )
+    {
+        fields[ count++ ] = encInfo -> cipher_salt;
+        memcpy( fields + count, encInfo -> cipher_tag, POLY1305_TAG );
+        count += POLY1305_TAG / sizeof( long );
+    }
+
+    size_t len = count * sizeof( long );
+
+    if( encInfo -> engine != eng_stdio )
+    {
+        bmp_embed( bmp, 1, ( const uchar * )fields, len, pos, encInfo -> src_map, encInfo -> stego_map, 0 );
+        return e_success;
+    }
+
+    // The fields may run over row ends, their whole span is rewritten
+    off_t first = bmp_offset( bmp, pos );
+    size_t span = bmp_offset( bmp, pos + len * 8 ) - first;
+    uchar *field = malloc( span );
+    Status status = e_failure;
+
+    // Everything buffered has to reach the file before the field is rewritten
+    if( field && fflush( encInfo -> fptr_stego_image ) == 0 &&
+        pread( fileno( encInfo -> fptr_src_image ), field, span, first ) == ( ssize_t )span )
+    {
+        bmp_embed( bmp, 1, ( const uchar * )fields, len, pos, field, field, first );
+
+        if( pwrite( fileno( encInfo -> fptr_stego_image ), field, span, first ) == ( ssize_t )span )
+            status = e_success;
+    }
+    free( field );
+
+    return status;
+}
+
+/* Next chunk of at most LZ_BLOCK secret bytes, straight from the secret
+ * map if there is one, else read into buff
+ * Returns its length, 0 at the end
+ */
+static size_t next_secret_chunk( EncodeInfo *encInfo, uchar *buff, unsigned long long done, const uchar **chunk )
+{
+    if( encInfo -> secret_map )
+    {
+        size_t left = encInfo -> size_secret_file - done;
+
+        *chunk = encInfo -> secret_map + done;
+        return left < LZ_BLOCK ? left : LZ_BLOCK;
+    }
+
+    *chunk = buff;
+    return fread( buff, 1, LZ_BLOCK, encInfo -> fptr_secret );
+}
+
+/* Compresses the secret a frame at a time and embeds the frames
+ * Works for files, maps and streams alike: memory stays at one frame and
+ * the image capacity is checked per frame, the sizes are patched at the end
+ */
+Status encode_secret_compressed( EncodeInfo *encInfo )
+{
+    unsigned long long done = 0, stored = 0;
+    Status status = e_success;
+    const uchar *chunk;
+    size_t len;
+
+    uchar *secret_buff = malloc( LZ_BLOCK );
+    uchar *frame = malloc( LZ_FRAME_BOUND( LZ_BLOCK ) );
+    if( secret_buff == NULL || frame == NULL )
+    {
+        free( secret_buff );
+        free( frame );
+        return encode_failed( encInfo, steg_err_nomem );
+    }
+
+    if( !encInfo -> streaming && encInfo -> secret_map == NULL )
+        fseek( encInfo -> fptr_secret, 0, SEEK_SET );
+
+    progress_begin( &encInfo -> progress, encInfo -> reporter, "Compressing data", encInfo -> streaming ? 0 : encInfo -> size_secret_file );
+
+    while( status == e_success && ( len = next_secret_chunk( encInfo, secret_buff, done, &chunk ) ) > 0 )
+    {
+        size_t frame_len = lz_frame_encode( chunk, len, frame );
+        size_t index = encInfo -> index ? chunk_index_size( codec_lz, done + len ) : 0;
+
+        if( stored + frame_len + index > ( unsigned long long )encInfo -> max_secret_size )
+        {
+            report_info( encInfo -> reporter, "%s cannot handle more than %ld compressed bytes of %s", encInfo -> src_image_fname, encInfo -> max_secret_size, encInfo -> secret_fname );
+            status = encode_failed( encInfo, steg_err_capacity );
+            break;
+        }
+
+        status = encode_bits_to_image( ( const char * )frame, frame_len, encInfo -> bits, encInfo );
+        encInfo -> data_crc = crc32c( encInfo -> data_crc, chunk, len ); // Of the raw secret, not the frames
+        if( status == e_success && encInfo -> index &&
+            chunk_index_add_frame( &encInfo -> chunk_index, stored, chunk, len ) != e_success )
+            status = encode_failed( encInfo, steg_err_nomem );
+
+        done += len;
+        stored += frame_len;
+        if( encInfo -> streaming )
+            encInfo -> progress.progress.bytes_total = done;
+        progress_update( &encInfo -> progress, done );
+    }
+
+    progress_end( &encInfo -> progress );
+    free( secret_buff );
+    free( frame );
+
+    if( status == e_success && encInfo -> secret_map == NULL && ferror( encInfo -> fptr_secret ) )
+    {
+        report_info( encInfo -> reporter, "Unable to read %s: %s", encInfo -> secret_fname, strerror( errno ) );
+        status = encode_failed( encInfo, steg_err_io );
+    }
+    if( status == e_success && done == 0 )
+    {
+        report_info( encInfo -> reporter, "Empty Secret String");
+        status = encode_failed( encInfo, steg_err_empty );
+    }
+
+    if( status == e_success )
+    {
+        report_info( encInfo -> reporter, "Compressed %llu bytes to %llu ( %.1f%% )", done, stored, 100.0 * stored / done );
+    }
+
+    encInfo -> size_secret_file = done;
+    encInfo -> size_stored = stored;
+
+    return status;
+}
+
+/* Encodes the secret file data in chunks, one image block worth per chunk,
+ * or one batch of the scatter
+ */
 Status encode_secret_file_data( EncodeInfo *encInfo )
 {
-    char secret_buff[1024]; // Buffer to encode a chunk of data
+    size_t chunk_size = ( encInfo -> scatter.domain ? SCATTER_BATCH : encInfo -> image_block.capacity ) / LSB_CARRIER( 1, encInfo -> bits );
     size_t read_bytes;
+    Status status = e_success;
+    unsigned long long done = 0;
+
+    if( encInfo -> codec != codec_none )
+    {
+        return encode_secret_compressed( encInfo );
+    }
+
+    if( encInfo -> streaming )
+    {
+        return encode_secret_stream( encInfo );
+    }
+
+    if( encInfo -> engine != eng_stdio )
+    {
+        return map_encode_secret_file_data( encInfo );
+    }
+
+    // Scattered data is placed by encode_bits_to_image() a batch at a time
+    if( encInfo -> pipeline && !encInfo -> scatter.domain )
+    {
+        return pipeline_encode_secret_file_data( encInfo );
+    }
+
+    if( encInfo -> threads != 1 && !encInfo -> scatter.domain )
+    {
+        return parallel_encode_secret_file_data( encInfo );
+    }
+
+    char *secret_buff = malloc( chunk_size ); // Buffer to encode a chunk of data
+    if( secret_buff == NULL )
+    {
+        return e_failure;
+    }
     
     //set the pointer of secret file to start
     fseek( encInfo -> fptr_secret , 0, SEEK_SET );
 
+    progress_begin( &encInfo -> progress, encInfo -> reporter, "Encoding data", encInfo -> size_secret_file );
+
     // Reads chunk of data from secret file
-    while( ( read_bytes = fread( secret_buff, 1, sizeof( secret_buff ), encInfo -> fptr_secret ) ) > 0 )
+    while( status == e_success && ( read_bytes = fread( secret_buff, 1, chunk_size, encInfo -> fptr_secret ) ) > 0 )
     {
-        encode_data_to_image( secret_buff, read_bytes, encInfo -> fptr_src_image, encInfo -> fptr_stego_image );
+        status = encode_bits_to_image( secret_buff, read_bytes, encInfo -> bits, encInfo );
+        encInfo -> data_crc = crc32c( encInfo -> data_crc, secret_buff, read_bytes ); // While the chunk is in cache
+        if( status == e_success )
+            status = index_secret_data( ( const uchar * )secret_buff, read_bytes, encInfo );
+
+        done += read_bytes;
+        progress_update( &encInfo -> progress, done ); // Once per chunk, never per byte
     }
 
-    return e_success;
+    progress_end( &encInfo -> progress );
+    free( secret_buff );
+
+    return status;
 }
 
-/* Copies the reamining data from source after completing encode to stego file */
+/* Copies the reamining data from source after completing encode to stego file
+ * The bytes never pass through user space, see fcopy.c, so the cost
+ * follows the secret size rather than the image size
+ */
 Status copy_remaining_img_data( FILE* fptr_src, FILE* fptr_dest )
 {
-    char data_buff[1024]; // Buffer to copy a chunk of data
-    size_t read_bytes;
+    struct stat st;
+    off_t pos = ftello( fptr_src );
 
-    while( ( read_bytes = fread( data_buff, 1, sizeof( data_buff ), fptr_src )) > 0 ) // Reads chunk of data to copy
+    if( pos < 0 || fstat( fileno( fptr_src ), &st ) != 0 )
     {
-        fwrite( data_buff, 1, read_bytes, fptr_dest ); // Writes the read data byte by byte
+        return e_failure;
     }
 
+    return copy_stream_region( fptr_src, fptr_dest, st.st_size > pos ? st.st_size - pos : 0 );
+}
+
+/* Saves what an in-place encode may rewrite to the undo record: the rows
+ * from the first one up to the last carrier byte the fields, the data at
+ * its largest compressed size and the chunk index can reach
+ */
+static Status save_in_place_span( EncodeInfo *encInfo )
+{
+    const BmpInfo *bmp = &encInfo -> bmp;
+    size_t size = encInfo -> size_secret_file;
+    size_t stored = size;
+
+    if( encInfo -> codec != codec_none )
+        stored += ( size + LZ_BLOCK - 1 ) / LZ_BLOCK * LZ_FRAME_HEADER;
+    if( encInfo -> index )
+        stored += chunk_index_size( encInfo -> codec, size );
+
+    size_t carriers = field_bytes( encInfo ) * 8 + LSB_CARRIER( stored, encInfo -> bits );
+    if( carriers > bmp -> capacity )
+        carriers = bmp -> capacity;
+    off_t end = bmp_offset( bmp, carriers );
+
+    report_info( encInfo -> reporter, "Saving %lld bytes of %s to its undo record", ( long long )( end - bmp -> data_offset ), encInfo -> src_image_fname );
+    if( undo_save( encInfo -> src_image_fname, fileno( encInfo -> fptr_src_image ), bmp -> data_offset, end - bmp -> data_offset ) != e_success )
+    {
+        return e_failure;
+    }
+    encInfo -> undo = 1;
+
     return e_success;
 }
 
-/* To do the encoding process and calls each required function
- * Displays required informations and success, failure messages
- * Closes all the opened files
+/* Sets up the scatter of the data over the carrier bytes after the fields
+ * The rows are copied to the stego image first, as the data lands all
+ * over them; in place they are already there
  */
-Status do_encoding( EncodeInfo *encInfo )
+static Status begin_scatter( EncodeInfo *encInfo )
 {
-    print_sleep("INFO: Opening required files\n");
-    if( open_files( encInfo ) == e_success )
+    size_t pos = encInfo -> carrier_pos;
+    Status status;
+
+    if( encInfo -> engine != eng_stdio )
+        status = encInfo -> in_place ? e_success : map_copy_remaining_img_data( encInfo );
+    else if( ( status = flush_image_block( encInfo ) ) == e_success && !encInfo -> in_place )
+        status = copy_remaining_img_data( encInfo -> fptr_src_image, encInfo -> fptr_stego_image );
+
+    // Written around the stream from here on
+    if( status == e_success && encInfo -> engine == eng_stdio && fflush( encInfo -> fptr_stego_image ) != 0 )
+        status = e_failure;
+    encInfo -> carrier_pos = pos;
+    if( status != e_success )
     {
-        print_sleep("INFO: Opened %s\n", encInfo -> src_image_fname );
-        print_sleep("INFO: Opened %s\n", encInfo -> secret_fname );
-        print_sleep("INFO: Opened %s\n", encInfo -> stego_image_fname );      
+        return e_failure;
     }
-    else
-        exit(1);
 
-    print_sleep("INFO: Done\n");
+    if( scatter_init( &encInfo -> scatter, encInfo -> key, pos, encInfo -> bmp.capacity - pos, encInfo -> encrypt,
+                      encInfo -> cipher_salt ) != e_success )
+    {
+        return encode_failed( encInfo, steg_err_nomem );
+    }
+
+    return e_success;
+}
+
+/* Records why encoding failed, the first reason is kept */
+static Status encode_failed( EncodeInfo *encInfo, StegError error )
+{
+    if( encInfo -> error == steg_ok )
+        encInfo -> error = error;
+
+    return e_failure;
+}
+
+/* Closes whatever encInfo has open
+ * A failed close of the stego image turns status into e_failure
+ */
+Status close_encode_files( EncodeInfo *encInfo, Status status )
+{
+    map_encode_close( encInfo );
+    if( encInfo -> io == io_uring && uring_close( &encInfo -> uring, &encInfo -> image_block ) != e_success )
+    {
+        if( status == e_success ) // Else reported where it failed
+            report_info( encInfo -> reporter, "Unable to write %s through io_uring: %s", encInfo -> stego_image_fname, strerror( encInfo -> uring.error ) );
+        status = encode_failed( encInfo, steg_err_io );
+    }
+    block_free( &encInfo -> image_block );
+    chunk_index_free( &encInfo -> chunk_index );
+    scatter_free( &encInfo -> scatter );
+
+    if( encInfo -> fptr_src_image )
+        fclose( encInfo -> fptr_src_image );
+    if( encInfo -> fptr_secret && encInfo -> fptr_secret != stdin )
+        fclose( encInfo -> fptr_secret );
+    if( encInfo -> fptr_stego_image && fclose( encInfo -> fptr_stego_image ) != 0 )
+    {
+        report_info( encInfo -> reporter, "Unable to close %s: %s", encInfo -> stego_image_fname, strerror( errno ) );
+        status = encode_failed( encInfo, steg_err_io );
+    }
 
-    print_sleep("INFO: ## Encoding Procedure Started ##\n");
+    encInfo -> fptr_src_image = encInfo -> fptr_secret = encInfo -> fptr_stego_image = NULL;
 
-    print_sleep("INFO: Checking for %s size\n", encInfo -> secret_fname );
+    // A failed in-place encode leaves the image as it found it
+    if( encInfo -> undo )
+    {
+        int restored;
+
+        if( undo_rollback( encInfo -> src_image_fname, &restored ) == e_success )
+            report_info( encInfo -> reporter, "Rolled %s back", encInfo -> src_image_fname );
+        else
+            report_info( encInfo -> reporter, "Unable to roll %s back, its undo record is kept: %s", encInfo -> src_image_fname, strerror( errno ) );
+        encInfo -> undo = 0;
+    }
+
+    return status;
+}
+
+/* Runs every encoding step on the open files, or caller buffers of eng_memory
+ * Displays required informations and success, failure messages
+ * Returns e_failure on the first failing step, with the reason in encInfo -> error
+ */
+Status encode_image( EncodeInfo *encInfo )
+{
+    report_info( encInfo -> reporter, "## Encoding Procedure Started ##");
+
+    report_info( encInfo -> reporter, "Checking for %s size", encInfo -> secret_fname );
     if( check_capacity( encInfo ) == e_success )
     {
-        print_sleep("INFO: Done. Found OK\n");
+        report_info( encInfo -> reporter, "Done. Found OK");
     }
     else
     {
-        print_sleep("INFO: %s cannot handle the %s\n", encInfo -> src_image_fname, encInfo -> secret_fname );
-        exit(0);
+        report_info( encInfo -> reporter, "%s cannot handle the %s", encInfo -> src_image_fname, encInfo -> secret_fname );
+        return encode_failed( encInfo, steg_err_capacity );
+    }
+
+    // In place the span to rewrite is saved first, which needs the secret size up front
+    if( encInfo -> in_place && encInfo -> streaming )
+    {
+        report_info( encInfo -> reporter, "In-place encodes need a secret of known size, not a stream");
+        return encode_failed( encInfo, steg_err_args );
+    }
+    // Scattered data reaches every row, saving and rewriting them all would
+    // write the pixel array twice
+    if( encInfo -> in_place && encInfo -> key )
+    {
+        report_info( encInfo -> reporter, "In-place encodes cannot scatter with a key, write a new stego image instead");
+        return encode_failed( encInfo, steg_err_args );
+    }
+    if( encInfo -> in_place && save_in_place_span( encInfo ) != e_success )
+    {
+        report_info( encInfo -> reporter, "Error saving the undo record of %s: %s", encInfo -> src_image_fname, strerror( errno ) );
+        return encode_failed( encInfo, undo_pending( encInfo -> src_image_fname ) ? steg_err_pending : steg_err_io );
+    }
+
+    // Map the files for the mmap engine
+    if( encInfo -> engine == eng_mmap )
+    {
+        report_info( encInfo -> reporter, "Mapping %s and %s", encInfo -> src_image_fname, encInfo -> stego_image_fname );
+        if( map_encode_files( encInfo ) == e_success )
+        {
+            report_info( encInfo -> reporter, "Done");
+        }
+        else
+        {
+            report_info( encInfo -> reporter, "Error mapping files");
+            return encode_failed( encInfo, steg_err_io );
+        }
+    }
+    // Or set up the ring of io_uring, without one the stdio engine reads and writes itself
+    else if( encInfo -> io == io_uring &&
+             uring_open( &encInfo -> uring, &encInfo -> image_block, &encInfo -> bmp, encInfo -> block_size,
+                         fileno( encInfo -> fptr_src_image ), fileno( encInfo -> fptr_stego_image ) ) != e_success )
+    {
+        report_info( encInfo -> reporter, "io_uring is not available, using stdio");
+        encInfo -> io = io_stdio;
+    }
+
+    if( encInfo -> engine == eng_stdio && encInfo -> io == io_stdio &&
+        ( block_alloc( &encInfo -> image_block, bmp_block_size( &encInfo -> bmp, encInfo -> block_size ) ) != e_success ||
+          bmp_block_bytes( &encInfo -> bmp, encInfo -> image_block.capacity ) == 0 ) )
+    {
+        report_info( encInfo -> reporter, "Unable to allocate image block");
+        return encode_failed( encInfo, steg_err_nomem );
     }
 
     // Start encoding
-    // Copying header to stego
-    print_sleep("INFO: Copying Image Header\n");
-    if( copy_bmp_header( encInfo -> fptr_src_image, encInfo -> fptr_stego_image ) == e_success )
+    // Copying header to stego, in place it is already there
+    report_info( encInfo -> reporter, encInfo -> in_place ? "Keeping Image Header" : "Copying Image Header");
+    Status copied;
+    if( encInfo -> in_place )
+    {
+        encInfo -> carrier_pos = 0;
+        copied = encInfo -> engine != eng_stdio ||
+                 ( fseeko( encInfo -> fptr_src_image, encInfo -> bmp.data_offset, SEEK_SET ) == 0 &&
+                   fseeko( encInfo -> fptr_stego_image, encInfo -> bmp.data_offset, SEEK_SET ) == 0 ) ? e_success : e_failure;
+    }
+    else if( encInfo -> engine != eng_stdio )
+        copied = map_copy_bmp_header( encInfo );
+    else
+        copied = copy_bmp_header( encInfo -> fptr_src_image, encInfo -> fptr_stego_image, encInfo -> bmp.data_offset );
+    if( copied == e_success )
     {
-        print_sleep("INFO: Done\n");
+        report_info( encInfo -> reporter, "Done");
     }
     else
     {
-        print_sleep("INFO: Error copying image header\n");
-        exit(1);
+        report_info( encInfo -> reporter, "Error copying image header");
+        return encode_failed( encInfo, steg_err_io );
     }
 
 
     // Encoding magic string
-    print_sleep("INFO: Encoding Magic String Signature\n");
+    report_info( encInfo -> reporter, "Encoding Magic String Signature");
     if( encode_magic_string( "#*", encInfo ) == e_success )
     {
-        print_sleep("INFO: Done\n");
+        report_info( encInfo -> reporter, "Done");
     }
     else
     {
-        print_sleep("INFO: Error copying magic string\n");
-        exit(1);
+        report_info( encInfo -> reporter, "Error copying magic string");
+        return encode_failed( encInfo, steg_err_io );
     }
     
 
     // Encoding secret file extension size
-    print_sleep("INFO: Encoding %s File Extenstion Size\n", encInfo -> secret_fname );
+    report_info( encInfo -> reporter, "Encoding %s File Extenstion Size", encInfo -> secret_fname );
 
     if( encode_secret_file_extn_size( encInfo -> size_extn_file, encInfo ) == e_success )
     {
-        print_sleep("INFO: Done\n");
+        report_info( encInfo -> reporter, "Done");
     }
     else
     {
-        print_sleep("INFO: Error copying secret file extension size\n");
-        exit(1);
+        report_info( encInfo -> reporter, "Error copying secret file extension size");
+        return encode_failed( encInfo, steg_err_io );
     }
 
 
     // Encoding secret file extension
-    print_sleep("INFO: Encoding %s File Extenstion\n", encInfo -> secret_fname );
+    report_info( encInfo -> reporter, "Encoding %s File Extenstion", encInfo -> secret_fname );
 
     if( encode_secret_file_extn( encInfo -> extn_secret_file, encInfo ) == e_success )
     {
-        print_sleep("INFO: Done\n");
+        report_info( encInfo -> reporter, "Done");
     }
     else
     {
-        print_sleep("INFO: Error copying secret file extension\n");
-        exit(1);
+        report_info( encInfo -> reporter, "Error copying secret file extension");
+        return encode_failed( encInfo, steg_err_io );
     }
 
 
     // Encoding Secret file size
-    print_sleep("INFO: Encoding %s File Size\n", encInfo -> secret_fname );
+    report_info( encInfo -> reporter, "Encoding %s File Size", encInfo -> secret_fname );
     if( encode_secret_file_size( encInfo -> size_secret_file, encInfo ) == e_success )
     {
-        print_sleep("INFO: Done\n");
+        report_info( encInfo -> reporter, "Done");
     }
     else
     {
-        print_sleep("INFO: Error copying secret file size\n");
-        exit(1);
+        report_info( encInfo -> reporter, "Error copying secret file size");
+        return encode_failed( encInfo, steg_err_io );
     }
 
+    // Size of the compressed data, patched once it is encoded
+    if( encInfo -> codec != codec_none )
+    {
+        report_info( encInfo -> reporter, "Encoding %s Stored Size", encInfo -> secret_fname );
+        if( encode_stored_size( 0, encInfo ) == e_success )
+        {
+            report_info( encInfo -> reporter, "Done");
+        }
+        else
+        {
+            report_info( encInfo -> reporter, "Error copying stored size");
+            return encode_failed( encInfo, steg_err_io );
+        }
+    }
+
+    // Checksum of the secret, patched once it is encoded
+    if( encInfo -> crc )
+    {
+        report_info( encInfo -> reporter, "Encoding %s Checksum", encInfo -> secret_fname );
+        if( encode_secret_crc( 0, encInfo ) == e_success )
+        {
+            report_info( encInfo -> reporter, "Done");
+        }
+        else
+        {
+            report_info( encInfo -> reporter, "Error copying checksum");
+            return encode_failed( encInfo, steg_err_io );
+        }
+    }
+
+    // Salt of the cipher, the last field
+    if( encInfo -> key && encInfo -> encrypt )
+    {
+        report_info( encInfo -> reporter, "Encoding %s Cipher Salt", encInfo -> secret_fname );
+        if( encode_cipher_salt( encInfo ) == e_success )
+        {
+            report_info( encInfo -> reporter, "Done");
+        }
+        else
+        {
+            report_info( encInfo -> reporter, "Error drawing or copying the cipher salt");
+            return encode_failed( encInfo, steg_err_io );
+        }
+    }
+
+
+    // With a key the data and the chunk index are spread over every carrier byte left
+    if( encInfo -> key )
+    {
+        report_info( encInfo -> reporter, "Scattering %s File Data over %zu carrier bytes with the key%s", encInfo -> secret_fname,
+                     encInfo -> bmp.capacity - encInfo -> carrier_pos, encInfo -> encrypt ? ", encrypted" : "" );
+        if( begin_scatter( encInfo ) == e_success )
+        {
+            report_info( encInfo -> reporter, "Done");
+        }
+        else
+        {
+            report_info( encInfo -> reporter, "Error copying the rows to scatter over");
+            return encode_failed( encInfo, steg_err_io );
+        }
+    }
 
     // Encode secret file data
-    print_sleep("INFO: Encoding %s File Data\n", encInfo -> secret_fname );
+    report_info( encInfo -> reporter, "Encoding %s File Data", encInfo -> secret_fname );
     if( encode_secret_file_data( encInfo ) == e_success )
     {
-        print_sleep("INFO: Done\n");
+        report_info( encInfo -> reporter, "Done");
     }
     else
     {
-        print_sleep("INFO: Error copying secret file data\n");
-        exit(1);
+        report_info( encInfo -> reporter, "Error copying secret file data");
+        return encode_failed( encInfo, steg_err_io );
     }
 
+    // Tag of the encrypted data and the extension, the chunk index is left out
+    if( encInfo -> scatter.encrypted )
+    {
+        report_info( encInfo -> reporter, "Tagging %s File Data", encInfo -> secret_fname );
+        if( scatter_tag( &encInfo -> scatter, encInfo -> codec != codec_none ? encInfo -> size_stored : encInfo -> size_secret_file,
+                         ( const uchar * )encInfo -> extn_secret_file, encInfo -> size_extn_file, encInfo -> cipher_tag ) == e_success )
+        {
+            report_info( encInfo -> reporter, "Done");
+        }
+        else
+        {
+            report_info( encInfo -> reporter, "Error tagging secret file data");
+            return encode_failed( encInfo, steg_err_io );
+        }
+    }
 
-    // Copy remaining data to stego file 
-    print_sleep("INFO: Copying Left Over Data\n");
-    if( copy_remaining_img_data( encInfo -> fptr_src_image, encInfo -> fptr_stego_image ) == e_success )
+    // Chunk index after the data, for decodes of a range
+    if( encInfo -> index )
     {
-        print_sleep("INFO: Done\n");
+        report_info( encInfo -> reporter, "Encoding %s Chunk Index of %zu entries", encInfo -> secret_fname, encInfo -> chunk_index.count );
+        if( encode_chunk_index( encInfo ) == e_success )
+        {
+            report_info( encInfo -> reporter, "Done");
+        }
+        else
+        {
+            report_info( encInfo -> reporter, "Error copying chunk index");
+            return encode_failed( encInfo, steg_err_io );
+        }
+    }
+
+
+    // Copy remaining data to stego file, in place or scattered it is already there
+    report_info( encInfo -> reporter, encInfo -> scatter.domain ? "Left Over Data Copied Before Scattering" :
+                                      encInfo -> in_place ? "Writing Last Encoded Rows" : "Copying Left Over Data");
+    Status status;
+    if( encInfo -> scatter.domain || ( encInfo -> in_place && encInfo -> engine != eng_stdio ) )
+        status = e_success;
+    else if( encInfo -> engine != eng_stdio )
+        status = map_copy_remaining_img_data( encInfo );
+    else if( ( status = flush_image_block( encInfo ) ) == e_success && !encInfo -> in_place ) // Write out the last encoded block first
+        status = copy_remaining_img_data( encInfo -> fptr_src_image, encInfo -> fptr_stego_image );
+
+    if( status == e_success )
+    {
+        report_info( encInfo -> reporter, "Done");
     }
     else
     {
-        print_sleep("INFO: Error copying secret file data\n");
-        exit(1);
+        report_info( encInfo -> reporter, "Error copying secret file data");
+        return encode_failed( encInfo, steg_err_io );
     }
 
-    print_sleep("INFO: ## Encoding Done Successfully ##\n");
+    // The size of a stream or compressed data, the checksum and the tag are only known now
+    if( encInfo -> streaming || encInfo -> codec != codec_none || encInfo -> crc || encInfo -> scatter.encrypted )
+    {
+        report_info( encInfo -> reporter, "Patching %s File Size to %ld", encInfo -> secret_fname, encInfo -> size_secret_file );
+        if( encInfo -> crc )
+            report_info( encInfo -> reporter, "Patching %s Checksum to CRC32C %08x%s", encInfo -> secret_fname, encInfo -> data_crc,
+                         encInfo -> scatter.encrypted ? ", masked" : "" );
+        if( encInfo -> scatter.encrypted )
+            report_info( encInfo -> reporter, "Patching %s Poly1305 Tag", encInfo -> secret_fname );
+        if( patch_secret_file_size( encInfo ) == e_success )
+        {
+            report_info( encInfo -> reporter, "Done");
+        }
+        else
+        {
+            report_info( encInfo -> reporter, "Error patching secret file size");
+            return encode_failed( encInfo, steg_err_io );
+        }
+    }
 
-    // Close all the files
-    fclose( encInfo -> fptr_src_image );
-    fclose( encInfo -> fptr_secret );
-    fclose( encInfo -> fptr_stego_image );
+    // Durable before the undo record goes
+    if( encInfo -> in_place )
+    {
+        report_info( encInfo -> reporter, "Syncing %s and removing its undo record", encInfo -> src_image_fname );
+        if( fflush( encInfo -> fptr_stego_image ) != 0 ||
+            undo_commit( encInfo -> src_image_fname, fileno( encInfo -> fptr_stego_image ) ) != e_success )
+        {
+            report_info( encInfo -> reporter, "Error syncing %s: %s", encInfo -> src_image_fname, strerror( errno ) );
+            return encode_failed( encInfo, steg_err_io );
+        }
+        encInfo -> undo = 0;
+        report_info( encInfo -> reporter, "Done");
+    }
+
+    if( encInfo -> io == io_uring )
+    {
+        const UringStats *stats = &encInfo -> uring.stats;
+        report_info( encInfo -> reporter, "Image I/O: %zu reads and %zu writes in %zu io_uring_enter calls", stats -> reads, stats -> writes, stats -> enters );
+    }
+
+    report_info( encInfo -> reporter, "## Encoding Done Successfully ##");
 
     return e_success;
-}
\ No newline at end of file
+}
+
+/* To do the encoding process of the named files
+ * Closes all the opened files, also when a step fails
+ * Returns e_failure on the first failing step, with the reason in encInfo -> error
+ */
+Status do_encoding( EncodeInfo *encInfo )
+{
+    report_info( encInfo -> reporter, "Opening required files");
+    if( open_files( encInfo ) == e_success )
+    {
+        report_info( encInfo -> reporter, "Opened %s", encInfo -> src_image_fname );
+        report_info( encInfo -> reporter, "Opened %s", encInfo -> secret_fname );
+        report_info( encInfo -> reporter, "Opened %s", encInfo -> stego_image_fname );      
+    }
+    else
+    {
+        report_info( encInfo -> reporter, "Error opening required files");
+        return close_encode_files( encInfo, encode_failed( encInfo, steg_err_io ) );
+    }
+
+    report_info( encInfo -> reporter, "Done");
+
+    // Close all the files
+    return close_encode_files( encInfo, encode_image( encInfo ) );
+}
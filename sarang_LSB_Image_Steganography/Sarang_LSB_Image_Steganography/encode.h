@@ -2,7 +2,15 @@
 #define ENCODE_H
 
 #include <stdio.h>
+#include <stdint.h>
 #include "types.h" // Contains user defined types
+#include "report.h"
+#include "blockio.h"
+#include "bmp.h"
+#include "steg.h"
+#include "chunk_index.h"
+#include "uring.h"
+#include "scatter.h"
 
 #define MAX_SECRET_BUF_SIZE 1
 #define MAX_IMAGE_BUF_SIZE (MAX_SECRET_BUF_SIZE * 8)
@@ -20,8 +28,9 @@ typedef struct _EncodeInfo
     /* Source Image info */
     char *src_image_fname;
     FILE *fptr_src_image;
-    uint image_capacity;
+    size_t image_capacity;  // Carrier bytes
     uint bits_per_pixel;
+    BmpInfo bmp;            // Layout of the rows
     char image_data[MAX_IMAGE_BUF_SIZE];
 
     /* Secret File Info */
@@ -31,10 +40,53 @@ typedef struct _EncodeInfo
     char secret_data[MAX_SECRET_BUF_SIZE];
     long size_secret_file;
     long size_extn_file;
+    int streaming;          // Size unknown until the secret ends, see encode_secret_stream()
+    long max_secret_size;   // Most the image can carry
+    long size_field_pos;    // Image offset of the encoded size
+    int bits;               // Payload bits per carrier byte of the data, 0 is 1
+    Codec codec;            // Compression of the data
+    long size_stored;       // Data bytes after compression
+    int crc;                // Store the CRC32C of the secret after the sizes
+    uint32_t data_crc;      // CRC32C of the secret bytes encoded so far
+    int index;              // Store a chunk index after the data, see chunk_index.h
+    ChunkIndex chunk_index; // Its entries so far
+    int container;          // The secret is a container of named entries, see container.h
+    const char *key;        // Scatter the data over the rows with this key, NULL keeps it in order
+    int encrypt;            // Also encrypt the data and the chunk index with the key
+    uint64_t cipher_salt;   // Random per encode, stored after the fields
+    uchar cipher_tag[ POLY1305_TAG ];   // Of the encrypted data and the extension, stored after the salt
+    Scatter scatter;        // Its permutation, set up once the fields are encoded, see scatter.h
 
     /* Stego Image Info */
     char *stego_image_fname;
     FILE *fptr_stego_image;
+    int in_place;           // The stego image is the source image, only the encoded span is written
+    int undo;               // The undo record of that span is on disk, see undo.h
+
+    /* Engine, maps are only used by eng_mmap and eng_memory */
+    Engine engine;
+    const uchar *src_map;
+    const uchar *secret_map;
+    uchar *stego_map;
+    size_t map_size;    // Size of the source and stego image maps
+
+    /* Next carrier byte to encode, see bmp.h */
+    size_t carrier_pos;
+
+    /* Image block of the stdio engine */
+    size_t block_size;
+    BlockBuffer image_block;
+    IoBackend io;       // Of the image block
+    UringIo uring;      // With io_uring
+
+    /* Worker threads for the data, 1 is serial, 0 is one per CPU */
+    int threads;
+    int pipeline;       // Read, embed and write the data as three stages instead, see pipeline.h
+
+    /* Reporting */
+    const Reporter *reporter;
+    ProgressState progress;
+    StegError error;    // Why encoding failed
 
 } EncodeInfo;
 
@@ -50,6 +102,12 @@ Status read_and_validate_encode_args( char *argv[], EncodeInfo *encInfo );
 /* Perform the encoding */
 Status do_encoding(EncodeInfo *encInfo);
 
+/* Perform the encoding steps on open files or caller buffers */
+Status encode_image( EncodeInfo *encInfo );
+
+/* Close whatever encInfo has open, returns status or e_failure if the stego image failed to close */
+Status close_encode_files( EncodeInfo *encInfo, Status status );
+
 /* Get File pointers for i/p and o/p files */
 Status open_files(EncodeInfo *encInfo);
 
@@ -57,13 +115,13 @@ Status open_files(EncodeInfo *encInfo);
 Status check_capacity(EncodeInfo *encInfo);
 
 /* Get image size */
-uint get_image_size_for_bmp(FILE *fptr_image);
+size_t get_image_size_for_bmp(FILE *fptr_image);
 
-/* Get file size */
-uint get_file_size(FILE *fptr);
+/* Get file size, -1 on failure */
+off_t get_file_size(FILE *fptr);
 
 /* Copy bmp image header */
-Status copy_bmp_header(FILE *fptr_src_image, FILE *fptr_dest_image);
+Status copy_bmp_header( FILE *fptr_src_image, FILE *fptr_dest_image, off_t header_size );
 
 /* Store Magic String */
 Status encode_magic_string(const char *magic_string, EncodeInfo *encInfo);
@@ -77,11 +135,41 @@ Status encode_secret_file_extn(const char *file_extn, EncodeInfo *encInfo);
 /* Encode secret file size */
 Status encode_secret_file_size( long file_size, EncodeInfo *encInfo);
 
+/* Encode stored data size, only with a codec */
+Status encode_stored_size( long stored_size, EncodeInfo *encInfo );
+
+/* Encode the checksum of the secret, only with crc set */
+Status encode_secret_crc( uint32_t crc, EncodeInfo *encInfo );
+
+/* Draw and encode the salt of the cipher and room for the tag, only with key and encrypt set */
+Status encode_cipher_salt( EncodeInfo *encInfo );
+
+/* Add raw secret bytes to the chunk index, if there is one */
+Status index_secret_data( const uchar *data, size_t len, EncodeInfo *encInfo );
+
+/* Encode the chunk index after the data, only with index set */
+Status encode_chunk_index( EncodeInfo *encInfo );
+
 /* Encode secret file data*/
 Status encode_secret_file_data(EncodeInfo *encInfo);
 
+/* Encode the secret compressed, a frame at a time */
+Status encode_secret_compressed( EncodeInfo *encInfo );
+
+/* Encode a secret of unknown size as it is read */
+Status encode_secret_stream( EncodeInfo *encInfo );
+
+/* Rewrite the size and checksum fields once the secret has ended */
+Status patch_secret_file_size( EncodeInfo *encInfo );
+
+/* Write the buffered image block to stego */
+Status flush_image_block( EncodeInfo *encInfo );
+
 /* Encode function, which does the real encoding */
-Status encode_data_to_image( const char *data, int size, FILE *fptr_src_image, FILE *fptr_stego_image);
+Status encode_data_to_image( const char *data, int size, EncodeInfo *encInfo );
+
+/* Encode at bits per carrier byte */
+Status encode_bits_to_image( const char *data, int size, int bits, EncodeInfo *encInfo );
 
 /* Encode a byte into LSB of image data array */
 Status encode_byte_to_lsb(char data, char *image_buffer);
@@ -0,0 +1,147 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#include "fcopy.h"
+#include "types.h"
+
+static Status copy_bytes( int in_fd, off_t in_off, int out_fd, off_t out_off, off_t len );
+
+/* Function Definitions */
+
+/* Shares the extents of the block aligned part of the region
+ * Returns the number of bytes at the start of the region that still
+ * have to be copied, len if nothing could be cloned
+ */
+static off_t clone_region( int in_fd, off_t in_off, int out_fd, off_t out_off, off_t len )
+{
+#ifdef FICLONERANGE
+    struct stat st;
+
+    if( fstat( in_fd, &st ) != 0 || st.st_blksize <= 0 )
+        return len;
+
+    // Both offsets must sit at the same place within a block
+    off_t blk = st.st_blksize;
+    if( in_off % blk != out_off % blk )
+        return len;
+
+    off_t head = ( blk - in_off % blk ) % blk;
+    if( head >= len )
+        return len;
+
+    // Unaligned lengths are only allowed up to the end of the source
+    off_t body = len - head;
+    if( in_off + len != st.st_size )
+        body -= body % blk;
+    if( body == 0 )
+        return len;
+
+    struct file_clone_range range =
+    {
+        .src_fd = in_fd,
+        .src_offset = in_off + head,
+        .src_length = body,
+        .dest_offset = out_off + head,
+    };
+
+    if( ioctl( out_fd, FICLONERANGE, &range ) != 0 )
+        return len; // Not supported here, copy it all
+
+    // The clone does not cover a trailing partial block
+    if( head + body < len )
+    {
+        if( copy_bytes( in_fd, in_off + head + body, out_fd, out_off + head + body, len - head - body ) != e_success )
+            return len;
+    }
+
+    return head;
+#else
+    ( void )in_fd; ( void )in_off; ( void )out_fd; ( void )out_off;
+    return len;
+#endif
+}
+
+/* Copies len bytes of in_fd at in_off to out_fd at out_off, without reflinks
+ * sendfile() moves the output offset, callers always pass explicit offsets
+ */
+static Status copy_bytes( int in_fd, off_t in_off, int out_fd, off_t out_off, off_t len )
+{
+    ssize_t n = 0;
+
+    // copy_file_range() copies inside the kernel, or offloads to the filesystem
+    while( len > 0 && ( n = copy_file_range( in_fd, &in_off, out_fd, &out_off, len, 0 ) ) > 0 )
+    {
+        len -= n;
+    }
+
+    // sendfile() writes at the output position, so move it there first
+    if( len > 0 && lseek( out_fd, out_off, SEEK_SET ) == out_off )
+    {
+        while( len > 0 && ( n = sendfile( out_fd, in_fd, &in_off, len ) ) > 0 )
+        {
+            len -= n;
+            out_off += n;
+        }
+    }
+
+    // Last resort, through a user space buffer
+    char data_buff[ 64 * 1024 ];
+    while( len > 0 )
+    {
+        n = pread( in_fd, data_buff, len < ( off_t )sizeof( data_buff ) ? len : ( off_t )sizeof( data_buff ), in_off );
+        if( n <= 0 || pwrite( out_fd, data_buff, n, out_off ) != n )
+        {
+            return e_failure;
+        }
+        in_off += n;
+        out_off += n;
+        len -= n;
+    }
+
+    return e_success;
+}
+
+/* Reflinks what can be shared, copies the unaligned head */
+Status copy_file_region( int in_fd, off_t in_off, int out_fd, off_t out_off, off_t len )
+{
+    off_t head = clone_region( in_fd, in_off, out_fd, out_off, len );
+
+    return copy_bytes( in_fd, in_off, out_fd, out_off, head );
+}
+
+/* Copies len bytes between the current positions of two streams */
+Status copy_stream_region( FILE *fptr_src, FILE *fptr_dest, off_t len )
+{
+    int in_fd = fileno( fptr_src );
+    int out_fd = fileno( fptr_dest );
+
+    // Descriptor offsets are only meaningful with empty stdio buffers
+    if( fflush( fptr_dest ) != 0 )
+    {
+        return e_failure;
+    }
+    off_t in_off = ftello( fptr_src );
+    off_t out_off = ftello( fptr_dest );
+    if( in_off < 0 || out_off < 0 )
+    {
+        return e_failure;
+    }
+
+    if( copy_file_region( in_fd, in_off, out_fd, out_off, len ) != e_success )
+    {
+        return e_failure;
+    }
+
+    // Move both streams past the copied region
+    if( fseeko( fptr_src, in_off + len, SEEK_SET ) != 0 || fseeko( fptr_dest, out_off + len, SEEK_SET ) != 0 )
+    {
+        return e_failure;
+    }
+
+    return e_success;
+}
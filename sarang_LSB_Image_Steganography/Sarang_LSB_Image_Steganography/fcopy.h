@@ -0,0 +1,26 @@
+#ifndef FCOPY_H
+#define FCOPY_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include "types.h" // Contains user defined types
+
+/*
+ * Kernel side file copies
+ * Untouched image bytes are moved without passing through user space:
+ * a reflink ( FICLONERANGE ) where the filesystem shares extents, else
+ * copy_file_range(), else sendfile(), else a plain pread/pwrite loop.
+ */
+
+/* Copies len bytes of in_fd at in_off to out_fd at out_off, through the
+ * whole chain above; both engines copy their untouched bytes with it
+ * The offset of out_fd may move, the offset of in_fd does not
+ */
+Status copy_file_region( int in_fd, off_t in_off, int out_fd, off_t out_off, off_t len );
+
+/* Copies len bytes from the current position of fptr_src to the current
+ * position of fptr_dest and advances both streams past them
+ */
+Status copy_stream_region( FILE *fptr_src, FILE *fptr_dest, off_t len );
+
+#endif
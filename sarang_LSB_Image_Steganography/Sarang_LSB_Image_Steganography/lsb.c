@@ -0,0 +1,516 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "lsb.h"
+#include "types.h"
+#include "encode.h"
+#include "decode.h"
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#define LSB_X86 1
+#include <immintrin.h>
+#endif
+
+#define LSB_MASK64 0x0101010101010101ULL
+
+/* Function pointer types of the kernels */
+typedef void ( *EmbedFn )( const uchar *data, size_t n, const uchar *src, uchar *dst );
+typedef void ( *ExtractFn )( const uchar *carrier, size_t n, uchar *data );
+
+/* One implementation of the kernels */
+typedef struct _LsbKernel
+{
+    const char *name;
+    int ( *supported )( void );
+    EmbedFn embed;
+    ExtractFn extract;
+} LsbKernel;
+
+/* Byte i of spread[b] is bit i of b, built once at startup */
+static uint64_t spread[256];
+
+/* Function Definitions */
+
+/* Portable path: one table lookup and one 64 bit merge per payload byte */
+static void embed_lut( const uchar *data, size_t n, const uchar *src, uchar *dst )
+{
+    for( size_t i = 0; i < n; i++ )
+    {
+        uint64_t carrier;
+
+        memcpy( &carrier, src + i * 8, 8 );
+        carrier = ( carrier & ~LSB_MASK64 ) | spread[ data[i] ];
+        memcpy( dst + i * 8, &carrier, 8 );
+    }
+}
+
+/* Portable path: folds the 8 byte LSBs of a 64 bit word into its low byte */
+static void extract_swar( const uchar *carrier, size_t n, uchar *data )
+{
+    for( size_t i = 0; i < n; i++ )
+    {
+        uint64_t bits;
+
+        memcpy( &bits, carrier + i * 8, 8 );
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        bits = __builtin_bswap64( bits );
+#endif
+        bits &= LSB_MASK64;
+        bits |= bits >> 7;  // Each byte holds 2 bits
+        bits |= bits >> 14; // 4 bits
+        bits |= bits >> 28; // 8 bits in the low byte
+        data[i] = ( uchar )bits;
+    }
+}
+
+static int always( void )
+{
+    return 1;
+}
+
+#ifdef LSB_X86
+
+/* BMI2 path: PDEP scatters the 8 bits straight to the byte LSBs */
+__attribute__(( target( "bmi2" ) ))
+static void embed_pdep( const uchar *data, size_t n, const uchar *src, uchar *dst )
+{
+    for( size_t i = 0; i < n; i++ )
+    {
+        uint64_t carrier;
+
+        memcpy( &carrier, src + i * 8, 8 );
+        carrier = ( carrier & ~LSB_MASK64 ) | _pdep_u64( data[i], LSB_MASK64 );
+        memcpy( dst + i * 8, &carrier, 8 );
+    }
+}
+
+/* BMI2 path: PEXT gathers the byte LSBs */
+__attribute__(( target( "bmi2" ) ))
+static void extract_pext( const uchar *carrier, size_t n, uchar *data )
+{
+    for( size_t i = 0; i < n; i++ )
+    {
+        uint64_t bits;
+
+        memcpy( &bits, carrier + i * 8, 8 );
+        data[i] = ( uchar )_pext_u64( bits, LSB_MASK64 );
+    }
+}
+
+/* Turns a vector of payload bytes, each repeated 8 times, into 0/1 bytes and merges them into carrier */
+static inline __m128i merge_sse2( __m128i repeated, __m128i carrier )
+{
+    const __m128i bit = _mm_set_epi8( -128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1 );
+    const __m128i one = _mm_set1_epi8( 1 );
+
+    __m128i set = _mm_cmpeq_epi8( _mm_and_si128( repeated, bit ), bit );
+
+    return _mm_or_si128( _mm_andnot_si128( one, carrier ), _mm_and_si128( set, one ) );
+}
+
+/* SSE2 path: 16 payload bytes per iteration, repeated by a tree of unpacks */
+static void embed_sse2( const uchar *data, size_t n, const uchar *src, uchar *dst )
+{
+    size_t i = 0;
+
+    for( ; i + 16 <= n; i += 16 )
+    {
+        __m128i x = _mm_loadu_si128( ( const __m128i * )( data + i ) );
+        __m128i x2[2], x4[4], x8[8];
+
+        x2[0] = _mm_unpacklo_epi8( x, x );
+        x2[1] = _mm_unpackhi_epi8( x, x );
+        for( int j = 0; j < 2; j++ )
+        {
+            x4[ 2 * j ] = _mm_unpacklo_epi16( x2[j], x2[j] );
+            x4[ 2 * j + 1 ] = _mm_unpackhi_epi16( x2[j], x2[j] );
+        }
+        for( int j = 0; j < 4; j++ )
+        {
+            x8[ 2 * j ] = _mm_unpacklo_epi32( x4[j], x4[j] );
+            x8[ 2 * j + 1 ] = _mm_unpackhi_epi32( x4[j], x4[j] );
+        }
+
+        const uchar *s = src + i * 8;
+        uchar *d = dst + i * 8;
+        for( int j = 0; j < 8; j++ )
+        {
+            __m128i carrier = _mm_loadu_si128( ( const __m128i * )( s + 16 * j ) );
+            _mm_storeu_si128( ( __m128i * )( d + 16 * j ), merge_sse2( x8[j], carrier ) );
+        }
+    }
+
+    embed_lut( data + i, n - i, src + i * 8, dst + i * 8 );
+}
+
+/* SSE2 path: shifting each LSB up to the sign bit lets movemask collect 2 payload bytes */
+static void extract_sse2( const uchar *carrier, size_t n, uchar *data )
+{
+    size_t i = 0;
+
+    for( ; i + 2 <= n; i += 2 )
+    {
+        __m128i v = _mm_loadu_si128( ( const __m128i * )( carrier + i * 8 ) );
+        uint16_t bits = ( uint16_t )_mm_movemask_epi8( _mm_slli_epi64( v, 7 ) );
+
+        memcpy( data + i, &bits, 2 );
+    }
+
+    extract_swar( carrier + i * 8, n - i, data + i );
+}
+
+static int has_avx2( void )
+{
+    return __builtin_cpu_supports( "avx2" );
+}
+
+/* AVX2 path: 4 payload bytes fan out to 32 carrier bytes with one shuffle */
+__attribute__(( target( "avx2" ) ))
+static void embed_avx2( const uchar *data, size_t n, const uchar *src, uchar *dst )
+{
+    const __m256i fan = _mm256_setr_epi8( 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                          2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3 );
+    const __m256i bit = _mm256_setr_epi8( 1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+                                          1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128 );
+    const __m256i one = _mm256_set1_epi8( 1 );
+    size_t i = 0;
+
+    for( ; i + 4 <= n; i += 4 )
+    {
+        uint32_t word;
+
+        memcpy( &word, data + i, 4 );
+
+        __m256i repeated = _mm256_shuffle_epi8( _mm256_set1_epi32( word ), fan );
+        __m256i set = _mm256_cmpeq_epi8( _mm256_and_si256( repeated, bit ), bit );
+        __m256i carrier = _mm256_loadu_si256( ( const __m256i * )( src + i * 8 ) );
+
+        carrier = _mm256_or_si256( _mm256_andnot_si256( one, carrier ), _mm256_and_si256( set, one ) );
+        _mm256_storeu_si256( ( __m256i * )( dst + i * 8 ), carrier );
+    }
+
+    embed_lut( data + i, n - i, src + i * 8, dst + i * 8 );
+}
+
+/* AVX2 path: shift plus movemask, 4 payload bytes per vector */
+__attribute__(( target( "avx2" ) ))
+static void extract_avx2( const uchar *carrier, size_t n, uchar *data )
+{
+    size_t i = 0;
+
+    for( ; i + 4 <= n; i += 4 )
+    {
+        __m256i v = _mm256_loadu_si256( ( const __m256i * )( carrier + i * 8 ) );
+        uint32_t bits = ( uint32_t )_mm256_movemask_epi8( _mm256_slli_epi64( v, 7 ) );
+
+        memcpy( data + i, &bits, 4 );
+    }
+
+    extract_swar( carrier + i * 8, n - i, data + i );
+}
+
+static int has_avx512( void )
+{
+    return __builtin_cpu_supports( "avx512bw" );
+}
+
+/* AVX-512BW path: 8 payload bytes read as a 64 bit word are exactly the
+ * byte mask of which of the 64 carrier bytes get their LSB set
+ */
+__attribute__(( target( "avx512bw" ) ))
+static void embed_avx512( const uchar *data, size_t n, const uchar *src, uchar *dst )
+{
+    const __m512i keep = _mm512_set1_epi8( ( char )0xFE );
+    size_t i = 0;
+
+    for( ; i + 8 <= n; i += 8 )
+    {
+        uint64_t word;
+
+        memcpy( &word, data + i, 8 );
+
+        __m512i carrier = _mm512_loadu_si512( src + i * 8 );
+        carrier = _mm512_or_si512( _mm512_and_si512( carrier, keep ), _mm512_maskz_set1_epi8( word, 1 ) );
+        _mm512_storeu_si512( dst + i * 8, carrier );
+    }
+
+    embed_lut( data + i, n - i, src + i * 8, dst + i * 8 );
+}
+
+/* AVX-512BW path: testing the LSB of 64 carrier bytes yields 8 payload bytes as one mask */
+__attribute__(( target( "avx512bw" ) ))
+static void extract_avx512( const uchar *carrier, size_t n, uchar *data )
+{
+    const __m512i one = _mm512_set1_epi8( 1 );
+    size_t i = 0;
+
+    for( ; i + 8 <= n; i += 8 )
+    {
+        uint64_t bits = _mm512_test_epi8_mask( _mm512_loadu_si512( carrier + i * 8 ), one );
+
+        memcpy( data + i, &bits, 8 );
+    }
+
+    extract_swar( carrier + i * 8, n - i, data + i );
+}
+
+static int has_bmi2( void )
+{
+    return __builtin_cpu_supports( "bmi2" );
+}
+
+#endif
+
+/* Wider depths, one specialisation per depth: with bits a constant the
+ * carrier loop unrolls to 8 / bits byte merges and the masks fold away
+ */
+__attribute__(( always_inline ))
+static inline void embed_depth( const int bits, const uchar *data, size_t n, const uchar *src, uchar *dst )
+{
+    const int per = 8 / bits;
+    const uchar low = ( uchar )( ( 1 << bits ) - 1 );
+
+    for( size_t i = 0; i < n; i++ )
+    {
+        for( int j = 0; j < per; j++ )
+            dst[ i * per + j ] = ( src[ i * per + j ] & ~low ) | ( ( data[i] >> ( j * bits ) ) & low );
+    }
+}
+
+__attribute__(( always_inline ))
+static inline void extract_depth( const int bits, const uchar *carrier, size_t n, uchar *data )
+{
+    const int per = 8 / bits;
+    const uchar low = ( uchar )( ( 1 << bits ) - 1 );
+
+    for( size_t i = 0; i < n; i++ )
+    {
+        uchar byte = 0;
+
+        for( int j = 0; j < per; j++ )
+            byte |= ( carrier[ i * per + j ] & low ) << ( j * bits );
+        data[i] = byte;
+    }
+}
+
+static void embed_2( const uchar *data, size_t n, const uchar *src, uchar *dst )
+{
+    embed_depth( 2, data, n, src, dst );
+}
+
+static void extract_2( const uchar *carrier, size_t n, uchar *data )
+{
+    extract_depth( 2, carrier, n, data );
+}
+
+static void embed_4( const uchar *data, size_t n, const uchar *src, uchar *dst )
+{
+    embed_depth( 4, data, n, src, dst );
+}
+
+static void extract_4( const uchar *carrier, size_t n, uchar *data )
+{
+    extract_depth( 4, carrier, n, data );
+}
+
+/* At 8 bits the payload replaces the carrier */
+static void embed_8( const uchar *data, size_t n, const uchar *src, uchar *dst )
+{
+    ( void )src;
+    memmove( dst, data, n );
+}
+
+static void extract_8( const uchar *carrier, size_t n, uchar *data )
+{
+    memmove( data, carrier, n );
+}
+
+/* Implementations, best first */
+static const LsbKernel kernels[] =
+{
+#ifdef LSB_X86
+    { "avx512", has_avx512, embed_avx512, extract_avx512 },
+    { "avx2",   has_avx2,   embed_avx2,   extract_avx2 },
+    { "sse2",   always,     embed_sse2,   extract_sse2 },
+    { "pdep",   has_bmi2,   embed_pdep,   extract_pext },
+#endif
+    { "lut",    always,     embed_lut,    extract_swar },
+};
+
+static const LsbKernel *active = &kernels[ sizeof( kernels ) / sizeof( kernels[0] ) - 1 ];
+
+/* Builds the tables and picks the best kernel the CPU supports, runs before main() */
+__attribute__(( constructor ))
+static void lsb_init( void )
+{
+    for( int b = 0; b < 256; b++ )
+    {
+        uchar bytes[8];
+
+        for( int i = 0; i < 8; i++ )
+            bytes[i] = ( b >> i ) & 1;
+        memcpy( &spread[b], bytes, 8 );
+    }
+
+#ifdef LSB_X86
+    __builtin_cpu_init();
+#endif
+
+    for( size_t i = 0; i < sizeof( kernels ) / sizeof( kernels[0] ); i++ )
+    {
+        if( kernels[i].supported() )
+        {
+            active = &kernels[i];
+            break;
+        }
+    }
+}
+
+/* Embeds n payload bytes into the LSBs of n * 8 bytes of src */
+void lsb_embed( const uchar *data, size_t n, const uchar *src, uchar *dst )
+{
+    active -> embed( data, n, src, dst );
+}
+
+/* Extracts n payload bytes from the LSBs of n * 8 carrier bytes */
+void lsb_extract( const uchar *carrier, size_t n, uchar *data )
+{
+    active -> extract( carrier, n, data );
+}
+
+/* 1 if bits is a supported depth */
+int lsb_bits_valid( int bits )
+{
+    return bits == 1 || bits == 2 || bits == 4 || bits == 8;
+}
+
+/* Embeds n payload bytes at bits per carrier byte */
+void lsb_embed_bits( int bits, const uchar *data, size_t n, const uchar *src, uchar *dst )
+{
+    switch( bits )
+    {
+        case 2:     embed_2( data, n, src, dst ); break;
+        case 4:     embed_4( data, n, src, dst ); break;
+        case 8:     embed_8( data, n, src, dst ); break;
+        default:    active -> embed( data, n, src, dst ); break;
+    }
+}
+
+/* Extracts n payload bytes at bits per carrier byte */
+void lsb_extract_bits( int bits, const uchar *carrier, size_t n, uchar *data )
+{
+    switch( bits )
+    {
+        case 2:     extract_2( carrier, n, data ); break;
+        case 4:     extract_4( carrier, n, data ); break;
+        case 8:     extract_8( carrier, n, data ); break;
+        default:    active -> extract( carrier, n, data ); break;
+    }
+}
+
+/* Name of the selected implementation */
+const char *lsb_kernel_name( void )
+{
+    return active -> name;
+}
+
+/* Force an implementation by name */
+Status lsb_select_kernel( const char *name )
+{
+    for( size_t i = 0; i < sizeof( kernels ) / sizeof( kernels[0] ); i++ )
+    {
+        if( strcmp( kernels[i].name, name ) == 0 && kernels[i].supported() )
+        {
+            active = &kernels[i];
+            return e_success;
+        }
+    }
+
+    return e_failure;
+}
+
+/* Checks every kernel the CPU supports against the byte-at-a-time reference */
+Status lsb_self_test( void )
+{
+    enum { max_len = 300 };
+    static uchar data[ max_len ], carrier[ max_len * 8 ], expect[ max_len * 8 ], out[ max_len * 8 ];
+    const LsbKernel *saved = active;
+    Status status = e_success;
+
+    for( size_t k = 0; k < sizeof( kernels ) / sizeof( kernels[0] ); k++ )
+    {
+        int ok = 1;
+
+        if( !kernels[k].supported() )
+        {
+            printf( "%-8s not supported\n", kernels[k].name );
+            continue;
+        }
+
+        srand( 1 );
+        for( size_t n = 0; n <= max_len && ok; n++ )
+        {
+            for( size_t i = 0; i < n; i++ )
+                data[i] = rand();
+            for( size_t i = 0; i < n * 8; i++ )
+                carrier[i] = expect[i] = rand();
+
+            for( size_t i = 0; i < n; i++ )
+                encode_byte_to_lsb( data[i], ( char * )expect + i * 8 );
+
+            // Out of place and in place embedding
+            kernels[k].embed( data, n, carrier, out );
+            ok = ok && memcmp( out, expect, n * 8 ) == 0;
+            kernels[k].embed( data, n, carrier, carrier );
+            ok = ok && memcmp( carrier, expect, n * 8 ) == 0;
+
+            // Extraction of random carrier bytes
+            for( size_t i = 0; i < n * 8; i++ )
+                carrier[i] = rand();
+            kernels[k].extract( carrier, n, out );
+            for( size_t i = 0; i < n && ok; i++ )
+                ok = ( char )out[i] == decode_byte_from_lsb( ( char * )carrier + i * 8 );
+        }
+
+        printf( "%-8s %s\n", kernels[k].name, ok ? "ok" : "MISMATCH" );
+        if( !ok )
+            status = e_failure;
+    }
+
+    active = saved;
+
+    // Wider depths against a bit by bit loop
+    for( int bits = 2; bits <= LSB_BITS_MAX; bits *= 2 )
+    {
+        int ok = 1;
+
+        srand( 1 );
+        for( size_t n = 0; n <= max_len && ok; n++ )
+        {
+            for( size_t i = 0; i < n; i++ )
+                data[i] = rand();
+            for( size_t i = 0; i < LSB_CARRIER( n, bits ); i++ )
+                carrier[i] = expect[i] = rand();
+
+            for( size_t b = 0; b < n * 8; b++ )
+            {
+                uchar *byte = expect + b / bits;
+                int shift = b % bits;
+
+                *byte = ( *byte & ~( 1 << shift ) ) | ( ( data[ b / 8 ] >> ( b % 8 ) ) & 1 ) << shift;
+            }
+
+            lsb_embed_bits( bits, data, n, carrier, out );
+            ok = ok && memcmp( out, expect, LSB_CARRIER( n, bits ) ) == 0;
+            lsb_extract_bits( bits, out, n, out + max_len * 4 );
+            ok = ok && memcmp( out + max_len * 4, data, n ) == 0;
+        }
+
+        printf( "%d bits   %s\n", bits, ok ? "ok" : "MISMATCH" );
+        if( !ok )
+            status = e_failure;
+    }
+
+    return status;
+}
@@ -0,0 +1,54 @@
+#ifndef LSB_H
+#define LSB_H
+
+#include <stddef.h>
+#include "types.h" // Contains user defined types
+
+/*
+ * Bulk LSB kernels
+ * Same bit layout as encode_byte_to_lsb(): bit i of a payload byte
+ * goes to the LSB of carrier byte i, so n payload bytes take n * 8
+ * carrier bytes. The implementation is picked once at startup from
+ * what the CPU supports.
+ */
+
+/* Embeds n payload bytes into the LSBs of n * 8 bytes of src, result in dst
+ * src and dst may be the same buffer
+ */
+void lsb_embed( const uchar *data, size_t n, const uchar *src, uchar *dst );
+
+/* Extracts n payload bytes from the LSBs of n * 8 carrier bytes */
+void lsb_extract( const uchar *carrier, size_t n, uchar *data );
+
+/* Payload bits per carrier byte */
+#define LSB_BITS_MIN 1
+#define LSB_BITS_MAX 8
+
+/* Carrier bytes n payload bytes take at bits per carrier byte */
+#define LSB_CARRIER( n, bits ) ( ( n ) * 8 / ( bits ) )
+
+/* 1 if bits is a supported depth: 1, 2, 4 or 8 */
+int lsb_bits_valid( int bits );
+
+/* Embeds n payload bytes into the low bits of LSB_CARRIER( n, bits ) bytes of src
+ * Bits j * bits .. ( j + 1 ) * bits - 1 of a payload byte go to carrier
+ * byte j, lowest first, so bits 1 is lsb_embed()
+ */
+void lsb_embed_bits( int bits, const uchar *data, size_t n, const uchar *src, uchar *dst );
+
+/* Extracts n payload bytes from the low bits of LSB_CARRIER( n, bits ) carrier bytes */
+void lsb_extract_bits( int bits, const uchar *carrier, size_t n, uchar *data );
+
+/* Name of the selected implementation ( "avx512", "avx2", "sse2", "pdep" or "lut" ) */
+const char *lsb_kernel_name( void );
+
+/* Force an implementation by name, e_failure if unknown or unsupported by the CPU */
+Status lsb_select_kernel( const char *name );
+
+/* Checks every kernel the CPU supports against encode_byte_to_lsb() and
+ * decode_byte_from_lsb() on random data, then the wider depths against
+ * a bit by bit loop, prints one line per kernel
+ */
+Status lsb_self_test( void );
+
+#endif
@@ -0,0 +1,300 @@
+#include <string.h>
+#include <stdint.h>
+#include "lz.h"
+#include "types.h"
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+#define LZ_LAST_LITERALS 5      // A block always ends in literals, as in LZ4
+#define LZ_MATCH_LIMIT 12       // No match starts closer than this to the end
+#define LZ_STORED 0x80000000u   // Payload length flag of raw frames
+
+/* Function Definitions */
+
+static uint32_t read32( const uchar *p )
+{
+    uint32_t v;
+
+    memcpy( &v, p, 4 );
+
+    return v;
+}
+
+/* Little endian whatever the host, for the frame header */
+static void put_le32( uchar *p, uint32_t v )
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint32_t get_le32( const uchar *p )
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | ( uint32_t )p[3] << 24;
+}
+
+static uint32_t hash32( uint32_t v )
+{
+    return ( v * 2654435761u ) >> ( 32 - LZ_HASH_BITS );
+}
+
+/* Length of the common run of m and r, m stops before end */
+static size_t match_length( const uchar *m, const uchar *r, const uchar *end )
+{
+    const uchar *start = m;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // 8 bytes at a time, the lowest differing byte ends the match
+    while( m + 8 <= end )
+    {
+        uint64_t a, b;
+
+        memcpy( &a, m, 8 );
+        memcpy( &b, r, 8 );
+        if( a != b )
+            return m - start + ( __builtin_ctzll( a ^ b ) >> 3 );
+        m += 8;
+        r += 8;
+    }
+#endif
+    while( m < end && *m == *r )
+    {
+        m++;
+        r++;
+    }
+
+    return m - start;
+}
+
+/* Writes what a token nibble of 15 leaves of len as a run of 255s */
+static uchar *put_length( uchar *op, size_t len )
+{
+    for( ; len >= 255; len -= 255 )
+        *op++ = 255;
+    *op++ = len;
+
+    return op;
+}
+
+/* Writes one sequence: lit_len literals, then a match unless match_len is 0
+ * Returns NULL if it does not fit before oend
+ */
+static uchar *put_sequence( uchar *op, uchar *oend, const uchar *lit, size_t lit_len, size_t offset, size_t match_len )
+{
+    size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+    size_t need = 1 + lit_len + lit_len / 255 + 1 + ( match_len ? 2 + ml / 255 + 1 : 0 );
+
+    if( need > ( size_t )( oend - op ) )
+    {
+        return NULL;
+    }
+
+    uchar *token = op++;
+    *token = ( lit_len < 15 ? lit_len : 15 ) << 4 | ( ml < 15 ? ml : 15 );
+
+    if( lit_len >= 15 )
+        op = put_length( op, lit_len - 15 );
+    memcpy( op, lit, lit_len );
+    op += lit_len;
+
+    if( match_len )
+    {
+        *op++ = offset & 0xFF;
+        *op++ = offset >> 8;
+        if( ml >= 15 )
+            op = put_length( op, ml - 15 );
+    }
+
+    return op;
+}
+
+/* Compresses n bytes of src into at most cap bytes of dst */
+size_t lz_compress( const uchar *src, size_t n, uchar *dst, size_t cap )
+{
+    uint32_t table[ 1 << LZ_HASH_BITS ];    // Last position of each hashed 4 byte sequence
+    const uchar *ip = src, *anchor = src, *end = src + n;
+    uchar *op = dst, *oend = dst + cap;
+
+    memset( table, 0, sizeof( table ) );
+
+    if( n > LZ_MATCH_LIMIT )
+    {
+        const uchar *limit = end - LZ_MATCH_LIMIT;
+        size_t misses = 0;
+
+        while( ip < limit )
+        {
+            uint32_t seq = read32( ip );
+            uint32_t h = hash32( seq );
+            const uchar *ref = src + table[h];
+
+            table[h] = ip - src;
+
+            if( ref >= ip || ip - ref > LZ_MAX_OFFSET || read32( ref ) != seq )
+            {
+                ip += 1 + ( misses++ >> 6 ); // Step up through data that does not compress
+                continue;
+            }
+            misses = 0;
+
+            size_t len = LZ_MIN_MATCH + match_length( ip + LZ_MIN_MATCH, ref + LZ_MIN_MATCH, end - LZ_LAST_LITERALS );
+
+            op = put_sequence( op, oend, anchor, ip - anchor, ip - ref, len );
+            if( op == NULL )
+            {
+                return 0;
+            }
+
+            ip = anchor = ip + len;
+            if( ip < limit )
+                table[ hash32( read32( ip - 2 ) ) ] = ip - 2 - src;
+        }
+    }
+
+    op = put_sequence( op, oend, anchor, end - anchor, 0, 0 );
+
+    return op ? ( size_t )( op - dst ) : 0;
+}
+
+/* Adds the bytes after a token nibble of 15 to len
+ * Returns -1 if src ends first
+ */
+static int get_length( const uchar **ip, const uchar *iend, size_t *len )
+{
+    uchar b;
+
+    if( *len != 15 )
+        return 0;
+
+    do
+    {
+        if( *ip >= iend )
+            return -1;
+        b = *( *ip )++;
+        *len += b;
+    } while( b == 255 );
+
+    return 0;
+}
+
+/* Decompresses n bytes of src into at most cap bytes of dst
+ * Every length and offset is checked, corrupt input never reads or
+ * writes out of bounds
+ */
+long lz_decompress( const uchar *src, size_t n, uchar *dst, size_t cap )
+{
+    const uchar *ip = src, *iend = src + n;
+    uchar *op = dst, *oend = dst + cap;
+
+    while( ip < iend )
+    {
+        uchar token = *ip++;
+        size_t len = token >> 4;
+
+        // Literals
+        if( get_length( &ip, iend, &len ) != 0 || len > ( size_t )( iend - ip ) || len > ( size_t )( oend - op ) )
+        {
+            return -1;
+        }
+        memcpy( op, ip, len );
+        ip += len;
+        op += len;
+
+        // The last sequence has no match
+        if( ip == iend )
+            break;
+
+        if( iend - ip < 2 )
+        {
+            return -1;
+        }
+        size_t offset = ip[0] | ip[1] << 8;
+        ip += 2;
+
+        len = token & 15;
+        if( offset == 0 || offset > ( size_t )( op - dst ) || get_length( &ip, iend, &len ) != 0 )
+        {
+            return -1;
+        }
+        len += LZ_MIN_MATCH;
+        if( len > ( size_t )( oend - op ) )
+        {
+            return -1;
+        }
+
+        // Overlapping matches repeat the last offset bytes
+        const uchar *ref = op - offset;
+        if( offset >= len )
+        {
+            memcpy( op, ref, len );
+        }
+        else
+        {
+            for( size_t i = 0; i < len; i++ )
+                op[i] = ref[i];
+        }
+        op += len;
+    }
+
+    return op - dst;
+}
+
+/* Writes the frame of n raw bytes, stored raw if compression does not help */
+size_t lz_frame_encode( const uchar *src, size_t n, uchar *frame )
+{
+    uchar *payload = frame + LZ_FRAME_HEADER;
+    size_t len = n > 1 ? lz_compress( src, n, payload, n - 1 ) : 0;
+    uint32_t word = len;
+
+    if( len == 0 )
+    {
+        memcpy( payload, src, n );
+        len = n;
+        word = n | LZ_STORED;
+    }
+
+    put_le32( frame, n );
+    put_le32( frame + 4, word );
+
+    return LZ_FRAME_HEADER + len;
+}
+
+/* Reads a frame header, e_failure if it cannot be one */
+Status lz_frame_header( const uchar *header, size_t *raw_len, size_t *payload_len )
+{
+    uint32_t raw = get_le32( header );
+    uint32_t word = get_le32( header + 4 );
+    uint32_t payload = word & ~LZ_STORED;
+
+    // Raw payloads are as long as the frame, compressed ones shorter
+    if( raw == 0 || raw > LZ_BLOCK || ( word & LZ_STORED ? payload != raw : payload == 0 || payload >= raw ) )
+    {
+        return e_failure;
+    }
+
+    *raw_len = raw;
+    *payload_len = payload;
+
+    return e_success;
+}
+
+/* Decodes the payload of a frame into its raw_len bytes at dst */
+Status lz_frame_decode( const uchar *header, const uchar *payload, uchar *dst )
+{
+    size_t raw, len;
+
+    if( lz_frame_header( header, &raw, &len ) != e_success )
+    {
+        return e_failure;
+    }
+
+    if( get_le32( header + 4 ) & LZ_STORED )
+    {
+        memcpy( dst, payload, raw );
+        return e_success;
+    }
+
+    return lz_decompress( payload, len, dst, raw ) == ( long )raw ? e_success : e_failure;
+}
@@ -0,0 +1,49 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stddef.h>
+#include "types.h" // Contains user defined types
+
+/*
+ * In-tree LZ compression
+ * Byte oriented LZ77 in the LZ4 block format: a token with literal and
+ * match lengths, the literals, a 2 byte offset. Single pass greedy
+ * matching over a small hash table, fast enough to sit between the
+ * secret file and the embed kernel.
+ * The secret is cut into frames of at most LZ_BLOCK bytes that are
+ * compressed independently, so encoding and decoding stream with one
+ * block of memory:
+ *     4 bytes  raw length, little endian
+ *     4 bytes  payload length, top bit set if the payload is stored raw
+ *     payload
+ */
+
+#define LZ_BLOCK ( 64 * 1024 )  // Most raw bytes per frame
+#define LZ_FRAME_HEADER 8
+
+/* Most bytes a frame of n raw bytes takes, header included */
+#define LZ_FRAME_BOUND( n ) ( LZ_FRAME_HEADER + ( n ) )
+
+/* Compresses n bytes of src into at most cap bytes of dst
+ * Returns the compressed size, 0 if it does not fit
+ */
+size_t lz_compress( const uchar *src, size_t n, uchar *dst, size_t cap );
+
+/* Decompresses n bytes of src into at most cap bytes of dst
+ * Returns the decompressed size, -1 if src is corrupt or dst too small
+ */
+long lz_decompress( const uchar *src, size_t n, uchar *dst, size_t cap );
+
+/* Writes the frame of n <= LZ_BLOCK raw bytes to frame, which holds
+ * LZ_FRAME_BOUND( n ) bytes, stored raw if compression does not help
+ * Returns the frame size
+ */
+size_t lz_frame_encode( const uchar *src, size_t n, uchar *frame );
+
+/* Reads a frame header, e_failure if it cannot be one */
+Status lz_frame_header( const uchar *header, size_t *raw_len, size_t *payload_len );
+
+/* Decodes the payload of a frame into its raw_len bytes at dst */
+Status lz_frame_decode( const uchar *header, const uchar *payload, uchar *dst );
+
+#endif
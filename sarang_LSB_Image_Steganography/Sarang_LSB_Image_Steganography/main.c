@@ -13,48 +13,603 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "steg.h"
 #include "encode.h"
-#include "decode.h"
 #include "types.h"
+#include "blockio.h"
+#include "lsb.h"
+#include "crc32c.h"
+#include "chacha.h"
+#include "poly1305.h"
+#include "sha256.h"
+#include "batch.h"
+#include "scan.h"
 
-int main( int argc, char *argv[] )
+#define KEY_MAX 1024        // Bytes of a key read by --key-file or --key-fd
+
+/* The key, read from a file or descriptor so ps and shell history never see it */
+static char key_line[ KEY_MAX + 2 ];
+
+/* Settings given as "--option" arguments */
+typedef struct _Options
 {
-    EncodeInfo enc_info;
-    DecodeInfo dec_info;
+    StegContext steg;       // Settings of every encode and decode
+    const char *batch;      // Manifest of --batch
+    int scan;               // --scan, the positional arguments are its roots
+    int verify;             // --verify, the positional arguments are stego images
+    int pack;               // --pack, the positional arguments are image, stego image and files
+    int list;               // --list, the positional argument is a stego image
+    int rollback;           // --rollback, the positional arguments are images encoded in place
+    const char *extract;    // Entry of --extract
+    const char *results;
+    int jobs;
+    const char *meta;       // Side channel of decode metadata, --meta or --meta-fd
+    int meta_fd;
+    int out_fd;             // Decode into this descriptor, -1 for a file
+} Options;
 
-    if( check_operation_type( argv ) ==  e_encode )
+/* Writes the decoded metadata as one JSON line, before the data follows */
+static void write_meta( const StegResult *result, void *user )
+{
+    FILE *meta = user;
+
+    fprintf( meta, "{\"extn\":" );
+    report_json_string( meta, result -> extn );
+    fprintf( meta, ",\"size\":%zu,\"bits\":%d,\"codec\":\"%s\",", result -> secret_size, result -> bits,
+             result -> codec == codec_lz ? "lz" : "none" );
+    if( result -> has_crc )
+        fprintf( meta, "\"crc32c\":\"%08x\",", result -> crc );
+    if( result -> has_index )
+        fprintf( meta, "\"index\":true," );
+    if( result -> container )
+        fprintf( meta, "\"container\":true," );
+    if( result -> scattered )
+        fprintf( meta, "\"scattered\":true," );
+    if( result -> encrypted )
+        fprintf( meta, "\"encrypted\":true," );
+    if( result -> output_size != result -> secret_size )
+        fprintf( meta, "\"range_size\":%zu,", result -> output_size );
+    fprintf( meta, "\"output\":" );
+    report_json_string( meta, result -> output );
+    fprintf( meta, "}\n" );
+    fflush( meta );
+}
+
+/* Opens the metadata side channel of opts, NULL if none was asked for */
+static FILE *open_meta( const Options *opts )
+{
+    if( opts -> meta )
+        return strcmp( opts -> meta, "-" ) == 0 ? stderr : fopen( opts -> meta, "w" );
+    if( opts -> meta_fd >= 0 )
+        return fdopen( opts -> meta_fd, "w" );
+
+    return NULL;
+}
+
+/* Decodes argv[2] into opts -> out_fd, or the named output file */
+static StegError decode( Options *opts, int argc, char *argv[] )
+{
+    StegError error = steg_err_args;
+    FILE *meta = open_meta( opts );
+
+    if( ( opts -> meta || opts -> meta_fd >= 0 ) && meta == NULL )
+    {
+        perror( "meta" );
+        return steg_err_io;
+    }
+    if( meta )
+    {
+        opts -> steg.header_cb = write_meta;
+        opts -> steg.header_user = meta;
+    }
+
+    if( argc >= 3 && opts -> out_fd >= 0 )
     {
-        if( argc >= 4 && read_and_validate_encode_args( argv, &enc_info ) == e_success )
+        int stego_fd = open( argv[2], O_RDONLY );
+
+        if( stego_fd < 0 )
+        {
+            perror( argv[2] );
+            error = steg_err_io;
+        }
+        else
         {
-            do_encoding( &enc_info );
+            error = steg_decode_fd( &opts -> steg, stego_fd, opts -> out_fd, NULL );
+            close( stego_fd );
         }
+    }
+    else if( argc >= 3 )
+        error = steg_decode_file( &opts -> steg, argv[2], argv[3], NULL );
 
+    if( meta && meta != stderr )
+        fclose( meta );
+
+    return error;
+}
+
+/* Verifies every stego image of paths, nothing is written
+ * Returns 0 if the data of every image could be extracted and matched its checksum
+ */
+static int verify( const Options *opts, char *paths[] )
+{
+    const Reporter *reporter = &opts -> steg.reporter;
+    int failed = 0;
+
+    for( ; *paths; paths++ )
+    {
+        StegResult result = { 0 };
+        StegError error = steg_verify_file( &opts -> steg, *paths, &result );
+
+        if( error != steg_ok )
+        {
+            report_error( reporter, "%s: FAILED, %s", *paths, steg_strerror( error ) );
+            failed++;
+        }
+        else if( result.output_size != result.secret_size && result.has_index )
+            report_info( reporter, "%s: OK, %zu of %zu bytes, chunk checksums match", *paths, result.output_size, result.secret_size );
+        else if( result.output_size != result.secret_size )
+            report_info( reporter, "%s: extracted %zu of %zu bytes, no chunk index to check them", *paths, result.output_size, result.secret_size );
+        else if( result.has_crc )
+            report_info( reporter, "%s: OK, %zu bytes, CRC32C %08x", *paths, result.secret_size, result.crc );
         else
+            report_info( reporter, "%s: extracted %zu bytes, no checksum stored", *paths, result.secret_size );
+    }
+
+    return failed ? 1 : 0;
+}
+
+/* Lists the entries of the container stego on stdout, one line each */
+static int list( const Options *opts, const char *stego )
+{
+    StegEntry *entries;
+    size_t count;
+    StegError error = steg_list_file( &opts -> steg, stego, &entries, &count );
+
+    if( error != steg_ok )
+    {
+        report_error( &opts -> steg.reporter, "%s: %s", stego, steg_strerror( error ) );
+        return 1;
+    }
+
+    for( size_t i = 0; i < count; i++ )
+    {
+        if( opts -> steg.reporter.mode == r_json )
         {
-            printf("./lsb_steg: Encoding: ./lsb_steg -e <.bmp file> <.txt file> [output file]\n");
-            return 1;
+            printf( "{\"name\":" );
+            report_json_string( stdout, entries[i].name );
+            printf( ",\"offset\":%zu,\"size\":%zu,\"crc32c\":\"%08x\"}\n", entries[i].offset, entries[i].size, entries[i].crc );
         }
+        else
+            printf( "%10zu  %08x  %s\n", entries[i].size, entries[i].crc, entries[i].name );
     }
+    steg_free_entries( entries );
 
-    if( check_operation_type( argv ) ==  e_decode )
+    return 0;
+}
+
+/* Parses a whole decimal number from min to max into value
+ * Returns e_failure for anything after the digits, overflow or a number out of range
+ */
+static Status parse_int( const char *arg, long min, long max, int *value )
+{
+    char *end;
+
+    errno = 0;
+    long n = strtol( arg, &end, 10 );
+    if( end == arg || *end != '\0' || errno == ERANGE || n < min || n > max )
+    {
+        return e_failure;
+    }
+    *value = n;
+
+    return e_success;
+}
+
+/* Parses a byte count with an optional K or M suffix into size
+ * Returns e_failure for a sign, anything after the suffix or overflow
+ */
+static Status parse_size( const char *arg, size_t *size )
+{
+    char *end;
+    unsigned long long unit = 1;
+
+    // strtoull() would take "-1" as the largest count
+    if( !isdigit( ( uchar )*arg ) )
+    {
+        return e_failure;
+    }
+
+    errno = 0;
+    unsigned long long n = strtoull( arg, &end, 10 );
+    if( *end == 'K' || *end == 'k' )
+        unit = 1024, end++;
+    else if( *end == 'M' || *end == 'm' )
+        unit = 1024 * 1024, end++;
+    if( *end != '\0' || errno == ERANGE || n > SIZE_MAX / unit )
+    {
+        return e_failure;
+    }
+    *size = n * unit;
+
+    return e_success;
+}
+
+/* Parses "off:len" of --range into the context, both with the suffixes
+ * of parse_size(), len empty or 0 is up to the end of the secret
+ * Returns e_failure if there is no colon or either count does not parse
+ */
+static Status parse_range( const char *arg, StegContext *ctx )
+{
+    const char *colon = strchr( arg, ':' );
+    char offset[ 32 ];
+
+    if( colon == NULL || colon - arg >= ( long )sizeof( offset ) )
     {
-        if( argc >= 3 && read_and_validate_decode_bmp( argv, &dec_info ) == d_success )
+        return e_failure;
+    }
+    snprintf( offset, sizeof( offset ), "%.*s", ( int )( colon - arg ), arg );
+    if( parse_size( offset, &ctx -> range_offset ) != e_success )
+    {
+        return e_failure;
+    }
+    ctx -> range_length = 0;
+
+    return colon[1] == '\0' || parse_size( colon + 1, &ctx -> range_length ) == e_success ? e_success : e_failure;
+}
+
+/* Reads the first line of fd, without its line end, into key_line
+ * Returns e_failure if it cannot be read, is empty or longer than KEY_MAX
+ */
+static Status read_key( int fd )
+{
+    size_t len = 0;
+
+    // Stops at the line end, a descriptor may stay open after it
+    while( len < sizeof( key_line ) - 1 && memchr( key_line, '\n', len ) == NULL )
+    {
+        ssize_t n = read( fd, key_line + len, sizeof( key_line ) - 1 - len );
+
+        if( n < 0 && errno == EINTR )
+            continue;
+        if( n < 0 )
         {
-            do_decoding( &dec_info, argv );
+            len = 0;
+            break;
         }
+        if( n == 0 )
+            break;
+        len += n;
+    }
+    key_line[ len ] = '\0';
+    key_line[ strcspn( key_line, "\r\n" ) ] = '\0';
+    len = strlen( key_line );
 
+    return len > 0 && len <= KEY_MAX ? e_success : e_failure;
+}
+
+/* Reports a value an option does not take, parse_options() fails with it */
+static int bad_value( const char *option, const char *value, const char *expect )
+{
+    fprintf( stderr, "ERROR: %s %s is no %s\n", option, value, expect );
+
+    return -1;
+}
+
+/* Removes the "--option" style arguments from argv and applies them,
+ * so the positional arguments keep their usual indices
+ * Returns the new argc, -1 once a value does not parse
+ */
+static int parse_options( int argc, char *argv[], Options *opts )
+{
+    int out = 1;
+
+    for( int i = 1; i < argc; i++ )
+    {
+        if( strcmp( argv[i], "-q" ) == 0 || strcmp( argv[i], "--quiet" ) == 0 )
+            opts -> steg.reporter.mode = r_quiet;
+        else if( strcmp( argv[i], "--json" ) == 0 )
+            opts -> steg.reporter.mode = r_json;
+        else if( strcmp( argv[i], "--engine" ) == 0 && i + 1 < argc )
+        {
+            i++;
+            if( strcmp( argv[i], "mmap" ) == 0 )
+                opts -> steg.engine = eng_mmap;
+            else if( strcmp( argv[i], "stdio" ) == 0 )
+                opts -> steg.engine = eng_stdio;
+            else
+                return bad_value( "--engine", argv[i], "engine, stdio or mmap" );
+        }
+        else if( strcmp( argv[i], "--io" ) == 0 && i + 1 < argc )
+        {
+            i++;
+            if( strcmp( argv[i], "uring" ) == 0 )
+                opts -> steg.io = io_uring;
+            else if( strcmp( argv[i], "stdio" ) == 0 )
+                opts -> steg.io = io_stdio;
+            else
+                return bad_value( "--io", argv[i], "I/O, stdio or uring" );
+        }
+        else if( strcmp( argv[i], "--threads" ) == 0 && i + 1 < argc )
+        {
+            if( parse_int( argv[++i], 0, 1024, &opts -> steg.threads ) != e_success )
+                return bad_value( "--threads", argv[i], "thread count from 0 to 1024" );
+        }
+        else if( strcmp( argv[i], "--pipeline" ) == 0 )
+            opts -> steg.pipeline = 1;
+        else if( strcmp( argv[i], "--in-place" ) == 0 )
+            opts -> steg.in_place = 1;
+        else if( strcmp( argv[i], "--rollback" ) == 0 )
+            opts -> rollback = 1;
+        else if( strcmp( argv[i], "--compress" ) == 0 )
+            opts -> steg.codec = codec_lz;
+        else if( strcmp( argv[i], "--crc" ) == 0 )
+            opts -> steg.crc = 1;
+        else if( strcmp( argv[i], "--verify" ) == 0 )
+            opts -> verify = 1;
+        else if( strcmp( argv[i], "--pack" ) == 0 )
+            opts -> pack = 1;
+        else if( strcmp( argv[i], "--list" ) == 0 )
+            opts -> list = 1;
+        else if( strcmp( argv[i], "--extract" ) == 0 && i + 1 < argc )
+            opts -> extract = argv[++i];
+        else if( strcmp( argv[i], "--index" ) == 0 )
+            opts -> steg.index = 1;
+        else if( strcmp( argv[i], "--key-file" ) == 0 && i + 1 < argc )
+        {
+            int fd = open( argv[++i], O_RDONLY );
+            Status status = fd >= 0 ? read_key( fd ) : e_failure;
+
+            if( fd >= 0 )
+                close( fd );
+            if( status != e_success )
+                return bad_value( "--key-file", argv[i], "file starting with a key line" );
+            opts -> steg.key = key_line;
+        }
+        else if( strcmp( argv[i], "--key-fd" ) == 0 && i + 1 < argc )
+        {
+            int fd;
+
+            if( parse_int( argv[++i], 0, INT_MAX, &fd ) != e_success || read_key( fd ) != e_success )
+                return bad_value( "--key-fd", argv[i], "descriptor to read a key line from" );
+            opts -> steg.key = key_line;
+        }
+        else if( strcmp( argv[i], "--key" ) == 0 )
+        {
+            fprintf( stderr, "ERROR: --key would show the key to ps and the shell history, use --key-file <path> or --key-fd <N>\n" );
+            return -1;
+        }
+        else if( strcmp( argv[i], "--encrypt" ) == 0 )
+            opts -> steg.encrypt = 1;
+        else if( strcmp( argv[i], "--range" ) == 0 && i + 1 < argc )
+        {
+            if( parse_range( argv[++i], &opts -> steg ) != e_success )
+                return bad_value( "--range", argv[i], "<offset>:<length>" );
+        }
+        else if( strcmp( argv[i], "--bits" ) == 0 && i + 1 < argc )
+        {
+            int bits;
+
+            if( parse_int( argv[++i], 1, 8, &bits ) != e_success || ( bits & ( bits - 1 ) ) != 0 )
+                return bad_value( "--bits", argv[i], "bit count of 1, 2, 4 or 8" );
+            opts -> steg.bits = bits;
+        }
+        else if( strcmp( argv[i], "--extn" ) == 0 && i + 1 < argc )
+            opts -> steg.extn = argv[++i];
+        else if( strcmp( argv[i], "--batch" ) == 0 && i + 1 < argc )
+            opts -> batch = argv[++i];
+        else if( strcmp( argv[i], "--scan" ) == 0 )
+            opts -> scan = 1;
+        else if( strcmp( argv[i], "--results" ) == 0 && i + 1 < argc )
+            opts -> results = argv[++i];
+        else if( strcmp( argv[i], "--jobs" ) == 0 && i + 1 < argc )
+        {
+            if( parse_int( argv[++i], 0, 1024, &opts -> jobs ) != e_success )
+                return bad_value( "--jobs", argv[i], "job count from 0 to 1024" );
+        }
+        else if( strcmp( argv[i], "--meta" ) == 0 && i + 1 < argc )
+            opts -> meta = argv[++i];
+        else if( strcmp( argv[i], "--meta-fd" ) == 0 && i + 1 < argc )
+        {
+            if( parse_int( argv[++i], 0, INT_MAX, &opts -> meta_fd ) != e_success )
+                return bad_value( "--meta-fd", argv[i], "descriptor" );
+        }
+        else if( strcmp( argv[i], "--out-fd" ) == 0 && i + 1 < argc )
+        {
+            if( parse_int( argv[++i], 0, INT_MAX, &opts -> out_fd ) != e_success )
+                return bad_value( "--out-fd", argv[i], "descriptor" );
+        }
+        else if( strcmp( argv[i], "--block-size" ) == 0 && i + 1 < argc )
+        {
+            size_t size;
+
+            if( parse_size( argv[++i], &size ) != e_success || size < BLOCK_SIZE_MIN || size > BLOCK_SIZE_MAX )
+                return bad_value( "--block-size", argv[i], "size from 64K to 64M" );
+            opts -> steg.block_size = block_size_clamp( size );
+        }
+        else if( strcmp( argv[i], "--kernel" ) == 0 && i + 1 < argc )
+        {
+            if( lsb_select_kernel( argv[++i] ) == e_failure )
+                return bad_value( "--kernel", argv[i], "kernel this CPU supports, see --self-test" );
+        }
         else
+            argv[out++] = argv[i];
+    }
+    argv[out] = NULL;
+
+    return out;
+}
+
+int main( int argc, char *argv[] )
+{
+    Options opts = { 0 };
+
+    steg_context_init( &opts.steg );
+    opts.steg.reporter.mode = r_human;
+    opts.meta_fd = -1;
+    opts.out_fd = -1;
+    argc = parse_options( argc, argv, &opts );
+    if( argc < 0 )
+    {
+        return 1;
+    }
+
+    if( argv[1] != NULL && strcmp( argv[1], "--self-test" ) == 0 )
+    {
+        Status lsb = lsb_self_test();
+        Status crc = crc32c_self_test();
+        Status cipher = chacha_self_test();
+        Status kdf = sha256_self_test();
+        Status mac = poly1305_self_test();
+
+        return lsb == e_success && crc == e_success && cipher == e_success && kdf == e_success && mac == e_success ? 0 : 1;
+    }
+
+    if( opts.batch )
+    {
+        BatchOptions batch = { .manifest = opts.batch, .results = opts.results, .jobs = opts.jobs, .steg = &opts.steg };
+
+        return run_batch( &batch ) == e_success ? 0 : 1;
+    }
+
+    if( opts.scan && argc >= 2 )
+    {
+        ScanOptions scan = { .roots = argv + 1, .results = opts.results, .jobs = opts.jobs, .steg = &opts.steg };
+
+        // Messages must not mix into results on stdout
+        if( opts.results == NULL || strcmp( opts.results, "-" ) == 0 )
+            opts.steg.reporter.out = stderr;
+
+        return run_scan( &scan ) == e_success ? 0 : 1;
+    }
+
+    if( opts.verify && argc >= 2 )
+    {
+        return verify( &opts, argv + 1 );
+    }
+
+    if( opts.rollback && argc >= 2 )
+    {
+        int failed = 0;
+
+        for( int i = 1; i < argc; i++ )
+        {
+            StegError error = steg_rollback_file( &opts.steg, argv[i] );
+
+            if( error != steg_ok )
+            {
+                report_error( &opts.steg.reporter, "%s: %s", argv[i], error == steg_err_args ? "no undo record" : steg_strerror( error ) );
+                failed = 1;
+            }
+        }
+        return failed;
+    }
+
+    // In place there is no output file, the files follow the image
+    if( opts.pack )
+    {
+        int first = opts.steg.in_place ? 2 : 3;
+        StegError error = argc > first ? steg_pack_files( &opts.steg, argv[1], ( const char *const * )argv + first, argc - first,
+                                                          opts.steg.in_place ? NULL : argv[2], NULL ) : steg_err_args;
+
+        if( error == steg_err_args )
+        {
+            printf("./lsb_steg: Packing: ./lsb_steg --pack <.bmp file> <output file> <file>... | --pack --in-place <.bmp file> <file>...\n");
+        }
+        else if( error != steg_ok )
+        {
+            report_error( &opts.steg.reporter, "%s: %s", argv[1], steg_strerror( error ) );
+        }
+        return error == steg_ok ? 0 : 1;
+    }
+
+    // Messages must not mix into the listing or the entry on stdout
+    if( opts.list && argc >= 2 )
+    {
+        opts.steg.reporter.out = stderr;
+        return list( &opts, argv[1] );
+    }
+
+    if( opts.extract && argc >= 2 )
+    {
+        if( argc >= 3 && strcmp( argv[2], "-" ) == 0 )
+            opts.steg.reporter.out = stderr;
+
+        StegError error = steg_extract_file( &opts.steg, argv[1], opts.extract, argv[2], NULL );
+
+        if( error != steg_ok )
+            report_error( &opts.steg.reporter, "%s: %s", opts.extract, steg_strerror( error ) );
+        return error == steg_ok ? 0 : 1;
+    }
+
+    if( check_operation_type( argv ) ==  e_encode )
+    {
+        StegError error = argc >= 4 ? steg_encode_file( &opts.steg, argv[2], argv[3], argv[4], NULL ) : steg_err_args;
+
+        if( error == steg_err_args )
+        {
+            printf("./lsb_steg: Encoding: ./lsb_steg -e <.bmp file> <.txt file> [output file] | --in-place, without one\n");
+        }
+        else if( error != steg_ok )
+        {
+            report_error( &opts.steg.reporter, "%s: %s%s", argv[2], steg_strerror( error ), error == steg_err_pending ? ", see --rollback" : "" );
+        }
+        return error == steg_ok ? 0 : 1;
+    }
+
+    if( check_operation_type( argv ) ==  e_decode )
+    {
+        // Messages must not mix into decoded data on stdout
+        if( opts.out_fd == STDOUT_FILENO || ( opts.out_fd < 0 && argc >= 4 && strcmp( argv[3], "-" ) == 0 ) )
+            opts.steg.reporter.out = stderr;
+
+        StegError error = decode( &opts, argc, argv );
+
+        if( error == steg_err_args )
+        {
+            fprintf( opts.steg.reporter.out, "./lsb_steg: Decoding: ./lsb_steg -d <.bmp file> [output file|-] [--out-fd <N>] [--meta <file|-> | --meta-fd <N>] [--range <offset>:<length>]\n");
+        }
+        else if( error != steg_ok )
         {
-            printf("./lsb_steg: Decoding: ./lsb_steg -d <.bmp file> [output file]\n");
-            return 1;
+            report_error( &opts.steg.reporter, "%s: %s", argv[2], steg_strerror( error ) );
         }
+        return error == steg_ok ? 0 : 1;
     }
 
 
     if( check_operation_type( argv ) ==  e_unsupported )
     {
         printf("./lsb_steg: Encoding: ./lsb_steg -e <.bmp file> <.txt file> [output file]");
-        printf("\n./lsb_steg: Decoding: ./lsb_steg -d <.bmp file> [output file]\n");
+        printf("\n./lsb_steg: Stdin:    ./lsb_steg -e <.bmp file> - [output file] [--extn <.ext, default .bin>]");
+        printf("\n./lsb_steg: Decoding: ./lsb_steg -d <.bmp file> [output file]");
+        printf("\n./lsb_steg: Stdout:   ./lsb_steg -d <.bmp file> - | --out-fd <N> [--meta <file|-> | --meta-fd <N>]");
+        printf("\n./lsb_steg: Batch:    ./lsb_steg --batch <manifest.jsonl|.csv> [--results <file|->] [--jobs <N>]");
+        printf("\n./lsb_steg: Scan:     ./lsb_steg --scan <dir|.bmp file>... [--results <file|->] [--jobs <N>]");
+        printf("\n./lsb_steg: Range:    ./lsb_steg -d <.bmp file> [output file|-] --range <offset>:<length, 0 to the end>");
+        printf("\n./lsb_steg: Verify:   ./lsb_steg --verify <.bmp file>..., extracts through the CRC32C, writes nothing");
+        printf("\n./lsb_steg: Pack:     ./lsb_steg --pack <.bmp file> <output file> <file>..., many files behind a table of contents");
+        printf("\n./lsb_steg: List:     ./lsb_steg --list <.bmp file>, the entries of a packed image");
+        printf("\n./lsb_steg: Extract:  ./lsb_steg --extract <name> <.bmp file> [output file|-], decodes that entry only");
+        printf("\n./lsb_steg: In place: ./lsb_steg -e <.bmp file> <.txt file> --in-place, rewrites only the encoded rows, not with a key");
+        printf("\n./lsb_steg: Rollback: ./lsb_steg --rollback <.bmp file>..., restores images an in-place encode left half done");
+        printf("\n./lsb_steg: Options:  -q, --quiet | --json | --kernel <avx512|avx2|sse2|pdep|lut> | --engine <stdio|mmap>");
+        printf("\n./lsb_steg:           --block-size <64K..64M> | --threads <N, 0 for one per CPU>");
+        printf("\n./lsb_steg:           --io <stdio|uring>, image blocks of the stdio engine read ahead and written behind");
+        printf("\n./lsb_steg:           --pipeline, raw data read, embedded and written by three threads at once");
+        printf("\n./lsb_steg:           --bits <1|2|4|8, payload bits per image byte when encoding> | --compress");
+        printf("\n./lsb_steg:           --crc, encode a CRC32C of the secret, which older decoders cannot read");
+        printf("\n./lsb_steg:           --index, encode a chunk index so ranges decode on their own and are checked");
+        printf("\n./lsb_steg:           --key-file <path> | --key-fd <N>, scatter the data over the whole image with the key");
+        printf("\n./lsb_steg:           on the first line there, decodes need the same key; it is never taken on the command line");
+        printf("\n./lsb_steg:           --encrypt, also encrypt the data with ChaCha20 of the stretched key and tag it with Poly1305");
+        printf("\n./lsb_steg: Kernels:  ./lsb_steg --self-test\n");
         return 1;
     }
 
@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mmap_engine.h"
+#include "lsb.h"
+#include "fcopy.h"
+#include "blockio.h"
+#include "crc32c.h"
+#include "types.h"
+
+#ifndef MAP_POPULATE
+#define MAP_POPULATE 0
+#endif
+
+/* Function Definitions */
+
+/* Maps a whole file read only for one sequential pass
+ * Returns the mapping or NULL with errno set, the size is stored in size
+ */
+static uchar *map_input( FILE *fptr, size_t *size )
+{
+    struct stat st;
+    int fd = fileno( fptr );
+
+    if( fstat( fd, &st ) != 0 )
+    {
+        return NULL;
+    }
+    if( st.st_size == 0 )
+    {
+        errno = EINVAL; // As mmap() itself would
+        return NULL;
+    }
+
+    void *map = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0 );
+    if( map == MAP_FAILED )
+    {
+        return NULL;
+    }
+    madvise( map, st.st_size, MADV_SEQUENTIAL );
+
+    *size = st.st_size;
+    return map;
+}
+
+/* Preallocates an output file of size bytes and maps it for writing
+ * A file that cannot be mapped is cut back to the size it had
+ * Returns the mapping or NULL with errno set
+ */
+static uchar *map_output( FILE *fptr, size_t size )
+{
+    int fd = fileno( fptr );
+    struct stat st;
+
+    if( size == 0 || fstat( fd, &st ) != 0 )
+    {
+        return NULL;
+    }
+
+    // Blocks are reserved up front, the file is never extended through the map
+    if( posix_fallocate( fd, 0, size ) != 0 && ftruncate( fd, size ) != 0 )
+    {
+        return NULL;
+    }
+
+    void *map = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if( map == MAP_FAILED )
+    {
+        int error = errno;
+
+        if( ftruncate( fd, st.st_size ) == 0 )
+            errno = error; // Else the file is left preallocated, which is worth reporting first
+        return NULL;
+    }
+    madvise( map, size, MADV_SEQUENTIAL );
+
+    return map;
+}
+
+/* Map source image and secret file, size and map the stego image */
+Status map_encode_files( EncodeInfo *encInfo )
+{
+    size_t secret_size;
+
+    encInfo -> src_map = map_input( encInfo -> fptr_src_image, &encInfo -> map_size );
+    if( encInfo -> src_map == NULL )
+    {
+        report_info( encInfo -> reporter, "Unable to map file %s: %s", encInfo -> src_image_fname, strerror( errno ) );
+        return e_failure;
+    }
+
+    // A streamed secret is read through its stream, see encode_secret_stream()
+    encInfo -> secret_map = encInfo -> streaming ? NULL : map_input( encInfo -> fptr_secret, &secret_size );
+    if( encInfo -> secret_map == NULL && !encInfo -> streaming )
+    {
+        report_info( encInfo -> reporter, "Unable to map file %s: %s", encInfo -> secret_fname, strerror( errno ) );
+        return e_failure;
+    }
+
+    encInfo -> stego_map = map_output( encInfo -> fptr_stego_image, encInfo -> map_size );
+    if( encInfo -> stego_map == NULL )
+    {
+        report_info( encInfo -> reporter, "Unable to map file %s: %s", encInfo -> stego_image_fname, strerror( errno ) );
+        return e_failure;
+    }
+
+    encInfo -> carrier_pos = 0;
+
+    return e_success;
+}
+
+/* Copies the header up to the first row, like the tail below */
+Status map_copy_bmp_header( EncodeInfo *encInfo )
+{
+    size_t header_size = encInfo -> bmp.data_offset;
+
+    if( encInfo -> map_size < header_size )
+    {
+        return e_failure;
+    }
+
+    if( encInfo -> engine == eng_memory || copy_file_region( fileno( encInfo -> fptr_src_image ), 0, fileno( encInfo -> fptr_stego_image ), 0, header_size ) != e_success )
+    {
+        if( encInfo -> stego_map != encInfo -> src_map ) // Caller buffers may be encoded in place
+            memcpy( encInfo -> stego_map, encInfo -> src_map, header_size );
+    }
+    encInfo -> carrier_pos = 0;
+
+    return e_success;
+}
+
+/* Embeds the secret file from its map, a chunk at a time for progress */
+Status map_encode_secret_file_data( EncodeInfo *encInfo )
+{
+    const uchar *secret = encInfo -> secret_map;
+    size_t size = encInfo -> size_secret_file;
+    size_t chunk = block_size_clamp( encInfo -> block_size ) / LSB_CARRIER( 1, encInfo -> bits );
+
+    progress_begin( &encInfo -> progress, encInfo -> reporter, "Encoding data", size );
+
+    for( size_t done = 0; done < size; done += chunk )
+    {
+        if( chunk > size - done )
+            chunk = size - done;
+
+        encode_bits_to_image( ( const char * )secret + done, chunk, encInfo -> bits, encInfo );
+        encInfo -> data_crc = crc32c( encInfo -> data_crc, secret + done, chunk ); // While the chunk is in cache
+        if( index_secret_data( secret + done, chunk, encInfo ) != e_success )
+        {
+            progress_end( &encInfo -> progress );
+            return e_failure;
+        }
+        progress_update( &encInfo -> progress, done + chunk );
+    }
+
+    progress_end( &encInfo -> progress );
+
+    return e_success;
+}
+
+/* Copies the bytes after the encoded region with copy_file_region(),
+ * reflinked or through the page cache shared with the stego map when the
+ * kernel can, else between the maps
+ */
+Status map_copy_remaining_img_data( EncodeInfo *encInfo )
+{
+    size_t pos = bmp_offset( &encInfo -> bmp, encInfo -> carrier_pos );
+    size_t len = encInfo -> map_size - pos;
+
+    if( encInfo -> engine == eng_memory || copy_file_region( fileno( encInfo -> fptr_src_image ), pos, fileno( encInfo -> fptr_stego_image ), pos, len ) != e_success )
+    {
+        if( encInfo -> stego_map != encInfo -> src_map )
+            memcpy( encInfo -> stego_map + pos, encInfo -> src_map + pos, len );
+    }
+    encInfo -> carrier_pos = encInfo -> bmp.capacity;
+
+    return e_success;
+}
+
+/* Unmap everything mapped by map_encode_files() */
+void map_encode_close( EncodeInfo *encInfo )
+{
+    // Caller buffers of eng_memory are only forgotten
+    if( encInfo -> engine == eng_memory )
+    {
+        encInfo -> src_map = encInfo -> secret_map = NULL;
+        encInfo -> stego_map = NULL;
+        return;
+    }
+
+    if( encInfo -> src_map )
+        munmap( ( void * )encInfo -> src_map, encInfo -> map_size );
+    if( encInfo -> secret_map )
+        munmap( ( void * )encInfo -> secret_map, encInfo -> size_secret_file );
+    if( encInfo -> stego_map )
+        munmap( encInfo -> stego_map, encInfo -> map_size );
+
+    encInfo -> src_map = encInfo -> secret_map = NULL;
+    encInfo -> stego_map = NULL;
+}
+
+/* Map the stego image, setup_stego() parses its layout */
+Status map_stego( DecodeInfo *decInfo )
+{
+    decInfo -> stego_map = map_input( decInfo -> fptr_stego_image, &decInfo -> map_size );
+    if( decInfo -> stego_map == NULL )
+    {
+        report_info( decInfo -> reporter, "Unable to map file %s: %s", decInfo -> stego_image_fname, strerror( errno ) );
+        return d_failure;
+    }
+    if( decInfo -> map_size < BMP_HEADER_MIN )
+    {
+        report_info( decInfo -> reporter, "File %s is too small for a BMP header", decInfo -> stego_image_fname );
+        return d_failure;
+    }
+
+    return d_success;
+}
+
+/* Decode the secret data from the stego map straight into a mapped output file
+ * Verification decodes every chunk into the same buffer instead, there is no output
+ */
+Status map_decode_file_data( DecodeInfo *decInfo )
+{
+    size_t size = decInfo -> file_size;
+    size_t chunk = block_size_clamp( decInfo -> block_size ) / LSB_CARRIER( 1, decInfo -> bits );
+    uchar *out = NULL;
+    uchar *scratch = NULL;
+
+    if( decInfo -> verify )
+    {
+        scratch = malloc( chunk );
+        if( scratch == NULL )
+        {
+            return d_failure;
+        }
+    }
+    else if( decInfo -> engine == eng_memory )
+    {
+        out = decInfo -> secret_map; // Caller buffer, sized by the caller
+    }
+    else if( size > 0 )
+    {
+        out = map_output( decInfo -> fptr_secret, size );
+        if( out == NULL )
+        {
+            report_info( decInfo -> reporter, "Unable to map file %s: %s", decInfo -> secret_fname, strerror( errno ) );
+            return d_failure;
+        }
+    }
+
+    progress_begin( &decInfo -> progress, decInfo -> reporter, decInfo -> verify ? "Verifying data" : "Decoding data", size );
+
+    Status status = d_success;
+    for( size_t done = 0; done < size && status == d_success; done += chunk )
+    {
+        if( chunk > size - done )
+            chunk = size - done;
+
+        uchar *data = scratch ? scratch : out + done;
+
+        status = decode_data_bits( decInfo, ( char * )data, chunk, decInfo -> bits );
+        decInfo -> data_crc = crc32c( decInfo -> data_crc, data, chunk ); // While the chunk is in cache
+        progress_update( &decInfo -> progress, done + chunk );
+    }
+
+    progress_end( &decInfo -> progress );
+    free( scratch );
+
+    if( out && decInfo -> engine != eng_memory )
+        munmap( out, size );
+
+    return status;
+}
+
+/* Unmap the stego image */
+void map_decode_close( DecodeInfo *decInfo )
+{
+    if( decInfo -> stego_map && decInfo -> engine != eng_memory )
+        munmap( ( void * )decInfo -> stego_map, decInfo -> map_size );
+
+    decInfo -> stego_map = NULL;
+}
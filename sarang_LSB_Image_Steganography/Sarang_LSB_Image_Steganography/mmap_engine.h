@@ -0,0 +1,46 @@
+#ifndef MMAP_ENGINE_H
+#define MMAP_ENGINE_H
+
+#include "types.h" // Contains user defined types
+#include "encode.h"
+#include "decode.h"
+
+/*
+ * Memory mapped engine
+ * Runs the LSB kernels straight over mapped images instead of
+ * copying through stdio buffers. Selected with --engine mmap, the
+ * files are still opened by open_files() / open_stego() / open_secret()
+ * and mapped through their descriptors.
+ * The libsteg memory calls reuse it with eng_memory, where the maps
+ * are caller buffers and there are no files behind them.
+ */
+
+/* Encoding side */
+
+/* Map source image and secret file, size and map the stego image */
+Status map_encode_files( EncodeInfo *encInfo );
+
+/* Copy bmp header between the maps */
+Status map_copy_bmp_header( EncodeInfo *encInfo );
+
+/* Embed the secret file straight from its map */
+Status map_encode_secret_file_data( EncodeInfo *encInfo );
+
+/* Copy remaining image bytes between the maps */
+Status map_copy_remaining_img_data( EncodeInfo *encInfo );
+
+/* Unmap everything mapped by map_encode_files() */
+void map_encode_close( EncodeInfo *encInfo );
+
+/* Decoding side */
+
+/* Map the stego image, positioned after the header */
+Status map_stego( DecodeInfo *decInfo );
+
+/* Decode the secret data from the stego map straight into a mapped output file */
+Status map_decode_file_data( DecodeInfo *decInfo );
+
+/* Unmap the stego image */
+void map_decode_close( DecodeInfo *decInfo );
+
+#endif
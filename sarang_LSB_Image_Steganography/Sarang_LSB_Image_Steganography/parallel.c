@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "parallel.h"
+#include "pool.h"
+#include "blockio.h"
+#include "encode.h"
+#include "decode.h"
+#include "lsb.h"
+#include "bmp.h"
+#include "crc32c.h"
+#include "types.h"
+
+/* Shared state of one parallel encode or decode */
+typedef struct _ParallelJob
+{
+    ProgressState *progress;    // Only updated by worker 0
+    int data_fd;                // Secret file, read on encode and written on decode, -1 to verify
+    off_t data_base;            // Offset of data byte 0 in data_fd, where a decode found it
+    int image_fd;               // Image read from
+    int stego_fd;               // Image written to, encode only
+    const BmpInfo *bmp;         // Layout of the image rows
+    size_t data_pos;            // Carrier byte of data byte 0
+    size_t size;                // Data bytes
+    int bits;                   // Payload bits per carrier byte
+    uchar **data_buf;           // Per worker chunk buffers
+    uchar **image_buf;
+    uint32_t *chunk_crc;        // CRC32C of every chunk's data
+    uint32_t crc;               // CRC32C of the data before, then with all chunks
+    ChunkIndex *index;          // Entries of the chunk index to fill, encode only, may be NULL
+    atomic_size_t done;         // Data bytes finished so far
+} ParallelJob;
+
+/* Function Definitions */
+
+/* Data length of chunk, the last one may be short */
+static size_t chunk_len( const ParallelJob *job, size_t chunk )
+{
+    size_t start = chunk * PARALLEL_CHUNK;
+
+    return job -> size - start < PARALLEL_CHUNK ? job -> size - start : PARALLEL_CHUNK;
+}
+
+/* Counts finished bytes, progress is reported by worker 0 only */
+static void chunk_done( ParallelJob *job, int worker, size_t len )
+{
+    size_t done = atomic_fetch_add( &job -> done, len ) + len;
+
+    if( worker == 0 )
+        progress_update( job -> progress, done );
+}
+
+/* First carrier byte of chunk and the file range its carrier bytes span */
+static size_t chunk_span( const ParallelJob *job, size_t chunk, size_t len, off_t *image_off, size_t *image_len )
+{
+    size_t pos = job -> data_pos + LSB_CARRIER( chunk * PARALLEL_CHUNK, job -> bits );
+
+    *image_off = bmp_offset( job -> bmp, pos );
+    *image_len = bmp_offset( job -> bmp, pos + LSB_CARRIER( len, job -> bits ) ) - *image_off;
+
+    return pos;
+}
+
+/* Encodes one chunk: secret and image in, image out */
+static int encode_chunk( size_t chunk, int worker, void *arg )
+{
+    ParallelJob *job = arg;
+    size_t len = chunk_len( job, chunk );
+    size_t start = chunk * PARALLEL_CHUNK;
+    uchar *data = job -> data_buf[ worker ];
+    uchar *image = job -> image_buf[ worker ];
+    off_t image_off;
+    size_t image_len;
+    size_t pos = chunk_span( job, chunk, len, &image_off, &image_len );
+
+    if( pread_full( job -> data_fd, data, len, start ) != 0 ||
+        pread_full( job -> image_fd, image, image_len, image_off ) != 0 )
+    {
+        return -1;
+    }
+
+    // Row padding in the span is written back as read
+    bmp_embed( job -> bmp, job -> bits, data, len, pos, image, image, image_off );
+
+    // Chunks hold whole index chunks, whose entries make up the chunk's checksum
+    if( job -> index )
+    {
+        uint32_t crc = 0;
+
+        for( size_t off = 0; off < len; off += INDEX_CHUNK )
+        {
+            size_t n = len - off < INDEX_CHUNK ? len - off : INDEX_CHUNK;
+            uint32_t entry = crc32c( 0, data + off, n );
+
+            job -> index -> crc[ ( start + off ) / INDEX_CHUNK ] = entry;
+            crc = crc32c_combine( crc, entry, n );
+        }
+        job -> chunk_crc[ chunk ] = crc;
+    }
+    else
+        job -> chunk_crc[ chunk ] = crc32c( 0, data, len );
+
+    if( pwrite_full( job -> stego_fd, image, image_len, image_off ) != 0 )
+    {
+        return -1;
+    }
+
+    chunk_done( job, worker, len );
+
+    return 0;
+}
+
+/* Decodes one chunk: image in, secret out */
+static int decode_chunk( size_t chunk, int worker, void *arg )
+{
+    ParallelJob *job = arg;
+    size_t len = chunk_len( job, chunk );
+    size_t start = chunk * PARALLEL_CHUNK;
+    uchar *data = job -> data_buf[ worker ];
+    uchar *image = job -> image_buf[ worker ];
+    off_t image_off;
+    size_t image_len;
+    size_t pos = chunk_span( job, chunk, len, &image_off, &image_len );
+
+    if( pread_full( job -> image_fd, image, image_len, image_off ) != 0 )
+    {
+        return -1;
+    }
+
+    bmp_extract( job -> bmp, job -> bits, image, image_off, pos, len, data );
+    job -> chunk_crc[ chunk ] = crc32c( 0, data, len );
+
+    if( job -> data_fd >= 0 && pwrite_full( job -> data_fd, data, len, job -> data_base + start ) != 0 )
+    {
+        return -1;
+    }
+
+    chunk_done( job, worker, len );
+
+    return 0;
+}
+
+/* Runs task over all chunks of job and reports how the threads scaled
+ * The chunk checksums are folded into job -> crc in data order
+ */
+static Status run_job( ParallelJob *job, int threads, PoolTask task, const Reporter *reporter, const char *what )
+{
+    size_t chunks = ( job -> size + PARALLEL_CHUNK - 1 ) / PARALLEL_CHUNK;
+    int workers = pool_workers( threads, chunks );
+    Status status = e_failure;
+
+    job -> data_buf = calloc( workers, sizeof( uchar * ) );
+    job -> image_buf = calloc( workers, sizeof( uchar * ) );
+    job -> chunk_crc = calloc( chunks ? chunks : 1, sizeof( uint32_t ) );
+    PoolWorkerStats *stats = calloc( workers, sizeof( PoolWorkerStats ) );
+
+    if( job -> data_buf && job -> image_buf && job -> chunk_crc && stats )
+    {
+        status = e_success;
+        for( int i = 0; i < workers && status == e_success; i++ )
+        {
+            job -> data_buf[i] = malloc( PARALLEL_CHUNK );
+            job -> image_buf[i] = malloc( bmp_file_bound( job -> bmp, LSB_CARRIER( PARALLEL_CHUNK, job -> bits ) ) );
+            if( job -> data_buf[i] == NULL || job -> image_buf[i] == NULL )
+                status = e_failure;
+        }
+    }
+
+    if( status == e_success )
+    {
+        double start = report_now();
+
+        status = pool_run( workers, chunks, task, job, stats );
+
+        // Scaling report: totals, then what each worker did
+        double elapsed = report_now() - start;
+        report_info( reporter, "%s %zu bytes with %d threads in %.3fs (%.2f MB/s)",
+                     what, job -> size, workers, elapsed, elapsed > 0 ? job -> size / elapsed / 1e6 : 0.0 );
+        for( int i = 0; i < workers; i++ )
+        {
+            report_info( reporter, "Thread %d: %zu chunks, %zu steals, busy %.3fs",
+                         i, stats[i].tasks, stats[i].steals, stats[i].busy );
+        }
+
+        for( size_t i = 0; i < chunks && status == e_success; i++ )
+            job -> crc = crc32c_combine( job -> crc, job -> chunk_crc[i], chunk_len( job, i ) );
+    }
+
+    for( int i = 0; i < workers && job -> data_buf && job -> image_buf; i++ )
+    {
+        free( job -> data_buf[i] );
+        free( job -> image_buf[i] );
+    }
+    free( job -> data_buf );
+    free( job -> image_buf );
+    free( job -> chunk_crc );
+    free( stats );
+
+    return status;
+}
+
+/* Encode the secret file data with encInfo -> threads workers */
+Status parallel_encode_secret_file_data( EncodeInfo *encInfo )
+{
+    BlockBuffer *block = &encInfo -> image_block;
+    ParallelJob job = { 0 };
+
+    // The block may hold bytes read ahead, carrier_pos is where the data starts
+    job.bmp = &encInfo -> bmp;
+    job.data_pos = encInfo -> carrier_pos;
+
+    // Everything before the data has to reach the file before the workers write
+    if( flush_image_block( encInfo ) != e_success || fflush( encInfo -> fptr_stego_image ) != 0 )
+    {
+        return e_failure;
+    }
+
+    job.progress = &encInfo -> progress;
+    job.data_fd = fileno( encInfo -> fptr_secret );
+    job.image_fd = fileno( encInfo -> fptr_src_image );
+    job.stego_fd = fileno( encInfo -> fptr_stego_image );
+    job.size = encInfo -> size_secret_file;
+    job.bits = encInfo -> bits;
+    job.crc = encInfo -> data_crc;
+    job.index = encInfo -> index ? &encInfo -> chunk_index : NULL; // Reserved by check_capacity()
+
+    progress_begin( &encInfo -> progress, encInfo -> reporter, "Encoding data", job.size );
+    Status status = run_job( &job, encInfo -> threads, encode_chunk, encInfo -> reporter, "Encoded" );
+    progress_end( &encInfo -> progress );
+
+    if( status != e_success )
+    {
+        return e_failure;
+    }
+    encInfo -> data_crc = job.crc;
+    if( job.index )
+    {
+        job.index -> count = chunk_index_entries( codec_none, job.size );
+        job.index -> raw = job.size;
+    }
+
+    // Both streams continue after the encoded data
+    encInfo -> carrier_pos = job.data_pos + LSB_CARRIER( job.size, job.bits );
+    off_t end = bmp_offset( job.bmp, encInfo -> carrier_pos );
+    if( fseeko( encInfo -> fptr_src_image, end, SEEK_SET ) != 0 || fseeko( encInfo -> fptr_stego_image, end, SEEK_SET ) != 0 )
+    {
+        return e_failure;
+    }
+    block -> base = end;
+
+    return e_success;
+}
+
+/* Decode the secret file data with decInfo -> threads workers, or only
+ * check it against its checksum if decInfo -> verify is set
+ */
+Status parallel_decode_file_data( DecodeInfo *decInfo )
+{
+    ParallelJob job = { 0 };
+
+    // The block may hold bytes read ahead, carrier_pos is where the data starts
+    job.bmp = &decInfo -> bmp;
+    job.data_pos = decInfo -> carrier_pos;
+
+    job.progress = &decInfo -> progress;
+    job.data_fd = decInfo -> verify ? -1 : fileno( decInfo -> fptr_secret );
+    job.image_fd = fileno( decInfo -> fptr_stego_image );
+    job.stego_fd = -1;
+    job.size = decInfo -> file_size;
+    job.bits = decInfo -> bits;
+    job.crc = decInfo -> data_crc;
+
+    // Size the output up front, workers fill it in any order after what the
+    // descriptor already holds, stdout redirected after a prefix included
+    if( job.data_fd >= 0 )
+    {
+        struct stat st;
+
+        if( fflush( decInfo -> fptr_secret ) != 0 || ( job.data_base = lseek( job.data_fd, 0, SEEK_CUR ) ) < 0 ||
+            fstat( job.data_fd, &st ) != 0 ||
+            ( st.st_size < job.data_base + ( off_t )job.size && ftruncate( job.data_fd, job.data_base + job.size ) != 0 ) )
+        {
+            report_info( decInfo -> reporter, "Unable to size %s: %s", decInfo -> secret_fname, strerror( errno ) );
+            return d_failure;
+        }
+    }
+
+    progress_begin( &decInfo -> progress, decInfo -> reporter, decInfo -> verify ? "Verifying data" : "Decoding data", job.size );
+    Status status = run_job( &job, decInfo -> threads, decode_chunk, decInfo -> reporter, decInfo -> verify ? "Verified" : "Decoded" );
+    progress_end( &decInfo -> progress );
+
+    if( status != e_success || ( job.data_fd >= 0 && fseeko( decInfo -> fptr_secret, job.data_base + job.size, SEEK_SET ) != 0 ) )
+    {
+        return d_failure;
+    }
+    decInfo -> data_crc = job.crc;
+
+    return d_success;
+}
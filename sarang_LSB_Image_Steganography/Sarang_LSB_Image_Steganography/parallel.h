@@ -0,0 +1,31 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "types.h" // Contains user defined types
+#include "encode.h"
+#include "decode.h"
+
+/*
+ * Multithreaded encoding and decoding
+ * Data byte i of the secret file always sits at carrier byte
+ * data_pos + i * 8 / bits, so the data is cut into cache sized chunks
+ * that the work stealing pool in pool.c handles independently. The file
+ * range of a chunk's carrier bytes, row padding included, is read and
+ * written with pread() / pwrite() at its final offset, so the output is
+ * byte identical to the serial path.
+ */
+
+#define PARALLEL_CHUNK ( 32 * 1024 ) // Data bytes per chunk, whole INDEX_CHUNKs, image chunks are 8 / bits times that
+
+/* Encode the secret file data with encInfo -> threads workers
+ * The header and the fields before the data must already be encoded
+ */
+Status parallel_encode_secret_file_data( EncodeInfo *encInfo );
+
+/* Decode the secret file data with decInfo -> threads workers
+ * The fields before the data must already be decoded, with
+ * decInfo -> verify nothing is written, the data only goes through its checksum
+ */
+Status parallel_decode_file_data( DecodeInfo *decInfo );
+
+#endif
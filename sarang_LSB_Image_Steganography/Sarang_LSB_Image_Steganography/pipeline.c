@@ -0,0 +1,431 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "pipeline.h"
+#include "blockio.h"
+#include "encode.h"
+#include "decode.h"
+#include "lsb.h"
+#include "bmp.h"
+#include "crc32c.h"
+#include "report.h"
+#include "types.h"
+
+#define PIPELINE_SPIN 256   // Empty checks of a ring before sleeping on it
+
+/* Stages */
+enum
+{
+    stage_read,
+    stage_kernel,
+    stage_write,
+    stage_count
+};
+
+/* One preallocated slot: a data chunk and the image span of its carrier bytes */
+typedef struct _PipeSlot
+{
+    uchar *data;
+    uchar *image;
+    size_t len;         // Data bytes
+    size_t pos;         // Carrier byte of data[0]
+    off_t image_off;    // File offset of image[0]
+    size_t image_len;
+} PipeSlot;
+
+/* Single producer, single consumer ring of slot numbers
+ * Only PIPELINE_SLOTS slots exist, so a push always finds room
+ */
+typedef struct _PipeRing
+{
+    atomic_uint tail __attribute__(( aligned( 64 ) )); // Pushed so far, written by the producer only
+    atomic_uint wake;       // Futex word, bumped when a sleeping consumer has to look again
+    atomic_int sleeping;    // The consumer is about to sleep or sleeps
+    unsigned head __attribute__(( aligned( 64 ) ));    // Popped so far, consumer only
+    int slots[ PIPELINE_SLOTS ];
+} PipeRing;
+
+/* Shared state of one pipelined encode or decode */
+typedef struct _Pipeline
+{
+    EncodeInfo *encInfo;        // Set for encodes
+    DecodeInfo *decInfo;        // Set for decodes
+    ProgressState *progress;    // Updated by the kernel stage
+    int data_fd;                // Secret file, read on encode and written in order on decode, -1 to verify
+    int image_fd;               // Image read from
+    int stego_fd;               // Image written to, encode only
+    const BmpInfo *bmp;         // Layout of the image rows
+    size_t data_pos;            // Carrier byte of data byte 0
+    size_t size;                // Data bytes
+    int bits;                   // Payload bits per carrier byte
+    size_t chunk_size;          // Data bytes per slot
+    size_t chunks;
+    PipeSlot slots[ PIPELINE_SLOTS ];
+    PipeRing free;              // Writer to reader
+    PipeRing read;              // Reader to kernel
+    PipeRing done;              // Kernel to writer
+    atomic_int failed;          // Set by the first stage that fails, stops the others
+    const char *failure;        // What that stage failed to do, NULL if it is not worth a message
+    int error;                  // And errno then
+    double busy[ stage_count ]; // Seconds each stage worked, each written by its own stage
+    double idle[ stage_count ]; // And waited on its ring
+} Pipeline;
+
+/* Function Definitions */
+
+/* Sleeps while *word is still val */
+static void futex_wait( atomic_uint *word, unsigned val )
+{
+    syscall( SYS_futex, word, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0 );
+}
+
+/* Wakes every thread sleeping on word */
+static void futex_wake( atomic_uint *word )
+{
+    syscall( SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0 );
+}
+
+/* Makes a consumer sleeping on ring look again */
+static void ring_kick( PipeRing *ring )
+{
+    atomic_fetch_add( &ring -> wake, 1 );
+    futex_wake( &ring -> wake );
+}
+
+/* Hands slot to the consumer of ring */
+static void ring_push( PipeRing *ring, int slot )
+{
+    unsigned tail = atomic_load_explicit( &ring -> tail, memory_order_relaxed );
+
+    ring -> slots[ tail & ( PIPELINE_SLOTS - 1 ) ] = slot;
+    atomic_store( &ring -> tail, tail + 1 ); // Ordered before the load of sleeping, see ring_pop()
+
+    if( atomic_load( &ring -> sleeping ) )
+        ring_kick( ring );
+}
+
+/* Takes the next slot of ring, waiting for one if it is empty
+ * Returns -1 once the pipeline has failed
+ */
+static int ring_pop( Pipeline *pipe, PipeRing *ring, int stage )
+{
+    unsigned head = ring -> head;
+    double start = 0;
+
+    for( int spin = 0; atomic_load_explicit( &ring -> tail, memory_order_acquire ) == head; spin++ )
+    {
+        if( atomic_load( &pipe -> failed ) )
+        {
+            return -1;
+        }
+        if( spin < PIPELINE_SPIN )
+            continue;
+        if( spin == PIPELINE_SPIN )
+            start = report_now();
+
+        // A push after the load of wake either sees sleeping set or changes wake, so the wait returns
+        unsigned wake = atomic_load( &ring -> wake );
+        atomic_store( &ring -> sleeping, 1 );
+        if( atomic_load( &ring -> tail ) == head && !atomic_load( &pipe -> failed ) )
+            futex_wait( &ring -> wake, wake );
+        atomic_store( &ring -> sleeping, 0 );
+    }
+    if( start > 0 )
+        pipe -> idle[ stage ] += report_now() - start;
+
+    int slot = ring -> slots[ head & ( PIPELINE_SLOTS - 1 ) ];
+    ring -> head = head + 1;
+
+    return slot;
+}
+
+/* Stops every stage, the first failure wins and keeps what and errno
+ * for run_pipeline() to report
+ */
+static void pipeline_fail( Pipeline *pipe, const char *what )
+{
+    int error = errno;
+
+    if( atomic_exchange( &pipe -> failed, 1 ) == 0 )
+    {
+        pipe -> failure = what;
+        pipe -> error = error;
+    }
+    ring_kick( &pipe -> free );
+    ring_kick( &pipe -> read );
+    ring_kick( &pipe -> done );
+}
+
+/* Reader stage: fills free slots with the next chunks, the secret bytes too on encode */
+static void *read_stage( void *arg )
+{
+    Pipeline *pipe = arg;
+
+    for( size_t chunk = 0; chunk < pipe -> chunks; chunk++ )
+    {
+        int i = ring_pop( pipe, &pipe -> free, stage_read );
+        if( i < 0 )
+        {
+            break;
+        }
+
+        double start = report_now();
+        PipeSlot *slot = &pipe -> slots[i];
+        size_t offset = chunk * pipe -> chunk_size;
+
+        slot -> len = pipe -> size - offset < pipe -> chunk_size ? pipe -> size - offset : pipe -> chunk_size;
+        slot -> pos = pipe -> data_pos + LSB_CARRIER( offset, pipe -> bits );
+        slot -> image_off = bmp_offset( pipe -> bmp, slot -> pos );
+        slot -> image_len = bmp_offset( pipe -> bmp, slot -> pos + LSB_CARRIER( slot -> len, pipe -> bits ) ) - slot -> image_off;
+
+        if( ( pipe -> encInfo && pread_full( pipe -> data_fd, slot -> data, slot -> len, offset ) != 0 ) ||
+            pread_full( pipe -> image_fd, slot -> image, slot -> image_len, slot -> image_off ) != 0 )
+        {
+            pipeline_fail( pipe, "read" );
+            break;
+        }
+
+        pipe -> busy[ stage_read ] += report_now() - start;
+        ring_push( &pipe -> read, i );
+    }
+
+    return NULL;
+}
+
+/* Kernel stage, on the calling thread: embeds or extracts every chunk in order,
+ * with the checksum and chunk index of the serial path
+ */
+static Status kernel_stage( Pipeline *pipe )
+{
+    size_t done = 0;
+
+    for( size_t chunk = 0; chunk < pipe -> chunks; chunk++ )
+    {
+        int i = ring_pop( pipe, &pipe -> read, stage_kernel );
+        if( i < 0 )
+        {
+            return e_failure;
+        }
+
+        double start = report_now();
+        PipeSlot *slot = &pipe -> slots[i];
+
+        if( pipe -> encInfo )
+        {
+            EncodeInfo *encInfo = pipe -> encInfo;
+
+            // Row padding in the span is written back as read
+            bmp_embed( pipe -> bmp, pipe -> bits, slot -> data, slot -> len, slot -> pos, slot -> image, slot -> image, slot -> image_off );
+            encInfo -> data_crc = crc32c( encInfo -> data_crc, slot -> data, slot -> len );
+            if( index_secret_data( slot -> data, slot -> len, encInfo ) != e_success )
+            {
+                pipeline_fail( pipe, NULL );
+                return e_failure;
+            }
+        }
+        else
+        {
+            DecodeInfo *decInfo = pipe -> decInfo;
+
+            bmp_extract( pipe -> bmp, pipe -> bits, slot -> image, slot -> image_off, slot -> pos, slot -> len, slot -> data );
+            decInfo -> data_crc = crc32c( decInfo -> data_crc, slot -> data, slot -> len );
+        }
+
+        done += slot -> len;
+        pipe -> busy[ stage_kernel ] += report_now() - start;
+        ring_push( &pipe -> done, i );
+        progress_update( pipe -> progress, done );
+    }
+
+    return e_success;
+}
+
+/* Writer stage: writes every chunk, the image span on encode and the
+ * secret bytes in order on decode, and gives the slot back to the reader
+ */
+static void *write_stage( void *arg )
+{
+    Pipeline *pipe = arg;
+
+    for( size_t chunk = 0; chunk < pipe -> chunks; chunk++ )
+    {
+        int i = ring_pop( pipe, &pipe -> done, stage_write );
+        if( i < 0 )
+        {
+            break;
+        }
+
+        double start = report_now();
+        PipeSlot *slot = &pipe -> slots[i];
+        int failed = 0;
+
+        if( pipe -> encInfo )
+            failed = pwrite_full( pipe -> stego_fd, slot -> image, slot -> image_len, slot -> image_off ) != 0;
+        else if( pipe -> data_fd >= 0 )
+            failed = write_full( pipe -> data_fd, slot -> data, slot -> len ) != 0;
+        if( failed )
+        {
+            pipeline_fail( pipe, "write" );
+            break;
+        }
+
+        pipe -> busy[ stage_write ] += report_now() - start;
+        ring_push( &pipe -> free, i );
+    }
+
+    return NULL;
+}
+
+/* Allocates the slots, runs the three stages and reports how busy each was */
+static Status run_pipeline( Pipeline *pipe, size_t block_size, const Reporter *reporter, const char *what )
+{
+    static const char *stages[ stage_count ] = { "Read", "Kernel", "Write" };
+    pthread_t reader, writer;
+    Status status = e_success;
+
+    pipe -> chunk_size = block_size_clamp( block_size ) / LSB_CARRIER( 1, pipe -> bits );
+    if( pipe -> size > 0 && pipe -> size < pipe -> chunk_size )
+        pipe -> chunk_size = pipe -> size;
+    pipe -> chunks = ( pipe -> size + pipe -> chunk_size - 1 ) / pipe -> chunk_size;
+
+    // Every buffer up front, none per chunk, and no more slots than chunks
+    size_t image_bound = bmp_file_bound( pipe -> bmp, LSB_CARRIER( pipe -> chunk_size, pipe -> bits ) );
+    int slots = pipe -> chunks < PIPELINE_SLOTS ? ( int )pipe -> chunks : PIPELINE_SLOTS;
+    for( int i = 0; i < slots; i++ )
+    {
+        pipe -> slots[i].data = malloc( pipe -> chunk_size );
+        pipe -> slots[i].image = malloc( image_bound );
+        if( pipe -> slots[i].data == NULL || pipe -> slots[i].image == NULL )
+            status = e_failure;
+        ring_push( &pipe -> free, i );
+    }
+
+    if( status == e_success )
+    {
+        double start = report_now();
+
+        if( pthread_create( &reader, NULL, read_stage, pipe ) != 0 )
+        {
+            status = e_failure;
+        }
+        else if( pthread_create( &writer, NULL, write_stage, pipe ) != 0 )
+        {
+            pipeline_fail( pipe, NULL );
+            pthread_join( reader, NULL );
+            status = e_failure;
+        }
+        else
+        {
+            status = kernel_stage( pipe );
+            pthread_join( reader, NULL );
+            pthread_join( writer, NULL );
+            if( atomic_load( &pipe -> failed ) )
+                status = e_failure;
+        }
+        if( pipe -> failure )
+            report_info( reporter, "Unable to %s through the pipeline: %s", pipe -> failure, strerror( pipe -> error ) );
+
+        // The slowest stage is the one that hardly waited
+        double elapsed = report_now() - start;
+        report_info( reporter, "%s %zu bytes through the pipeline in %.3fs (%.2f MB/s)",
+                     what, pipe -> size, elapsed, elapsed > 0 ? pipe -> size / elapsed / 1e6 : 0.0 );
+        for( int i = 0; i < stage_count; i++ )
+        {
+            report_info( reporter, "%s stage: busy %.3fs, waiting %.3fs", stages[i], pipe -> busy[i], pipe -> idle[i] );
+        }
+    }
+
+    for( int i = 0; i < PIPELINE_SLOTS; i++ )
+    {
+        free( pipe -> slots[i].data );
+        free( pipe -> slots[i].image );
+    }
+
+    return status;
+}
+
+/* Encode the secret file data through the pipeline */
+Status pipeline_encode_secret_file_data( EncodeInfo *encInfo )
+{
+    BlockBuffer *block = &encInfo -> image_block;
+    Pipeline pipe;
+
+    memset( &pipe, 0, sizeof( pipe ) );
+
+    // The block may hold bytes read ahead, carrier_pos is where the data starts
+    pipe.bmp = &encInfo -> bmp;
+    pipe.data_pos = encInfo -> carrier_pos;
+
+    // Everything before the data has to reach the file before the writer writes
+    if( flush_image_block( encInfo ) != e_success || fflush( encInfo -> fptr_stego_image ) != 0 )
+    {
+        return e_failure;
+    }
+
+    pipe.encInfo = encInfo;
+    pipe.progress = &encInfo -> progress;
+    pipe.data_fd = fileno( encInfo -> fptr_secret );
+    pipe.image_fd = fileno( encInfo -> fptr_src_image );
+    pipe.stego_fd = fileno( encInfo -> fptr_stego_image );
+    pipe.size = encInfo -> size_secret_file;
+    pipe.bits = encInfo -> bits;
+
+    progress_begin( &encInfo -> progress, encInfo -> reporter, "Encoding data", pipe.size );
+    Status status = run_pipeline( &pipe, encInfo -> block_size, encInfo -> reporter, "Encoded" );
+    progress_end( &encInfo -> progress );
+
+    if( status != e_success )
+    {
+        return e_failure;
+    }
+
+    // Both streams continue after the encoded data
+    encInfo -> carrier_pos = pipe.data_pos + LSB_CARRIER( pipe.size, pipe.bits );
+    off_t end = bmp_offset( pipe.bmp, encInfo -> carrier_pos );
+    if( fseeko( encInfo -> fptr_src_image, end, SEEK_SET ) != 0 || fseeko( encInfo -> fptr_stego_image, end, SEEK_SET ) != 0 )
+    {
+        return e_failure;
+    }
+    block -> base = end;
+
+    return e_success;
+}
+
+/* Decode the secret file data through the pipeline, or only check it */
+Status pipeline_decode_file_data( DecodeInfo *decInfo )
+{
+    Pipeline pipe;
+
+    memset( &pipe, 0, sizeof( pipe ) );
+
+    // The block may hold bytes read ahead, carrier_pos is where the data starts
+    pipe.decInfo = decInfo;
+    pipe.bmp = &decInfo -> bmp;
+    pipe.data_pos = decInfo -> carrier_pos;
+    pipe.progress = &decInfo -> progress;
+    pipe.data_fd = decInfo -> verify ? -1 : fileno( decInfo -> fptr_secret );
+    pipe.image_fd = fileno( decInfo -> fptr_stego_image );
+    pipe.stego_fd = -1;
+    pipe.size = decInfo -> file_size;
+    pipe.bits = decInfo -> bits;
+
+    // The writer writes from where the stream is
+    if( pipe.data_fd >= 0 && fflush( decInfo -> fptr_secret ) != 0 )
+    {
+        report_info( decInfo -> reporter, "Unable to write %s: %s", decInfo -> secret_fname, strerror( errno ) );
+        return d_failure;
+    }
+
+    progress_begin( &decInfo -> progress, decInfo -> reporter, decInfo -> verify ? "Verifying data" : "Decoding data", pipe.size );
+    Status status = run_pipeline( &pipe, decInfo -> block_size, decInfo -> reporter, decInfo -> verify ? "Verified" : "Decoded" );
+    progress_end( &decInfo -> progress );
+
+    return status == e_success ? d_success : d_failure;
+}
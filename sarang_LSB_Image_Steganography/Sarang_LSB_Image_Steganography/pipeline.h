@@ -0,0 +1,37 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "types.h" // Contains user defined types
+#include "encode.h"
+#include "decode.h"
+
+/*
+ * Three stage pipeline
+ * The data of one job runs through a reader thread, the LSB kernel on
+ * the calling thread and a writer thread at once, so the disk reads the
+ * next block while the kernel works on this one and the previous one is
+ * written. The stages hand PIPELINE_SLOTS preallocated slots, each a
+ * data chunk and the image span of its carrier bytes, round through
+ * three single producer, single consumer rings: free ( writer to reader ),
+ * read ( reader to kernel ) and done ( kernel to writer ). Pushes and pops
+ * are lock free; a stage that finds its ring empty spins briefly, then
+ * sleeps on a futex until the stage before it pushes. Slots keep data
+ * order, so checksums and the chunk index are built as by the serial
+ * path and decodes write the secret in order, pipes included.
+ * Throughput is that of the slowest stage, reported at the end.
+ */
+
+#define PIPELINE_SLOTS 4    // Slots in flight, a power of 2
+
+/* Encode the secret file data through the pipeline
+ * The header and the fields before the data must already be encoded
+ */
+Status pipeline_encode_secret_file_data( EncodeInfo *encInfo );
+
+/* Decode the secret file data through the pipeline, or only check it
+ * against its checksum if decInfo -> verify is set
+ * The fields before the data must already be decoded
+ */
+Status pipeline_decode_file_data( DecodeInfo *decInfo );
+
+#endif
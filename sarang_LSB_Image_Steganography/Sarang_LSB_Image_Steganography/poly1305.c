@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "poly1305.h"
+#include "types.h"
+
+#define LIMB 0x3FFFFFF      // 26 bits
+
+/* Function Definitions */
+
+/* Little endian word at p */
+static uint32_t le32( const uchar *p )
+{
+    return p[0] | ( uint32_t )p[1] << 8 | ( uint32_t )p[2] << 16 | ( uint32_t )p[3] << 24;
+}
+
+/* Splits r into limbs, clamped as RFC 8439 2.5 asks, and keeps s */
+void poly1305_init( Poly1305 *p, const uchar key[ POLY1305_KEY ] )
+{
+    p -> r[0] = le32( key ) & 0x3FFFFFF;
+    p -> r[1] = ( le32( key + 3 ) >> 2 ) & 0x3FFFF03;
+    p -> r[2] = ( le32( key + 6 ) >> 4 ) & 0x3FFC0FF;
+    p -> r[3] = ( le32( key + 9 ) >> 6 ) & 0x3F03FFF;
+    p -> r[4] = ( le32( key + 12 ) >> 8 ) & 0x00FFFFF;
+
+    memset( p -> h, 0, sizeof( p -> h ) );
+    for( int i = 0; i < 4; i++ )
+        p -> pad[i] = le32( key + 16 + 4 * i );
+    p -> fill = 0;
+}
+
+/* h = ( h + block ) * r mod 2^130 - 5 for one 16 byte block, hibit is
+ * the 2^128 bit, set for all but a padded last block
+ */
+static void block( Poly1305 *p, const uchar *m, uint32_t hibit )
+{
+    const uint32_t *r = p -> r;
+    uint32_t s1 = r[1] * 5, s2 = r[2] * 5, s3 = r[3] * 5, s4 = r[4] * 5;
+    uint32_t *h = p -> h;
+    uint64_t d0, d1, d2, d3, d4, c;
+
+    h[0] += le32( m ) & LIMB;
+    h[1] += ( le32( m + 3 ) >> 2 ) & LIMB;
+    h[2] += ( le32( m + 6 ) >> 4 ) & LIMB;
+    h[3] += ( le32( m + 9 ) >> 6 ) & LIMB;
+    h[4] += ( le32( m + 12 ) >> 8 ) | hibit;
+
+    // 2^130 wraps to 5, so the limbs past the top come back times 5
+    d0 = ( uint64_t )h[0] * r[0] + ( uint64_t )h[1] * s4 + ( uint64_t )h[2] * s3 + ( uint64_t )h[3] * s2 + ( uint64_t )h[4] * s1;
+    d1 = ( uint64_t )h[0] * r[1] + ( uint64_t )h[1] * r[0] + ( uint64_t )h[2] * s4 + ( uint64_t )h[3] * s3 + ( uint64_t )h[4] * s2;
+    d2 = ( uint64_t )h[0] * r[2] + ( uint64_t )h[1] * r[1] + ( uint64_t )h[2] * r[0] + ( uint64_t )h[3] * s4 + ( uint64_t )h[4] * s3;
+    d3 = ( uint64_t )h[0] * r[3] + ( uint64_t )h[1] * r[2] + ( uint64_t )h[2] * r[1] + ( uint64_t )h[3] * r[0] + ( uint64_t )h[4] * s4;
+    d4 = ( uint64_t )h[0] * r[4] + ( uint64_t )h[1] * r[3] + ( uint64_t )h[2] * r[2] + ( uint64_t )h[3] * r[1] + ( uint64_t )h[4] * r[0];
+
+    c = d0 >> 26; h[0] = d0 & LIMB;
+    d1 += c; c = d1 >> 26; h[1] = d1 & LIMB;
+    d2 += c; c = d2 >> 26; h[2] = d2 & LIMB;
+    d3 += c; c = d3 >> 26; h[3] = d3 & LIMB;
+    d4 += c; c = d4 >> 26; h[4] = d4 & LIMB;
+    h[0] += c * 5;
+    h[1] += h[0] >> 26;
+    h[0] &= LIMB;
+}
+
+/* Runs whole blocks, keeps a partial one for later */
+void poly1305_update( Poly1305 *p, const uchar *data, size_t n )
+{
+    if( p -> fill > 0 )
+    {
+        size_t len = 16 - p -> fill < n ? 16 - p -> fill : n;
+
+        memcpy( p -> buf + p -> fill, data, len );
+        p -> fill += len;
+        data += len;
+        n -= len;
+        if( p -> fill < 16 )
+        {
+            return;
+        }
+        block( p, p -> buf, 1 << 24 );
+        p -> fill = 0;
+    }
+
+    for( ; n >= 16; data += 16, n -= 16 )
+        block( p, data, 1 << 24 );
+
+    memcpy( p -> buf, data, n );
+    p -> fill = n;
+}
+
+/* Pads the last block with 1 and zeros, reduces h fully and adds s */
+void poly1305_final( Poly1305 *p, uchar tag[ POLY1305_TAG ] )
+{
+    uint32_t *h = p -> h;
+    uint32_t g[5], c, mask;
+    uint64_t f;
+
+    if( p -> fill > 0 )
+    {
+        p -> buf[ p -> fill ] = 1;
+        memset( p -> buf + p -> fill + 1, 0, 16 - p -> fill - 1 );
+        block( p, p -> buf, 0 );
+    }
+
+    c = h[1] >> 26; h[1] &= LIMB;
+    h[2] += c; c = h[2] >> 26; h[2] &= LIMB;
+    h[3] += c; c = h[3] >> 26; h[3] &= LIMB;
+    h[4] += c; c = h[4] >> 26; h[4] &= LIMB;
+    h[0] += c * 5; c = h[0] >> 26; h[0] &= LIMB;
+    h[1] += c;
+
+    // h - p, taken without a branch if it does not go below 0
+    g[0] = h[0] + 5; c = g[0] >> 26; g[0] &= LIMB;
+    g[1] = h[1] + c; c = g[1] >> 26; g[1] &= LIMB;
+    g[2] = h[2] + c; c = g[2] >> 26; g[2] &= LIMB;
+    g[3] = h[3] + c; c = g[3] >> 26; g[3] &= LIMB;
+    g[4] = h[4] + c - ( 1 << 26 );
+
+    mask = ( g[4] >> 31 ) - 1;
+    for( int i = 0; i < 5; i++ )
+        h[i] = ( h[i] & ~mask ) | ( g[i] & mask );
+
+    // Back to 32 bit words mod 2^128, plus s
+    uint32_t w[4] = { h[0] | h[1] << 26, h[1] >> 6 | h[2] << 20, h[2] >> 12 | h[3] << 14, h[3] >> 18 | h[4] << 8 };
+
+    f = 0;
+    for( int i = 0; i < 4; i++ )
+    {
+        f = ( uint64_t )w[i] + p -> pad[i] + ( f >> 32 );
+        tag[ 4 * i ] = f;
+        tag[ 4 * i + 1 ] = f >> 8;
+        tag[ 4 * i + 2 ] = f >> 16;
+        tag[ 4 * i + 3 ] = f >> 24;
+    }
+
+    memset( p, 0, sizeof( *p ) );
+}
+
+/* ORs every byte difference together */
+int poly1305_differ( const uchar a[ POLY1305_TAG ], const uchar b[ POLY1305_TAG ] )
+{
+    uchar diff = 0;
+
+    for( int i = 0; i < POLY1305_TAG; i++ )
+        diff |= a[i] ^ b[i];
+
+    return diff != 0;
+}
+
+/* RFC 8439 2.5.2, then every split of the message against the whole */
+Status poly1305_self_test( void )
+{
+    static const char msg[] = "Cryptographic Forum Research Group";
+    static const uchar key[ POLY1305_KEY ] =
+    {
+        0x85, 0xD6, 0xBE, 0x78, 0x57, 0x55, 0x6D, 0x33, 0x7F, 0x44, 0x52, 0xFE, 0x42, 0xD5, 0x06, 0xA8,
+        0x01, 0x03, 0x80, 0x8A, 0xFB, 0x0D, 0xB2, 0xFD, 0x4A, 0xBF, 0xF6, 0xAF, 0x41, 0x49, 0xF5, 0x1B
+    };
+    static const uchar expect[ POLY1305_TAG ] =
+    {
+        0xA8, 0x06, 0x1D, 0xC1, 0x30, 0x51, 0x36, 0xC6, 0xC2, 0x2B, 0x8B, 0xAF, 0x0C, 0x01, 0x27, 0xA9
+    };
+    size_t len = sizeof( msg ) - 1;
+    uchar tag[ POLY1305_TAG ];
+    Poly1305 p;
+    int ok;
+
+    poly1305_init( &p, key );
+    poly1305_update( &p, ( const uchar * )msg, len );
+    poly1305_final( &p, tag );
+    ok = !poly1305_differ( tag, expect );
+
+    for( size_t split = 0; split <= len && ok; split++ )
+    {
+        poly1305_init( &p, key );
+        poly1305_update( &p, ( const uchar * )msg, split );
+        poly1305_update( &p, ( const uchar * )msg + split, len - split );
+        poly1305_final( &p, tag );
+        ok = !poly1305_differ( tag, expect );
+    }
+
+    printf( "poly1305 %s\n", ok ? "ok" : "MISMATCH" );
+
+    return ok ? e_success : e_failure;
+}
@@ -0,0 +1,43 @@
+#ifndef POLY1305_H
+#define POLY1305_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h" // Contains user defined types
+
+/*
+ * Poly1305 one time authenticator, RFC 8439
+ * The tag of encrypted data, see scatter.h. The 32 byte key must never
+ * tag two messages: chacha.h derives a new one from every salt. The
+ * accumulator is kept in 26 bit limbs, so every product fits 64 bits.
+ */
+
+#define POLY1305_KEY 32     // Bytes of the one time key, r then s
+#define POLY1305_TAG 16     // Bytes of a tag
+
+/* State of one tag */
+typedef struct _Poly1305
+{
+    uint32_t r[5];      // Clamped r in 26 bit limbs
+    uint32_t h[5];      // Accumulator
+    uint32_t pad[4];    // s, added at the end
+    uchar buf[16];      // Partial block
+    size_t fill;        // Bytes in buf
+} Poly1305;
+
+/* Starts a tag with the one time key */
+void poly1305_init( Poly1305 *p, const uchar key[ POLY1305_KEY ] );
+
+/* Takes n more bytes of the message */
+void poly1305_update( Poly1305 *p, const uchar *data, size_t n );
+
+/* Ends the message and writes its tag */
+void poly1305_final( Poly1305 *p, uchar tag[ POLY1305_TAG ] );
+
+/* Compares two tags in time independent of where they differ, 0 if equal */
+int poly1305_differ( const uchar a[ POLY1305_TAG ], const uchar b[ POLY1305_TAG ] );
+
+/* Checks against the RFC 8439 test vector, fed whole and in pieces, prints one line */
+Status poly1305_self_test( void );
+
+#endif
@@ -0,0 +1,196 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "pool.h"
+#include "report.h"
+#include "types.h"
+
+/* Share of tasks still owned by one worker, [lo, hi) */
+typedef struct _PoolDeque
+{
+    pthread_mutex_t lock;
+    size_t lo;
+    size_t hi;
+} __attribute__(( aligned( 64 ) )) PoolDeque;
+
+/* State shared by all workers of one pool_run() */
+typedef struct _Pool
+{
+    int workers;
+    PoolDeque *deques;
+    PoolTask task;
+    void *arg;
+    PoolWorkerStats *stats;
+    atomic_int failed;
+} Pool;
+
+/* Argument of one worker thread */
+typedef struct _PoolWorker
+{
+    Pool *pool;
+    int index;
+} PoolWorker;
+
+/* Function Definitions */
+
+/* Workers pool_run() will use */
+int pool_workers( int threads, size_t tasks )
+{
+    if( threads <= 0 )
+    {
+        long cpus = sysconf( _SC_NPROCESSORS_ONLN );
+        threads = cpus > 0 ? cpus : 1;
+    }
+    if( ( size_t )threads > tasks )
+        threads = tasks ? tasks : 1;
+
+    return threads;
+}
+
+/* Takes the next task from the front of the own share */
+static int pop_own( PoolDeque *deque, size_t *task )
+{
+    int found = 0;
+
+    pthread_mutex_lock( &deque -> lock );
+    if( deque -> lo < deque -> hi )
+    {
+        *task = deque -> lo++;
+        found = 1;
+    }
+    pthread_mutex_unlock( &deque -> lock );
+
+    return found;
+}
+
+/* Moves the back half of some other share into the own, empty, share */
+static int steal( Pool *pool, int self )
+{
+    for( int i = 1; i < pool -> workers; i++ )
+    {
+        PoolDeque *victim = &pool -> deques[ ( self + i ) % pool -> workers ];
+        size_t lo = 0, hi = 0;
+
+        pthread_mutex_lock( &victim -> lock );
+        size_t left = victim -> hi - victim -> lo;
+        if( left > 0 )
+        {
+            hi = victim -> hi;
+            lo = hi - ( left + 1 ) / 2;
+            victim -> hi = lo;
+        }
+        pthread_mutex_unlock( &victim -> lock );
+
+        if( hi > lo )
+        {
+            PoolDeque *own = &pool -> deques[ self ];
+
+            pthread_mutex_lock( &own -> lock );
+            own -> lo = lo;
+            own -> hi = hi;
+            pthread_mutex_unlock( &own -> lock );
+
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Runs tasks until there is nothing left to run or steal */
+static void *pool_worker( void *arg )
+{
+    PoolWorker *worker = arg;
+    Pool *pool = worker -> pool;
+    PoolWorkerStats *stats = &pool -> stats[ worker -> index ];
+    size_t task;
+
+    while( !atomic_load( &pool -> failed ) )
+    {
+        if( !pop_own( &pool -> deques[ worker -> index ], &task ) )
+        {
+            if( !steal( pool, worker -> index ) )
+                break;
+            stats -> steals++;
+            continue;
+        }
+
+        double start = report_now();
+        if( pool -> task( task, worker -> index, pool -> arg ) != 0 )
+            atomic_store( &pool -> failed, 1 );
+        stats -> busy += report_now() - start;
+        stats -> tasks++;
+    }
+
+    return NULL;
+}
+
+/* Runs every task on pool_workers( threads, tasks ) workers */
+Status pool_run( int threads, size_t tasks, PoolTask task, void *arg, PoolWorkerStats *stats )
+{
+    Pool pool = { 0 };
+    int workers = pool_workers( threads, tasks );
+    Status status = e_success;
+
+    PoolDeque *deques = aligned_alloc( 64, workers * sizeof( PoolDeque ) );
+    PoolWorker *args = calloc( workers, sizeof( PoolWorker ) );
+    pthread_t *tids = calloc( workers, sizeof( pthread_t ) );
+    PoolWorkerStats *own_stats = stats ? NULL : calloc( workers, sizeof( PoolWorkerStats ) );
+
+    if( deques == NULL || args == NULL || tids == NULL || ( stats == NULL && own_stats == NULL ) )
+    {
+        free( deques );
+        free( args );
+        free( tids );
+        free( own_stats );
+        return e_failure;
+    }
+
+    pool.workers = workers;
+    pool.deques = deques;
+    pool.task = task;
+    pool.arg = arg;
+    pool.stats = stats ? stats : own_stats;
+    memset( pool.stats, 0, workers * sizeof( PoolWorkerStats ) );
+
+    // Contiguous shares keep each worker's I/O sequential until it steals
+    for( int i = 0; i < workers; i++ )
+    {
+        pthread_mutex_init( &deques[i].lock, NULL );
+        deques[i].lo = tasks * i / workers;
+        deques[i].hi = tasks * ( i + 1 ) / workers;
+        args[i].pool = &pool;
+        args[i].index = i;
+    }
+
+    // A worker that could not be started leaves its share to be stolen
+    int started[ workers ];
+    for( int i = 1; i < workers; i++ )
+    {
+        started[i] = pthread_create( &tids[i], NULL, pool_worker, &args[i] ) == 0;
+    }
+
+    pool_worker( &args[0] );
+
+    for( int i = 1; i < workers; i++ )
+    {
+        if( started[i] )
+            pthread_join( tids[i], NULL );
+    }
+    for( int i = 0; i < workers; i++ )
+    {
+        pthread_mutex_destroy( &deques[i].lock );
+    }
+
+    if( atomic_load( &pool.failed ) )
+        status = e_failure;
+
+    free( deques );
+    free( args );
+    free( tids );
+    free( own_stats );
+
+    return status;
+}
@@ -0,0 +1,35 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include "types.h" // Contains user defined types
+
+/*
+ * Work stealing thread pool
+ * Tasks are numbered 0 .. tasks - 1. Every worker starts with its own
+ * contiguous share and takes from the front of it; a worker that runs
+ * dry steals the back half of another worker's share. Worker 0 is the
+ * calling thread.
+ */
+
+/* Runs one task, non zero stops the whole pool */
+typedef int ( *PoolTask )( size_t task, int worker, void *arg );
+
+/* What one worker did */
+typedef struct _PoolWorkerStats
+{
+    size_t tasks;   // Tasks run
+    size_t steals;  // Successful steals
+    double busy;    // Seconds spent in tasks
+} PoolWorkerStats;
+
+/* Workers pool_run() will use for a request of threads, 0 is one per CPU */
+int pool_workers( int threads, size_t tasks );
+
+/* Runs every task on pool_workers( threads, tasks ) workers
+ * stats, if not NULL, has room for that many workers
+ * Returns e_failure if a task failed or no thread could be started
+ */
+Status pool_run( int threads, size_t tasks, PoolTask task, void *arg, PoolWorkerStats *stats );
+
+#endif
@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "report.h"
+
+/* Function Definitions */
+
+/* Monotonic time in seconds */
+double report_now( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Initialise a reporter with defaults for the given mode */
+void reporter_init( Reporter *reporter, ReportMode mode )
+{
+    reporter -> mode = mode;
+    reporter -> out = stdout;
+    reporter -> progress_cb = NULL;
+    reporter -> progress_user = NULL;
+    reporter -> progress_interval = 0.25;
+}
+
+/* Writes str as a JSON string literal, with quotes */
+void report_json_string( FILE *out, const char *str )
+{
+    fputc( '"', out );
+
+    for( ; *str; str++ )
+    {
+        unsigned char ch = *str;
+
+        if( ch == '"' || ch == '\\' )
+            fprintf( out, "\\%c", ch );
+        else if( ch == '\n' )
+            fputs( "\\n", out );
+        else if( ch < 0x20 )
+            fprintf( out, "\\u%04x", ch );
+        else
+            fputc( ch, out );
+    }
+
+    fputc( '"', out );
+}
+
+/* Prints msg as a line of event, "INFO: ..." or its JSON object */
+static void print_message( FILE *out, ReportMode mode, const char *event, const char *msg )
+{
+    if( mode != r_json )
+    {
+        fprintf( out, "%s: %s\n", strcmp( event, "error" ) == 0 ? "ERROR" : "INFO", msg );
+    }
+    else
+    {
+        fprintf( out, "{\"event\":\"%s\",\"message\":", event );
+        report_json_string( out, msg );
+        fputs( "}\n", out );
+    }
+}
+
+/* Report an informational message */
+void report_info( const Reporter *reporter, const char *fmt, ... )
+{
+    char msg[512];
+    va_list args;
+
+    if( reporter == NULL || reporter -> mode == r_quiet )
+        return;
+
+    va_start( args, fmt );
+    vsnprintf( msg, sizeof( msg ), fmt, args );
+    va_end( args );
+
+    print_message( reporter -> out, reporter -> mode, "info", msg );
+}
+
+/* Report an error, to stderr in any mode */
+void report_error( const Reporter *reporter, const char *fmt, ... )
+{
+    char msg[512];
+    va_list args;
+
+    va_start( args, fmt );
+    vsnprintf( msg, sizeof( msg ), fmt, args );
+    va_end( args );
+
+    print_message( stderr, reporter && reporter -> mode == r_json ? r_json : r_human, "error", msg );
+}
+
+/* Prints a progress snapshot in the reporter's mode */
+static void print_progress( const Reporter *reporter, const Progress *p, int final )
+{
+    FILE *out = reporter -> out;
+
+    if( reporter -> mode == r_json )
+    {
+        fputs( "{\"event\":\"progress\",\"stage\":", out );
+        report_json_string( out, p -> stage );
+        fprintf( out, ",\"bytes_done\":%llu,\"bytes_total\":%llu,\"elapsed\":%.6f,\"throughput\":%.0f,\"eta\":%.3f,\"final\":%s}\n",
+                 p -> bytes_done, p -> bytes_total, p -> elapsed, p -> throughput, p -> eta, final ? "true" : "false" );
+        fflush( out );
+        return;
+    }
+
+    // Human mode: live line on a terminal, summary line otherwise
+    int tty = isatty( fileno( out ) );
+    if( !final && !tty )
+        return;
+
+    double percent = p -> bytes_total ? 100.0 * p -> bytes_done / p -> bytes_total : 100.0;
+    fprintf( out, "%sINFO: %s: %llu/%llu bytes (%.1f%%) %.2f MB/s",
+             tty ? "\r" : "", p -> stage, p -> bytes_done, p -> bytes_total, percent, p -> throughput / 1e6 );
+    if( final )
+        fprintf( out, " in %.3fs\n", p -> elapsed );
+    else
+        fprintf( out, " ETA %.1fs", p -> eta );
+    fflush( out );
+}
+
+/* Fills the derived fields and hands the snapshot out */
+static void emit_progress( ProgressState *state, double now, int final )
+{
+    const Reporter *reporter = state -> reporter;
+    Progress *p = &state -> progress;
+
+    p -> elapsed = now - state -> start;
+    p -> throughput = p -> elapsed > 0 ? p -> bytes_done / p -> elapsed : 0;
+    if( p -> bytes_done >= p -> bytes_total )
+        p -> eta = 0;
+    else if( p -> throughput > 0 )
+        p -> eta = ( p -> bytes_total - p -> bytes_done ) / p -> throughput;
+    else
+        p -> eta = -1;
+
+    state -> last = now;
+
+    if( reporter -> progress_cb )
+        reporter -> progress_cb( p, reporter -> progress_user );
+    else if( reporter -> mode != r_quiet )
+        print_progress( reporter, p, final );
+}
+
+/* Start a progress stage of total bytes */
+void progress_begin( ProgressState *state, const Reporter *reporter, const char *stage, unsigned long long total )
+{
+    memset( state, 0, sizeof( *state ) );
+    state -> reporter = reporter;
+    state -> progress.stage = stage;
+    state -> progress.bytes_total = total;
+    state -> start = state -> last = report_now();
+}
+
+/* Update the bytes done, reported at most once per progress_interval */
+void progress_update( ProgressState *state, unsigned long long done )
+{
+    const Reporter *reporter = state -> reporter;
+
+    state -> progress.bytes_done = done;
+
+    // Nobody listening, skip the clock read
+    if( reporter == NULL || ( reporter -> mode == r_quiet && reporter -> progress_cb == NULL ) )
+        return;
+
+    double now = report_now();
+    if( now - state -> last >= reporter -> progress_interval )
+        emit_progress( state, now, 0 );
+}
+
+/* Finish a progress stage, always reported */
+void progress_end( ProgressState *state )
+{
+    if( state -> reporter == NULL )
+        return;
+
+    emit_progress( state, report_now(), 1 );
+}
@@ -0,0 +1,79 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stdio.h>
+
+/*
+ * Status and progress reporting
+ * Every message of the encode/decode flow goes through a Reporter,
+ * which decides how (and whether) it is shown. Nothing in here sleeps.
+ */
+
+/* Output modes of a reporter */
+typedef enum
+{
+    r_quiet,    // Print nothing
+    r_human,    // "INFO: ..." lines
+    r_json      // One JSON object per line
+} ReportMode;
+
+/* Snapshot handed to progress callbacks */
+typedef struct _Progress
+{
+    const char *stage;              // Name of the running stage
+    unsigned long long bytes_done;  // Bytes processed so far
+    unsigned long long bytes_total; // Bytes to process in this stage
+    double elapsed;                 // Seconds since the stage started
+    double throughput;              // Bytes per second
+    double eta;                     // Seconds left, -1 if unknown
+} Progress;
+
+typedef void ( *ProgressCallback )( const Progress *progress, void *user );
+
+/* Where and how messages are reported */
+typedef struct _Reporter
+{
+    ReportMode mode;
+    FILE *out;                      // Stream for messages ( stdout by default )
+    ProgressCallback progress_cb;   // Replaces the built-in progress output if set
+    void *progress_user;            // Passed back to progress_cb
+    double progress_interval;       // Minimum seconds between two progress updates
+} Reporter;
+
+/* Running state of one progress stage, kept in Encode/DecodeInfo */
+typedef struct _ProgressState
+{
+    const Reporter *reporter;
+    Progress progress;
+    double start;
+    double last;
+} ProgressState;
+
+/* Initialise a reporter with defaults for the given mode */
+void reporter_init( Reporter *reporter, ReportMode mode );
+
+/* Report an informational message, fmt carries no "INFO:" prefix nor newline */
+void report_info( const Reporter *reporter, const char *fmt, ... ) __attribute__(( format( printf, 2, 3 ) ));
+
+/* Report an error the same way, "ERROR:" instead, always to stderr and
+ * never silenced by r_quiet, for the program's own failures; the library
+ * only reports through report_info()
+ */
+void report_error( const Reporter *reporter, const char *fmt, ... ) __attribute__(( format( printf, 2, 3 ) ));
+
+/* Start a progress stage of total bytes */
+void progress_begin( ProgressState *state, const Reporter *reporter, const char *stage, unsigned long long total );
+
+/* Update the bytes done, reported at most once per progress_interval */
+void progress_update( ProgressState *state, unsigned long long done );
+
+/* Finish a progress stage, always reported */
+void progress_end( ProgressState *state );
+
+/* Write str to out as a JSON string literal, quotes included */
+void report_json_string( FILE *out, const char *str );
+
+/* Monotonic time in seconds */
+double report_now( void );
+
+#endif
@@ -0,0 +1,411 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "scan.h"
+#include "pool.h"
+#include "types.h"
+
+#define SCAN_BATCH 256  // Files of one directory probed per work item
+
+/* Work item: a directory to read, or a batch of its files to probe */
+typedef struct _ScanItem
+{
+    char *dir;
+    char **names;               // NULL to read dir
+    size_t count;
+} ScanItem;
+
+/* State shared by the workers */
+typedef struct _Scan
+{
+    const ScanOptions *opts;
+    StegContext probe;          // Settings of the probes, quiet
+    ScanItem *items;            // Work left, a stack so the walk stays depth first
+    size_t count;
+    size_t capacity;
+    int busy;                   // Workers on an item
+    pthread_mutex_t lock;       // Guards items and busy
+    pthread_cond_t more;        // An item was pushed or the walk ended
+    pthread_mutex_t out_lock;   // Serialises the result lines
+    FILE *results;
+    atomic_size_t files;
+    atomic_size_t stego;
+    atomic_size_t failed;       // Directories and files that could not be read
+} Scan;
+
+/* Function Definitions */
+
+/* 1 if name ends in .bmp, in any case */
+static int is_bmp_name( const char *name )
+{
+    size_t len = strlen( name );
+
+    return len > 4 && strcasecmp( name + len - 4, ".bmp" ) == 0;
+}
+
+/* Joins dir and name with a '/', NULL if out of memory */
+static char *join_path( const char *dir, const char *name )
+{
+    size_t dir_len = strlen( dir );
+    char *path = malloc( dir_len + strlen( name ) + 2 );
+
+    if( path )
+        sprintf( path, "%s%s%s", dir, dir_len && dir[ dir_len - 1 ] == '/' ? "" : "/", name );
+
+    return path;
+}
+
+/* Frees an item and everything it owns */
+static void item_free( ScanItem *item )
+{
+    for( size_t i = 0; i < item -> count; i++ )
+        free( item -> names[i] );
+    free( item -> names );
+    free( item -> dir );
+}
+
+/* Hands an item to the workers, the scan owns it from here
+ * Returns e_failure, with the item freed, if out of memory
+ */
+static Status push_item( Scan *scan, ScanItem *item )
+{
+    Status status = e_success;
+
+    pthread_mutex_lock( &scan -> lock );
+
+    if( scan -> count == scan -> capacity )
+    {
+        size_t capacity = scan -> capacity ? scan -> capacity * 2 : 64;
+        ScanItem *items = realloc( scan -> items, capacity * sizeof( ScanItem ) );
+
+        if( items )
+        {
+            scan -> items = items;
+            scan -> capacity = capacity;
+        }
+    }
+    if( scan -> count < scan -> capacity )
+    {
+        scan -> items[ scan -> count++ ] = *item;
+        pthread_cond_signal( &scan -> more );
+    }
+    else
+        status = e_failure;
+
+    pthread_mutex_unlock( &scan -> lock );
+
+    if( status != e_success )
+        item_free( item );
+
+    return status;
+}
+
+/* Waits for the next item, 0 once the walk is over */
+static int next_item( Scan *scan, ScanItem *item )
+{
+    int found = 0;
+
+    pthread_mutex_lock( &scan -> lock );
+
+    // Items may still come while another worker reads a directory
+    while( scan -> count == 0 && scan -> busy > 0 )
+        pthread_cond_wait( &scan -> more, &scan -> lock );
+
+    if( scan -> count > 0 )
+    {
+        *item = scan -> items[ --scan -> count ];
+        scan -> busy++;
+        found = 1;
+    }
+
+    pthread_mutex_unlock( &scan -> lock );
+
+    return found;
+}
+
+/* Marks an item of next_item() done, the last one wakes everybody to leave */
+static void item_done( Scan *scan )
+{
+    pthread_mutex_lock( &scan -> lock );
+
+    if( --scan -> busy == 0 && scan -> count == 0 )
+        pthread_cond_broadcast( &scan -> more );
+
+    pthread_mutex_unlock( &scan -> lock );
+}
+
+/* Writes the result line of one image */
+static void write_result( Scan *scan, const char *path, StegError error, const StegResult *result )
+{
+    FILE *out = scan -> results;
+
+    pthread_mutex_lock( &scan -> out_lock );
+
+    fputs( "{\"path\":", out );
+    report_json_string( out, path );
+    if( error == steg_ok )
+    {
+        fputs( ",\"stego\":true,\"extn\":", out );
+        report_json_string( out, result -> extn );
+        fprintf( out, ",\"size\":%zu,\"bits\":%d,\"codec\":\"%s\"", result -> secret_size, result -> bits,
+                 result -> codec == codec_lz ? "lz" : "none" );
+        if( result -> has_crc )
+            fprintf( out, ",\"crc32c\":\"%08x\"", result -> crc );
+        if( result -> has_index )
+            fputs( ",\"index\":true", out );
+        if( result -> container )
+            fputs( ",\"container\":true", out );
+        if( result -> scattered )
+            fputs( result -> encrypted ? ",\"scattered\":true,\"encrypted\":true" : ",\"scattered\":true", out );
+    }
+    else
+    {
+        fputs( ",\"stego\":false", out );
+        if( error != steg_err_not_stegged )
+        {
+            fputs( ",\"error\":", out );
+            report_json_string( out, steg_strerror( error ) );
+        }
+    }
+    fputs( "}\n", out );
+
+    pthread_mutex_unlock( &scan -> out_lock );
+}
+
+/* Probes the file name of the directory at dir_fd, path is what gets reported */
+static void probe_file( Scan *scan, int dir_fd, const char *name, const char *path )
+{
+    StegResult result = { 0 };
+    StegError error;
+
+    // No access time updates for millions of archived files, where allowed
+    int fd = openat( dir_fd, name, O_RDONLY | O_CLOEXEC | O_NOATIME );
+    if( fd < 0 && errno == EPERM )
+        fd = openat( dir_fd, name, O_RDONLY | O_CLOEXEC );
+
+    if( fd < 0 )
+        error = steg_err_io;
+    else
+    {
+        error = steg_probe_fd( &scan -> probe, fd, &result );
+        close( fd );
+    }
+
+    atomic_fetch_add( &scan -> files, 1 );
+    if( error == steg_ok )
+        atomic_fetch_add( &scan -> stego, 1 );
+    if( error == steg_err_io || error == steg_err_nomem )
+        atomic_fetch_add( &scan -> failed, 1 );
+
+    write_result( scan, path, error, &result );
+}
+
+/* Probes a batch of files of one directory */
+static void probe_batch( Scan *scan, const ScanItem *item )
+{
+    int dir_fd = open( item -> dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+
+    for( size_t i = 0; i < item -> count; i++ )
+    {
+        char *path = join_path( item -> dir, item -> names[i] );
+
+        if( dir_fd < 0 || path == NULL )
+        {
+            atomic_fetch_add( &scan -> files, 1 );
+            atomic_fetch_add( &scan -> failed, 1 );
+            write_result( scan, path ? path : item -> names[i], path ? steg_err_io : steg_err_nomem, NULL );
+        }
+        else
+            probe_file( scan, dir_fd, item -> names[i], path );
+        free( path );
+    }
+
+    if( dir_fd >= 0 )
+        close( dir_fd );
+}
+
+/* Reads a directory: subdirectories and full batches of .bmp files
+ * go back to the workers, the last batch is probed right away
+ */
+static void read_dir( Scan *scan, const char *dir )
+{
+    int dir_fd = open( dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+    DIR *stream = dir_fd < 0 ? NULL : fdopendir( dir_fd );
+    ScanItem batch = { 0 };
+    struct dirent *entry;
+
+    if( stream == NULL )
+    {
+        report_info( &scan -> opts -> steg -> reporter, "Unable to read directory %s", dir );
+        atomic_fetch_add( &scan -> failed, 1 );
+        if( dir_fd >= 0 )
+            close( dir_fd );
+        return;
+    }
+
+    while( ( entry = readdir( stream ) ) != NULL )
+    {
+        const char *name = entry -> d_name;
+        unsigned char type = entry -> d_type;
+
+        if( strcmp( name, "." ) == 0 || strcmp( name, ".." ) == 0 )
+            continue;
+
+        // Most file systems fill d_type, the others take a stat
+        if( type == DT_UNKNOWN )
+        {
+            struct stat st;
+
+            if( fstatat( dir_fd, name, &st, AT_SYMLINK_NOFOLLOW ) != 0 )
+                continue;
+            type = S_ISDIR( st.st_mode ) ? DT_DIR : S_ISREG( st.st_mode ) ? DT_REG : DT_UNKNOWN;
+        }
+
+        if( type == DT_DIR )
+        {
+            ScanItem sub = { .dir = join_path( dir, name ) };
+
+            if( sub.dir == NULL || push_item( scan, &sub ) != e_success )
+                atomic_fetch_add( &scan -> failed, 1 );
+            continue;
+        }
+        if( type != DT_REG || !is_bmp_name( name ) )
+            continue;
+
+        if( batch.names == NULL )
+        {
+            batch.names = malloc( SCAN_BATCH * sizeof( char * ) );
+            batch.dir = strdup( dir );
+            batch.count = 0;
+            if( batch.names == NULL || batch.dir == NULL )
+            {
+                item_free( &batch );
+                memset( &batch, 0, sizeof( batch ) );
+                atomic_fetch_add( &scan -> failed, 1 );
+                continue;
+            }
+        }
+        if( ( batch.names[ batch.count ] = strdup( name ) ) != NULL )
+            batch.count++;
+        else
+            atomic_fetch_add( &scan -> failed, 1 );
+
+        if( batch.count == SCAN_BATCH )
+        {
+            if( push_item( scan, &batch ) != e_success )
+                atomic_fetch_add( &scan -> failed, 1 );
+            memset( &batch, 0, sizeof( batch ) );
+        }
+    }
+    closedir( stream );
+
+    if( batch.names )
+    {
+        probe_batch( scan, &batch );
+        item_free( &batch );
+    }
+}
+
+/* Pool task: one walker, it leaves when the walk is over */
+static int scan_task( size_t task, int worker, void *arg )
+{
+    Scan *scan = arg;
+    ScanItem item;
+
+    ( void )task;
+    ( void )worker;
+
+    while( next_item( scan, &item ) )
+    {
+        if( item.names )
+            probe_batch( scan, &item );
+        else
+            read_dir( scan, item.dir );
+
+        item_free( &item );
+        item_done( scan );
+    }
+
+    return 0;
+}
+
+/* Scans every root */
+Status run_scan( const ScanOptions *opts )
+{
+    Scan scan = { .opts = opts };
+    const Reporter *reporter = &opts -> steg -> reporter;
+    Status status = e_success;
+
+    scan.results = opts -> results == NULL || strcmp( opts -> results, "-" ) == 0 ? stdout : fopen( opts -> results, "w" );
+    if( scan.results == NULL )
+    {
+        perror( "fopen" );
+        fprintf( stderr, "ERROR: Unable to open file %s\n", opts -> results );
+        return e_failure;
+    }
+
+    // Per file messages would drown the results
+    scan.probe = *opts -> steg;
+    reporter_init( &scan.probe.reporter, r_quiet );
+
+    pthread_mutex_init( &scan.lock, NULL );
+    pthread_cond_init( &scan.more, NULL );
+    pthread_mutex_init( &scan.out_lock, NULL );
+
+    double start = report_now();
+
+    // Files given as roots are probed whatever their name, directories walked
+    for( char **root = opts -> roots; *root; root++ )
+    {
+        struct stat st;
+
+        if( stat( *root, &st ) != 0 )
+        {
+            report_info( reporter, "Unable to read %s", *root );
+            atomic_fetch_add( &scan.failed, 1 );
+        }
+        else if( S_ISDIR( st.st_mode ) )
+        {
+            ScanItem item = { .dir = strdup( *root ) };
+
+            if( item.dir == NULL || push_item( &scan, &item ) != e_success )
+                atomic_fetch_add( &scan.failed, 1 );
+        }
+        else
+            probe_file( &scan, AT_FDCWD, *root, *root );
+    }
+
+    // One task per worker, each walks until no directory is left
+    int workers = pool_workers( opts -> jobs, 1 << 20 );
+    if( scan.count > 0 && pool_run( workers, workers, scan_task, &scan, NULL ) != e_success )
+        status = e_failure;
+
+    double elapsed = report_now() - start;
+    size_t files = atomic_load( &scan.files );
+    report_info( reporter, "Scanned %zu images with %d threads in %.3fs (%.0f files/s): %zu stego, %zu unreadable",
+                 files, workers, elapsed, elapsed > 0 ? files / elapsed : 0.0, atomic_load( &scan.stego ), atomic_load( &scan.failed ) );
+
+    if( atomic_load( &scan.failed ) )
+        status = e_failure;
+    if( fflush( scan.results ) != 0 || ( scan.results != stdout && fclose( scan.results ) != 0 ) )
+        status = e_failure;
+
+    // Left over only if the pool could not start
+    while( scan.count > 0 )
+        item_free( &scan.items[ --scan.count ] );
+    free( scan.items );
+    pthread_mutex_destroy( &scan.out_lock );
+    pthread_cond_destroy( &scan.more );
+    pthread_mutex_destroy( &scan.lock );
+
+    return status;
+}
@@ -0,0 +1,34 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include "types.h" // Contains user defined types
+#include "steg.h"
+
+/*
+ * Scan mode
+ * Walks directory trees with a pool of threads and probes every .bmp
+ * file with steg_probe_fd(): one open, one fstat and mostly one 4K read
+ * of the header and first rows per file. Nothing is decoded or written
+ * but one JSON line per image in the results
+ *     {"path":"a/b.bmp","stego":true,"extn":".txt","size":27,"bits":1,"codec":"none","crc32c":"1c291ca3"}
+ *     {"path":"a/c.bmp","stego":false}
+ *     {"path":"a/d.bmp","stego":false,"error":"not a bmp image"}
+ * Roots that are files are probed whatever their name. Symbolic links
+ * are not followed, so every file is probed once.
+ */
+
+/* Settings of one scan */
+typedef struct _ScanOptions
+{
+    char **roots;               // Directories and files, NULL terminated
+    const char *results;        // NULL or "-" is stdout
+    int jobs;                   // Threads, 0 is one per CPU
+    const StegContext *steg;    // Its reporter gets the summary
+} ScanOptions;
+
+/* Scans every root
+ * Returns e_success if every directory and file could be read
+ */
+Status run_scan( const ScanOptions *opts );
+
+#endif
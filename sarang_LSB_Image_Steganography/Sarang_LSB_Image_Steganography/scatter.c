@@ -0,0 +1,382 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "scatter.h"
+#include "blockio.h"
+#include "lsb.h"
+#include "types.h"
+
+#define SCATTER_RADIX_BITS 11   // Digit of the radix sort
+#define SCATTER_PLACE_MASK ( ( ( uint64_t )1 << SCATTER_INDEX_BITS ) - 1 )
+
+/* Function Definitions */
+
+/* splitmix64 finalizer, for the round keys */
+static uint64_t mix( uint64_t x )
+{
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+
+    return x;
+}
+
+/* Derives the permutation and allocates the batch buffers */
+Status scatter_init( Scatter *sc, const char *key, size_t base, size_t domain, int encrypt, uint64_t salt )
+{
+    uint64_t hash = 0xCBF29CE484222325ULL; // FNV-1a of the key
+
+    memset( sc, 0, sizeof( *sc ) );
+    if( key == NULL || key[0] == '\0' || domain == 0 || ( uint64_t )( base + domain ) >> ( 64 - SCATTER_INDEX_BITS ) != 0 )
+    {
+        return e_failure;
+    }
+
+    for( const uchar *k = ( const uchar * )key; *k; k++ )
+        hash = ( hash ^ *k ) * 0x100000001B3ULL;
+
+    // Smallest even bit count that holds every index of the domain
+    int bits = 2;
+    while( bits < 64 && ( ( uint64_t )1 << bits ) < domain )
+        bits += 2;
+
+    // Round keys differ per domain size and salt, so one key places the data of two images differently
+    for( int r = 0; r < SCATTER_ROUNDS; r++ )
+        sc -> round_key[r] = mix( ( hash ^ domain ^ mix( salt ) ) + ( r + 1 ) * 0x9E3779B97F4A7C15ULL );
+
+    sc -> order = malloc( SCATTER_BATCH * sizeof( uint64_t ) );
+    sc -> spare = malloc( SCATTER_BATCH * sizeof( uint64_t ) );
+    sc -> stage = malloc( SCATTER_BATCH );
+    sc -> window = malloc( SCATTER_WINDOW );
+    if( sc -> order == NULL || sc -> spare == NULL || sc -> stage == NULL || sc -> window == NULL )
+    {
+        scatter_free( sc );
+        return e_failure;
+    }
+
+    sc -> base = base;
+    sc -> domain = domain;
+    sc -> half = bits / 2;
+    sc -> encrypted = encrypt;
+    if( encrypt )
+    {
+        chacha_init( &sc -> cipher, key, salt );
+        poly1305_init( &sc -> mac, sc -> cipher.mac_key );
+    }
+
+    return e_success;
+}
+
+/* One pass of the Feistel network over 2 * sc -> half bits
+ * The round function is the top half bits of a multiplicative hash of
+ * the right half and the round key
+ */
+static uint64_t feistel( const Scatter *sc, uint64_t x )
+{
+    uint64_t mask = ( ( uint64_t )1 << sc -> half ) - 1;
+    uint64_t left = x >> sc -> half;
+    uint64_t right = x & mask;
+
+    for( int r = 0; r < SCATTER_ROUNDS; r++ )
+    {
+        uint64_t next = left ^ ( ( right ^ sc -> round_key[r] ) * 0x9E3779B97F4A7C15ULL ) >> ( 64 - sc -> half );
+
+        left = right;
+        right = next;
+    }
+
+    return left << sc -> half | right;
+}
+
+/* Carrier byte of data carrier byte i
+ * Cycle walking: the network permutes the whole power of 2, indices past
+ * the domain are sent through it again until one lands inside, which
+ * keeps a permutation of the domain and takes less than 4 passes on average
+ */
+size_t scatter_position( const Scatter *sc, size_t i )
+{
+    uint64_t x = i;
+
+    do
+        x = feistel( sc, x );
+    while( x >= sc -> domain );
+
+    return sc -> base + x;
+}
+
+/* Places data carrier bytes first .. first + m - 1 and sorts them by
+ * window, the SCATTER_WINDOW aligned file bytes they fall into; inside a
+ * window the order does not matter, it is cache resident
+ * Returns the sorted batch, file offset above SCATTER_INDEX_BITS and place below
+ */
+static const uint64_t *place_batch( Scatter *sc, const BmpInfo *bmp, size_t first, size_t m )
+{
+    uint64_t *a = sc -> order, *b = sc -> spare;
+    size_t count[ 1 << SCATTER_RADIX_BITS ];
+    uint64_t high = 0;
+
+    for( size_t k = 0; k < m; k++ )
+    {
+        a[k] = ( uint64_t )bmp_offset( bmp, scatter_position( sc, first + k ) ) << SCATTER_INDEX_BITS | k;
+        high |= a[k];
+    }
+
+    // Least significant digit first over the window bits only, one pass up to 2^( 16 + 11 ) bytes
+    for( int shift = SCATTER_INDEX_BITS + SCATTER_WINDOW_SHIFT; shift < 64 && ( high >> shift ) != 0; shift += SCATTER_RADIX_BITS )
+    {
+        size_t sum = 0;
+
+        memset( count, 0, sizeof( count ) );
+        for( size_t k = 0; k < m; k++ )
+            count[ ( a[k] >> shift ) & ( ( 1 << SCATTER_RADIX_BITS ) - 1 ) ]++;
+        for( size_t d = 0; d < ( 1 << SCATTER_RADIX_BITS ); d++ )
+        {
+            size_t c = count[d];
+
+            count[d] = sum;
+            sum += c;
+        }
+        for( size_t k = 0; k < m; k++ )
+            b[ count[ ( a[k] >> shift ) & ( ( 1 << SCATTER_RADIX_BITS ) - 1 ) ]++ ] = a[k];
+
+        uint64_t *t = a;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+/* Moves the m carrier bytes of a sorted batch between fd and the stage a
+ * window at a time, only the bytes from its first to its last position
+ * are read: in copies them into the stage, otherwise they are patched
+ * from the stage and written back
+ */
+static Status run_windows( Scatter *sc, const uint64_t *order, size_t m, int fd, int in )
+{
+    for( size_t i = 0; i < m; )
+    {
+        uint64_t window = order[i] >> ( SCATTER_INDEX_BITS + SCATTER_WINDOW_SHIFT );
+        off_t lo = order[i] >> SCATTER_INDEX_BITS, hi = lo;
+        size_t j = i + 1;
+
+        for( ; j < m && order[j] >> ( SCATTER_INDEX_BITS + SCATTER_WINDOW_SHIFT ) == window; j++ )
+        {
+            off_t off = order[j] >> SCATTER_INDEX_BITS;
+
+            lo = off < lo ? off : lo;
+            hi = off > hi ? off : hi;
+        }
+
+        if( pread_full( fd, sc -> window, hi - lo + 1, lo ) != 0 )
+        {
+            return e_failure;
+        }
+        for( size_t k = i; k < j; k++ )
+        {
+            size_t at = ( order[k] >> SCATTER_INDEX_BITS ) - lo;
+
+            if( in )
+                sc -> stage[ order[k] & SCATTER_PLACE_MASK ] = sc -> window[ at ];
+            else
+                sc -> window[ at ] = sc -> stage[ order[k] & SCATTER_PLACE_MASK ];
+        }
+        if( !in && pwrite_full( fd, sc -> window, hi - lo + 1, lo ) != 0 )
+        {
+            return e_failure;
+        }
+        i = j;
+    }
+
+    return e_success;
+}
+
+/* Gathers the carrier bytes of a sorted batch into the stage, from src or fd */
+static Status gather( Scatter *sc, const uint64_t *order, size_t m, const uchar *src, int fd )
+{
+    if( src == NULL )
+    {
+        return run_windows( sc, order, m, fd, 1 );
+    }
+
+    for( size_t k = 0; k < m; k++ )
+        sc -> stage[ order[k] & SCATTER_PLACE_MASK ] = src[ order[k] >> SCATTER_INDEX_BITS ];
+
+    return e_success;
+}
+
+/* Puts the stage back to the carrier bytes of a sorted batch, to dst or fd */
+static Status put( Scatter *sc, const uint64_t *order, size_t m, uchar *dst, int fd )
+{
+    if( dst == NULL )
+    {
+        return run_windows( sc, order, m, fd, 0 );
+    }
+
+    for( size_t k = 0; k < m; k++ )
+        dst[ order[k] >> SCATTER_INDEX_BITS ] = sc -> stage[ order[k] & SCATTER_PLACE_MASK ];
+
+    return e_success;
+}
+
+/* Takes n encrypted payload bytes from offset on into the tag, if they
+ * go on where it is; once they do not it is never ended
+ */
+static void mac_update( Scatter *sc, uint64_t offset, const uchar *data, size_t n )
+{
+    if( offset != sc -> mac_next )
+    {
+        sc -> mac_next = UINT64_MAX;
+        return;
+    }
+
+    poly1305_update( &sc -> mac, data, n );
+    sc -> mac_next += n;
+}
+
+/* Data carrier byte of carrier byte pos, e_failure if n payload bytes from there leave the domain */
+static Status data_start( const Scatter *sc, int bits, size_t pos, size_t n, size_t *first )
+{
+    if( pos < sc -> base || pos - sc -> base > sc -> domain || LSB_CARRIER( n, bits ) > sc -> domain - ( pos - sc -> base ) )
+    {
+        return e_failure;
+    }
+    *first = pos - sc -> base;
+
+    return e_success;
+}
+
+/* Embeds n payload bytes a batch at a time, encrypting them on the way */
+Status scatter_embed( Scatter *sc, const BmpInfo *bmp, int bits, const uchar *data, size_t n, size_t pos,
+                      const uchar *src, uchar *dst, int fd )
+{
+    size_t per = LSB_CARRIER( 1, bits );
+    size_t first;
+
+    if( data_start( sc, bits, pos, n, &first ) != e_success )
+    {
+        return e_failure; // Not enough image left
+    }
+
+    while( n > 0 )
+    {
+        size_t bytes = n < SCATTER_BATCH / per ? n : SCATTER_BATCH / per;
+        size_t m = bytes * per;
+        const uint64_t *order = place_batch( sc, bmp, first, m );
+
+        if( gather( sc, order, m, src, fd ) != e_success )
+        {
+            return e_failure;
+        }
+        if( sc -> encrypted )
+        {
+            uchar sealed[ SCATTER_CIPHER_BLOCK ];
+
+            // Keystream XOR and embed of each block back to back, it never leaves L1
+            for( size_t done = 0, len; done < bytes; done += len )
+            {
+                uchar *stage = sc -> stage + done * per;
+
+                len = bytes - done < SCATTER_CIPHER_BLOCK ? bytes - done : SCATTER_CIPHER_BLOCK;
+                chacha_xor( &sc -> cipher, first / per + done, data + done, sealed, len );
+                mac_update( sc, first / per + done, sealed, len );
+                lsb_embed_bits( bits, sealed, len, stage, stage );
+            }
+        }
+        else
+        {
+            lsb_embed_bits( bits, data, bytes, sc -> stage, sc -> stage );
+        }
+        if( put( sc, order, m, dst, fd ) != e_success )
+        {
+            return e_failure;
+        }
+
+        first += m;
+        data += bytes;
+        n -= bytes;
+    }
+
+    return e_success;
+}
+
+/* Extracts n payload bytes a batch at a time, decrypting them on the way */
+Status scatter_extract( Scatter *sc, const BmpInfo *bmp, int bits, const uchar *src, int fd, size_t pos, size_t n, uchar *data )
+{
+    size_t per = LSB_CARRIER( 1, bits );
+    size_t first;
+
+    if( data_start( sc, bits, pos, n, &first ) != e_success )
+    {
+        return e_failure; // Stego image ends before the data does
+    }
+
+    while( n > 0 )
+    {
+        size_t bytes = n < SCATTER_BATCH / per ? n : SCATTER_BATCH / per;
+        size_t m = bytes * per;
+
+        if( gather( sc, place_batch( sc, bmp, first, m ), m, src, fd ) != e_success )
+        {
+            return e_failure;
+        }
+        if( sc -> encrypted )
+        {
+            for( size_t done = 0, len; done < bytes; done += len )
+            {
+                len = bytes - done < SCATTER_CIPHER_BLOCK ? bytes - done : SCATTER_CIPHER_BLOCK;
+                lsb_extract_bits( bits, sc -> stage + done * per, len, data + done );
+                mac_update( sc, first / per + done, data + done, len );
+                chacha_xor( &sc -> cipher, first / per + done, data + done, data + done, len );
+            }
+        }
+        else
+        {
+            lsb_extract_bits( bits, sc -> stage, bytes, data );
+        }
+
+        first += m;
+        data += bytes;
+        n -= bytes;
+    }
+
+    return e_success;
+}
+
+/* Pads the payload bytes, takes the aad, pads it and takes both lengths */
+Status scatter_tag( Scatter *sc, uint64_t size, const uchar *aad, size_t aad_len, uchar tag[ POLY1305_TAG ] )
+{
+    static const uchar zeros[16];
+    uchar lengths[16];
+
+    if( !sc -> encrypted || sc -> mac_next != size )
+    {
+        return e_failure;
+    }
+
+    poly1305_update( &sc -> mac, zeros, ( 16 - size % 16 ) % 16 );
+    poly1305_update( &sc -> mac, aad, aad_len );
+    poly1305_update( &sc -> mac, zeros, ( 16 - aad_len % 16 ) % 16 );
+    for( int i = 0; i < 8; i++ )
+    {
+        lengths[i] = size >> 8 * i;
+        lengths[ 8 + i ] = ( uint64_t )aad_len >> 8 * i;
+    }
+    poly1305_update( &sc -> mac, lengths, sizeof( lengths ) );
+    poly1305_final( &sc -> mac, tag );
+    sc -> mac_next = UINT64_MAX;
+
+    return e_success;
+}
+
+/* Frees the batch buffers */
+void scatter_free( Scatter *sc )
+{
+    free( sc -> order );
+    free( sc -> spare );
+    free( sc -> stage );
+    free( sc -> window );
+    memset( sc, 0, sizeof( *sc ) );
+}
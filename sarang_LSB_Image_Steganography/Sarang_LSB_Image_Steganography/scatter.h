@@ -0,0 +1,101 @@
+#ifndef SCATTER_H
+#define SCATTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h" // Contains user defined types
+#include "bmp.h"
+#include "chacha.h"
+
+/*
+ * Keyed scatter
+ * With a key the data does not take the carrier bytes right after the
+ * fields one by one: carrier byte i of the data, chunk index included,
+ * goes to carrier byte base + P( i ), where P is a permutation of the
+ * domain, every carrier byte from base to the end of the image. P is a
+ * balanced Feistel network of SCATTER_ROUNDS rounds over the smallest
+ * even number of bits that holds the domain, walked until it lands
+ * inside it, with round keys hashed from the key and the domain size.
+ * It is computed for each position as it is needed, never stored.
+ * The key is not stretched and the rounds are no cipher: they decide
+ * where the bits go, not what they are.
+ * Positions are placed SCATTER_BATCH carrier bytes at a time: the batch
+ * is radix sorted by the SCATTER_WINDOW aligned file window each falls
+ * into, its carrier bytes are gathered into a stage in data order, run
+ * through the LSB kernels and put back window by window. Maps are walked
+ * front to back; descriptors are read and written once per window the
+ * batch touches. Memory stays at about 17 bytes per batch carrier byte
+ * plus a window, whatever the size of the image.
+ * Encrypted data is XORed with ChaCha20 of the key, see chacha.h, inside
+ * the same loops: SCATTER_CIPHER_BLOCK payload bytes are encrypted into a
+ * buffer and embedded into the stage, or extracted from it and decrypted
+ * where they land, while they are in L1. Keystream byte i goes with data
+ * byte i, so ranges and the chunk index decrypt on their own.
+ * The encrypted bytes are taken into a Poly1305 tag, see poly1305.h, in
+ * the same loops, as long as they come in order from payload byte 0:
+ * scatter_tag() ends it after the data, before the chunk index, on
+ * encode and on a decode of all of it. A range leaves it unfinished.
+ */
+
+#define SCATTER_ROUNDS 4
+#define SCATTER_BATCH ( 1 << 20 )       // Carrier bytes per sort, a multiple of 8
+#define SCATTER_INDEX_BITS 20           // Bits of a carrier byte's place in its batch
+#define SCATTER_WINDOW_SHIFT 16
+#define SCATTER_WINDOW ( 1 << SCATTER_WINDOW_SHIFT )   // Aligned file bytes read and written at once
+#define SCATTER_CIPHER_BLOCK 4096       // Payload bytes encrypted or decrypted at once, a multiple of CHACHA_BLOCK
+
+/* Permutation and batch buffers of one encode or decode */
+typedef struct _Scatter
+{
+    size_t base;        // Carrier byte of data carrier byte 0, the first after the fields
+    size_t domain;      // Carrier bytes from base to the end of the image, 0 if not scattered
+    int half;           // Bits of each Feistel half
+    uint64_t round_key[ SCATTER_ROUNDS ];
+    uint64_t *order;    // File offset and batch place of every carrier byte of a batch
+    uint64_t *spare;    // Second buffer of the radix sort
+    uchar *stage;       // Carrier bytes of a batch in data order
+    uchar *window;      // File bytes around neighbouring positions
+    int encrypted;      // The payload bytes are XORed with cipher
+    ChaCha cipher;
+    Poly1305 mac;       // Tag of the encrypted payload bytes
+    uint64_t mac_next;  // Payload byte the tag goes on at, UINT64_MAX once they came out of order
+} Scatter;
+
+/* Derives the permutation of domain carrier bytes from base for key and
+ * allocates the batch buffers, with encrypt the cipher of key too
+ * The salt of encrypted data, random per encode, goes into both, so one
+ * key never places or encrypts two secrets alike; without encrypt it is 0
+ * Returns e_failure for an empty key or domain, or if allocation fails
+ */
+Status scatter_init( Scatter *sc, const char *key, size_t base, size_t domain, int encrypt, uint64_t salt );
+
+/* Carrier byte of data carrier byte i, i below sc -> domain */
+size_t scatter_position( const Scatter *sc, size_t i );
+
+/* Embeds n payload bytes at bits per carrier byte into the scattered
+ * carrier bytes of data carrier bytes pos - sc -> base onwards, encrypted
+ * if sc is
+ * They are read from the map src and written to the map dst, or without
+ * maps read from and written back to fd, which has to be open read write
+ */
+Status scatter_embed( Scatter *sc, const BmpInfo *bmp, int bits, const uchar *data, size_t n, size_t pos,
+                      const uchar *src, uchar *dst, int fd );
+
+/* Extracts n payload bytes at bits per carrier byte from the same carrier
+ * bytes, read from the map src or without one from fd, decrypted if sc is
+ */
+Status scatter_extract( Scatter *sc, const BmpInfo *bmp, int bits, const uchar *src, int fd, size_t pos, size_t n, uchar *data );
+
+/* Ends the tag of encrypted payload bytes 0 .. size - 1 and the aad_len
+ * bytes of aad after them, which are not encrypted; both are padded to
+ * 16 bytes and followed by their lengths, as RFC 8439 2.8 does with the
+ * two the other way round
+ * Returns e_failure if sc is not encrypted or the payload bytes did not
+ * all go through it in order, the tag cannot be ended twice
+ */
+Status scatter_tag( Scatter *sc, uint64_t size, const uchar *aad, size_t aad_len, uchar tag[ POLY1305_TAG ] );
+
+/* Frees the batch buffers, sc is not scattered afterwards */
+void scatter_free( Scatter *sc );
+
+#endif
@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "sha256.h"
+#include "types.h"
+
+#define ROTR32( v, n ) ( ( ( v ) >> ( n ) ) | ( ( v ) << ( 32 - ( n ) ) ) )
+
+/* Round constants, the cube roots of the first 64 primes */
+static const uint32_t k[64] =
+{
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+/* Keys of HMAC: the states after the password XORed with the pads */
+typedef struct _Hmac
+{
+    Sha256 inner;
+    Sha256 outer;
+} Hmac;
+
+/* Function Definitions */
+
+/* One compression of a 64 byte block into the state, words big endian */
+static void compress( uint32_t h[8], const uchar *block )
+{
+    uint32_t w[64], a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], x = h[7];
+
+    for( int i = 0; i < 16; i++ )
+        w[i] = ( uint32_t )block[ 4 * i ] << 24 | ( uint32_t )block[ 4 * i + 1 ] << 16 | ( uint32_t )block[ 4 * i + 2 ] << 8 | block[ 4 * i + 3 ];
+    for( int i = 16; i < 64; i++ )
+    {
+        uint32_t s0 = ROTR32( w[ i - 15 ], 7 ) ^ ROTR32( w[ i - 15 ], 18 ) ^ ( w[ i - 15 ] >> 3 );
+        uint32_t s1 = ROTR32( w[ i - 2 ], 17 ) ^ ROTR32( w[ i - 2 ], 19 ) ^ ( w[ i - 2 ] >> 10 );
+
+        w[i] = w[ i - 16 ] + s0 + w[ i - 7 ] + s1;
+    }
+
+    for( int i = 0; i < 64; i++ )
+    {
+        uint32_t t1 = x + ( ROTR32( e, 6 ) ^ ROTR32( e, 11 ) ^ ROTR32( e, 25 ) ) + ( ( e & f ) ^ ( ~e & g ) ) + k[i] + w[i];
+        uint32_t t2 = ( ROTR32( a, 2 ) ^ ROTR32( a, 13 ) ^ ROTR32( a, 22 ) ) + ( ( a & b ) ^ ( a & c ) ^ ( b & c ) );
+
+        x = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+    h[5] += f;
+    h[6] += g;
+    h[7] += x;
+}
+
+/* Starts a hash from the initial values, the square roots of the first 8 primes */
+void sha256_init( Sha256 *s )
+{
+    static const uint32_t iv[8] = { 0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19 };
+
+    memcpy( s -> h, iv, sizeof( iv ) );
+    s -> len = 0;
+}
+
+/* Fills the block buffer and compresses it whenever it is full */
+void sha256_update( Sha256 *s, const void *data, size_t n )
+{
+    const uchar *p = data;
+    size_t fill = s -> len % SHA256_BLOCK;
+
+    s -> len += n;
+    while( n > 0 )
+    {
+        size_t len = SHA256_BLOCK - fill < n ? SHA256_BLOCK - fill : n;
+
+        if( fill == 0 && len == SHA256_BLOCK )
+        {
+            compress( s -> h, p ); // Whole blocks straight from the data
+        }
+        else
+        {
+            memcpy( s -> buf + fill, p, len );
+            if( fill + len == SHA256_BLOCK )
+                compress( s -> h, s -> buf );
+        }
+
+        p += len;
+        n -= len;
+        fill = 0;
+    }
+}
+
+/* 0x80, zeros up to 8 bytes before a block end and the bit length */
+void sha256_final( Sha256 *s, uchar out[ SHA256_SIZE ] )
+{
+    size_t fill = s -> len % SHA256_BLOCK;
+    uint64_t bits = s -> len * 8;
+
+    s -> buf[ fill++ ] = 0x80;
+    if( fill > SHA256_BLOCK - 8 )
+    {
+        memset( s -> buf + fill, 0, SHA256_BLOCK - fill );
+        compress( s -> h, s -> buf );
+        fill = 0;
+    }
+    memset( s -> buf + fill, 0, SHA256_BLOCK - 8 - fill );
+    for( int i = 0; i < 8; i++ )
+        s -> buf[ SHA256_BLOCK - 1 - i ] = bits >> 8 * i;
+    compress( s -> h, s -> buf );
+
+    for( int i = 0; i < 8; i++ )
+    {
+        out[ 4 * i ] = s -> h[i] >> 24;
+        out[ 4 * i + 1 ] = s -> h[i] >> 16;
+        out[ 4 * i + 2 ] = s -> h[i] >> 8;
+        out[ 4 * i + 3 ] = s -> h[i];
+    }
+}
+
+/* Absorbs the password XORed with the inner and outer pads, a password
+ * longer than a block is hashed first
+ */
+static void hmac_init( Hmac *m, const uchar *pass, size_t pass_len )
+{
+    uchar key[ SHA256_BLOCK ] = { 0 }, pad[ SHA256_BLOCK ];
+
+    if( pass_len > SHA256_BLOCK )
+    {
+        sha256_init( &m -> inner );
+        sha256_update( &m -> inner, pass, pass_len );
+        sha256_final( &m -> inner, key );
+    }
+    else
+    {
+        memcpy( key, pass, pass_len );
+    }
+
+    for( int i = 0; i < SHA256_BLOCK; i++ )
+        pad[i] = key[i] ^ 0x36;
+    sha256_init( &m -> inner );
+    sha256_update( &m -> inner, pad, SHA256_BLOCK );
+    for( int i = 0; i < SHA256_BLOCK; i++ )
+        pad[i] = key[i] ^ 0x5C;
+    sha256_init( &m -> outer );
+    sha256_update( &m -> outer, pad, SHA256_BLOCK );
+}
+
+/* HMAC of the n bytes of data, or of data followed by the 4 bytes of more */
+static void hmac( const Hmac *m, const uchar *data, size_t n, const uchar *more, uchar out[ SHA256_SIZE ] )
+{
+    Sha256 s = m -> inner;
+
+    sha256_update( &s, data, n );
+    if( more )
+        sha256_update( &s, more, 4 );
+    sha256_final( &s, out );
+
+    s = m -> outer;
+    sha256_update( &s, out, SHA256_SIZE );
+    sha256_final( &s, out );
+}
+
+/* Block i of the output is U1 ^ U2 ^ .. of U1 = HMAC( salt || i ), Uj = HMAC( Uj-1 ) */
+void pbkdf2_sha256( const uchar *pass, size_t pass_len, const uchar *salt, size_t salt_len, uint32_t rounds,
+                    uchar *out, size_t n )
+{
+    Hmac m;
+
+    hmac_init( &m, pass, pass_len );
+    for( uint32_t block = 1; n > 0; block++ )
+    {
+        uchar count[4] = { block >> 24, block >> 16, block >> 8, block };
+        uchar u[ SHA256_SIZE ], t[ SHA256_SIZE ];
+        size_t len = n < SHA256_SIZE ? n : SHA256_SIZE;
+
+        hmac( &m, salt, salt_len, count, u );
+        memcpy( t, u, SHA256_SIZE );
+        for( uint32_t r = 1; r < rounds; r++ )
+        {
+            hmac( &m, u, SHA256_SIZE, NULL, u );
+            for( int i = 0; i < SHA256_SIZE; i++ )
+                t[i] ^= u[i];
+        }
+
+        memcpy( out, t, len );
+        out += len;
+        n -= len;
+    }
+}
+
+/* FIPS 180-4 "abc" and the two block message, RFC 7914 and the common
+ * 4096 round PBKDF2 vectors
+ */
+Status sha256_self_test( void )
+{
+    static const char two_blocks[] = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    static const uchar abc_digest[ SHA256_SIZE ] =
+    {
+        0xBA, 0x78, 0x16, 0xBF, 0x8F, 0x01, 0xCF, 0xEA, 0x41, 0x41, 0x40, 0xDE, 0x5D, 0xAE, 0x22, 0x23,
+        0xB0, 0x03, 0x61, 0xA3, 0x96, 0x17, 0x7A, 0x9C, 0xB4, 0x10, 0xFF, 0x61, 0xF2, 0x00, 0x15, 0xAD
+    };
+    static const uchar two_digest[ SHA256_SIZE ] =
+    {
+        0x24, 0x8D, 0x6A, 0x61, 0xD2, 0x06, 0x38, 0xB8, 0xE5, 0xC0, 0x26, 0x93, 0x0C, 0x3E, 0x60, 0x39,
+        0xA3, 0x3C, 0xE4, 0x59, 0x64, 0xFF, 0x21, 0x67, 0xF6, 0xEC, 0xED, 0xD4, 0x19, 0xDB, 0x06, 0xC1
+    };
+    static const uchar passwd_key[64] =  // "passwd", "salt", 1 round
+    {
+        0x55, 0xAC, 0x04, 0x6E, 0x56, 0xE3, 0x08, 0x9F, 0xEC, 0x16, 0x91, 0xC2, 0x25, 0x44, 0xB6, 0x05,
+        0xF9, 0x41, 0x85, 0x21, 0x6D, 0xDE, 0x04, 0x65, 0xE6, 0x8B, 0x9D, 0x57, 0xC2, 0x0D, 0xAC, 0xBC,
+        0x49, 0xCA, 0x9C, 0xCC, 0xF1, 0x79, 0xB6, 0x45, 0x99, 0x16, 0x64, 0xB3, 0x9D, 0x77, 0xEF, 0x31,
+        0x7C, 0x71, 0xB8, 0x45, 0xB1, 0xE3, 0x0B, 0xD5, 0x09, 0x11, 0x20, 0x41, 0xD3, 0xA1, 0x97, 0x83
+    };
+    static const uchar password_key[ SHA256_SIZE ] =    // "password", "salt", 4096 rounds
+    {
+        0xC5, 0xE4, 0x78, 0xD5, 0x92, 0x88, 0xC8, 0x41, 0xAA, 0x53, 0x0D, 0xB6, 0x84, 0x5C, 0x4C, 0x8D,
+        0x96, 0x28, 0x93, 0xA0, 0x01, 0xCE, 0x4E, 0x11, 0xA4, 0x96, 0x38, 0x73, 0xAA, 0x98, 0x13, 0x4A
+    };
+    uchar digest[ SHA256_SIZE ], key[64];
+    Sha256 s;
+    int ok;
+
+    sha256_init( &s );
+    sha256_update( &s, "abc", 3 );
+    sha256_final( &s, digest );
+    ok = memcmp( digest, abc_digest, SHA256_SIZE ) == 0;
+
+    // Fed in uneven pieces, across the block end
+    sha256_init( &s );
+    for( size_t i = 0; i < sizeof( two_blocks ) - 1; i += 5 )
+        sha256_update( &s, two_blocks + i, sizeof( two_blocks ) - 1 - i < 5 ? sizeof( two_blocks ) - 1 - i : 5 );
+    sha256_final( &s, digest );
+    ok = ok && memcmp( digest, two_digest, SHA256_SIZE ) == 0;
+
+    pbkdf2_sha256( ( const uchar * )"passwd", 6, ( const uchar * )"salt", 4, 1, key, sizeof( passwd_key ) );
+    ok = ok && memcmp( key, passwd_key, sizeof( passwd_key ) ) == 0;
+    pbkdf2_sha256( ( const uchar * )"password", 8, ( const uchar * )"salt", 4, 4096, key, sizeof( password_key ) );
+    ok = ok && memcmp( key, password_key, sizeof( password_key ) ) == 0;
+
+    printf( "sha256/pbkdf2 %s\n", ok ? "ok" : "MISMATCH" );
+
+    return ok ? e_success : e_failure;
+}
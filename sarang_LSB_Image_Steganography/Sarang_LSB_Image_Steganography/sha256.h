@@ -0,0 +1,44 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h" // Contains user defined types
+
+/*
+ * SHA-256, FIPS 180-4, and PBKDF2 with HMAC-SHA256, RFC 8018
+ * Only the key derivation of chacha.h uses them, once per encode or
+ * decode, so they are plain C. HMAC keeps the inner and outer states of
+ * the password, so an iteration of PBKDF2 costs two compressions.
+ */
+
+#define SHA256_BLOCK 64     // Bytes per compression
+#define SHA256_SIZE 32      // Bytes of a digest
+
+/* State of one hash */
+typedef struct _Sha256
+{
+    uint32_t h[8];
+    uint64_t len;       // Bytes hashed so far
+    uchar buf[ SHA256_BLOCK ];
+} Sha256;
+
+/* Starts a hash */
+void sha256_init( Sha256 *s );
+
+/* Hashes n more bytes of data */
+void sha256_update( Sha256 *s, const void *data, size_t n );
+
+/* Pads the hash and writes its digest */
+void sha256_final( Sha256 *s, uchar out[ SHA256_SIZE ] );
+
+/* Derives n bytes to out from the password pass of pass_len bytes and
+ * the salt with rounds iterations of HMAC-SHA256 per 32 bytes
+ */
+void pbkdf2_sha256( const uchar *pass, size_t pass_len, const uchar *salt, size_t salt_len, uint32_t rounds,
+                    uchar *out, size_t n );
+
+/* Checks SHA-256 and PBKDF2 against published test vectors, prints one line */
+Status sha256_self_test( void );
+
+#endif
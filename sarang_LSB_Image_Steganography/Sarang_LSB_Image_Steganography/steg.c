@@ -0,0 +1,919 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "steg.h"
+#include "encode.h"
+#include "decode.h"
+#include "lsb.h"
+#include "crc32c.h"
+#include "chunk_index.h"
+#include "container.h"
+#include "undo.h"
+#include "types.h"
+
+#define PROBE_READ 4096     // First read of a probe, header and first rows of most images
+
+/* Carrier bytes of the longest fields before the data: magic string,
+ * extension size, extension, file size, stored size and checksum, all at 1 bit
+ */
+#define PROBE_CARRIER ( ( 2 + 8 + STEG_MAX_EXTN + 8 + 8 + 8 ) * 8 )
+
+/* Function Definitions */
+
+/* Initialise ctx with the defaults: stdio engine and I/O, serial, quiet, 1 bit,
+ * uncompressed, without a CRC32C or chunk index, decodes of the whole secret
+ */
+void steg_context_init( StegContext *ctx )
+{
+    ctx -> engine = eng_stdio;
+    ctx -> block_size = 0;
+    ctx -> threads = 1;
+    ctx -> pipeline = 0;
+    ctx -> in_place = 0;
+    ctx -> extn = NULL;
+    ctx -> bits = 1;
+    ctx -> codec = codec_none;
+    ctx -> crc = 0;
+    ctx -> index = 0;
+    ctx -> key = NULL;
+    ctx -> encrypt = 0;
+    ctx -> io = io_stdio;
+    ctx -> range_offset = 0;
+    ctx -> range_length = 0;
+    ctx -> header_cb = NULL;
+    ctx -> header_user = NULL;
+    reporter_init( &ctx -> reporter, r_quiet );
+}
+
+/* Message for an error code */
+const char *steg_strerror( StegError error )
+{
+    switch( error )
+    {
+        case steg_ok:               return "success";
+        case steg_err_args:         return "invalid argument";
+        case steg_err_io:           return "input/output error";
+        case steg_err_nomem:        return "out of memory";
+        case steg_err_format:       return "not a bmp image";
+        case steg_err_capacity:     return "secret does not fit the image";
+        case steg_err_empty:        return "empty secret";
+        case steg_err_not_stegged:  return "image is not stegged";
+        case steg_err_corrupt:      return "stego fields are corrupt";
+        case steg_err_space:        return "output buffer too small";
+        case steg_err_checksum:     return "data does not match its checksum";
+        case steg_err_range:        return "range is outside the secret";
+        case steg_err_not_container: return "image holds no container";
+        case steg_err_entry:        return "no such entry";
+        case steg_err_pending:      return "an interrupted in-place encode needs a rollback";
+        case steg_err_key:          return "data is scattered with a key, none was given";
+    }
+
+    return "unknown error";
+}
+
+/* Secret bytes a bmp image in memory can carry */
+size_t steg_capacity( const void *image, size_t image_size, size_t extn_len )
+{
+    return steg_capacity_bits( image, image_size, extn_len, 1 );
+}
+
+/* Secret bytes at bits per carrier byte that fit the image of bmp after fields bytes of header fields
+ * Same rule as check_capacity(), header fields at 1 bit, the data at bits
+ */
+static size_t data_capacity( const BmpInfo *bmp, size_t fields, int bits )
+{
+    size_t carrier = bmp -> capacity;
+
+    fields *= 8;
+
+    return carrier > fields ? ( carrier - fields ) * bits / 8 : 0;
+}
+
+/* Same at bits per carrier byte */
+size_t steg_capacity_bits( const void *image, size_t image_size, size_t extn_len, int bits )
+{
+    BmpInfo bmp;
+
+    if( image == NULL || !lsb_bits_valid( bits ) || bmp_parse( image, image_size, &bmp ) != e_success )
+    {
+        return 0;
+    }
+
+    return data_capacity( &bmp, 18 + extn_len + 8, bits ); // 2 MS + 8 extn size + extn + 8 file size + 8 crc
+}
+
+/* Fills result from what decInfo decoded, output only for the file calls */
+static void decode_result( const DecodeInfo *decInfo, StegResult *result, const char *output )
+{
+    size_t offset, length;
+
+    if( result == NULL )
+        return;
+
+    result -> secret_size = decInfo -> file_size;
+    strcpy( result -> extn, decInfo -> extn_secret_file );
+    result -> bits = decInfo -> bits;
+    result -> codec = decInfo -> codec;
+    result -> has_crc = decInfo -> has_crc && !decInfo -> crc_masked;
+    result -> crc = decInfo -> crc;
+    result -> has_index = decInfo -> has_index;
+    result -> container = decInfo -> container;
+    result -> scattered = decInfo -> scattered;
+    result -> encrypted = decInfo -> encrypted;
+    result -> io_enters = decInfo -> uring.stats.enters;
+    result -> output_size = decInfo -> file_size;
+    if( decInfo -> range && decode_range_bounds( decInfo, &offset, &length ) == d_success )
+        result -> output_size = length;
+    snprintf( result -> output, sizeof( result -> output ), "%s", output ? output : "" );
+}
+
+/* Hands the decoded fields to the context's header callback */
+static void header_trampoline( const DecodeInfo *decInfo, void *user )
+{
+    const StegContext *ctx = user;
+    StegResult result;
+
+    decode_result( decInfo, &result, decInfo -> secret_fname );
+    ctx -> header_cb( &result, ctx -> header_user );
+}
+
+/* Copies the context settings shared by every call into encInfo */
+static void encode_settings( const StegContext *ctx, EncodeInfo *encInfo )
+{
+    encInfo -> engine = ctx -> engine == eng_mmap ? eng_mmap : eng_stdio;
+    encInfo -> io = encInfo -> engine == eng_stdio ? ctx -> io : io_stdio;
+    encInfo -> block_size = ctx -> block_size;
+    encInfo -> threads = ctx -> threads;
+    encInfo -> pipeline = ctx -> pipeline;
+    encInfo -> bits = ctx -> bits;
+    encInfo -> codec = ctx -> codec;
+    encInfo -> crc = ctx -> crc;
+    encInfo -> index = ctx -> index;
+    encInfo -> key = ctx -> key;
+    encInfo -> encrypt = ctx -> encrypt;
+    encInfo -> reporter = &ctx -> reporter;
+}
+
+/* Same for decInfo */
+static void decode_settings( const StegContext *ctx, DecodeInfo *decInfo )
+{
+    decInfo -> engine = ctx -> engine == eng_mmap ? eng_mmap : eng_stdio;
+    decInfo -> io = decInfo -> engine == eng_stdio ? ctx -> io : io_stdio;
+    decInfo -> block_size = ctx -> block_size;
+    decInfo -> threads = ctx -> threads;
+    decInfo -> pipeline = ctx -> pipeline;
+    decInfo -> key = ctx -> key;
+    decInfo -> reporter = &ctx -> reporter;
+    decInfo -> range = ctx -> range_offset > 0 || ctx -> range_length > 0;
+    decInfo -> range_offset = ctx -> range_offset;
+    decInfo -> range_length = ctx -> range_length;
+    if( ctx -> header_cb )
+    {
+        decInfo -> header_cb = header_trampoline;
+        decInfo -> header_user = ( void * )ctx;
+    }
+}
+
+/* Stores extn, ".txt", in encInfo
+ * Returns steg_err_args if it is no extension or too long to be decoded
+ */
+static StegError set_extn( EncodeInfo *encInfo, const char *extn )
+{
+    if( extn == NULL || extn[0] != '.' || strlen( extn ) >= STEG_MAX_EXTN )
+    {
+        return steg_err_args;
+    }
+    strcpy( encInfo -> extn_secret_file, extn );
+
+    return steg_ok;
+}
+
+/* Opens a stream on a duplicate of fd, so closing it leaves fd open */
+static FILE *stream_of( int fd, const char *mode )
+{
+    int dup_fd = dup( fd );
+    FILE *fptr = dup_fd < 0 ? NULL : fdopen( dup_fd, mode );
+
+    if( fptr == NULL && dup_fd >= 0 )
+        close( dup_fd );
+
+    return fptr;
+}
+
+/* Whether fd is open for reading and writing, outputs only map if they are */
+static int fd_read_write( int fd )
+{
+    int flags = fcntl( fd, F_GETFL );
+
+    return flags >= 0 && ( flags & O_ACCMODE ) == O_RDWR;
+}
+
+/* Encodes secret into image, the stego image goes to stego */
+StegError steg_encode_mem( const StegContext *ctx, const void *image, size_t image_size,
+                           const void *secret, size_t secret_size, const char *extn, void *stego )
+{
+    EncodeInfo info = { 0 };
+
+    if( ctx == NULL || image == NULL || stego == NULL || ( secret == NULL && secret_size > 0 ) )
+    {
+        return steg_err_args;
+    }
+    if( set_extn( &info, extn ) != steg_ok )
+    {
+        return steg_err_args;
+    }
+    if( image_size < STEG_HEADER_SIZE )
+    {
+        return steg_err_format;
+    }
+    if( secret_size > LONG_MAX ) // The size field holds a long
+    {
+        return steg_err_capacity;
+    }
+
+    encode_settings( ctx, &info );
+    info.engine = eng_memory;
+    info.src_image_fname = "image";
+    info.secret_fname = "secret";
+    info.stego_image_fname = "stego";
+    info.src_map = image;
+    info.secret_map = secret;
+    info.stego_map = stego;
+    info.map_size = image_size;
+    info.size_secret_file = secret_size;
+
+    if( !lsb_bits_valid( info.bits ) )
+    {
+        return steg_err_args;
+    }
+    // The header may claim more rows than the buffer holds
+    if( bmp_parse( image, image_size, &info.bmp ) != e_success )
+    {
+        return steg_err_format;
+    }
+    if( secret_size > 0 && info.codec == codec_none &&
+        secret_size + ( info.index ? chunk_index_size( codec_none, secret_size ) : 0 ) >
+        data_capacity( &info.bmp, 18 + strlen( extn ) + ( info.crc ? 8 : 0 ) + ( info.key && info.encrypt ? 8 + POLY1305_TAG : 0 ), info.bits ) )
+    {
+        return steg_err_capacity;
+    }
+
+    encode_image( &info );
+    close_encode_files( &info, e_success );
+
+    return info.error;
+}
+
+/* Decodes the secret of stego into secret */
+StegError steg_decode_mem( const StegContext *ctx, const void *stego, size_t stego_size,
+                           void *secret, size_t secret_cap, StegResult *result )
+{
+    DecodeInfo info = { 0 };
+
+    if( ctx == NULL || stego == NULL || result == NULL )
+    {
+        return steg_err_args;
+    }
+    if( stego_size < STEG_HEADER_SIZE )
+    {
+        return steg_err_format;
+    }
+
+    decode_settings( ctx, &info );
+    info.engine = eng_memory;
+    info.stego_image_fname = "stego";
+    info.stego_map = stego;
+    info.map_size = stego_size;
+
+    if( setup_stego( &info ) != d_success || decode_header( &info ) != d_success )
+    {
+        return info.error;
+    }
+    decode_result( &info, result, NULL );
+
+    size_t offset = 0, length = info.file_size;
+    if( info.range && decode_range_bounds( &info, &offset, &length ) != d_success )
+    {
+        return steg_err_range;
+    }
+    if( secret == NULL || secret_cap < length )
+    {
+        return steg_err_space;
+    }
+
+    info.secret_map = secret;
+    if( decode_image_data( &info ) != d_success )
+    {
+        close_decode_files( &info, d_failure );
+
+        // Fields are fine but the image ends before the data does, or it does not match its checksum, or needs a key
+        return info.error == steg_err_checksum || info.error == steg_err_key ? info.error : steg_err_corrupt;
+    }
+    close_decode_files( &info, d_success );
+
+    return steg_ok;
+}
+
+/* Reads the fields before the data of the stego image at fd, nothing else */
+StegError steg_probe_fd( const StegContext *ctx, int fd, StegResult *result )
+{
+    DecodeInfo info = { 0 };
+    uchar head[ PROBE_READ ];
+    uchar *image = head;
+    BmpInfo bmp;
+    struct stat st;
+
+    if( ctx == NULL || result == NULL )
+    {
+        return steg_err_args;
+    }
+
+    ssize_t got = fstat( fd, &st ) == 0 ? pread( fd, head, sizeof( head ), 0 ) : -1;
+    if( got < 0 )
+    {
+        return steg_err_io;
+    }
+    if( got < STEG_HEADER_SIZE )
+    {
+        return steg_err_format;
+    }
+
+    // Enough bytes for the fields in the parsed layout and in the legacy one
+    if( bmp_parse_header( head, st.st_size, &bmp ) != e_success )
+        bmp_legacy( &bmp, st.st_size );
+    off_t want = bmp_offset( &bmp, bmp.capacity < PROBE_CARRIER ? bmp.capacity : PROBE_CARRIER );
+    if( want < BMP_LEGACY_OFFSET + PROBE_CARRIER )
+        want = BMP_LEGACY_OFFSET + PROBE_CARRIER;
+    if( want > st.st_size )
+        want = st.st_size;
+
+    // Rows far from the header take a second read
+    if( want > got )
+    {
+        image = malloc( want );
+        if( image == NULL )
+        {
+            return steg_err_nomem;
+        }
+        memcpy( image, head, got );
+        ssize_t more = pread( fd, image + got, want - got, got );
+        got = more < 0 ? got : got + more;
+    }
+
+    decode_settings( ctx, &info );
+    info.engine = eng_memory;
+    info.stego_image_fname = "stego";
+    info.stego_map = image;
+    info.map_size = got;
+    info.bmp = bmp;
+    info.bmp.capacity = bmp_carrier_index( &bmp, got ); // Only what was read
+    info.header_cb = NULL;
+
+    StegError error = steg_ok;
+    if( decode_header( &info ) != d_success )
+    {
+        error = info.error;
+    }
+    else
+    {
+        // The data has to fit the whole image, in the layout the fields were found in
+        size_t capacity = bmp_is_legacy( &info.bmp ) && !bmp_is_legacy( &bmp ) ? ( size_t )st.st_size - BMP_LEGACY_OFFSET : bmp.capacity;
+        size_t index = info.has_index ? chunk_index_size( info.codec, info.file_size ) : 0;
+        if( info.carrier_pos + LSB_CARRIER( info.stored_size + index, info.bits ) > capacity )
+            error = steg_err_corrupt;
+        decode_result( &info, result, NULL );
+    }
+
+    if( image != head )
+        free( image );
+
+    return error;
+}
+
+/* Encodes the file at secret_fd into the bmp image at image_fd */
+StegError steg_encode_fd( const StegContext *ctx, int image_fd, int secret_fd, const char *extn, int stego_fd )
+{
+    EncodeInfo info = { 0 };
+
+    if( ctx == NULL || set_extn( &info, extn ) != steg_ok )
+    {
+        return steg_err_args;
+    }
+
+    encode_settings( ctx, &info );
+    info.src_image_fname = "image";
+    info.secret_fname = "secret";
+    info.stego_image_fname = "stego";
+    info.fptr_src_image = stream_of( image_fd, "rb" );
+    info.fptr_secret = stream_of( secret_fd, "rb" );
+    info.fptr_stego_image = stream_of( stego_fd, info.engine == eng_mmap || info.key ? "w+b" : "wb" );
+
+    if( info.fptr_src_image == NULL || info.fptr_secret == NULL || info.fptr_stego_image == NULL )
+    {
+        close_encode_files( &info, e_failure );
+        return steg_err_io;
+    }
+
+    close_encode_files( &info, encode_image( &info ) );
+
+    return info.error;
+}
+
+/* Decodes the secret of the stego image at stego_fd into secret_fd */
+StegError steg_decode_fd( const StegContext *ctx, int stego_fd, int secret_fd, StegResult *result )
+{
+    DecodeInfo info = { 0 };
+
+    if( ctx == NULL )
+    {
+        return steg_err_args;
+    }
+
+    decode_settings( ctx, &info );
+    info.stego_image_fname = "stego";
+    info.secret_fname = "secret";
+    info.fptr_stego_image = stream_of( stego_fd, "rb" );
+    info.fptr_secret = stream_of( secret_fd, info.engine == eng_mmap && fd_read_write( secret_fd ) ? "w+b" : "wb" );
+
+    if( info.fptr_stego_image == NULL || info.fptr_secret == NULL || setup_stego( &info ) != d_success )
+    {
+        close_decode_files( &info, d_failure );
+        return steg_err_io;
+    }
+
+    if( decode_header( &info ) == d_success )
+    {
+        if( ctx -> header_cb )
+        {
+            StegResult header;
+
+            // No output name for descriptors
+            decode_result( &info, &header, NULL );
+            ctx -> header_cb( &header, ctx -> header_user );
+        }
+        decode_image_data( &info );
+        decode_result( &info, result, NULL );
+    }
+    close_decode_files( &info, d_success );
+
+    return info.error;
+}
+
+/* Extracts the secret of the stego image at stego_fd through its checksum only,
+ * name is what the messages call it
+ */
+static StegError verify_stego( const StegContext *ctx, int stego_fd, const char *name, StegResult *result )
+{
+    DecodeInfo info = { 0 };
+
+    decode_settings( ctx, &info );
+    info.stego_image_fname = ( char * )name;
+    info.verify = 1;
+    info.fptr_stego_image = stream_of( stego_fd, "rb" );
+
+    if( info.fptr_stego_image == NULL || setup_stego( &info ) != d_success )
+    {
+        close_decode_files( &info, d_failure );
+        return steg_err_io;
+    }
+
+    if( decode_header( &info ) == d_success )
+    {
+        decode_image_data( &info );
+        decode_result( &info, result, NULL );
+    }
+    close_decode_files( &info, d_success );
+
+    return info.error;
+}
+
+/* Extracts the secret of the stego image at stego_fd through its checksum only */
+StegError steg_verify_fd( const StegContext *ctx, int stego_fd, StegResult *result )
+{
+    if( ctx == NULL )
+    {
+        return steg_err_args;
+    }
+
+    return verify_stego( ctx, stego_fd, "stego", result );
+}
+
+/* Encodes secret into image, with the naming rules of the command line */
+StegError steg_encode_file( const StegContext *ctx, const char *image, const char *secret,
+                            const char *stego, StegResult *result )
+{
+    EncodeInfo info = { 0 };
+    char *argv[] = { "lsb_steg", "-e", ( char * )image, ( char * )secret, ( char * )stego, NULL };
+
+    if( ctx == NULL || image == NULL || secret == NULL )
+    {
+        return steg_err_args;
+    }
+
+    encode_settings( ctx, &info );
+    info.in_place = ctx -> in_place;
+    if( info.in_place && stego )
+    {
+        return steg_err_args;
+    }
+    if( strcmp( secret, "-" ) == 0 && ctx -> extn && set_extn( &info, ctx -> extn ) != steg_ok )
+    {
+        return steg_err_args;
+    }
+    if( read_and_validate_encode_args( argv, &info ) != e_success )
+    {
+        return steg_err_args;
+    }
+
+    do_encoding( &info );
+
+    if( result )
+    {
+        result -> secret_size = info.size_secret_file;
+        strcpy( result -> extn, info.extn_secret_file );
+        result -> bits = info.bits;
+        result -> codec = info.codec;
+        result -> has_crc = info.crc;
+        result -> crc = info.crc ? info.data_crc : 0;
+        result -> has_index = info.index;
+        result -> io_enters = info.uring.stats.enters;
+        result -> container = 0;
+        result -> output_size = info.size_secret_file;
+        snprintf( result -> output, sizeof( result -> output ), "%s", info.stego_image_fname );
+    }
+
+    return info.error;
+}
+
+/* Decodes the secret of stego, with the naming rules of the command line */
+StegError steg_decode_file( const StegContext *ctx, const char *stego, const char *output, StegResult *result )
+{
+    DecodeInfo info = { 0 };
+    char *argv[] = { "lsb_steg", "-d", ( char * )stego, ( char * )output, NULL };
+
+    if( ctx == NULL || stego == NULL )
+    {
+        return steg_err_args;
+    }
+
+    decode_settings( ctx, &info );
+    if( read_and_validate_decode_bmp( argv, &info ) != d_success )
+    {
+        return steg_err_args;
+    }
+
+    do_decoding( &info, argv );
+    decode_result( &info, result, info.secret_fname );
+
+    return info.error;
+}
+
+/* Verifies the stego image stego */
+StegError steg_verify_file( const StegContext *ctx, const char *stego, StegResult *result )
+{
+    if( ctx == NULL || stego == NULL )
+    {
+        return steg_err_args;
+    }
+
+    int fd = open( stego, O_RDONLY | O_CLOEXEC );
+    if( fd < 0 )
+    {
+        report_info( &ctx -> reporter, "Unable to open %s", stego );
+        return steg_err_io;
+    }
+
+    StegError error = verify_stego( ctx, fd, stego, result );
+    close( fd );
+
+    return error;
+}
+
+/* Restores image from its undo record */
+StegError steg_rollback_file( const StegContext *ctx, const char *image )
+{
+    int restored;
+
+    if( ctx == NULL || image == NULL || !undo_pending( image ) )
+    {
+        return steg_err_args;
+    }
+    if( undo_rollback( image, &restored ) != e_success )
+    {
+        report_info( &ctx -> reporter, "Unable to roll %s back, its undo record is kept: %s", image, strerror( errno ) );
+        return steg_err_io;
+    }
+
+    // A torn record was written before the image was touched
+    if( restored )
+        report_info( &ctx -> reporter, "Rolled %s back", image );
+    else
+        report_info( &ctx -> reporter, "Removed the torn undo record of %s, the image was not touched", image );
+
+    return steg_ok;
+}
+
+/* Copies the file at path to the end of body, its size and CRC32C into entry */
+static StegError pack_entry( FILE *body, const char *path, StegEntry *entry, const Reporter *reporter )
+{
+    uchar buf[ 65536 ];
+    size_t n;
+    FILE *fptr = fopen( path, "rb" );
+
+    if( fptr == NULL )
+    {
+        report_info( reporter, "Unable to open %s", path );
+        return steg_err_io;
+    }
+
+    entry -> size = 0;
+    entry -> crc = 0;
+    while( ( n = fread( buf, 1, sizeof( buf ), fptr ) ) > 0 )
+    {
+        entry -> crc = crc32c( entry -> crc, buf, n );
+        entry -> size += n;
+        if( fwrite( buf, 1, n, body ) != n )
+            break;
+    }
+
+    int failed = ferror( fptr ) || ferror( body );
+    fclose( fptr );
+    if( failed )
+    {
+        report_info( reporter, "Error copying %s", path );
+        return steg_err_io;
+    }
+
+    // Sizes of the table are 4 bytes
+    return entry -> size > UINT32_MAX ? steg_err_capacity : steg_ok;
+}
+
+/* Packs the count files into image behind a table of contents
+ * The container is put together in a temporary file, then encoded like any secret
+ */
+StegError steg_pack_files( const StegContext *ctx, const char *image, const char *const files[], size_t count,
+                           const char *stego, StegResult *result )
+{
+    EncodeInfo info = { 0 };
+    StegError error = steg_ok;
+
+    if( ctx == NULL || image == NULL || files == NULL || count == 0 || ( ctx -> in_place && stego ) )
+    {
+        return steg_err_args;
+    }
+    for( size_t i = 0; i < count; i++ )
+    {
+        if( files[i] == NULL || files[i][0] == '\0' || strlen( files[i] ) >= STEG_MAX_NAME )
+        {
+            return steg_err_args;
+        }
+    }
+
+    StegEntry *entries = calloc( count, sizeof( StegEntry ) );
+    FILE *body = tmpfile();
+    if( entries == NULL || body == NULL )
+    {
+        error = entries == NULL ? steg_err_nomem : steg_err_io;
+    }
+
+    // Placeholder table, its size only depends on the names
+    for( size_t i = 0; i < count && error == steg_ok; i++ )
+        strcpy( entries[i].name, files[i] );
+    if( error == steg_ok && container_write_toc( body, entries, count ) != e_success )
+        error = steg_err_io;
+
+    for( size_t i = 0; i < count && error == steg_ok; i++ )
+        error = pack_entry( body, files[i], &entries[i], &ctx -> reporter );
+
+    if( error == steg_ok && ( fseeko( body, 0, SEEK_SET ) != 0 || container_write_toc( body, entries, count ) != e_success ||
+                              fflush( body ) != 0 || fseeko( body, 0, SEEK_SET ) != 0 ) )
+        error = steg_err_io;
+
+    free( entries );
+    if( error != steg_ok )
+    {
+        if( body )
+            fclose( body );
+        return error;
+    }
+
+    encode_settings( ctx, &info );
+    set_extn( &info, CONTAINER_EXTN );
+    info.container = 1;
+    info.src_image_fname = ( char * )image;
+    info.secret_fname = "container";
+    info.in_place = ctx -> in_place;
+    info.stego_image_fname = ( char * )( info.in_place ? image : stego ? stego : "stego_img.bmp" );
+    info.fptr_secret = body;
+    info.fptr_src_image = fopen( image, "rb" );
+    info.fptr_stego_image = info.fptr_src_image ? fopen( info.stego_image_fname, info.in_place ? "r+b" : info.engine == eng_mmap || info.key ? "w+b" : "wb" ) : NULL;
+
+    if( info.fptr_src_image == NULL || info.fptr_stego_image == NULL )
+    {
+        report_info( &ctx -> reporter, "Unable to open %s", info.fptr_src_image ? info.stego_image_fname : image );
+        close_encode_files( &info, e_failure );
+        return steg_err_io;
+    }
+
+    close_encode_files( &info, encode_image( &info ) );
+
+    if( result )
+    {
+        result -> secret_size = info.size_secret_file;
+        strcpy( result -> extn, info.extn_secret_file );
+        result -> bits = info.bits;
+        result -> codec = info.codec;
+        result -> has_crc = info.crc;
+        result -> crc = info.crc ? info.data_crc : 0;
+        result -> has_index = info.index;
+        result -> io_enters = info.uring.stats.enters;
+        result -> container = 1;
+        result -> output_size = info.size_secret_file;
+        snprintf( result -> output, sizeof( result -> output ), "%s", info.stego_image_fname );
+    }
+
+    return info.error;
+}
+
+/* Decodes len bytes from offset of the data into buf, the data starts at data_pos */
+static Status decode_bytes( DecodeInfo *decInfo, size_t data_pos, uchar *buf, size_t offset, size_t len )
+{
+    decInfo -> secret_map = buf;
+    decInfo -> range = 1;
+    decInfo -> range_offset = offset;
+    decInfo -> range_length = len;
+    decInfo -> carrier_pos = data_pos;
+
+    Status status = decode_range_data( decInfo );
+    decInfo -> secret_map = NULL;
+
+    return status;
+}
+
+/* Opens the container stego and decodes its table of contents into entries
+ * Leaves the image open in decInfo, with where its data starts in data_pos
+ */
+static StegError open_container( const StegContext *ctx, const char *stego, DecodeInfo *decInfo, size_t *data_pos,
+                                 StegEntry **entries, size_t *count )
+{
+    uchar header[ CONTAINER_HEADER ];
+    size_t toc_size;
+
+    *entries = NULL;
+    decode_settings( ctx, decInfo );
+    decInfo -> stego_image_fname = ( char * )stego;
+
+    if( open_stego( decInfo ) != d_success )
+    {
+        return steg_err_io;
+    }
+    if( decode_header( decInfo ) != d_success )
+    {
+        return decInfo -> error;
+    }
+    if( !decInfo -> container )
+    {
+        report_info( &ctx -> reporter, "%s holds a single secret, no container", stego );
+        return steg_err_not_container;
+    }
+    *data_pos = decInfo -> carrier_pos;
+
+    if( decInfo -> file_size < CONTAINER_HEADER ||
+        decode_bytes( decInfo, *data_pos, header, 0, CONTAINER_HEADER ) != d_success ||
+        container_read_header( header, decInfo -> file_size, count, &toc_size ) != e_success )
+    {
+        report_info( &ctx -> reporter, "Table of contents of %s is corrupt", stego );
+        return decInfo -> error != steg_ok ? decInfo -> error : steg_err_corrupt;
+    }
+
+    uchar *toc = malloc( toc_size );
+    *entries = malloc( ( *count ? *count : 1 ) * sizeof( StegEntry ) );
+    if( toc == NULL || *entries == NULL )
+    {
+        free( toc );
+        return steg_err_nomem;
+    }
+
+    StegError error = steg_ok;
+    if( decode_bytes( decInfo, *data_pos, toc, 0, toc_size ) != d_success ||
+        container_parse_toc( toc, toc_size, decInfo -> file_size, *entries, *count ) != e_success )
+    {
+        report_info( &ctx -> reporter, "Table of contents of %s is corrupt", stego );
+        error = decInfo -> error != steg_ok ? decInfo -> error : steg_err_corrupt;
+    }
+    free( toc );
+
+    return error;
+}
+
+/* Lists the entries of the container stego */
+StegError steg_list_file( const StegContext *ctx, const char *stego, StegEntry **entries, size_t *count )
+{
+    DecodeInfo info = { 0 };
+    size_t data_pos;
+
+    if( ctx == NULL || stego == NULL || entries == NULL || count == NULL )
+    {
+        return steg_err_args;
+    }
+
+    StegError error = open_container( ctx, stego, &info, &data_pos, entries, count );
+    close_decode_files( &info, d_success );
+    if( error != steg_ok )
+    {
+        free( *entries );
+        *entries = NULL;
+        *count = 0;
+    }
+
+    return error;
+}
+
+/* Frees the entries of steg_list_file() */
+void steg_free_entries( StegEntry *entries )
+{
+    free( entries );
+}
+
+/* Extracts the entry name of the container stego
+ * Only the table and the range of the entry's bytes are decoded
+ */
+StegError steg_extract_file( const StegContext *ctx, const char *stego, const char *name, const char *output,
+                             StegResult *result )
+{
+    DecodeInfo info = { 0 };
+    StegEntry *entries, *entry = NULL;
+    size_t count, data_pos;
+
+    if( ctx == NULL || stego == NULL || name == NULL )
+    {
+        return steg_err_args;
+    }
+
+    StegError error = open_container( ctx, stego, &info, &data_pos, &entries, &count );
+    for( size_t i = 0; i < count && error == steg_ok && entry == NULL; i++ )
+    {
+        if( strcmp( entries[i].name, name ) == 0 )
+            entry = &entries[i];
+    }
+    if( error == steg_ok && entry == NULL )
+    {
+        report_info( &ctx -> reporter, "No entry %s in %s", name, stego );
+        error = steg_err_entry;
+    }
+
+    // Without directories, so names cannot write outside the current one
+    if( output == NULL && entry )
+    {
+        output = strrchr( entry -> name, '/' ) ? strrchr( entry -> name, '/' ) + 1 : entry -> name;
+    }
+
+    if( error == steg_ok )
+    {
+        info.secret_fname = ( char * )output;
+        info.fptr_secret = strcmp( output, "-" ) == 0 ? stdout : fopen( output, "wb" );
+        if( info.fptr_secret == NULL )
+        {
+            report_info( &ctx -> reporter, "Unable to open %s", output );
+            error = steg_err_io;
+        }
+    }
+
+    // A range of length 0 runs to the end, so empty entries decode nothing
+    if( error == steg_ok && entry -> size > 0 )
+    {
+        report_info( &ctx -> reporter, "Extracting %s, %zu bytes from %zu", entry -> name, entry -> size, entry -> offset );
+        info.data_crc = 0;
+        if( decode_bytes( &info, data_pos, NULL, entry -> offset, entry -> size ) != d_success )
+        {
+            error = info.error != steg_ok ? info.error : steg_err_io;
+        }
+        else if( info.data_crc != entry -> crc )
+        {
+            report_info( &ctx -> reporter, "CRC32C %08x of %s does not match the stored %08x", info.data_crc, entry -> name, entry -> crc );
+            error = steg_err_checksum;
+        }
+    }
+
+    if( close_decode_files( &info, d_success ) != d_success && error == steg_ok )
+    {
+        error = steg_err_io;
+    }
+
+    if( result && entry )
+    {
+        decode_result( &info, result, output );
+        result -> secret_size = entry -> size;
+        result -> output_size = entry -> size;
+        result -> has_crc = 1;
+        result -> crc = entry -> crc;
+    }
+    free( entries );
+
+    return error;
+}
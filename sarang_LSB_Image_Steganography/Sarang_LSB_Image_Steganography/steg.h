@@ -0,0 +1,281 @@
+#ifndef STEG_H
+#define STEG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h" // Contains user defined types
+#include "report.h"
+
+/*
+ * libsteg
+ * Encode and decode calls for programs that embed the steganography
+ * code instead of running lsb_steg. Calls never exit and never print
+ * unless the context's reporter asks for it; failures come back as a
+ * StegError. All state of a call lives on its stack, a context is
+ * only read, so one context may serve concurrent calls.
+ * The LSB kernel is picked once per process, see lsb.h.
+ */
+
+#ifndef STEG_API
+#define STEG_API __attribute__(( visibility( "default" ) ))
+#endif
+
+#define STEG_MAX_EXTN 5     // Extension buffer, dot and terminator included
+#define STEG_HEADER_SIZE 54 // Smallest bmp header, the header up to the first row is copied as is
+#define STEG_MAX_NAME 256   // Entry name buffer of containers, terminator included
+
+/* Error codes */
+typedef enum
+{
+    steg_ok,
+    steg_err_args,          // Invalid argument
+    steg_err_io,            // Read, write, open or map failed
+    steg_err_nomem,         // Allocation failed
+    steg_err_format,        // Image too small to be a bmp
+    steg_err_capacity,      // Secret does not fit the image
+    steg_err_empty,         // Empty secret
+    steg_err_not_stegged,   // No magic string in the image
+    steg_err_corrupt,       // Magic string found, fields after it are not valid
+    steg_err_space,         // Caller buffer too small for the secret
+    steg_err_checksum,      // Data does not match the CRC32C stored with it
+    steg_err_range,         // Range starts or ends past the end of the secret
+    steg_err_not_container, // The image holds a single secret, not a container
+    steg_err_entry,         // No entry of that name in the container
+    steg_err_pending,       // An interrupted in-place encode left an undo record, see steg_rollback_file()
+    steg_err_key            // The data is scattered with a key and the context has none
+} StegError;
+
+/* What a call encoded or decoded */
+typedef struct _StegResult
+{
+    size_t secret_size;
+    char extn[ STEG_MAX_EXTN ];
+    int bits;               // Payload bits per carrier byte of the data
+    Codec codec;            // Compression of the data
+    int has_crc;            // A CRC32C of the secret is stored
+    uint32_t crc;           // That CRC32C
+    int has_index;          // A chunk index follows the data, ranges are checked against it
+    int container;          // The secret is a container of named entries
+    int scattered;          // The data is scattered with a key
+    int encrypted;          // And encrypted with it
+    size_t output_size;     // Bytes a decode writes: secret_size, or those of the range
+    size_t io_enters;       // io_uring_enter() calls of the image blocks, 0 with io_stdio
+    char output[ 256 ];     // Output file of the file calls
+} StegResult;
+
+/* One file of a container */
+typedef struct _StegEntry
+{
+    char name[ STEG_MAX_NAME ];
+    size_t offset;          // Of its bytes in the data of the image
+    size_t size;
+    uint32_t crc;           // CRC32C of its bytes
+} StegEntry;
+
+/* Called by decodes once size and extension are known, before any data is written */
+typedef void ( *StegHeaderCallback )( const StegResult *result, void *user );
+
+/* Settings of the calls, initialise with steg_context_init() */
+typedef struct _StegContext
+{
+    Engine engine;          // eng_stdio or eng_mmap, for file and fd calls
+    size_t block_size;      // Image block of eng_stdio, 0 is the default
+    IoBackend io;           // How eng_stdio reads and writes its blocks, io_uring falls back to io_stdio
+    int threads;            // Worker threads for the data, 1 is serial, 0 is one per CPU
+    int pipeline;           // eng_stdio runs raw data through a read, kernel and write thread instead
+    int in_place;           // File encodes and packs rewrite the image itself, see steg_rollback_file()
+    Reporter reporter;      // r_quiet by default
+    const char *extn;       // Extension of a secret read from stdin, NULL is ".bin"
+    int bits;               // Payload bits per carrier byte of encodes: 1, 2, 4 or 8
+    Codec codec;            // Compression of encodes, decodes read it from the image
+    int crc;                // Encodes store a CRC32C of the secret, off by default, decodes check it if there is one
+    int index;              // Encodes store a chunk index, for decodes of a range
+    const char *key;        // Encodes scatter the data with it, decodes of scattered data need it, NULL is none
+    int encrypt;            // Encodes also encrypt the data with the key, which is then required
+    size_t range_offset;    // Decodes write only the secret bytes from range_offset,
+    size_t range_length;    // range_length of them, 0 is up to the end
+    StegHeaderCallback header_cb;   // Side channel for the metadata, may be NULL
+    void *header_user;
+} StegContext;
+
+/* Initialise ctx with the defaults: stdio engine and I/O, serial, quiet, 1 bit,
+ * uncompressed, without a CRC32C or chunk index, decodes of the whole secret
+ * Encodes with these defaults write the original format byte for byte,
+ * see below.
+ */
+STEG_API void steg_context_init( StegContext *ctx );
+
+/* Format
+ * The fields of the original lsb_steg are kept: magic string, extension
+ * size, extension and file size, each a long, then the data at 1 bit.
+ * Every setting that adds to them is opt-in: bits other than 1, a codec,
+ * crc, index, key and containers set flags in the high bytes of the
+ * extension size, see common.h, and images encoded with any of them
+ * cannot be read by the original decoder. So are 24 and 32 bit images
+ * whose rows are not laid out like the legacy 54 byte header assumes.
+ * Decodes read both.
+ */
+
+/* Message for an error code */
+STEG_API const char *steg_strerror( StegError error );
+
+/* Secret bytes a bmp image in memory can carry with an extension of extn_len
+ * characters, dot included, and a CRC32C, 0 if it can carry none
+ */
+STEG_API size_t steg_capacity( const void *image, size_t image_size, size_t extn_len );
+
+/* Same at bits per carrier byte, decodes read the depth from the image
+ * Compressed secrets fit as long as their compressed size does, a chunk
+ * index takes 4 bytes per 4K of secret on top
+ */
+STEG_API size_t steg_capacity_bits( const void *image, size_t image_size, size_t extn_len, int bits );
+
+/* Ranges
+ * With range_offset or range_length set, decodes and verifies only touch
+ * the carrier bytes of the range. Raw data is read from where its first
+ * byte sits; with a chunk index only the 4K chunks the range overlaps
+ * are extracted, each checked against its CRC32C, steg_err_checksum if
+ * one does not match. Compressed data is decoded from the frame holding
+ * the range, found through the index or by hopping over frame headers.
+ * The CRC32C of the whole secret is not checked.
+ */
+
+/* Keys
+ * With ctx -> key set, encodes spread the data and the chunk index over
+ * every carrier byte after the fields instead of the ones right after
+ * them, in an order only the key gives back, see scatter.h. The fields
+ * stay in place, so probes and scans find scattered images too; decodes
+ * of their data fail with steg_err_key without a key. A wrong key yields
+ * garbage, which the CRC32C of ctx -> crc catches; unencrypted and without
+ * one it goes unnoticed. Scattered data is placed on the
+ * calling thread; threads and pipeline do not apply to it. The stego
+ * descriptor of steg_encode_fd() has to be readable too.
+ * With ctx -> encrypt the scattered bytes are also ChaCha20 encrypted
+ * with the key, see chacha.h, in the loop that embeds them, so it costs
+ * no pass over the data of its own. Decodes decrypt the same way without
+ * being asked to, the image says so. The fields are not encrypted; a
+ * random salt stored after them makes every encrypted encode place and
+ * encrypt its data differently, even with the same key and image. The
+ * cipher key is stretched from the key and the salt, which costs about
+ * half a second per encode or decode, see chacha.h. A Poly1305 tag of
+ * the encrypted data and the extension follows the salt: decodes and
+ * verifies of all of the data fail with steg_err_checksum for a wrong
+ * key or a changed bit, after the garbage is written; ranges and
+ * container entries are not tagged. The CRC32C is stored masked, so it
+ * says nothing about the plaintext.
+ */
+
+/* Memory calls */
+
+/* Encodes secret_size bytes of secret, of extension extn ( ".txt" ), into the
+ * image_size byte bmp image, the stego image goes to the image_size bytes at
+ * stego, which may be image itself
+ */
+STEG_API StegError steg_encode_mem( const StegContext *ctx, const void *image, size_t image_size,
+                                    const void *secret, size_t secret_size, const char *extn, void *stego );
+
+/* Decodes the secret of the stego image into the secret_cap bytes at secret
+ * result, which must not be NULL, gets the size and extension, also on
+ * steg_err_space, so a call with secret NULL asks for the size
+ * A range of the context is written from secret, result -> output_size bytes
+ */
+STEG_API StegError steg_decode_mem( const StegContext *ctx, const void *stego, size_t stego_size,
+                                    void *secret, size_t secret_cap, StegResult *result );
+
+/* Descriptor calls
+ * Image descriptors must be seekable, they are used from offset 0 and
+ * their offsets move. Outputs are written from offset 0 and must be open
+ * for reading too with eng_mmap. Descriptors stay open.
+ */
+
+
+/* Encodes the file at secret_fd, of extension extn, into the bmp image at image_fd
+ * A secret_fd that is no regular file, such as a pipe, is streamed: read
+ * once in chunks, its size field is written when it ends
+ */
+STEG_API StegError steg_encode_fd( const StegContext *ctx, int image_fd, int secret_fd, const char *extn, int stego_fd );
+
+/* Decodes the secret of the stego image at stego_fd into secret_fd, result may be NULL
+ * A secret_fd that is no regular file, such as a pipe or stdout, is
+ * written in order a block at a time
+ */
+STEG_API StegError steg_decode_fd( const StegContext *ctx, int stego_fd, int secret_fd, StegResult *result );
+
+/* Reads only the fields before the data of the stego image at fd, so
+ * telling stego images from clean ones costs one fstat() and mostly one
+ * read of 4K: steg_ok and result filled if the magic string and fields
+ * are there and the data fits the image, steg_err_not_stegged if not
+ * Nothing is written and the offset of fd does not move.
+ */
+STEG_API StegError steg_probe_fd( const StegContext *ctx, int fd, StegResult *result );
+
+/* Extracts the secret of the stego image at stego_fd through its CRC32C
+ * without writing anything, result may be NULL
+ * Returns steg_ok if the data matches the stored checksum, steg_err_checksum
+ * if not. Images encoded without one only have their fields checked and
+ * the data extracted, result -> has_crc is 0 for them.
+ */
+STEG_API StegError steg_verify_fd( const StegContext *ctx, int stego_fd, StegResult *result );
+
+/* File calls, with the naming rules of the command line */
+
+/* Encodes secret into image, stego NULL is stego_img.bmp, result may be NULL
+ * secret "-" streams stdin, stored with ctx -> extn
+ */
+STEG_API StegError steg_encode_file( const StegContext *ctx, const char *image, const char *secret,
+                                     const char *stego, StegResult *result );
+
+/* Decodes the secret of stego, output NULL is decoded<extn>, "-" is stdout,
+ * result may be NULL
+ */
+STEG_API StegError steg_decode_file( const StegContext *ctx, const char *stego, const char *output, StegResult *result );
+
+/* Verifies the stego image stego like steg_verify_fd(), result may be NULL */
+STEG_API StegError steg_verify_file( const StegContext *ctx, const char *stego, StegResult *result );
+
+/* In place
+ * With ctx -> in_place, file encodes and packs write into the image
+ * instead of a new stego image, stego must be NULL. Only the rows the
+ * encode reaches are rewritten, about 8 / bits bytes per secret byte,
+ * and the same again is written to the undo record first. Scattered data
+ * reaches every row, which would write the whole pixel array twice, so
+ * in-place encodes with ctx -> key fail with steg_err_args.
+ * Those rows are first saved to <image>.undo, see undo.h, which goes once
+ * the image is synced. A failed encode writes them back itself; after a
+ * crash steg_rollback_file() does, and until then in-place encodes of
+ * the image fail with steg_err_pending.
+ */
+
+/* Restores image from the undo record an interrupted in-place encode left
+ * Returns steg_err_args if there is none
+ */
+STEG_API StegError steg_rollback_file( const StegContext *ctx, const char *image );
+
+/* Containers
+ * Many files in one stego image behind a table of contents at the start
+ * of the data, see container.h. Listing decodes the table only, extracting
+ * an entry decodes the range of its bytes only, checked against the
+ * entry's CRC32C. The range settings of the context are not used.
+ */
+
+/* Packs the count files into image, stego NULL is stego_img.bmp, result may be NULL
+ * Entries are named by the paths as given, of at most STEG_MAX_NAME - 1 bytes
+ */
+STEG_API StegError steg_pack_files( const StegContext *ctx, const char *image, const char *const files[], size_t count,
+                                    const char *stego, StegResult *result );
+
+/* Lists the entries of the container stego into *entries, count of them,
+ * free them with steg_free_entries()
+ */
+STEG_API StegError steg_list_file( const StegContext *ctx, const char *stego, StegEntry **entries, size_t *count );
+
+/* Frees the entries of steg_list_file() */
+STEG_API void steg_free_entries( StegEntry *entries );
+
+/* Extracts the entry name of the container stego into output, NULL is the
+ * name without its directories, "-" is stdout, result may be NULL
+ */
+STEG_API StegError steg_extract_file( const StegContext *ctx, const char *stego, const char *name, const char *output,
+                                      StegResult *result );
+
+#endif
@@ -1,6 +1,5 @@
 #ifndef TYPES_H
 #define TYPES_H
-#include <unistd.h>
 /* User defined types */
 typedef unsigned int uint;
 typedef unsigned char uchar;
@@ -14,6 +13,28 @@ typedef enum
     d_failure
 } Status;
 
+/* I/O engine used for the image data */
+typedef enum
+{
+    eng_stdio,  // FILE streams
+    eng_mmap,   // Memory maps
+    eng_memory  // Caller owned buffers, set by the libsteg memory calls
+} Engine;
+
+/* How eng_stdio reads and writes its image blocks */
+typedef enum
+{
+    io_stdio,   // Blocking reads and writes of the streams
+    io_uring    // Read ahead and written behind through an io_uring, see uring.h
+} IoBackend;
+
+/* Codec of the secret data, recorded in the stego header */
+typedef enum
+{
+    codec_none, // Raw bytes
+    codec_lz    // LZ frames, see lz.h
+} Codec;
+
 typedef enum
 {
     e_encode,
@@ -21,11 +42,4 @@ typedef enum
     e_unsupported 
 } OperationType;
 
-#define print_sleep(fmt, ...) \
-    do \
-    { \
-        usleep(500000); \
-        printf(fmt, ##__VA_ARGS__); \
-    } while (0)
-
 #endif
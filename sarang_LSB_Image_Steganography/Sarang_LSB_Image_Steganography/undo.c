@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "undo.h"
+#include "blockio.h"
+#include "crc32c.h"
+#include "types.h"
+
+#define UNDO_BUFFER ( 1024 * 1024 ) // Bytes copied at a time
+
+/* Function Definitions */
+
+/* Path of the undo record of image */
+Status undo_path( const char *image, char *path, size_t size )
+{
+    int n = snprintf( path, size, "%s%s", image, UNDO_SUFFIX );
+
+    return n > 0 && ( size_t )n < size ? e_success : e_failure;
+}
+
+/* Syncs the directory holding path, so a new or removed name is durable too */
+static Status sync_dir( const char *path )
+{
+    char copy[ 4096 ];
+
+    snprintf( copy, sizeof( copy ), "%s", path );
+    int fd = open( dirname( copy ), O_RDONLY | O_DIRECTORY );
+    if( fd < 0 )
+    {
+        return e_failure;
+    }
+
+    int failed = fsync( fd ) != 0;
+    close( fd );
+
+    return failed ? e_failure : e_success;
+}
+
+/* Whether an undo record of image is left */
+int undo_pending( const char *image )
+{
+    char path[ 4096 ];
+
+    return undo_path( image, path, sizeof( path ) ) == e_success && access( path, F_OK ) == 0;
+}
+
+/* Saves the span of the image to a new record and syncs it */
+Status undo_save( const char *image, int image_fd, off_t offset, size_t len )
+{
+    char path[ 4096 ];
+    uchar header[ UNDO_HEADER ];
+    uint64_t field;
+    Status status = e_success;
+
+    if( undo_path( image, path, sizeof( path ) ) != e_success )
+    {
+        return e_failure;
+    }
+
+    uchar *buf = malloc( UNDO_BUFFER );
+    int fd = buf ? open( path, O_WRONLY | O_CREAT | O_EXCL, 0600 ) : -1;
+    if( fd < 0 )
+    {
+        if( buf == NULL )
+            errno = ENOMEM;
+        free( buf );
+        return e_failure;
+    }
+
+    // Header first with room for the CRC32C, which covers offset, length and bytes
+    memcpy( header, UNDO_MAGIC, 8 );
+    field = offset;
+    memcpy( header + 8, &field, 8 );
+    field = len;
+    memcpy( header + 16, &field, 8 );
+    uint32_t crc = crc32c( 0, header + 8, 16 );
+
+    int error = 0;
+
+    if( pwrite_full( fd, header, UNDO_HEADER, 0 ) != 0 )
+        status = e_failure;
+    for( size_t done = 0; done < len && status == e_success; )
+    {
+        size_t n = len - done < UNDO_BUFFER ? len - done : UNDO_BUFFER;
+
+        if( pread_full( image_fd, buf, n, offset + done ) != 0 || pwrite_full( fd, buf, n, UNDO_HEADER + done ) != 0 )
+            status = e_failure;
+        crc = crc32c( crc, buf, n );
+        done += n;
+    }
+
+    memcpy( header + 24, &crc, 4 );
+    if( status == e_success && ( pwrite_full( fd, header + 24, 4, 24 ) != 0 || fsync( fd ) != 0 ) )
+        status = e_failure;
+    if( status == e_success && sync_dir( path ) != e_success )
+        status = e_failure;
+    error = errno;
+    close( fd );
+    free( buf );
+
+    // A record that is not durable protects nothing
+    if( status != e_success )
+    {
+        unlink( path );
+        errno = error;
+        return e_failure;
+    }
+
+    return e_success;
+}
+
+/* Syncs the image, then removes its record */
+Status undo_commit( const char *image, int image_fd )
+{
+    char path[ 4096 ];
+
+    if( fsync( image_fd ) != 0 )
+    {
+        return e_failure;
+    }
+    if( undo_path( image, path, sizeof( path ) ) != e_success || unlink( path ) != 0 )
+    {
+        return e_failure;
+    }
+    sync_dir( path ); // The encode is done whether or not the removal is durable yet
+
+    return e_success;
+}
+
+/* Checks the record at fd against its CRC32C, offset and length of the span in *offset and *len */
+static Status undo_check( int fd, uchar *buf, off_t *offset, size_t *len )
+{
+    uchar header[ UNDO_HEADER ];
+    uint64_t field;
+    uint32_t stored;
+    struct stat st;
+
+    if( fstat( fd, &st ) != 0 || pread_full( fd, header, UNDO_HEADER, 0 ) != 0 || memcmp( header, UNDO_MAGIC, 8 ) != 0 )
+    {
+        return e_failure;
+    }
+    memcpy( &field, header + 8, 8 );
+    *offset = field;
+    memcpy( &field, header + 16, 8 );
+    *len = field;
+    memcpy( &stored, header + 24, 4 );
+    if( ( uint64_t )st.st_size != UNDO_HEADER + ( uint64_t )*len )
+    {
+        return e_failure; // Torn
+    }
+
+    uint32_t crc = crc32c( 0, header + 8, 16 );
+    for( size_t done = 0; done < *len; )
+    {
+        size_t n = *len - done < UNDO_BUFFER ? *len - done : UNDO_BUFFER;
+
+        if( pread_full( fd, buf, n, UNDO_HEADER + done ) != 0 )
+        {
+            return e_failure;
+        }
+        crc = crc32c( crc, buf, n );
+        done += n;
+    }
+
+    return crc == stored ? e_success : e_failure;
+}
+
+/* Writes the saved bytes back, only from a record that checks out */
+Status undo_rollback( const char *image, int *restored )
+{
+    char path[ 4096 ];
+    off_t offset;
+    size_t len;
+    Status status = e_success;
+    int error = 0;
+
+    *restored = 0;
+    if( undo_path( image, path, sizeof( path ) ) != e_success )
+    {
+        return e_failure;
+    }
+
+    uchar *buf = malloc( UNDO_BUFFER );
+    int fd = buf ? open( path, O_RDONLY ) : -1;
+    if( fd < 0 )
+    {
+        free( buf );
+        return e_failure;
+    }
+
+    // The record is checked whole before a byte of the image is written
+    if( undo_check( fd, buf, &offset, &len ) == e_success )
+    {
+        int image_fd = open( image, O_WRONLY );
+
+        status = image_fd >= 0 ? e_success : e_failure;
+        for( size_t done = 0; done < len && status == e_success; )
+        {
+            size_t n = len - done < UNDO_BUFFER ? len - done : UNDO_BUFFER;
+
+            if( pread_full( fd, buf, n, UNDO_HEADER + done ) != 0 || pwrite_full( image_fd, buf, n, offset + done ) != 0 )
+                status = e_failure;
+            done += n;
+        }
+        if( status == e_success && fsync( image_fd ) != 0 )
+            status = e_failure;
+        error = errno;
+        if( image_fd >= 0 )
+            close( image_fd );
+        *restored = status == e_success;
+    }
+
+    close( fd );
+    free( buf );
+
+    // Kept for another try if the bytes did not make it back
+    if( status != e_success )
+    {
+        errno = error;
+        return e_failure;
+    }
+    if( unlink( path ) != 0 )
+    {
+        return e_failure;
+    }
+    sync_dir( path );
+
+    return e_success;
+}
@@ -0,0 +1,47 @@
+#ifndef UNDO_H
+#define UNDO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "types.h" // Contains user defined types
+
+/*
+ * Undo records of in-place encodes
+ * Before an in-place encode touches the image, the bytes of the span it
+ * may rewrite are saved to <image>.undo, which is synced together with
+ * its directory entry. The record goes once the encoded image is synced.
+ * A crash in between leaves it behind for undo_rollback(), which writes
+ * the saved bytes back. A record torn while it was written fails its
+ * CRC32C; the image was not touched yet then, the record is only removed.
+ *     8 bytes  UNDO_MAGIC
+ *     8 bytes  image offset of the span
+ *     8 bytes  span bytes
+ *     4 bytes  CRC32C of offset, length and the bytes
+ * followed by the bytes, fields in host order as the record never leaves
+ * the machine. Failures leave errno set for the caller to report.
+ */
+
+#define UNDO_SUFFIX ".undo"
+#define UNDO_MAGIC "LSBUNDO1"
+#define UNDO_HEADER 28
+
+/* Path of the undo record of image into path, e_failure if it does not fit */
+Status undo_path( const char *image, char *path, size_t size );
+
+/* Whether an undo record of image is left from an interrupted encode */
+int undo_pending( const char *image );
+
+/* Saves len bytes of the image at image_fd from offset, synced before it returns
+ * Fails if a record is already there
+ */
+Status undo_save( const char *image, int image_fd, off_t offset, size_t len );
+
+/* Syncs the image at image_fd, then removes its undo record */
+Status undo_commit( const char *image, int image_fd );
+
+/* Writes the bytes of the undo record of image back and removes it
+ * restored is set if any were written, not for a torn record
+ */
+Status undo_rollback( const char *image, int *restored );
+
+#endif
@@ -0,0 +1,428 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include "uring.h"
+#include "types.h"
+
+/* States of a buffer */
+enum
+{
+    blk_free,
+    blk_reading,
+    blk_read,
+    blk_handed,     // The image block being encoded or decoded
+    blk_writing
+};
+
+/* Function Definitions */
+
+/* Adds the request of block i to the submission queue, its rest after a short transfer */
+static void uring_queue( UringIo *io, int i )
+{
+    UringBlock *b = &io -> blocks[i];
+    unsigned tail = *io -> sq_tail;
+    unsigned slot = tail & *io -> sq_mask;
+    struct io_uring_sqe *sqe = &io -> sqes[ slot ];
+    int write = b -> state == blk_writing;
+
+    memset( sqe, 0, sizeof( *sqe ) );
+    if( io -> fixed )
+    {
+        sqe -> opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe -> buf_index = i;
+    }
+    else
+        sqe -> opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe -> fd = write ? io -> out_fd : io -> in_fd;
+    sqe -> addr = ( uintptr_t )( b -> data + b -> done );
+    sqe -> len = b -> len - b -> done;
+    sqe -> off = b -> offset + b -> done;
+    sqe -> user_data = i;
+
+    io -> sq_array[ slot ] = slot;
+    __atomic_store_n( io -> sq_tail, tail + 1, __ATOMIC_RELEASE );
+    io -> queued++;
+}
+
+/* Takes the result res of the request of block i */
+static void uring_complete( UringIo *io, int i, int res )
+{
+    UringBlock *b = &io -> blocks[i];
+    int write = b -> state == blk_writing;
+
+    if( !write && b -> stale )
+    {
+        b -> state = blk_free; // Nobody wants it any more
+        return;
+    }
+    if( res == -EINTR || res == -EAGAIN )
+    {
+        uring_queue( io, i );
+        return;
+    }
+    if( res < 0 || ( write && res == 0 ) )
+    {
+        if( io -> error == 0 )
+            io -> error = res < 0 ? -res : EIO;
+        b -> state = blk_free;
+        return;
+    }
+
+    b -> done += res;
+    if( res > 0 && b -> done < b -> len )
+    {
+        uring_queue( io, i ); // Short, the rest
+        return;
+    }
+
+    // A read of 0 bytes is the end of the file
+    b -> state = write ? blk_free : blk_read;
+}
+
+/* Submits what is queued and waits for wait completions, then takes every completion */
+static Status uring_enter( UringIo *io, unsigned wait )
+{
+    int n = syscall( __NR_io_uring_enter, io -> ring_fd, io -> queued, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0 );
+
+    if( n < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY )
+    {
+        if( io -> error == 0 )
+            io -> error = errno;
+        return e_failure;
+    }
+    io -> stats.enters++;
+    if( n > 0 )
+        io -> queued -= n;
+
+    unsigned head = *io -> cq_head;
+    unsigned tail = __atomic_load_n( io -> cq_tail, __ATOMIC_ACQUIRE );
+    for( ; head != tail; head++ )
+    {
+        struct io_uring_cqe *cqe = &io -> cqes[ head & *io -> cq_mask ];
+
+        uring_complete( io, cqe -> user_data, cqe -> res );
+    }
+    __atomic_store_n( io -> cq_head, head, __ATOMIC_RELEASE );
+
+    return e_success;
+}
+
+/* Whether any buffer has a request queued or in flight, and of what state */
+static int uring_busy( const UringIo *io, int state )
+{
+    for( int i = 0; i < io -> count; i++ )
+    {
+        if( io -> blocks[i].state == state )
+            return 1;
+    }
+
+    return 0;
+}
+
+/* Gives the handed out block back, to be written if it holds encoded bytes */
+static void uring_give_back( UringIo *io, BlockBuffer *block )
+{
+    if( io -> current < 0 )
+    {
+        return;
+    }
+
+    UringBlock *b = &io -> blocks[ io -> current ];
+    if( io -> out_fd >= 0 && block -> fill > 0 )
+    {
+        b -> state = blk_writing;
+        b -> offset = block -> base;
+        b -> len = block -> fill;
+        b -> done = 0;
+        io -> stats.writes++;
+        uring_queue( io, io -> current );
+    }
+    else
+        b -> state = blk_free;
+
+    io -> current = -1;
+}
+
+/* Sets up the ring, maps its queues and registers the buffers */
+Status uring_open( UringIo *io, BlockBuffer *block, const BmpInfo *bmp, size_t block_size, int in_fd, int out_fd )
+{
+    struct io_uring_params params;
+    struct iovec iov[ URING_BLOCKS ];
+    struct stat st;
+
+    memset( io, 0, sizeof( *io ) );
+    memset( block, 0, sizeof( *block ) );
+    io -> current = -1;
+    io -> in_fd = in_fd;
+    io -> out_fd = out_fd;
+
+    size_t capacity = block_size_clamp( bmp_block_size( bmp, block_size ) );
+    io -> read_bytes = bmp_block_bytes( bmp, capacity );
+    if( io -> read_bytes == 0 || fstat( in_fd, &st ) != 0 )
+    {
+        return e_failure;
+    }
+    io -> in_size = st.st_size;
+
+    // Buffers no bigger than the image, registering pins every page of them
+    off_t rest = io -> in_size - bmp -> data_offset;
+    if( rest > 0 && ( size_t )rest < io -> read_bytes && bmp_block_bytes( bmp, bmp_block_size( bmp, rest ) ) > 0 )
+    {
+        capacity = block_size_clamp( bmp_block_size( bmp, rest ) );
+        io -> read_bytes = bmp_block_bytes( bmp, capacity );
+    }
+    // And no more of them than the image has blocks
+    io -> count = URING_BLOCKS;
+    if( rest > 0 && ( size_t )rest / io -> read_bytes < URING_BLOCKS )
+        io -> count = ( rest + io -> read_bytes - 1 ) / io -> read_bytes;
+
+    memset( &params, 0, sizeof( params ) );
+    io -> ring_fd = syscall( __NR_io_uring_setup, URING_ENTRIES, &params );
+    if( io -> ring_fd < 0 )
+    {
+        return e_failure; // No io_uring in this kernel, or not allowed
+    }
+
+    // Both rings share one mapping with IORING_FEAT_SINGLE_MMAP
+    io -> sq_ring_size = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+    io -> cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof( struct io_uring_cqe );
+    if( params.features & IORING_FEAT_SINGLE_MMAP && io -> cq_ring_size > io -> sq_ring_size )
+        io -> sq_ring_size = io -> cq_ring_size;
+
+    void *ring = mmap( NULL, io -> sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, io -> ring_fd, IORING_OFF_SQ_RING );
+    if( ring == MAP_FAILED )
+    {
+        close( io -> ring_fd );
+        return e_failure;
+    }
+    io -> sq_ring = ring;
+
+    if( params.features & IORING_FEAT_SINGLE_MMAP )
+        io -> cq_ring = io -> sq_ring;
+    else
+    {
+        ring = mmap( NULL, io -> cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, io -> ring_fd, IORING_OFF_CQ_RING );
+        io -> cq_ring = ring == MAP_FAILED ? NULL : ring;
+    }
+
+    io -> sqes_size = params.sq_entries * sizeof( struct io_uring_sqe );
+    ring = mmap( NULL, io -> sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, io -> ring_fd, IORING_OFF_SQES );
+    io -> sqes = ring == MAP_FAILED ? NULL : ring;
+
+    if( io -> cq_ring == NULL || io -> sqes == NULL )
+    {
+        uring_close( io, block );
+        return e_failure;
+    }
+
+    uchar *sq = io -> sq_ring, *cq = io -> cq_ring;
+    io -> sq_tail = ( unsigned * )( sq + params.sq_off.tail );
+    io -> sq_mask = ( unsigned * )( sq + params.sq_off.ring_mask );
+    io -> sq_array = ( unsigned * )( sq + params.sq_off.array );
+    io -> cq_head = ( unsigned * )( cq + params.cq_off.head );
+    io -> cq_tail = ( unsigned * )( cq + params.cq_off.tail );
+    io -> cq_mask = ( unsigned * )( cq + params.cq_off.ring_mask );
+    io -> cqes = ( struct io_uring_cqe * )( cq + params.cq_off.cqes );
+
+    block -> capacity = capacity;
+
+    // Decodes mostly stop after a few blocks, their buffers come as the window grows
+    io -> window = out_fd >= 0 ? io -> count : 1;
+    if( out_fd < 0 )
+    {
+        block -> base = bmp -> data_offset;
+        return e_success;
+    }
+
+    for( int i = 0; i < io -> count; i++ )
+    {
+        void *data;
+
+        if( posix_memalign( &data, BLOCK_ALIGN, capacity ) != 0 )
+        {
+            uring_close( io, block );
+            return e_failure;
+        }
+        io -> blocks[i].data = data;
+        iov[i].iov_base = data;
+        iov[i].iov_len = capacity;
+    }
+
+    // Pinned memory counts against RLIMIT_MEMLOCK, plain requests do without
+    io -> fixed = syscall( __NR_io_uring_register, io -> ring_fd, IORING_REGISTER_BUFFERS, iov, io -> count ) == 0;
+
+    block -> base = bmp -> data_offset;
+
+    return e_success;
+}
+
+/* Writes block behind and hands out the one after it
+ * The read ahead of it is used if there is one, else every read ahead is
+ * dropped and reading starts over from there
+ */
+Status uring_next( UringIo *io, BlockBuffer *block )
+{
+    off_t want = block -> base + block -> fill;
+    int next = -1;
+
+    uring_give_back( io, block );
+
+    for( int i = 0; i < io -> count; i++ )
+    {
+        UringBlock *b = &io -> blocks[i];
+
+        if( ( b -> state == blk_reading || b -> state == blk_read ) && !b -> stale && b -> offset == want )
+            next = i;
+    }
+
+    // Reads before want, or of anything else if want was not read ahead
+    for( int i = 0; i < io -> count; i++ )
+    {
+        UringBlock *b = &io -> blocks[i];
+
+        if( ( b -> state == blk_reading || b -> state == blk_read ) && ( next < 0 || b -> offset < want ) )
+        {
+            b -> stale = 1;
+            if( b -> state == blk_read )
+                b -> state = blk_free;
+        }
+    }
+    if( next < 0 )
+        io -> next_read = want;
+    if( io -> window < io -> count )
+        io -> window++;
+
+    for( ;; )
+    {
+        if( io -> error )
+        {
+            return e_failure;
+        }
+
+        // Every free buffer of the window reads ahead
+        for( int i = 0; i < io -> window && io -> next_read < io -> in_size; i++ )
+        {
+            UringBlock *b = &io -> blocks[i];
+
+            if( b -> state != blk_free )
+                continue;
+            if( b -> data == NULL )
+            {
+                void *data;
+
+                if( posix_memalign( &data, BLOCK_ALIGN, block -> capacity ) != 0 )
+                {
+                    io -> error = ENOMEM;
+                    break;
+                }
+                b -> data = data;
+            }
+
+            b -> state = blk_reading;
+            b -> stale = 0;
+            b -> offset = io -> next_read;
+            b -> len = io -> in_size - io -> next_read < ( off_t )io -> read_bytes ? ( size_t )( io -> in_size - io -> next_read ) : io -> read_bytes;
+            b -> done = 0;
+            io -> next_read += b -> len;
+            io -> stats.reads++;
+            if( next < 0 && b -> offset == want )
+                next = i;
+            uring_queue( io, i );
+        }
+
+        // Submit the write and the reads in one call, wait only if want is not there yet
+        int ready = next >= 0 ? io -> blocks[ next ].state == blk_read : want >= io -> in_size;
+        if( ( !ready || io -> queued > 0 ) && uring_enter( io, ready ? 0 : 1 ) != e_success )
+        {
+            return e_failure;
+        }
+        if( ready && io -> queued == 0 )
+        {
+            break;
+        }
+    }
+
+    // Past the end of the file the block stays empty
+    if( next < 0 || io -> blocks[ next ].state != blk_read )
+    {
+        block -> base = want;
+        block -> fill = 0;
+        return io -> error ? e_failure : e_success;
+    }
+
+    UringBlock *b = &io -> blocks[ next ];
+    b -> state = blk_handed;
+    io -> current = next;
+    block -> data = b -> data;
+    block -> base = b -> offset;
+    block -> fill = b -> done;
+
+    return e_success;
+}
+
+/* Writes block behind and waits until every write has reached the file */
+Status uring_flush( UringIo *io, BlockBuffer *block )
+{
+    off_t end = block -> base + block -> fill;
+
+    uring_give_back( io, block );
+    while( io -> error == 0 && ( io -> queued > 0 || uring_busy( io, blk_writing ) ) )
+    {
+        if( uring_enter( io, uring_busy( io, blk_writing ) ? 1 : 0 ) != e_success )
+            break;
+    }
+
+    block -> base = end;
+    block -> fill = 0;
+
+    return io -> error ? e_failure : e_success;
+}
+
+/* Waits for the requests in flight before the buffers go */
+Status uring_close( UringIo *io, BlockBuffer *block )
+{
+    UringStats stats = io -> stats;
+    int error = io -> error;
+    int leak = 0;
+
+    if( io -> sq_ring == NULL )
+    {
+        return e_success;
+    }
+
+    io -> current = -1;
+    while( io -> queued > 0 || uring_busy( io, blk_reading ) || uring_busy( io, blk_writing ) )
+    {
+        if( uring_enter( io, io -> queued > 0 ? 0 : 1 ) != e_success )
+        {
+            leak = 1; // The kernel may still write to them
+            break;
+        }
+    }
+    error = error ? error : io -> error;
+
+    if( io -> sqes )
+        munmap( io -> sqes, io -> sqes_size );
+    if( io -> cq_ring && io -> cq_ring != io -> sq_ring )
+        munmap( io -> cq_ring, io -> cq_ring_size );
+    munmap( io -> sq_ring, io -> sq_ring_size );
+    close( io -> ring_fd );
+
+    for( int i = 0; i < io -> count && !leak; i++ )
+        free( io -> blocks[i].data );
+
+    memset( io, 0, sizeof( *io ) );
+    memset( block, 0, sizeof( *block ) );
+    io -> stats = stats;
+    io -> error = error; // For the caller to report
+
+    return error ? e_failure : e_success;
+}
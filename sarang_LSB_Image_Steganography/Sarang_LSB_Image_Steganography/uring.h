@@ -0,0 +1,98 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "types.h" // Contains user defined types
+#include "blockio.h"
+#include "bmp.h"
+
+/*
+ * io_uring image I/O
+ * The image blocks of the stdio engine read and written through an
+ * io_uring, set up with the raw system calls. URING_BLOCKS registered
+ * buffers rotate: one is handed out to be encoded or decoded, the next
+ * ones are read ahead and the previous ones written behind, so the
+ * device works while the kernels do. Every uring_next() submits the
+ * write of the block given back and the reads of the free buffers in
+ * one io_uring_enter(). Reads follow the block handed out, a block
+ * wanted at any other offset drops them, see seek_stego().
+ * Without registered buffers, over RLIMIT_MEMLOCK, plain reads and
+ * writes are submitted instead. Decodes, which mostly stop after a few
+ * blocks, use plain reads of buffers allocated as their read ahead
+ * grows, one more buffer every block.
+ */
+
+#define URING_BLOCKS 4      // One handed out, the others reading ahead or writing behind
+#define URING_ENTRIES 8     // Queue entries, a buffer has one request in flight at most
+
+/* One registered buffer */
+typedef struct _UringBlock
+{
+    uchar *data;
+    int state;          // Free, reading, read, handed out or writing
+    int stale;          // Read ahead of an offset no longer wanted
+    off_t offset;       // File offset of data[0]
+    size_t len;         // Bytes to read or write
+    size_t done;        // Of them so far, a read stops short at the end of the file
+} UringBlock;
+
+/* What the ring did */
+typedef struct _UringStats
+{
+    size_t enters;      // io_uring_enter() calls, the system calls of the image I/O
+    size_t reads;       // Read requests
+    size_t writes;      // Write requests
+} UringStats;
+
+typedef struct _UringIo
+{
+    /* Ring */
+    int ring_fd;
+    void *sq_ring;      // NULL while closed
+    void *cq_ring;      // Same mapping as sq_ring with IORING_FEAT_SINGLE_MMAP
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    unsigned queued;    // Prepared and not submitted yet
+    int fixed;          // Buffers are registered
+
+    /* Files */
+    int in_fd;          // Source or stego image, read
+    int out_fd;         // Stego image written by encodes, -1 for decodes
+    off_t in_size;      // Reads stop at the end of in_fd
+    size_t read_bytes;  // Of every read, whole rows, see bmp_block_bytes()
+
+    /* Buffers */
+    UringBlock blocks[ URING_BLOCKS ];
+    int count;          // Of them in use, fewer for images of fewer blocks
+    int window;         // Of them reading ahead so far, decodes start with 1 and grow
+    int current;        // Handed out as the image block, -1 for none
+    off_t next_read;    // Offset of the next read ahead
+    int error;          // errno of the first failed request, kept by uring_close() too
+
+    UringStats stats;   // Kept by uring_close()
+} UringIo;
+
+/* Sets up the ring and its buffers for the image block of bmp, block_size as
+ * the stdio engine sizes it, and points block at its first row
+ * Returns e_failure if the kernel has no io_uring, for a fallback to stdio
+ */
+Status uring_open( UringIo *io, BlockBuffer *block, const BmpInfo *bmp, size_t block_size, int in_fd, int out_fd );
+
+/* Gives block back, written to out_fd with encodes, and hands out the block
+ * that follows it in the file, empty at the end of the file
+ */
+Status uring_next( UringIo *io, BlockBuffer *block );
+
+/* Gives block back and waits for every write, block stays at its end */
+Status uring_flush( UringIo *io, BlockBuffer *block );
+
+/* Waits for every request, frees the buffers and the ring, safe if never opened */
+Status uring_close( UringIo *io, BlockBuffer *block );
+
+#endif